@@ -50,6 +50,37 @@ void pagerank(graph_type::vertex_type vertex) {
                                                               pagerank_map);
 }
 
+/*
+ * The same update without locking the edges. PageRank tolerates
+ * reading a neighbor value that is being updated concurrently.
+ */
+void snapshot_pagerank(graph_type::vertex_type vertex) {
+  vertex.data() = 0.15 + 0.85 * warp::snapshot_map_reduce_neighborhood(vertex,
+                                                                       IN_EDGES,
+                                                                       pagerank_map);
+}
+
+/*
+ * Runs the iterations with the given update function, batching mirror
+ * requests or not, and returns the number of vertex updates per second.
+ */
+double run_pagerank(distributed_control& dc, graph_type& graph,
+                    void (*update)(graph_type::vertex_type),
+                    bool batch, size_t iterations) {
+  warp::set_batch_mirror_requests(batch);
+  graph.transform_vertices(init_vertex);
+  dc.barrier();
+  timer ti;
+  for (size_t i = 0;i < iterations; ++i) {
+    warp::parfor_all_vertices(graph, update);
+    dc.cout() << "Iteration " << i << " complete\n";
+  }
+  const double runtime = ti.current_time();
+  dc.cout() << "Finished Running in " << runtime
+            << " seconds." << std::endl;
+  return iterations * graph.num_vertices() / runtime;
+}
+
 /*
  * We want to save the final graph so we define a write which will be
  * used in graph.save("path/prefix", pagerank_writer()) to save the graph.
@@ -81,6 +112,17 @@ int main(int argc, char** argv) {
   std::string saveprefix;
   clopts.attach_option("saveprefix", saveprefix,
                        "Prefix to save the output pagerank in");
+  bool snapshot = false;
+  clopts.attach_option("snapshot", snapshot,
+                       "Map the neighborhood without locking the edges");
+  bool batch = false;
+  clopts.attach_option("batch", batch,
+                       "Batch the requests to mirrors of concurrently "
+                       "updated vertices");
+  bool compare = false;
+  clopts.attach_option("compare", compare,
+                       "Run with and without edge locks and with and "
+                       "without batching and compare the throughput");
 
   if(!clopts.parse(argc, argv)) {
     dc.cout() << "Error in parsing command line arguments." << std::endl;
@@ -94,18 +136,30 @@ int main(int argc, char** argv) {
   // must call finalize before querying the graph
   graph.finalize();
 
-  // Initialize the vertex data
-  graph.transform_vertices(init_vertex);
-
-  timer ti;
-  for (size_t i = 0;i < iterations; ++i) {
-    warp::parfor_all_vertices(graph, pagerank);
-    std::cout << "Iteration " << i << " complete\n";
+  if (compare) {
+    // the locked, unbatched run is the baseline
+    const double locked_rate =
+        run_pagerank(dc, graph, pagerank, false, iterations);
+    const double locked_batch_rate =
+        run_pagerank(dc, graph, pagerank, true, iterations);
+    const double snapshot_rate =
+        run_pagerank(dc, graph, snapshot_pagerank, false, iterations);
+    const double snapshot_batch_rate =
+        run_pagerank(dc, graph, snapshot_pagerank, true, iterations);
+    dc.cout() << "Locked:            " << locked_rate << " updates/s\n"
+              << "Locked, batched:   " << locked_batch_rate << " updates/s ("
+              << locked_batch_rate / locked_rate << "x)\n"
+              << "Snapshot:          " << snapshot_rate << " updates/s ("
+              << snapshot_rate / locked_rate << "x)\n"
+              << "Snapshot, batched: " << snapshot_batch_rate << " updates/s ("
+              << snapshot_batch_rate / locked_rate << "x)" << std::endl;
+  } else {
+    const double rate = run_pagerank(dc, graph,
+                                     snapshot ? snapshot_pagerank : pagerank,
+                                     batch, iterations);
+    dc.cout() << rate << " updates/s" << std::endl;
   }
 
-  dc.cout() << "Finished Running in " << ti.current_time()
-            << " seconds." << std::endl;
-
 
   // Save the final graph -----------------------------------------------------
   if (saveprefix != "") {
@@ -75,6 +75,12 @@ namespace graphlab {
    * simultaneously within the same engine execution . For details on their 
    * usage, see their respective documentation.
    * 
+   * Vertex aggregators created with add_incremental_vertex_aggregator()
+   * are maintained continuously instead of being recomputed by a scan
+   * of the graph. Engines which support them call start_incremental()
+   * after start() and update_vertex() after every apply. Engines which
+   * do not simply never call start_incremental() and the aggregators
+   * fall back to scanning the graph.
    */
   template<typename Graph, typename IContext>
   class distributed_aggregator {
@@ -289,6 +295,105 @@ namespace graphlab {
     std::map<std::string, imap_reduce_base*> aggregators;
     std::map<std::string, float> aggregate_period;
 
+    /**
+     * \internal
+     * The running state of an incremental vertex aggregator.
+     */
+    struct iincremental_base {
+      /** \brief Maps every owned vertex, resetting the running sum */
+      virtual void initialize(icontext_type&, graph_type&, procid_t) = 0;
+
+      /** \brief Replaces the contribution of a vertex in the running sum
+       *         by its current value. Must not be called concurrently
+       *         on the same vertex. */
+      virtual void update_vertex(icontext_type&, vertex_type&) = 0;
+
+      /** \brief Returns the running sum of this machine stored in an any
+       *         holding the same type as imap_reduce_base::get_accumulator()*/
+      virtual any get_accumulator() const = 0;
+
+      virtual ~iincremental_base() { }
+    };
+
+    /**
+     * \internal
+     * An incremental vertex aggregator over an invertible reduction.
+     * The last mapped value of every owned vertex is kept so that an
+     * update subtracts the old value and adds the new one. The running
+     * sum is split into lock striped partial sums (by lvid) so that
+     * concurrent applies rarely contend.
+     */
+    template <typename ReductionType, typename VertexMapperType>
+    struct incremental_type : public iincremental_base {
+      static const size_t NUM_STRIPES = 64;
+      struct stripe {
+        simple_spinlock lock;
+        conditional_addition_wrapper<ReductionType> acc;
+        char padding[64];
+      };
+      VertexMapperType map_function;
+      std::vector<stripe> stripes;
+      std::vector<ReductionType> last_value;
+
+      incremental_type(VertexMapperType map_function)
+                : map_function(map_function), stripes(NUM_STRIPES) { }
+
+      void initialize(icontext_type& context, graph_type& graph,
+                      procid_t procid) {
+        for (size_t i = 0; i < stripes.size(); ++i) stripes[i].acc.clear();
+        last_value.clear();
+        last_value.resize(graph.num_local_vertices());
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
+          local_vertex_type lvertex = graph.l_vertex(i);
+          if (lvertex.owner() == procid) {
+            vertex_type vertex(lvertex);
+            last_value[i] = map_function(context, vertex);
+            stripe& s = stripes[i % NUM_STRIPES];
+            s.lock.lock();
+            s.acc += last_value[i];
+            s.lock.unlock();
+          }
+        }
+      }
+
+      void update_vertex(icontext_type& context, vertex_type& vertex) {
+        const lvid_type lvid = vertex.local_id();
+        ReductionType value = map_function(context, vertex);
+        stripe& s = stripes[lvid % NUM_STRIPES];
+        s.lock.lock();
+        /**
+         * A compiler error on this line is typically due to the
+         * reduction type of an incremental aggregator not having an
+         * operator-=. Ensure that the following is available:
+         *
+         *   ReductionType& operator-=(ReductionType& lvalue,
+         *                             const ReductionType& rvalue);
+         */
+        s.acc.value -= last_value[lvid];
+        s.acc.value += value;
+        s.lock.unlock();
+        last_value[lvid] = value;
+      }
+
+      any get_accumulator() const {
+        conditional_addition_wrapper<ReductionType> acc;
+        for (size_t i = 0; i < stripes.size(); ++i) {
+          stripe& s = const_cast<stripe&>(stripes[i]);
+          s.lock.lock();
+          acc += s.acc;
+          s.lock.unlock();
+        }
+        return any(acc);
+      }
+    };
+
+    std::map<std::string, iincremental_base*> incremental;
+    /// The incremental aggregators fed by the running engine
+    std::vector<iincremental_base*> active_incremental;
+
     struct async_aggregator_state {
       /// Performs reduction of all local threads. On machine 0, also
       /// accumulates for all machines.
@@ -311,6 +416,17 @@ namespace graphlab {
     mutex schedule_lock;
     size_t ncpus;
 
+    /**
+     * Returns the incremental aggregator of the key if the engine is
+     * feeding it and NULL otherwise.
+     */
+    iincremental_base* get_active_incremental(const std::string& key) {
+      if (active_incremental.empty()) return NULL;
+      typename std::map<std::string, iincremental_base*>::iterator iter =
+                                                      incremental.find(key);
+      return iter == incremental.end() ? NULL : iter->second;
+    }
+
     template <typename ReductionType, typename F>
     static void test_vertex_mapper_type(std::string key = "") {
       bool test_result = test_function_or_const_functor_2<F,
@@ -387,6 +503,26 @@ namespace graphlab {
                             rmi(dc, this), graph(graph), 
                             context(context), ncpus(0) { }
 
+    /**
+     * \copydoc graphlab::iengine::add_incremental_vertex_aggregator
+     */
+    template <typename ReductionType, 
+              typename VertexMapperType, 
+              typename FinalizerType>
+    bool add_incremental_vertex_aggregator(const std::string& key,
+                                           VertexMapperType map_function,
+                                           FinalizerType finalize_function) {
+      // the regular aggregator provides the finalization and is used
+      // as is whenever the engine does not feed the updates
+      if (!add_vertex_aggregator<ReductionType>(key, map_function,
+                                                finalize_function)) {
+        return false;
+      }
+      incremental[key] =
+          new incremental_type<ReductionType, VertexMapperType>(map_function);
+      return true;
+    }
+
     /**
      * \copydoc graphlab::iengine::add_vertex_aggregator
      */
@@ -524,42 +660,50 @@ namespace graphlab {
       
       imap_reduce_base* mr = aggregators[key];
       mr->clear_accumulator();
-      // ok. now we perform reduction on local data in parallel
+      iincremental_base* inc = get_active_incremental(key);
+      if (inc != NULL) {
+        // the running sum of this machine is already available
+        any acc = inc->get_accumulator();
+        mr->set_accumulator_any(acc);
+      }
+      else {
+        // ok. now we perform reduction on local data in parallel
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
-      {
-        imap_reduce_base* localmr = mr->clone_empty();
-        if (localmr->is_vertex_map()) {
+        {
+          imap_reduce_base* localmr = mr->clone_empty();
+          if (localmr->is_vertex_map()) {
 #ifdef _OPENMP
-        #pragma omp for
+          #pragma omp for
 #endif
-          for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
-            local_vertex_type lvertex = graph.l_vertex(i);
-            if (lvertex.owner() == rmi.procid()) {
-              vertex_type vertex(lvertex);
-              localmr->perform_map_vertex(*context, vertex);
+            for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
+              local_vertex_type lvertex = graph.l_vertex(i);
+              if (lvertex.owner() == rmi.procid()) {
+                vertex_type vertex(lvertex);
+                localmr->perform_map_vertex(*context, vertex);
+              }
             }
           }
-        }
-        else {
+          else {
 #ifdef _OPENMP
-        #pragma omp for
+          #pragma omp for
 #endif
-          for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
-            foreach(local_edge_type e, graph.l_vertex(i).in_edges()) {
-              edge_type edge(e);
-              localmr->perform_map_edge(*context, edge);
+            for (int i = 0; i < (int)graph.num_local_vertices(); ++i) {
+              foreach(local_edge_type e, graph.l_vertex(i).in_edges()) {
+                edge_type edge(e);
+                localmr->perform_map_edge(*context, edge);
+              }
             }
           }
-        }
 #ifdef _OPENMP
-        #pragma omp critical
+          #pragma omp critical
 #endif
-        {
-          mr->add_accumulator(localmr);
+          {
+            mr->add_accumulator(localmr);
+          }
+          delete localmr;
         }
-        delete localmr;
       }
       
       std::vector<any> gathervec(rmi.numprocs());
@@ -659,6 +803,36 @@ namespace graphlab {
     }
     
     
+    /**
+     * Must be called on engine start, after start(), by engines which
+     * call update_vertex() after every apply. Maps every owned vertex
+     * once to initialize the incremental aggregators, after which
+     * aggregate_now() and the periodic aggregations read their running
+     * sums instead of scanning the graph until stop() is called.
+     * Must be called on all machines simultaneously.
+     */
+    void start_incremental() {
+      active_incremental.clear();
+      typename std::map<std::string, iincremental_base*>::iterator iter =
+                                                      incremental.begin();
+      while (iter != incremental.end()) {
+        iter->second->initialize(*context, graph, rmi.procid());
+        active_incremental.push_back(iter->second);
+        ++iter;
+      }
+    }
+
+    /**
+     * Updates the incremental aggregators with the current data of the
+     * vertex. To be called by the engine after every apply on a master
+     * vertex, before any other apply on the same vertex.
+     */
+    inline void update_vertex(icontext_type& context, vertex_type& vertex) {
+      for (size_t i = 0; i < active_incremental.size(); ++i) {
+        active_incremental[i]->update_vertex(context, vertex);
+      }
+    }
+
     /**
      * If asynchronous aggregation is desired, this function is
      * to be called periodically on each machine. This polls the schedule to
@@ -708,8 +882,16 @@ namespace graphlab {
       ASSERT_GT(iter->second.per_thread_aggregation.size(), cpuid);
       
       imap_reduce_base* localmr = iter->second.per_thread_aggregation[cpuid];
+      iincremental_base* inc = get_active_incremental(key);
+      if (inc != NULL) {
+        // the running sum is read once for the whole machine
+        if (cpuid == 0) {
+          any acc = inc->get_accumulator();
+          localmr->set_accumulator_any(acc);
+        }
+      }
       // perform the reduction using the local mr
-      if (localmr->is_vertex_map()) {
+      else if (localmr->is_vertex_map()) {
         for (int i = cpuid;i < (int)graph.num_local_vertices(); i+=ncpus) {
           local_vertex_type lvertex = graph.l_vertex(i);
           if (lvertex.owner() == rmi.procid()) {
@@ -895,6 +1077,7 @@ namespace graphlab {
      */
     void stop() {
       schedule.clear();
+      active_incremental.clear();
       // clear the aggregators
       {
         typename std::map<std::string, imap_reduce_base*>::iterator iter =
@@ -1087,6 +1270,12 @@ namespace graphlab {
     
     
     ~distributed_aggregator() {
+      typename std::map<std::string, iincremental_base*>::iterator iter =
+                                                      incremental.begin();
+      while (iter != incremental.end()) {
+        delete iter->second;
+        ++iter;
+      }
       delete context;
     }
   }; 
@@ -198,6 +198,23 @@ namespace graphlab {
    * model to factorized consistency where only individual gather/apply/scatter
    * calls are guaranteed to be locally consistent. Can produce massive
    * increases in throughput at a consistency penalty.
+   * \li \b optimistic (default: false) Set to true to provide the same
+   * full consistency as factorized=false without acquiring the
+   * Chandy-Misra locks (factorized is then ignored). The versions of all
+   * neighboring vertices are recorded before the gather. Before the
+   * apply, every replica of the vertex marks itself as committing (which
+   * fails any concurrent validation of a neighbor) and then validates the
+   * recorded versions. The mark is held until the replica finished its
+   * scatter, so the vertex data and the adjacent edge data written by the
+   * update are never read or written by a validated neighbor update. If a
+   * neighbor was modified in the mean time, the mark is withdrawn and the
+   * update is retried, and after
+   * \b optimistic_retries failed attempts the update takes the locks
+   * before retrying, which excludes the other locked updates. Best suited
+   * to vertex programs where conflicts are rare (coloring, connected
+   * components, label propagation).
+   * \li \b optimistic_retries (default: 2) Number of times a conflicting
+   * optimistic update is retried before falling back to acquiring locks.
    * \li \b nfibers (default: 10000) Number of fibers to use
    * \li \b stacksize (default: 16384) Stacksize of each fiber.
    */
@@ -328,9 +345,26 @@ namespace graphlab {
     /// A pointer to the lock implementation
     distributed_chandy_misra<graph_type>* cmlocks;
 
+    /**
+     * \brief The graph structure version the engine datastructures were
+     * last sized for. See distributed_graph::get_structure_version().
+     */
+    size_t graph_version;
+
     /// Per vertex data locks
     std::vector<simple_spinlock> vertexlocks;
 
+    /**
+     * \brief Per vertex data version. Only maintained in optimistic mode.
+     * The version of a replica is odd from the validation of an update of
+     * the vertex until the replica finished its scatter (or the update is
+     * aborted), and even otherwise. A gather which reads an odd version cannot validate.
+     */
+    std::vector<atomic<size_t> > vertex_versions;
+
+    /// The version signature of a gather which read a committing vertex
+    static const size_t INVALID_SIGNATURE = size_t(-1);
+
     /// Total update function completion time
     std::vector<double> total_completion_time;
 
@@ -399,6 +433,21 @@ namespace graphlab {
     /// engine option. Sets to true if factorized consistency is used
     bool factorized_consistency;
 
+    /// engine option. Sets to true if updates are run without locks and
+    /// validated against the neighbor versions at apply time.
+    bool optimistic;
+
+    /// engine option. Number of times a conflicting optimistic update is
+    /// retried before falling back to the locked path.
+    size_t optimistic_retries;
+
+    /// Number of optimistic updates which validated successfully
+    atomic<uint64_t> optimistic_commits;
+    /// Number of optimistic attempts which failed validation
+    atomic<uint64_t> optimistic_aborts;
+    /// Number of updates which fell back to the locked path
+    atomic<uint64_t> optimistic_fallbacks;
+
     bool endgame_mode;
 
     /// Time when engine is started
@@ -447,6 +496,8 @@ namespace graphlab {
       stacksize = 16384;
       use_cache = false;
       factorized_consistency = true;
+      optimistic = false;
+      optimistic_retries = 2;
       track_task_time = false;
       timed_termination = (size_t)(-1);
       termination_reason = execution_status::UNSET;
@@ -484,6 +535,14 @@ namespace graphlab {
           opts.get_engine_args().get_option("factorized", factorized_consistency);
           if (rmi.procid() == 0)
             logstream(LOG_EMPH) << "Engine Option: factorized = " << factorized_consistency << std::endl;
+        } else if (opt == "optimistic") {
+          opts.get_engine_args().get_option("optimistic", optimistic);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: optimistic = " << optimistic << std::endl;
+        } else if (opt == "optimistic_retries") {
+          opts.get_engine_args().get_option("optimistic_retries", optimistic_retries);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: optimistic_retries = " << optimistic_retries << std::endl;
         } else if (opt == "nfibers") {
           opts.get_engine_args().get_option("nfibers", nfibers);
           if (rmi.procid() == 0)
@@ -504,6 +563,15 @@ namespace graphlab {
           logstream(LOG_FATAL) << "Unexpected Engine Option: " << opt << std::endl;
         }
       }
+      // the optimistic mode is a lock free implementation of the full
+      // consistency model
+      if (optimistic && factorized_consistency) {
+        if (rmi.procid() == 0) {
+          logstream(LOG_EMPH) << "Optimistic mode provides full consistency. "
+                              << "factorized is ignored." << std::endl;
+        }
+        factorized_consistency = false;
+      }
       opts_copy = opts;
       // set a default scheduler if none
       if (opts_copy.get_scheduler_type() == "") {
@@ -516,7 +584,8 @@ namespace graphlab {
                                   opts_copy);
       rmi.barrier();
 
-      // create initial fork arrangement based on the alternate vid mapping
+      // create initial fork arrangement based on the alternate vid mapping.
+      // The optimistic mode needs the locks for its fallback path.
       if (factorized_consistency == false) {
         cmlocks = new distributed_chandy_misra<graph_type>(rmi.dc(), graph,
                                                     boost::bind(&engine_type::lock_ready, this, _1));
@@ -526,6 +595,8 @@ namespace graphlab {
         cmlocks = NULL;
       }
 
+      graph_version = graph.get_structure_version();
+
       // construct the termination consensus object
       consensus = new fiber_async_consensus(rmi.dc(), nfibers);
     }
@@ -553,9 +624,32 @@ namespace graphlab {
       if (!factorized_consistency) {
         cm_handles.resize(graph.num_local_vertices());
       }
+      if (optimistic) {
+        vertex_versions.resize(graph.num_local_vertices());
+      }
+      // the forks are per edge and must be rebuilt if the structure changed
+      if (cmlocks != NULL && graph_version != graph.get_structure_version()) {
+        cmlocks->resize();
+      }
+      graph_version = graph.get_structure_version();
       rmi.barrier();
     }
 
+    /**
+     * \internal
+     * Commits any pending changes to the graph structure, and resizes the
+     * engine datastructures if the structure changed since the last call.
+     * Must be called on all machines at the same time.
+     */
+    void update_graph_structure() {
+      // finalize() costs a barrier even when nothing changed, so only
+      // call it if some machine has a pending change
+      size_t pending_changes = !graph.is_finalized();
+      rmi.all_reduce(pending_changes);
+      if (pending_changes > 0) graph.finalize();
+      if (graph_version != graph.get_structure_version()) init();
+    }
+
 
 
   public:
@@ -741,6 +835,7 @@ namespace graphlab {
 
     void signal(vertex_id_type gvid,
                 const message_type& message = message_type()) {
+      update_graph_structure();
       rmi.barrier();
       internal_signal_gvid(gvid, message);
       rmi.barrier();
@@ -756,6 +851,7 @@ namespace graphlab {
     void signal_vset(const vertex_set& vset,
                     const message_type& message = message_type(),
                     const std::string& order = "shuffle") {
+      update_graph_structure();
       logstream(LOG_DEBUG) << rmi.procid() << ": Schedule All" << std::endl;
       // allocate a vector with all the local owned vertices
       // and schedule all of them.
@@ -917,8 +1013,81 @@ namespace graphlab {
     }
 
 
+    /**
+     * \internal
+     * Computes the sum of the local versions of all neighbors of lvid.
+     * Since versions only ever increase, the signature changes if and only
+     * if one of the neighbors was modified. All edges are covered, not
+     * only the gather edges, since the scatter also writes the adjacent
+     * edges. Returns INVALID_SIGNATURE if a neighbor is committing.
+     */
+    size_t neighbor_version_signature(lvid_type lvid) {
+      local_vertex_type local_vertex(graph.l_vertex(lvid));
+      size_t signature = 0;
+      bool committing = false;
+      foreach(local_edge_type local_edge, local_vertex.in_edges()) {
+        const size_t version = vertex_versions[local_edge.source().id()].value;
+        committing = committing || (version & 1);
+        signature += version;
+      }
+      foreach(local_edge_type local_edge, local_vertex.out_edges()) {
+        const size_t version = vertex_versions[local_edge.target().id()].value;
+        committing = committing || (version & 1);
+        signature += version;
+      }
+      return committing ? INVALID_SIGNATURE : signature;
+    }
+
+
+    /**
+     * \internal
+     * Performs the local gather without acquiring locks, returning the
+     * partial gather together with the version signature of the neighbors
+     * read. The signature is taken before the gather so that any concurrent
+     * modification is detected by perform_validate.
+     */
+    std::pair<conditional_gather_type, size_t>
+    perform_optimistic_gather(vertex_id_type vid,
+                              vertex_program_type& vprog_) {
+      vertex_program_type vprog = vprog_;
+      lvid_type lvid = graph.local_vid(vid);
+      std::pair<conditional_gather_type, size_t> ret;
+      ret.second = neighbor_version_signature(lvid);
+      ret.first = perform_gather(vid, vprog);
+      return ret;
+    }
+
+
+    /**
+     * \internal
+     * Marks the local replica of vid as committing and returns true if
+     * none of the neighbors on this machine were modified since the
+     * signature was taken. The mark is made (with a full barrier) before
+     * the neighbors are read, so of two adjacent vertices validating at the
+     * same time at least one fails. The mark is cleared once the replica
+     * finished its scatter, or by perform_abort().
+     */
+    bool perform_validate(vertex_id_type vid, size_t signature) {
+      lvid_type lvid = graph.local_vid(vid);
+      vertex_versions[lvid].inc();
+      if (signature == INVALID_SIGNATURE) return false;
+      return neighbor_version_signature(lvid) == signature;
+    }
+
+
+    /**
+     * \internal
+     * Clears the committing mark of the local replica of vid after a
+     * failed validation.
+     */
+    void perform_abort(vertex_id_type vid) {
+      vertex_versions[graph.local_vid(vid)].inc();
+    }
+
+
     void perform_scatter_local(lvid_type lvid,
-                               vertex_program_type& vprog) {
+                               vertex_program_type& vprog,
+                               bool release_locks) {
       local_vertex_type local_vertex(graph.l_vertex(lvid));
       vertex_type vertex(local_vertex);
       context_type context(*this, graph);
@@ -947,7 +1116,7 @@ namespace graphlab {
       } 
 
       // release locks
-      if (!factorized_consistency) {
+      if (release_locks) {
         cmlocks->philosopher_stops_eating_per_replica(lvid);
       }
     }
@@ -955,13 +1124,16 @@ namespace graphlab {
 
     void perform_scatter(vertex_id_type vid,
                     vertex_program_type& vprog_,
-                    const vertex_data_type& newdata) {
+                    const vertex_data_type& newdata,
+                    bool release_locks) {
       vertex_program_type vprog = vprog_;
       lvid_type lvid = graph.local_vid(vid);
       vertexlocks[lvid].lock();
       graph.l_vertex(lvid).data() = newdata;
       vertexlocks[lvid].unlock();
-      perform_scatter_local(lvid, vprog);
+      perform_scatter_local(lvid, vprog, release_locks);
+      // clears the committing mark once the edges are written
+      if (optimistic) vertex_versions[lvid].inc();
     }
 
 
@@ -1001,6 +1173,117 @@ namespace graphlab {
     }
 
 
+    /**
+     * \internal
+     * Acquires the Chandy-Misra locks on lvid, descheduling the current
+     * fiber until all forks are available. The locks are released on
+     * every replica by perform_scatter_local.
+     */
+    void acquire_vertex_locks(const lvid_type lvid) {
+      cm_handles[lvid] = new vertex_fiber_cm_handle;
+      cm_handles[lvid]->philosopher_ready = false;
+      cm_handles[lvid]->fiber_handle = fiber_control::get_tid();
+      cmlocks->make_philosopher_hungry(lvid);
+      cm_handles[lvid]->lock.lock();
+      while (!cm_handles[lvid]->philosopher_ready) {
+        fiber_control::deschedule_self(&(cm_handles[lvid]->lock.m_mut));
+        cm_handles[lvid]->lock.lock();
+      }
+      cm_handles[lvid]->lock.unlock();
+    }
+
+
+    /**
+     * \internal
+     * Performs the distributed gather for vid, issuing the partial gathers
+     * on all mirrors in parallel.
+     */
+    conditional_gather_type gather_all_replicas(const vertex_id_type vid,
+                                                const lvid_type lvid,
+                                                vertex_program_type& vprog) {
+      local_vertex_type local_vertex(graph.l_vertex(lvid));
+      conditional_gather_type gather_result;
+      std::vector<request_future<conditional_gather_type> > gather_futures;
+      foreach(procid_t mirror, local_vertex.mirrors()) {
+        gather_futures.push_back(
+            object_fiber_remote_request(rmi, 
+                                        mirror, 
+                                        &async_consistent_engine::perform_gather, 
+                                        vid,
+                                        vprog));
+      }
+      gather_result += perform_gather(vid, vprog);
+
+      for(size_t i = 0;i < gather_futures.size(); ++i) {
+        gather_result += gather_futures[i]();
+      }
+      return gather_result;
+    }
+
+
+    /**
+     * \internal
+     * Performs an optimistic (lock free) gather on all replicas followed
+     * by a validation of the neighbor versions on all replicas.
+     * Returns true if the gather is consistent and may be applied.
+     */
+    bool optimistic_gather_all_replicas(const vertex_id_type vid,
+                                        const lvid_type lvid,
+                                        vertex_program_type& vprog,
+                                        conditional_gather_type& gather_result) {
+      typedef std::pair<conditional_gather_type, size_t> signed_gather_type;
+      local_vertex_type local_vertex(graph.l_vertex(lvid));
+      std::vector<procid_t> mirrors;
+      std::vector<request_future<signed_gather_type> > gather_futures;
+      foreach(procid_t mirror, local_vertex.mirrors()) {
+        mirrors.push_back(mirror);
+        gather_futures.push_back(
+            object_fiber_remote_request(rmi,
+                                        mirror,
+                                        &async_consistent_engine::perform_optimistic_gather,
+                                        vid,
+                                        vprog));
+      }
+      signed_gather_type local_result = perform_optimistic_gather(vid, vprog);
+      gather_result = local_result.first;
+      std::vector<size_t> signatures(mirrors.size());
+      for(size_t i = 0;i < gather_futures.size(); ++i) {
+        signed_gather_type mirror_result = gather_futures[i]();
+        gather_result += mirror_result.first;
+        signatures[i] = mirror_result.second;
+      }
+
+      // validate. The mirrors are validated in parallel
+      std::vector<request_future<bool> > validate_futures;
+      for(size_t i = 0;i < mirrors.size(); ++i) {
+        validate_futures.push_back(
+            object_fiber_remote_request(rmi,
+                                        mirrors[i],
+                                        &async_consistent_engine::perform_validate,
+                                        vid,
+                                        signatures[i]));
+      }
+      bool valid = perform_validate(vid, local_result.second);
+      for(size_t i = 0;i < validate_futures.size(); ++i) {
+        valid = validate_futures[i]() && valid;
+      }
+      if (!valid) {
+        // every replica was marked. withdraw the marks before retrying.
+        std::vector<request_future<void> > abort_futures;
+        for(size_t i = 0;i < mirrors.size(); ++i) {
+          abort_futures.push_back(
+              object_fiber_remote_request(rmi,
+                                          mirrors[i],
+                                          &async_consistent_engine::perform_abort,
+                                          vid));
+        }
+        perform_abort(vid);
+        for(size_t i = 0;i < abort_futures.size(); ++i) abort_futures[i]();
+      }
+      return valid;
+    }
+
+
     /**
      * \internal
      * Called when the scheduler returns a vertex to run.
@@ -1030,19 +1313,9 @@ namespace graphlab {
       /**************************************************************************/
       /*                             Acquire Locks                              */
       /**************************************************************************/
-      if (!factorized_consistency) {
-        // begin lock acquisition
-        cm_handles[lvid] = new vertex_fiber_cm_handle;
-        cm_handles[lvid]->philosopher_ready = false;
-        cm_handles[lvid]->fiber_handle = fiber_control::get_tid();
-        cmlocks->make_philosopher_hungry(lvid);
-        cm_handles[lvid]->lock.lock();
-        while (!cm_handles[lvid]->philosopher_ready) {
-          fiber_control::deschedule_self(&(cm_handles[lvid]->lock.m_mut));
-          cm_handles[lvid]->lock.lock();
-        }
-        cm_handles[lvid]->lock.unlock();
-      }
+      // in optimistic mode the locks are only acquired on fallback
+      bool locked = !factorized_consistency && !optimistic;
+      if (locked) acquire_vertex_locks(lvid);
 
       /**************************************************************************/
       /*                             Begin Program                              */
@@ -1061,19 +1334,23 @@ namespace graphlab {
       /*                              Gather Phase                              */
       /**************************************************************************/
       conditional_gather_type gather_result;
-      std::vector<request_future<conditional_gather_type> > gather_futures;
-      foreach(procid_t mirror, local_vertex.mirrors()) {
-        gather_futures.push_back(
-            object_fiber_remote_request(rmi, 
-                                        mirror, 
-                                        &async_consistent_engine::perform_gather, 
-                                        vid,
-                                        vprog));
-      }
-      gather_result += perform_gather(vid, vprog);
-
-      for(size_t i = 0;i < gather_futures.size(); ++i) {
-        gather_result += gather_futures[i]();
+      if (optimistic) {
+        size_t attempts = 0;
+        while(!optimistic_gather_all_replicas(vid, lvid, vprog, gather_result)) {
+          optimistic_aborts.inc();
+          if (!locked && ++attempts > optimistic_retries) {
+            // too much contention. take the locks to exclude the other
+            // locked updates. Optimistic updates of the neighbors are
+            // still only excluded by the validation, so keep validating.
+            optimistic_fallbacks.inc();
+            acquire_vertex_locks(lvid);
+            locked = true;
+          }
+          fiber_control::yield();
+        }
+        if (!locked) optimistic_commits.inc();
+      } else {
+        gather_result = gather_all_replicas(vid, lvid, vprog);
       }
 
      /**************************************************************************/
@@ -1081,6 +1358,7 @@ namespace graphlab {
      /**************************************************************************/
      vertexlocks[lvid].lock();
      vprog.apply(context, vertex, gather_result.value);      
+     aggregator.update_vertex(context, vertex);
      vertexlocks[lvid].unlock();
 
 
@@ -1106,9 +1384,12 @@ namespace graphlab {
                                        &async_consistent_engine::perform_scatter, 
                                        vid,
                                        vprog,
-                                       local_vertex.data()));
+                                       local_vertex.data(),
+                                       locked));
      }
-     perform_scatter_local(lvid, vprog);
+     perform_scatter_local(lvid, vprog, locked);
+     // clears the committing mark of the master once its edges are written
+     if (optimistic) vertex_versions[lvid].inc();
      for(size_t i = 0;i < scatter_futures.size(); ++i) 
        scatter_futures[i]();
 
@@ -1117,7 +1398,7 @@ namespace graphlab {
       /************************************************************************/
       // the scatter is used to release the chandy misra
       // here I cleanup
-      if (!factorized_consistency) {
+      if (locked) {
         delete cm_handles[lvid];
         cm_handles[lvid] = NULL;
       }
@@ -1209,6 +1490,7 @@ namespace graphlab {
       */
     execution_status::status_enum start() {
       bool old_fasttrack = rmi.dc().set_fast_track_requests(false);
+      update_graph_structure();
       logstream(LOG_INFO) << "Spawning " << nfibers << " threads" << std::endl;
       ASSERT_TRUE(scheduler_ptr != NULL);
       consensus->reset();
@@ -1219,6 +1501,7 @@ namespace graphlab {
 
       // start the aggregator
       aggregator.start(ncpus);
+      aggregator.start_incremental();
       aggregator.aggregate_all_periodic();
 
       started = true;
@@ -1231,6 +1514,9 @@ namespace graphlab {
       force_stop = false;
       endgame_mode = false;
       programs_executed = 0;
+      optimistic_commits = 0;
+      optimistic_aborts = 0;
+      optimistic_fallbacks = 0;
       launch_timer.start();
 
       termination_reason = execution_status::RUNNING;
@@ -1266,6 +1552,22 @@ namespace graphlab {
       rmi.all_reduce(numadds);
       rmi.cout() << "Schedule Adds: " << numadds << std::endl;
 
+      if (optimistic) {
+        size_t commits = optimistic_commits.value;
+        size_t aborts = optimistic_aborts.value;
+        size_t fallbacks = optimistic_fallbacks.value;
+        rmi.all_reduce(commits);
+        rmi.all_reduce(aborts);
+        rmi.all_reduce(fallbacks);
+        const size_t attempts = commits + aborts;
+        rmi.cout() << "Optimistic Commits: " << commits << std::endl;
+        rmi.cout() << "Optimistic Aborts: " << aborts << std::endl;
+        rmi.cout() << "Optimistic Fallbacks: " << fallbacks << std::endl;
+        rmi.cout() << "Optimistic Abort Rate: "
+                   << (attempts > 0 ? double(aborts) / attempts : 0.0)
+                   << std::endl;
+      }
+
       if (track_task_time) {
         double total_task_time = 0;
         for (size_t i = 0;i < total_completion_time.size(); ++i) {
@@ -759,6 +759,19 @@ class distributed_chandy_misra {
     rmi.barrier();
   }
 
+  /**
+   * \brief Rebuilds the philosophers and forks after the graph structure
+   * changed. Must be called on all machines at the same time while no
+   * philosopher is hungry or eating.
+   */
+  void resize() {
+    std::vector<unsigned char>(graph.num_local_edges(), 0).swap(forkset);
+    std::vector<philosopher>(graph.num_local_vertices()).swap(philosopherset);
+    clean_fork_count = 0;
+    compute_initial_fork_arrangement();
+    rmi.barrier();
+  }
+
   size_t num_clean_forks() const {
     return clean_fork_count.value;
   }
@@ -550,6 +550,88 @@ namespace graphlab {
     } // end of add vertex aggregator
 
 #endif
+
+
+    /**
+     * \brief Creates a vertex aggregator which is maintained
+     *        incrementally while the engine runs. Returns true on
+     *        success. Returns false if an aggregator of the same name
+     *        already exists.
+     *
+     * An incremental aggregator behaves like one created by
+     * add_vertex_aggregator() but, instead of mapping every vertex each
+     * time it is computed, the engine maps a vertex again after each
+     * of its applies and replaces the vertex's previous contribution
+     * in a running sum. aggregate_now() and aggregate_periodic() then
+     * only need to combine one running sum per machine, which makes
+     * frequent periodic aggregation cheap on large graphs.
+     *
+     * This requires that:
+     * \li ReductionType is invertible: it must have operator-=
+     *     in addition to operator+=, and a default constructed
+     *     ReductionType must be the zero of the sum.
+     * \li The map function depends only on the data of the
+     *     vertex, and the vertex data is only modified by the apply of
+     *     the vertex itself (not in gather or scatter, and not through
+     *     the data of neighboring vertices).
+     *
+     * The running sums are rebuilt with a full scan when the engine
+     * starts, so changes made to the graph between engine runs (such
+     * as transform_vertices()) are accounted for. Engines which do not
+     * run vertex programs through apply (and aggregate_now() calls
+     * made while no engine is running) compute the aggregator by
+     * scanning the graph as usual.
+     *
+     * For instance, the energy aggregator of a vertex program which
+     * keeps a per vertex energy could be written as:
+     * \code
+     * double vertex_energy(icontext_type& context, const vertex_type& vertex) {
+     *   return vertex.data().energy;
+     * }
+     * engine.add_incremental_vertex_aggregator<double>("energy",
+     *                                                  vertex_energy,
+     *                                                  print_finalize);
+     * engine.aggregate_periodic("energy", 1);
+     * \endcode
+     *
+     * Note that floating point running sums accumulate rounding
+     * errors in proportion to the number of updates since the engine
+     * started.
+     *
+     * \tparam ReductionType The output of the map function. Must have
+     *                        operator+= and operator-= defined, and must
+     *                        be \ref sec_serializable.
+     * \tparam VertexMapperType The type of the map function.
+     *                          Not generally needed.
+     *                          Can be inferred by the compiler.
+     * \tparam FinalizerType The type of the finalize function.
+     *                       Not generally needed.
+     *                       Can be inferred by the compiler.
+     *
+     * \param [in] key The name of this aggregator. Must be unique.
+     * \param [in] map_function The Map function to use. As in
+     *                          add_vertex_aggregator().
+     * \param [in] finalize_function The Finalize function to use. As in
+     *                               add_vertex_aggregator().
+     */
+    template <typename ReductionType,
+              typename VertexMapType,
+              typename FinalizerType>
+    bool add_incremental_vertex_aggregator(const std::string& key,
+                                           VertexMapType map_function,
+                                           FinalizerType finalize_function) {
+      BOOST_CONCEPT_ASSERT((graphlab::Serializable<ReductionType>));
+      BOOST_CONCEPT_ASSERT((graphlab::OpPlusEq<ReductionType>));
+
+      aggregator_type* aggregator = get_aggregator();
+      if(aggregator == NULL) {
+        logstream(LOG_FATAL) << "Aggregation not supported by this engine!" 
+                             << std::endl;
+        return false; // does not return
+      }
+      return aggregator->template add_incremental_vertex_aggregator
+          <ReductionType>(key, map_function, finalize_function);
+    } // end of add incremental vertex aggregator
    
 
     /** 
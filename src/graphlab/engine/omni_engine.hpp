@@ -31,6 +31,7 @@
 #include <graphlab/engine/iengine.hpp>
 #include <graphlab/engine/synchronous_engine.hpp>
 #include <graphlab/engine/async_consistent_engine.hpp>
+#include <graphlab/engine/stale_synchronous_engine.hpp>
 
 namespace graphlab {
 
@@ -71,9 +72,12 @@ namespace graphlab {
    *  (\ref synchronous_engine)
    *  \li "asynchronous" or "async": uses the asynchronous engine
    *  (\ref async_consistent_engine)
+   *  \li "stale_synchronous" or "ssp": uses the stale synchronous engine
+   *  (\ref stale_synchronous_engine)
 *
    * \see graphlab::synchronous_engine
    * \see graphlab::async_consistent_engine
+   * \see graphlab::stale_synchronous_engine
    *
    */
   template<typename VertexProgram>
@@ -136,6 +140,11 @@ namespace graphlab {
      */
     typedef async_consistent_engine<VertexProgram> async_consistent_engine_type;
 
+    /**
+     * \brief the type of stale synchronous engine
+     */
+    typedef stale_synchronous_engine<VertexProgram> stale_synchronous_engine_type;
+
 
 
   private:
@@ -193,6 +202,9 @@ namespace graphlab {
       } else if(engine_type == "async" || engine_type == "asynchronous") {
         logstream(LOG_INFO) << "Using the Synchronous engine." << std::endl;
         engine_ptr = new async_consistent_engine_type(dc, graph, new_options);
+      } else if(engine_type == "ssp" || engine_type == "stale_synchronous") {
+        logstream(LOG_INFO) << "Using the Stale Synchronous engine." << std::endl;
+        engine_ptr = new stale_synchronous_engine_type(dc, graph, new_options);
       } else {
         logstream(LOG_FATAL) << "Invalid engine type: " << engine_type << std::endl;
       }
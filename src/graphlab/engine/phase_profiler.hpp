@@ -0,0 +1,292 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_ENGINE_PHASE_PROFILER_HPP
+#define GRAPHLAB_ENGINE_PHASE_PROFILER_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <graphlab/util/timer.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/serialization/vector.hpp>
+
+namespace graphlab {
+
+  /**
+   * \brief The per machine result of a \ref phase_profiler.
+   *
+   * seconds[phase * NUM_BUCKETS + bucket] is the estimated time spent
+   * in the phase by vertices in the degree bucket and
+   * samples[phase * NUM_BUCKETS + bucket] is the number of timed
+   * events behind the estimate.
+   */
+  struct phase_profile {
+    std::vector<double> seconds;
+    std::vector<size_t> samples;
+    void save(oarchive& oarc) const { oarc << seconds << samples; }
+    void load(iarchive& iarc) { iarc >> seconds >> samples; }
+  };
+
+
+  /**
+   * \brief A sampling profiler for the phases of a vertex program.
+   *
+   * The profiler keeps, for every engine thread, the time spent in
+   * each phase (gather, apply, scatter, lock waits, exchange send and
+   * exchange receive) broken down by the degree of the vertex.  Degree
+   * bucket b holds the vertices with degree in [2^(b-1), 2^b) (bucket
+   * 0 holds the isolated vertices and the last degree bucket
+   * everything larger).  Events which are not associated with a vertex (such as
+   * the processing of a received exchange buffer) are recorded with
+   * degree \ref NO_DEGREE and reported in their own bucket.
+   *
+   * To keep the overhead low only one in every sample_interval events
+   * of a phase is timed with the cycle counter and the measured time
+   * is scaled by the interval.  Contended lock waits and received
+   * buffers are rare relative to the vertex operations and are timed
+   * every time with end_always().
+   *
+   * \code
+   * const unsigned long long start = profiler.begin(thread_id, phase_profiler::APPLY);
+   * vprog.apply(context, vertex, accum);
+   * profiler.end(thread_id, phase_profiler::APPLY, degree, start);
+   * \endcode
+   *
+   * The thread slots are padded so that threads never share a cache
+   * line, and no atomic operations are used: each slot must only be
+   * written by its own thread.
+   */
+  class phase_profiler {
+  public:
+    enum phase_type {
+      GATHER,
+      APPLY,
+      SCATTER,
+      LOCK_WAIT,
+      EXCHANGE_SEND,
+      EXCHANGE_RECV,
+      NUM_PHASES
+    };
+
+    /// The number of degree buckets including the NO_DEGREE bucket
+    static const size_t NUM_BUCKETS = 24;
+    /// The degree passed for events not associated with a vertex
+    static const size_t NO_DEGREE = size_t(-1);
+
+  private:
+    struct thread_slot {
+      size_t counter[NUM_PHASES];
+      double ticks[NUM_PHASES * NUM_BUCKETS];
+      size_t samples[NUM_PHASES * NUM_BUCKETS];
+      char padding[64];
+      thread_slot() { clear(); }
+      void clear() {
+        for (size_t i = 0; i < NUM_PHASES; ++i) counter[i] = 0;
+        for (size_t i = 0; i < NUM_PHASES * NUM_BUCKETS; ++i) {
+          ticks[i] = 0; samples[i] = 0;
+        }
+      }
+    };
+
+    std::vector<thread_slot> slots;
+    size_t interval;
+
+  public:
+    phase_profiler() : interval(0) { }
+
+    /**
+     * Enables the profiler for nthreads threads timing one in every
+     * sample_interval events.  A sample_interval of 0 disables it.
+     */
+    void init(size_t nthreads, size_t sample_interval) {
+      interval = sample_interval;
+      slots.clear();
+      if (interval > 0) slots.resize(nthreads);
+    }
+
+    bool enabled() const { return interval > 0; }
+
+    size_t sample_interval() const { return interval; }
+
+    /// Clears all the measurements
+    void clear() {
+      for (size_t i = 0; i < slots.size(); ++i) slots[i].clear();
+    }
+
+    /**
+     * Returns the cycle counter if this event of the phase is to be
+     * timed and 0 otherwise.
+     */
+    inline unsigned long long begin(size_t thread_id, phase_type phase) {
+      if (interval == 0) return 0;
+      size_t& counter = slots[thread_id].counter[phase];
+      if (++counter < interval) return 0;
+      counter = 0;
+      return rdtsc();
+    }
+
+    /**
+     * Records the event started at start (the return value of
+     * begin()), weighted by the sampling interval.  Does nothing if
+     * start is 0.
+     */
+    inline void end(size_t thread_id, phase_type phase, size_t degree,
+                    unsigned long long start) {
+      if (start != 0) record(thread_id, phase, degree, rdtsc() - start, interval);
+    }
+
+    /// Records an event which was timed unconditionally
+    inline void end_always(size_t thread_id, phase_type phase, size_t degree,
+                           unsigned long long start) {
+      if (interval != 0) record(thread_id, phase, degree, rdtsc() - start, 1);
+    }
+
+    inline void record(size_t thread_id, phase_type phase, size_t degree,
+                       unsigned long long ticks, size_t weight) {
+      const size_t idx = phase * NUM_BUCKETS + degree_bucket(degree);
+      thread_slot& slot = slots[thread_id];
+      slot.ticks[idx] += double(ticks) * weight;
+      ++slot.samples[idx];
+    }
+
+    /// Returns the bucket of the degree
+    static size_t degree_bucket(size_t degree) {
+      if (degree == NO_DEGREE) return NUM_BUCKETS - 1;
+      size_t bucket = 0;
+      while (degree > 0 && bucket < NUM_BUCKETS - 2) { degree >>= 1; ++bucket; }
+      return bucket;
+    }
+
+    /// Returns a printable name of the degree bucket
+    static std::string bucket_name(size_t bucket) {
+      if (bucket == NUM_BUCKETS - 1) return "none";
+      if (bucket == 0) return "0";
+      std::stringstream strm;
+      strm << (size_t(1) << (bucket - 1));
+      if (bucket == NUM_BUCKETS - 2) strm << "-";
+      else if (bucket > 1) strm << "-" << ((size_t(1) << bucket) - 1);
+      return strm.str();
+    }
+
+    static const char* phase_name(size_t phase) {
+      static const char* names[NUM_PHASES] =
+        {"gather", "apply", "scatter", "lock_wait",
+         "exchange_send", "exchange_recv"};
+      return names[phase];
+    }
+
+    /// Sums the thread slots into a profile of this machine
+    phase_profile local_profile() const {
+      phase_profile profile;
+      profile.seconds.resize(NUM_PHASES * NUM_BUCKETS, 0);
+      profile.samples.resize(NUM_PHASES * NUM_BUCKETS, 0);
+      const double tps = double(estimate_ticks_per_second());
+      for (size_t t = 0; t < slots.size(); ++t) {
+        for (size_t i = 0; i < NUM_PHASES * NUM_BUCKETS; ++i) {
+          profile.seconds[i] += slots[t].ticks[i] / tps;
+          profile.samples[i] += slots[t].samples[i];
+        }
+      }
+      return profile;
+    }
+
+    /**
+     * Writes the profiles of all machines (indexed by process id) as
+     * JSON.  Empty buckets are omitted.
+     */
+    static void save_json(std::ostream& out,
+                          const std::vector<phase_profile>& profiles,
+                          size_t sample_interval) {
+      out << "{\n  \"sample_interval\": " << sample_interval
+          << ",\n  \"machines\": [";
+      for (size_t p = 0; p < profiles.size(); ++p) {
+        out << (p ? "," : "") << "\n    {\"procid\": " << p
+            << ", \"phases\": {";
+        for (size_t ph = 0; ph < NUM_PHASES; ++ph) {
+          out << (ph ? "," : "") << "\n      \"" << phase_name(ph) << "\": [";
+          bool first = true;
+          for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+            const size_t idx = ph * NUM_BUCKETS + b;
+            if (profiles[p].samples[idx] == 0) continue;
+            out << (first ? "" : ", ") << "{\"degree\": \"" << bucket_name(b)
+                << "\", \"samples\": " << profiles[p].samples[idx]
+                << ", \"seconds\": " << std::setprecision(9)
+                << profiles[p].seconds[idx] << "}";
+            first = false;
+          }
+          out << "]";
+        }
+        out << "}}";
+      }
+      out << "\n  ]\n}\n";
+    }
+
+    /**
+     * Writes the profiles in the folded stack format read by
+     * flamegraph.pl: one "machine;engine;phase;degree microseconds"
+     * line per non-empty bucket.
+     */
+    static void save_folded(std::ostream& out,
+                            const std::vector<phase_profile>& profiles,
+                            const std::string& engine_name) {
+      for (size_t p = 0; p < profiles.size(); ++p) {
+        for (size_t ph = 0; ph < NUM_PHASES; ++ph) {
+          for (size_t b = 0; b < NUM_BUCKETS; ++b) {
+            const size_t idx = ph * NUM_BUCKETS + b;
+            const size_t usec = size_t(profiles[p].seconds[idx] * 1e6);
+            if (usec == 0) continue;
+            out << "machine_" << p << ";" << engine_name << ";"
+                << phase_name(ph) << ";degree_" << bucket_name(b)
+                << " " << usec << "\n";
+          }
+        }
+      }
+    }
+
+    /**
+     * Writes prefix.json and prefix.folded.
+     */
+    static void save(const std::string& prefix,
+                     const std::vector<phase_profile>& profiles,
+                     size_t sample_interval,
+                     const std::string& engine_name) {
+      std::ofstream json((prefix + ".json").c_str());
+      std::ofstream folded((prefix + ".folded").c_str());
+      if (!json.good() || !folded.good()) {
+        logstream(LOG_ERROR) << "Unable to write phase profile "
+                             << prefix << std::endl;
+        return;
+      }
+      save_json(json, profiles, sample_interval);
+      save_folded(folded, profiles, engine_name);
+    }
+  }; // end of phase_profiler
+
+} // end of namespace graphlab
+
+#endif
@@ -0,0 +1,1318 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_STALE_SYNCHRONOUS_ENGINE_HPP
+#define GRAPHLAB_STALE_SYNCHRONOUS_ENGINE_HPP
+
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include <graphlab/engine/iengine.hpp>
+
+#include <graphlab/vertex_program/ivertex_program.hpp>
+#include <graphlab/vertex_program/icontext.hpp>
+#include <graphlab/vertex_program/context.hpp>
+
+#include <graphlab/engine/execution_status.hpp>
+#include <graphlab/options/graphlab_options.hpp>
+
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/parallel/fiber_group.hpp>
+#include <graphlab/util/memory_info.hpp>
+#include <graphlab/util/generics/conditional_addition_wrapper.hpp>
+
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/rpc/fiber_buffered_exchange.hpp>
+
+
+#include <graphlab/macros_def.hpp>
+
+namespace graphlab {
+
+
+  /**
+   * \ingroup engines
+   *
+   * \brief The stale synchronous engine executes vertex programs in a
+   * sequence of super-steps (clocks) like the
+   * \ref graphlab::synchronous_engine, but allows each machine to run up
+   * to \b staleness clocks ahead of the slowest machine.
+   *
+   * \tparam VertexProgram The user defined vertex program which
+   * should implement the \ref graphlab::ivertex_program interface.
+   *
+   * ### Execution Semantics
+   *
+   * Each machine advances its own clock independently. There is no global
+   * barrier between super-steps: a machine may begin clock \c c as soon as
+   * every other machine has completed clock <tt>c - staleness - 1</tt>,
+   * and all the data those machines sent before completing that clock has
+   * been received. Within a clock each machine:
+   * \li Forwards messages received by mirrors to the masters.
+   * \li Computes the partial gathers requested by the masters of its
+   * mirrors and sends them back, tagged with the current clock.
+   * \li Invokes \ref graphlab::ivertex_program::init on all master vertices
+   * with messages and requests a fresh partial gather from every mirror.
+   * Combines the most recent partial gather of every mirror with the local
+   * gather and invokes \ref graphlab::ivertex_program::apply. A partial
+   * gather computed by a mirror during clock \c t is reused, also by later
+   * activations of the vertex, until clock <tt>t + staleness + 1</tt>. If a
+   * partial is older, the vertex is deferred until a fresh partial arrives.
+   * \li Sends the new vertex data to the mirrors and runs the scatter on
+   * all replicas.
+   *
+   * Mirror vertex data is therefore at most \b staleness clocks older than
+   * the data on the master, and the gather passed to apply reflects edge and
+   * neighbor data at most <tt>staleness + 1</tt> clocks old. With
+   * staleness=0 all machines advance in lock step. Larger staleness lets
+   * vertices with mirrors apply more often, since fewer applys are deferred
+   * waiting for a fresh partial gather.
+   *
+   * The engine uses the \ref graphlab::ivertex_program interface unmodified.
+   * Each mirror gathers with the vertex program of the latest activation
+   * which requested a gather, and scatters with the vertex program of every
+   * apply, even if several scatter requests arrive in the same clock. Since
+   * a reused partial gather may have been computed by the vertex program of
+   * an earlier activation, gather_edges and gather should not depend on
+   * state set by init.
+   *
+   * A machine which reaches max_iterations stops running clocks, but keeps
+   * receiving (and discarding) data until every machine has stopped, so
+   * the remaining machines can still detect quiescence.
+   *
+   * <a name=engineopts>Engine Options</a>
+   * =====================
+   * \li <b>max_iterations</b>: (default: infinity) The maximum number
+   * of clocks each machine runs.
+   * \li <b>timeout</b>: (default: infinity) The maximum time in
+   * seconds that the engine may run.
+   * \li <b>staleness</b>: (default: 1) The maximum number of clocks a
+   * machine may run ahead of the slowest machine.
+   *
+   * At termination the engine reports, for each machine, the mean and
+   * maximum number of clocks it ran ahead of the slowest machine and the
+   * total time spent waiting on slower machines.
+   *
+   * \see graphlab::omni_engine
+   * \see graphlab::synchronous_engine
+   * \see graphlab::async_consistent_engine
+   */
+  template<typename VertexProgram>
+  class stale_synchronous_engine :
+    public iengine<VertexProgram> {
+
+  public:
+    /**
+     * \brief The user defined vertex program type. Equivalent to the
+     * VertexProgram template argument.
+     */
+    typedef VertexProgram vertex_program_type;
+
+    /**
+     * \brief The user defined type returned by the gather function.
+     */
+    typedef typename VertexProgram::gather_type gather_type;
+
+    /**
+     * \brief The user defined message type used to signal neighboring
+     * vertex programs.
+     */
+    typedef typename VertexProgram::message_type message_type;
+
+    /**
+     * \brief The type of data associated with each vertex in the graph
+     */
+    typedef typename VertexProgram::vertex_data_type vertex_data_type;
+
+    /**
+     * \brief The type of data associated with each edge in the graph
+     */
+    typedef typename VertexProgram::edge_data_type edge_data_type;
+
+    /**
+     * \brief The type of graph supported by this vertex program
+     */
+    typedef typename VertexProgram::graph_type  graph_type;
+
+    /**
+     * \brief The type used to represent a vertex in the graph.
+     */
+    typedef typename graph_type::vertex_type          vertex_type;
+
+    /**
+     * \brief The type used to represent an edge in the graph.
+     */
+    typedef typename graph_type::edge_type            edge_type;
+
+    /**
+     * \brief The type of the callback interface passed by the engine to vertex
+     * programs.  See \ref graphlab::icontext for details.
+     */
+    typedef icontext<graph_type, gather_type, message_type> icontext_type;
+
+  private:
+    typedef typename graph_type::local_vertex_type    local_vertex_type;
+    typedef typename graph_type::local_edge_type      local_edge_type;
+    typedef typename graph_type::lvid_type            lvid_type;
+
+    typedef context<stale_synchronous_engine> context_type;
+    friend class context<stale_synchronous_engine>;
+
+    typedef typename iengine<vertex_program_type>::aggregator_type aggregator_type;
+
+    typedef conditional_addition_wrapper<gather_type> conditional_gather_type;
+
+    /// Flags attached to a vertex program sent to the mirrors
+    enum vprog_request_flags {
+      GATHER_REQUEST = 1,  ///< compute and send back a partial gather
+      SCATTER_REQUEST = 2  ///< run the scatter on the local edges
+    };
+
+    dc_dist_object< stale_synchronous_engine<VertexProgram> > rmi;
+
+    graph_type& graph;
+
+    /// The number of CPUs used.
+    size_t ncpus;
+
+    /// The local worker threads used by this engine
+    fiber_group threads;
+
+    /// The maximum number of clocks to run on each machine
+    size_t max_iterations;
+
+    /// The maximum number of clocks a machine may be ahead of the slowest
+    size_t staleness;
+
+    /// The number of clocks completed by this machine
+    size_t clock;
+
+    /// The time in seconds at which the engine started.
+    float start_time;
+
+    /// The timeout time in seconds
+    float timeout;
+
+    /// Used to stop the engine prematurely
+    bool force_abort;
+
+    /// Set when global quiescence is detected by any machine
+    bool terminated;
+
+    /// The vertex locks protect the per vertex state below
+    std::vector<simple_spinlock> vlocks;
+
+    /**
+     * \brief The vertex program of the current activation of each master,
+     * and the vertex program of the most recent gather request of each
+     * mirror.
+     */
+    std::vector<vertex_program_type> vertex_programs;
+
+    /**
+     * \brief The number of activations of each master, and the activation
+     * of the most recent gather request of each mirror.
+     */
+    std::vector<size_t> activation;
+
+    /**
+     * \brief The vertex programs whose scatter is pending on each vertex.
+     * A mirror may receive the scatters of several applys before it runs
+     * them.
+     */
+    std::vector<std::vector<vertex_program_type> > scatter_programs;
+
+    /// Vector of messages associated with each vertex.
+    std::vector<message_type> messages;
+
+    /// Bit indicating whether a message is present for each vertex.
+    dense_bitset has_message;
+
+    /**
+     * \brief Bit (masters only) indicating that init was called on the
+     * vertex program and the apply is waiting for fresh partial gathers.
+     */
+    dense_bitset pending_apply;
+
+    /**
+     * \brief Bit (mirrors only) indicating that the master requested a
+     * partial gather.
+     */
+    dense_bitset gather_request;
+
+    /// Bit indicating that the scatter should be run on this clock.
+    dense_bitset scatter_request;
+
+    /**
+     * \brief Offset of the first partial gather slot of each master
+     * vertex. A master with m mirrors owns the m slots
+     * [partial_offset[lvid], partial_offset[lvid+1]) ordered by the
+     * process id of the mirror.
+     */
+    std::vector<size_t> partial_offset;
+
+    /// The most recent partial gather received from each mirror
+    std::vector<conditional_gather_type> partial_gather;
+
+    /// The clock at which each partial gather was computed. -1 if none.
+    std::vector<int> partial_clock;
+
+    /// True if a partial gather was requested and has not arrived.
+    std::vector<unsigned char> partial_requested;
+
+    /// The graph structure version the datastructures were sized for
+    size_t graph_version;
+
+    /// Protects the clock table
+    mutex clock_lock;
+    conditional clock_cond;
+
+    /// The number of clocks completed by each machine
+    std::vector<size_t> remote_clock;
+
+    /// True if the machine has stopped running clocks
+    std::vector<unsigned char> remote_done;
+
+    /// True if the machine had no local work at its last announcement
+    std::vector<unsigned char> remote_idle;
+
+    /// Total number of elements sent by each machine at its last announcement
+    std::vector<size_t> remote_sent;
+
+    /// Total number of elements received by each machine at its last
+    /// announcement
+    std::vector<size_t> remote_received;
+
+    /// Number of elements each machine had sent to this machine at its last
+    /// announcement
+    std::vector<size_t> expected_from;
+
+    /// Number of elements sent to each machine through all exchanges
+    std::vector<atomic<size_t> > sent_to;
+
+    /// Number of elements received from each machine through all exchanges
+    std::vector<atomic<size_t> > received_from;
+
+    /// The termination snapshot used by the double counting check
+    std::vector<size_t> last_quiescent_clock;
+    size_t last_quiescent_sent;
+
+    /// A counter measuring the number of applys that have been completed
+    atomic<size_t> completed_applys;
+
+    /// Number of applys deferred waiting for a fresh partial gather
+    atomic<size_t> deferred_applys;
+
+    /// Sum of the number of clocks this machine ran ahead of the slowest
+    size_t total_lag;
+
+    /// Maximum number of clocks this machine ran ahead of the slowest
+    size_t max_lag;
+
+    /// Total time spent waiting for slower machines
+    double wait_time;
+
+    /// The shared counter used coordinate operations between threads.
+    atomic<size_t> shared_lvid_counter;
+
+    /// The aggregation key to compute on this clock. Empty if none.
+    std::string aggregation_key;
+
+    typedef std::pair<vertex_id_type, message_type> vid_message_pair_type;
+    typedef fiber_buffered_exchange<vid_message_pair_type> message_exchange_type;
+    message_exchange_type message_exchange;
+
+    typedef std::pair<vertex_id_type, vertex_data_type> vid_vdata_pair_type;
+    typedef fiber_buffered_exchange<vid_vdata_pair_type> vdata_exchange_type;
+    vdata_exchange_type vdata_exchange;
+
+    /// A vertex program sent by a master to one of its mirrors
+    struct vprog_request {
+      /// A combination of vprog_request_flags
+      unsigned char flags;
+      /// The activation of the master which sent the request
+      size_t activation;
+      vertex_program_type program;
+      void save(oarchive& oarc) const {
+        oarc << flags << activation << program;
+      }
+      void load(iarchive& iarc) {
+        iarc >> flags >> activation >> program;
+      }
+    };
+
+    /// A partial gather sent by a mirror to its master
+    struct gather_reply {
+      /// The clock of the mirror when the partial was computed
+      int clock;
+      conditional_gather_type value;
+      void save(oarchive& oarc) const {
+        oarc << clock << value;
+      }
+      void load(iarchive& iarc) {
+        iarc >> clock >> value;
+      }
+    };
+
+    typedef std::pair<vertex_id_type, vprog_request> vid_prog_pair_type;
+    typedef fiber_buffered_exchange<vid_prog_pair_type> vprog_exchange_type;
+    vprog_exchange_type vprog_exchange;
+
+    typedef std::pair<vertex_id_type, gather_reply> vid_gather_pair_type;
+    typedef fiber_buffered_exchange<vid_gather_pair_type> gather_exchange_type;
+    gather_exchange_type gather_exchange;
+
+    /// The distributed aggregator used to manage background aggregation.
+    aggregator_type aggregator;
+
+  public:
+
+    /**
+     * \brief Construct a stale synchronous engine for a given graph and
+     * options.
+     *
+     * Must be called on all machines at the same time.
+     *
+     * @param [in] dc Distributed controller to associate with
+     * @param [in,out] graph A reference to the graph object that this
+     * engine will modify. The graph must be fully constructed and
+     * finalized.
+     * @param [in] opts A graphlab::graphlab_options object specifying engine
+     *                  parameters.
+     */
+    stale_synchronous_engine(distributed_control& dc, graph_type& graph,
+                             const graphlab_options& opts = graphlab_options()) :
+      rmi(dc, this), graph(graph),
+      ncpus(opts.get_ncpus()),
+      threads(2*1024*1024 /* 2MB stack per fiber*/),
+      max_iterations(-1), staleness(1), clock(0),
+      timeout(0), force_abort(false), terminated(false),
+      message_exchange(dc),
+      vdata_exchange(dc),
+      vprog_exchange(dc),
+      gather_exchange(dc),
+      aggregator(dc, graph, new context_type(*this, graph)) {
+      std::vector<std::string> keys = opts.get_engine_args().get_option_keys();
+      foreach(std::string opt, keys) {
+        if (opt == "max_iterations") {
+          opts.get_engine_args().get_option("max_iterations", max_iterations);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: max_iterations = "
+              << max_iterations << std::endl;
+        } else if (opt == "timeout") {
+          opts.get_engine_args().get_option("timeout", timeout);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: timeout = "
+              << timeout << std::endl;
+        } else if (opt == "staleness") {
+          opts.get_engine_args().get_option("staleness", staleness);
+          if (rmi.procid() == 0)
+            logstream(LOG_EMPH) << "Engine Option: staleness = "
+              << staleness << std::endl;
+        } else {
+          logstream(LOG_FATAL) << "Unexpected Engine Option: " << opt << std::endl;
+        }
+      }
+      sent_to.resize(rmi.numprocs());
+      received_from.resize(rmi.numprocs());
+      graph.finalize();
+      init();
+      rmi.barrier();
+    } // end of constructor
+
+
+    /**
+     * \brief Initialize the engine and allocate datastructures for vertex,
+     * and lock, clear all the messages.
+     */
+    void init() {
+      memory_info::log_usage("Before Engine Initialization");
+      const size_t nverts = graph.num_local_vertices();
+      vlocks.resize(nverts);
+      vertex_programs.resize(nverts);
+      activation.assign(nverts, 0);
+      scatter_programs.clear();
+      scatter_programs.resize(nverts);
+      messages.resize(nverts, message_type());
+      has_message.resize(nverts);
+      has_message.clear();
+      pending_apply.resize(nverts);
+      pending_apply.clear();
+      gather_request.resize(nverts);
+      gather_request.clear();
+      scatter_request.resize(nverts);
+      scatter_request.clear();
+      // allocate a partial gather slot for every mirror of every master
+      partial_offset.resize(nverts + 1);
+      size_t nslots = 0;
+      for (lvid_type lvid = 0; lvid < nverts; ++lvid) {
+        partial_offset[lvid] = nslots;
+        if (graph.l_is_master(lvid)) {
+          nslots += graph.l_get_vertex_record(lvid).num_mirrors();
+        }
+      }
+      partial_offset[nverts] = nslots;
+      partial_gather.clear();
+      partial_gather.resize(nslots);
+      partial_clock.clear();
+      partial_clock.resize(nslots, -1);
+      partial_requested.clear();
+      partial_requested.resize(nslots, 0);
+      graph_version = graph.get_structure_version();
+      memory_info::log_usage("After Engine Initialization");
+    }
+
+
+    /**
+     * \brief Start execution of the stale synchronous engine.
+     *
+     * The start function begins computation and does not return until
+     * there are no remaining messages on any machine, or until
+     * max_iterations clocks have been run.
+     *
+     * @return The reason for termination
+     */
+    execution_status::status_enum start() {
+      update_graph_structure();
+      rmi.barrier();
+      start_time = timer::approx_time_seconds();
+      clock = 0;
+      force_abort = false;
+      terminated = false;
+      completed_applys = 0;
+      deferred_applys = 0;
+      total_lag = 0; max_lag = 0; wait_time = 0;
+      for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+        sent_to[i] = 0;
+        received_from[i] = 0;
+      }
+      clock_lock.lock();
+      remote_clock.assign(rmi.numprocs(), 0);
+      remote_done.assign(rmi.numprocs(), 0);
+      remote_idle.assign(rmi.numprocs(), 0);
+      remote_sent.assign(rmi.numprocs(), 0);
+      remote_received.assign(rmi.numprocs(), 0);
+      expected_from.assign(rmi.numprocs(), 0);
+      last_quiescent_clock.assign(rmi.numprocs(), 0);
+      last_quiescent_sent = (size_t)(-1);
+      clock_lock.unlock();
+      execution_status::status_enum termination_reason =
+        execution_status::UNSET;
+      aggregator.start(ncpus);
+      aggregator.start_incremental();
+      aggregator.aggregate_all_periodic();
+      rmi.barrier();
+
+      float last_print = -5;
+      while(clock < max_iterations) {
+        if(timeout != 0 && timeout < elapsed_seconds()) {
+          termination_reason = execution_status::TIMEOUT;
+          break;
+        }
+        // wait until we are within the staleness bound of every machine
+        if (!wait_for_clock()) break;
+        if(rmi.procid() == 0 && elapsed_seconds() - last_print >= 5) {
+          logstream(LOG_EMPH) << rmi.procid() << ": Starting clock: "
+                              << clock << std::endl;
+          last_print = elapsed_seconds();
+        }
+        run_local(&stale_synchronous_engine::recv_exchanges,
+                  fiber_control::get_instance().num_workers());
+        aggregation_key = aggregator.tick_asynchronous();
+        if (!aggregation_key.empty()) {
+          run_local(&stale_synchronous_engine::compute_aggregator, ncpus);
+        }
+        run_local(&stale_synchronous_engine::exchange_messages, ncpus);
+        run_local(&stale_synchronous_engine::execute_mirror_gathers, ncpus);
+        run_local(&stale_synchronous_engine::execute_applys, ncpus);
+        run_local(&stale_synchronous_engine::execute_scatters, ncpus);
+        run_local(&stale_synchronous_engine::flush_exchanges,
+                  fiber_control::get_instance().num_workers());
+        rmi.dc().flush();
+        ++clock;
+        announce_clock();
+      }
+      if (termination_reason == execution_status::UNSET) {
+        termination_reason = force_abort ? execution_status::FORCED_ABORT :
+                                           execution_status::TASK_DEPLETION;
+      }
+      wait_for_done();
+      rmi.full_barrier();
+      // discard anything left in the exchanges
+      run_local(&stale_synchronous_engine::clear_exchanges,
+                fiber_control::get_instance().num_workers());
+      rmi.barrier();
+
+      size_t global_completed = completed_applys;
+      rmi.all_reduce(global_completed);
+      completed_applys = global_completed;
+      size_t global_deferred = deferred_applys;
+      rmi.all_reduce(global_deferred);
+
+      // per machine iteration lag statistics
+      std::vector<double> mean_lag(rmi.numprocs(), 0);
+      std::vector<size_t> all_max_lag(rmi.numprocs(), 0);
+      std::vector<double> all_wait_time(rmi.numprocs(), 0);
+      std::vector<size_t> all_clocks(rmi.numprocs(), 0);
+      mean_lag[rmi.procid()] = clock > 0 ? double(total_lag) / clock : 0;
+      all_max_lag[rmi.procid()] = max_lag;
+      all_wait_time[rmi.procid()] = wait_time;
+      all_clocks[rmi.procid()] = clock;
+      rmi.all_gather(mean_lag);
+      rmi.all_gather(all_max_lag);
+      rmi.all_gather(all_wait_time);
+      rmi.all_gather(all_clocks);
+      rmi.cout() << "Updates: " << completed_applys.value << "\n";
+      rmi.cout() << "Deferred Applys: " << global_deferred << "\n";
+      if (rmi.procid() == 0) {
+        for (size_t i = 0; i < rmi.numprocs(); ++i) {
+          logstream(LOG_INFO) << "Machine " << i << ": "
+                              << all_clocks[i] << " clocks, "
+                              << "mean lag " << mean_lag[i] << ", "
+                              << "max lag " << all_max_lag[i] << ", "
+                              << "wait time " << all_wait_time[i] << "s"
+                              << std::endl;
+        }
+      }
+      aggregator.stop();
+      return termination_reason;
+    } // end of start
+
+
+    // documentation inherited from iengine
+    size_t num_updates() const { return completed_applys.value; }
+
+    // documentation inherited from iengine
+    float elapsed_seconds() const {
+      return timer::approx_time_seconds() - start_time;
+    }
+
+    /**
+     * \brief Get the number of clocks completed by this machine since
+     * start was last invoked.
+     */
+    int iteration() const { return clock; }
+
+    // documentation inherited from iengine
+    void signal(vertex_id_type gvid,
+                const message_type& message = message_type()) {
+      update_graph_structure();
+      rmi.barrier();
+      internal_signal_rpc(gvid, message);
+      rmi.barrier();
+    }
+
+    // documentation inherited from iengine
+    void signal_all(const message_type& message = message_type(),
+                    const std::string& order = "shuffle") {
+      update_graph_structure();
+      for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid) {
+        if(graph.l_is_master(lvid)) {
+          internal_signal(vertex_type(graph.l_vertex(lvid)), message);
+        }
+      }
+    }
+
+    // documentation inherited from iengine
+    void signal_vset(const vertex_set& vset,
+                     const message_type& message = message_type(),
+                     const std::string& order = "shuffle") {
+      update_graph_structure();
+      for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid) {
+        if(graph.l_is_master(lvid) && vset.l_contains(lvid)) {
+          internal_signal(vertex_type(graph.l_vertex(lvid)), message);
+        }
+      }
+    }
+
+    aggregator_type* get_aggregator() { return &aggregator; }
+
+  private:
+
+    // Context interface ======================================================
+
+    void internal_stop() {
+      for (procid_t i = 0; i < rmi.numprocs(); ++i)
+        rmi.remote_call(i, &stale_synchronous_engine::rpc_stop);
+    }
+
+    void rpc_stop() {
+      force_abort = true;
+      clock_lock.lock();
+      clock_cond.broadcast();
+      clock_lock.unlock();
+    }
+
+    void internal_signal(const vertex_type& vertex,
+                         const message_type& message = message_type()) {
+      const lvid_type lvid = vertex.local_id();
+      vlocks[lvid].lock();
+      if( has_message.get(lvid) ) {
+        messages[lvid] += message;
+      } else {
+        messages[lvid] = message;
+        has_message.set_bit(lvid);
+      }
+      vlocks[lvid].unlock();
+    }
+
+    void internal_signal_gvid(vertex_id_type gvid,
+                              const message_type& message = message_type()) {
+      procid_t proc = graph.master(gvid);
+      if(proc == rmi.procid()) internal_signal_rpc(gvid, message);
+      else rmi.remote_call(proc,
+                           &stale_synchronous_engine::internal_signal_rpc,
+                           gvid, message);
+    }
+
+    void internal_signal_rpc(vertex_id_type gvid,
+                             const message_type& message = message_type()) {
+      if (graph.is_master(gvid)) {
+        internal_signal(graph.vertex(gvid), message);
+      }
+    }
+
+    /// Gather caching is not supported by this engine
+    void internal_post_delta(const vertex_type& vertex,
+                             const gather_type& delta) { }
+
+    /// Gather caching is not supported by this engine
+    void internal_clear_gather_cache(const vertex_type& vertex) { }
+
+
+    /**
+     * \brief Commits any pending changes to the graph structure and
+     * reinitializes the engine if the structure changed. Must be called on
+     * all machines at the same time.
+     */
+    void update_graph_structure() {
+      // finalize() costs a barrier even when nothing changed, so only
+      // call it if some machine has a pending change
+      size_t pending_changes = !graph.is_finalized();
+      rmi.all_reduce(pending_changes);
+      if (pending_changes > 0) graph.finalize();
+      if (graph_version != graph.get_structure_version()) init();
+    }
+
+
+    // Clock management =======================================================
+
+    /**
+     * \brief Executes nfibers copies of a member function on this machine
+     * only, each with a unique consecutive id. Unlike the synchronous
+     * engine there is no distributed barrier at the end.
+     */
+    template<typename MemberFunction>
+    void run_local(MemberFunction member_fun, size_t nfibers) {
+      shared_lvid_counter = 0;
+      for(size_t i = 0; i < nfibers; ++i) {
+        fiber_control::affinity_type affinity;
+        affinity.clear(); affinity.set_bit(i);
+        threads.launch(boost::bind(member_fun, this, i), affinity);
+      }
+      threads.join();
+    }
+
+    /**
+     * \brief Called by every other machine when it completes a clock.
+     *
+     * \param src The machine completing the clock
+     * \param src_clock The number of clocks completed by src
+     * \param sent_to_me Total number of elements src sent to this machine
+     * \param idle True if src has no messages or pending work
+     * \param sent Total number of elements src sent to all machines
+     * \param received Total number of elements src received
+     */
+    void rpc_clock(procid_t src, size_t src_clock, size_t sent_to_me,
+                   bool idle, size_t sent, size_t received) {
+      clock_lock.lock();
+      if (src_clock > remote_clock[src]) {
+        remote_clock[src] = src_clock;
+        expected_from[src] = sent_to_me;
+        remote_idle[src] = idle;
+        remote_sent[src] = sent;
+        remote_received[src] = received;
+      }
+      clock_cond.broadcast();
+      clock_lock.unlock();
+    }
+
+    /**
+     * \brief Called by a machine which stopped running clocks. Called again
+     * whenever the machine receives more data afterwards.
+     *
+     * \param src The machine which stopped
+     * \param sent Total number of elements src sent to all machines
+     * \param received Total number of elements src received
+     */
+    void rpc_done(procid_t src, size_t sent, size_t received) {
+      clock_lock.lock();
+      remote_done[src] = true;
+      remote_idle[src] = true;
+      remote_sent[src] = sent;
+      remote_received[src] = received;
+      clock_cond.broadcast();
+      clock_lock.unlock();
+    }
+
+    /// Called by the machine which detected global quiescence
+    void rpc_terminate() {
+      clock_lock.lock();
+      terminated = true;
+      clock_cond.broadcast();
+      clock_lock.unlock();
+    }
+
+    /// True if this machine has no outstanding local work
+    bool local_idle() const {
+      return has_message.empty() &&
+             pending_apply.empty() &&
+             gather_request.empty() &&
+             scatter_request.empty();
+    }
+
+    /**
+     * \brief Broadcasts the completion of a clock to all machines
+     */
+    void announce_clock() {
+      const bool idle = local_idle();
+      size_t sent = 0, received = 0;
+      for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+        sent += sent_to[i].value;
+        received += received_from[i].value;
+      }
+      for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+        if (i == rmi.procid()) {
+          rpc_clock(i, clock, sent_to[i].value, idle, sent, received);
+        } else {
+          rmi.remote_call(i, &stale_synchronous_engine::rpc_clock,
+                          rmi.procid(), clock, sent_to[i].value,
+                          idle, sent, received);
+        }
+      }
+      rmi.dc().flush();
+    }
+
+    /**
+     * \brief Double counting termination check. Must be called with the
+     * clock lock held. The engine is quiescent if all machines are idle,
+     * and every element sent has been received. The check must succeed
+     * twice on strictly newer announcements from every machine with the
+     * same counts to rule out elements in flight between announcements.
+     * Machines which stopped running clocks are idle and only contribute
+     * their counts.
+     */
+    bool check_quiescence() {
+      size_t sent = 0, received = 0;
+      for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+        if (!remote_idle[i]) {
+          last_quiescent_sent = (size_t)(-1);
+          return false;
+        }
+        sent += remote_sent[i];
+        received += remote_received[i];
+      }
+      if (sent != received) {
+        last_quiescent_sent = (size_t)(-1);
+        return false;
+      }
+      bool newer = true;
+      for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+        newer = newer && (remote_done[i] ||
+                          remote_clock[i] > last_quiescent_clock[i]);
+      }
+      if (!newer) return false;
+      const bool stable = (last_quiescent_sent == sent);
+      last_quiescent_sent = sent;
+      last_quiescent_clock = remote_clock;
+      return stable;
+    }
+
+    /**
+     * \brief Blocks until this machine may begin its next clock, i.e.
+     * every machine has completed at least clock - staleness clocks and
+     * all data sent by those machines up to their announcement has been
+     * received. Returns false if the engine should stop.
+     */
+    bool wait_for_clock() {
+      timer ti; ti.start();
+      while(1) {
+        clock_lock.lock();
+        if (!terminated && check_quiescence()) {
+          terminated = true;
+          for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+            if (i != rmi.procid()) {
+              rmi.remote_call(i, &stale_synchronous_engine::rpc_terminate);
+            }
+          }
+        }
+        if (terminated || force_abort) {
+          clock_lock.unlock();
+          wait_time += ti.current_time();
+          return false;
+        }
+        size_t min_clock = clock;
+        bool ready = true;
+        for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+          if (remote_done[i]) continue;
+          min_clock = std::min(min_clock, remote_clock[i]);
+          if (remote_clock[i] + staleness < clock ||
+              received_from[i].value < expected_from[i]) {
+            ready = false;
+          }
+        }
+        if (ready) {
+          const size_t lag = clock - min_clock;
+          total_lag += lag;
+          max_lag = std::max(max_lag, lag);
+          clock_lock.unlock();
+          break;
+        }
+        clock_cond.timedwait_ms(clock_lock, 1);
+        clock_lock.unlock();
+        // data may have arrived. receive it to update the counts
+        run_local(&stale_synchronous_engine::recv_exchanges,
+                  fiber_control::get_instance().num_workers());
+      }
+      wait_time += ti.current_time();
+      return true;
+    }
+
+    /**
+     * \brief Tells every other machine that this machine stopped running
+     * clocks, and blocks until every machine stopped or termination was
+     * detected. Data received in the meantime is discarded, but counted and
+     * reported so that the other machines can detect quiescence.
+     */
+    void wait_for_done() {
+      size_t last_received = (size_t)(-1);
+      while(1) {
+        size_t sent = 0, received = 0;
+        for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+          sent += sent_to[i].value;
+          received += received_from[i].value;
+        }
+        if (received != last_received) {
+          for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+            if (i != rmi.procid()) {
+              rmi.remote_call(i, &stale_synchronous_engine::rpc_done,
+                              rmi.procid(), sent, received);
+            }
+          }
+          rmi.dc().flush();
+          last_received = received;
+        }
+        clock_lock.lock();
+        remote_done[rmi.procid()] = true;
+        bool all_done = true;
+        for (procid_t i = 0; i < rmi.numprocs(); ++i) {
+          all_done = all_done && remote_done[i];
+        }
+        if (all_done || terminated || force_abort) {
+          clock_lock.unlock();
+          break;
+        }
+        clock_cond.timedwait_ms(clock_lock, 1);
+        clock_lock.unlock();
+        run_local(&stale_synchronous_engine::clear_exchanges,
+                  fiber_control::get_instance().num_workers());
+      }
+    }
+
+
+    // Program Steps ==========================================================
+
+    /**
+     * \brief Returns the slot of the partial gather of mirror proc for
+     * the master vertex lvid.
+     */
+    size_t partial_slot(lvid_type lvid, procid_t proc) const {
+      size_t slot = partial_offset[lvid];
+      foreach(procid_t mirror, graph.l_get_vertex_record(lvid).mirrors()) {
+        if (mirror == proc) return slot;
+        ++slot;
+      }
+      ASSERT_MSG(false, "Partial gather received from a non mirror");
+      return slot;
+    }
+
+    /**
+     * \brief Computes the gather of the vertex program of lvid over the
+     * local edges of lvid.
+     */
+    conditional_gather_type local_gather(context_type& context, lvid_type lvid) {
+      const vertex_program_type& vprog = vertex_programs[lvid];
+      local_vertex_type local_vertex = graph.l_vertex(lvid);
+      const vertex_type vertex(local_vertex);
+      const edge_dir_type gather_dir = vprog.gather_edges(context, vertex);
+      conditional_gather_type accum;
+      vprog.pre_local_gather(accum.value);
+      if(gather_dir == IN_EDGES || gather_dir == ALL_EDGES) {
+        foreach(local_edge_type local_edge, local_vertex.in_edges()) {
+          edge_type edge(local_edge);
+          accum += vprog.gather(context, vertex, edge);
+        }
+      }
+      if(gather_dir == OUT_EDGES || gather_dir == ALL_EDGES) {
+        foreach(local_edge_type local_edge, local_vertex.out_edges()) {
+          edge_type edge(local_edge);
+          accum += vprog.gather(context, vertex, edge);
+        }
+      }
+      if (accum.has_value) vprog.post_local_gather(accum.value);
+      return accum;
+    }
+
+    /**
+     * \brief Receives everything currently available in all the exchanges.
+     */
+    void recv_exchanges(const size_t thread_id) {
+      recv_messages();
+      recv_vertex_data();
+      recv_vertex_programs();
+      recv_gathers();
+    }
+
+    /// Discards everything currently available in all the exchanges
+    void clear_exchanges(const size_t thread_id) {
+      discard_exchange(message_exchange);
+      discard_exchange(vdata_exchange);
+      discard_exchange(vprog_exchange);
+      discard_exchange(gather_exchange);
+    }
+
+    /// Discards everything available in an exchange, counting it as received
+    template <typename ExchangeType>
+    void discard_exchange(ExchangeType& exchange) {
+      typename ExchangeType::recv_buffer_type recv_buffer;
+      while(exchange.recv(recv_buffer)) {
+        for (size_t i = 0;i < recv_buffer.size(); ++i) {
+          received_from[recv_buffer[i].proc].inc(recv_buffer[i].buffer.size());
+        }
+      }
+    }
+
+    /// Flushes the send buffers of the current worker
+    void flush_exchanges(const size_t thread_id) {
+      message_exchange.partial_flush();
+      vdata_exchange.partial_flush();
+      vprog_exchange.partial_flush();
+      gather_exchange.partial_flush();
+    }
+
+    void compute_aggregator(const size_t thread_id) {
+      aggregator.tick_asynchronous_compute(thread_id, aggregation_key);
+    }
+
+    /**
+     * \brief Sends the messages received by mirrors to their masters
+     */
+    void exchange_messages(const size_t thread_id) {
+      const size_t nverts = graph.num_local_vertices();
+      while (1) {
+        lvid_type lvid = shared_lvid_counter.inc_ret_last(1);
+        if (lvid >= nverts) break;
+        if (graph.l_is_master(lvid) || !has_message.get(lvid)) continue;
+        vlocks[lvid].lock();
+        const procid_t master = graph.l_master(lvid);
+        message_exchange.send(master,
+                              std::make_pair(graph.global_vid(lvid),
+                                             messages[lvid]));
+        messages[lvid] = message_type();
+        has_message.clear_bit(lvid);
+        vlocks[lvid].unlock();
+        sent_to[master].inc();
+      }
+    }
+
+    /**
+     * \brief Computes the partial gathers requested by the masters and
+     * sends them back tagged with the current clock
+     */
+    void execute_mirror_gathers(const size_t thread_id) {
+      context_type context(*this, graph);
+      const size_t nverts = graph.num_local_vertices();
+      while (1) {
+        lvid_type lvid = shared_lvid_counter.inc_ret_last(1);
+        if (lvid >= nverts) break;
+        if (!gather_request.get(lvid)) continue;
+        gather_request.clear_bit(lvid);
+        const procid_t master = graph.l_master(lvid);
+        gather_reply reply;
+        reply.clock = clock;
+        reply.value = local_gather(context, lvid);
+        gather_exchange.send(master,
+                             std::make_pair(graph.global_vid(lvid), reply));
+        sent_to[master].inc();
+      }
+    }
+
+    /**
+     * \brief Requests a new partial gather from every mirror of lvid which
+     * does not already have a request outstanding.
+     */
+    void request_partial_gathers(lvid_type lvid) {
+      const vertex_id_type vid = graph.global_vid(lvid);
+      vprog_request request;
+      request.flags = GATHER_REQUEST;
+      request.activation = activation[lvid];
+      request.program = vertex_programs[lvid];
+      size_t slot = partial_offset[lvid];
+      foreach(procid_t mirror, graph.l_get_vertex_record(lvid).mirrors()) {
+        if (!partial_requested[slot]) {
+          partial_requested[slot] = 1;
+          vprog_exchange.send(mirror, std::make_pair(vid, request));
+          sent_to[mirror].inc();
+        }
+        ++slot;
+      }
+    }
+
+    /**
+     * \brief Returns true if the partial gathers of all mirrors of lvid are
+     * within the staleness bound.
+     */
+    bool partial_gathers_fresh(lvid_type lvid) const {
+      for (size_t slot = partial_offset[lvid];
+           slot < partial_offset[lvid + 1]; ++slot) {
+        if (partial_clock[slot] < 0 ||
+            size_t(partial_clock[slot]) + staleness + 1 < clock) return false;
+      }
+      return true;
+    }
+
+    /**
+     * \brief Runs init on all masters with messages and apply on all masters
+     * whose gathers are complete.
+     */
+    void execute_applys(const size_t thread_id) {
+      context_type context(*this, graph);
+      const size_t nverts = graph.num_local_vertices();
+      while (1) {
+        lvid_type lvid = shared_lvid_counter.inc_ret_last(1);
+        if (lvid >= nverts) break;
+        if (!graph.l_is_master(lvid)) continue;
+        vertex_type vertex(graph.l_vertex(lvid));
+        // the lock only protects the messages. init, gather and apply run
+        // without it since they may signal this vertex
+        vlocks[lvid].lock();
+        const bool activate = !pending_apply.get(lvid);
+        if (activate && !has_message.get(lvid)) {
+          vlocks[lvid].unlock();
+          continue;
+        }
+        message_type message;
+        if (activate) {
+          message = messages[lvid];
+          messages[lvid] = message_type();
+          has_message.clear_bit(lvid);
+          pending_apply.set_bit(lvid);
+        }
+        vlocks[lvid].unlock();
+        if (activate) {
+          vertex_programs[lvid] = vertex_program_type();
+          vertex_programs[lvid].init(context, vertex, message);
+          ++activation[lvid];
+          // partial gathers of earlier activations are kept and reused
+          // while they are within the staleness bound. Ask the mirrors for
+          // fresh ones computed with the new vertex program.
+          const vertex_program_type& const_vprog = vertex_programs[lvid];
+          if (const_vprog.gather_edges(context, vertex) != graphlab::NO_EDGES) {
+            request_partial_gathers(lvid);
+          }
+        }
+        conditional_gather_type accum;
+        const vertex_program_type& const_vprog = vertex_programs[lvid];
+        if (const_vprog.gather_edges(context, vertex) != graphlab::NO_EDGES) {
+          if (!partial_gathers_fresh(lvid)) {
+            // wait for the mirrors. Make sure we asked for fresh data
+            request_partial_gathers(lvid);
+            deferred_applys.inc();
+            continue;
+          }
+          accum = local_gather(context, lvid);
+          for (size_t slot = partial_offset[lvid];
+               slot < partial_offset[lvid + 1]; ++slot) {
+            accum += partial_gather[slot];
+          }
+        }
+        pending_apply.clear_bit(lvid);
+        vertex_programs[lvid].apply(context, vertex, accum.value);
+        aggregator.update_vertex(context, vertex);
+        ++completed_applys;
+        // synchronize the changed vertex data with all mirrors
+        const bool scatter = const_vprog.scatter_edges(context, vertex) !=
+                             graphlab::NO_EDGES;
+        const vertex_id_type vid = graph.global_vid(lvid);
+        vprog_request request;
+        if (scatter) {
+          request.flags = SCATTER_REQUEST;
+          request.activation = activation[lvid];
+          request.program = vertex_programs[lvid];
+        }
+        foreach(procid_t mirror, graph.l_get_vertex_record(lvid).mirrors()) {
+          vdata_exchange.send(mirror, std::make_pair(vid, vertex.data()));
+          sent_to[mirror].inc();
+          if (scatter) {
+            vprog_exchange.send(mirror, std::make_pair(vid, request));
+            sent_to[mirror].inc();
+          }
+        }
+        if (scatter) {
+          vlocks[lvid].lock();
+          scatter_programs[lvid].push_back(vertex_programs[lvid]);
+          vlocks[lvid].unlock();
+          scatter_request.set_bit(lvid);
+        }
+      }
+    }
+
+    /**
+     * \brief Runs the scatter on all replicas with a pending scatter
+     */
+    void execute_scatters(const size_t thread_id) {
+      context_type context(*this, graph);
+      const size_t nverts = graph.num_local_vertices();
+      while (1) {
+        lvid_type lvid = shared_lvid_counter.inc_ret_last(1);
+        if (lvid >= nverts) break;
+        if (!scatter_request.get(lvid)) continue;
+        scatter_request.clear_bit(lvid);
+        std::vector<vertex_program_type> vprogs;
+        vlocks[lvid].lock();
+        vprogs.swap(scatter_programs[lvid]);
+        vlocks[lvid].unlock();
+        local_vertex_type local_vertex = graph.l_vertex(lvid);
+        const vertex_type vertex(local_vertex);
+        for (size_t i = 0; i < vprogs.size(); ++i) {
+          const vertex_program_type& vprog = vprogs[i];
+          const edge_dir_type scatter_dir = vprog.scatter_edges(context, vertex);
+          if(scatter_dir == IN_EDGES || scatter_dir == ALL_EDGES) {
+            foreach(local_edge_type local_edge, local_vertex.in_edges()) {
+              edge_type edge(local_edge);
+              vprog.scatter(context, vertex, edge);
+            }
+          }
+          if(scatter_dir == OUT_EDGES || scatter_dir == ALL_EDGES) {
+            foreach(local_edge_type local_edge, local_vertex.out_edges()) {
+              edge_type edge(local_edge);
+              vprog.scatter(context, vertex, edge);
+            }
+          }
+        }
+      }
+    }
+
+
+    // Data Synchronization ===================================================
+
+    void recv_messages() {
+      typename message_exchange_type::recv_buffer_type recv_buffer;
+      while(message_exchange.recv(recv_buffer)) {
+        for (size_t i = 0;i < recv_buffer.size(); ++i) {
+          typename message_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
+          foreach(const vid_message_pair_type& pair, buffer) {
+            internal_signal_rpc(pair.first, pair.second);
+          }
+          received_from[recv_buffer[i].proc].inc(buffer.size());
+        }
+      }
+    }
+
+    void recv_vertex_data() {
+      typename vdata_exchange_type::recv_buffer_type recv_buffer;
+      while(vdata_exchange.recv(recv_buffer)) {
+        for (size_t i = 0;i < recv_buffer.size(); ++i) {
+          typename vdata_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
+          foreach(const vid_vdata_pair_type& pair, buffer) {
+            const lvid_type lvid = graph.local_vid(pair.first);
+            vlocks[lvid].lock();
+            graph.l_vertex(lvid).data() = pair.second;
+            vlocks[lvid].unlock();
+          }
+          received_from[recv_buffer[i].proc].inc(buffer.size());
+        }
+      }
+    }
+
+    void recv_vertex_programs() {
+      typename vprog_exchange_type::recv_buffer_type recv_buffer;
+      while(vprog_exchange.recv(recv_buffer)) {
+        for (size_t i = 0;i < recv_buffer.size(); ++i) {
+          typename vprog_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
+          foreach(const vid_prog_pair_type& pair, buffer) {
+            const lvid_type lvid = graph.local_vid(pair.first);
+            const vprog_request& request = pair.second;
+            vlocks[lvid].lock();
+            if ((request.flags & GATHER_REQUEST) &&
+                request.activation >= activation[lvid]) {
+              vertex_programs[lvid] = request.program;
+              activation[lvid] = request.activation;
+              gather_request.set_bit(lvid);
+            }
+            if (request.flags & SCATTER_REQUEST) {
+              scatter_programs[lvid].push_back(request.program);
+              scatter_request.set_bit(lvid);
+            }
+            vlocks[lvid].unlock();
+          }
+          received_from[recv_buffer[i].proc].inc(buffer.size());
+        }
+      }
+    }
+
+    void recv_gathers() {
+      typename gather_exchange_type::recv_buffer_type recv_buffer;
+      while(gather_exchange.recv(recv_buffer)) {
+        for (size_t i = 0;i < recv_buffer.size(); ++i) {
+          typename gather_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
+          const procid_t proc = recv_buffer[i].proc;
+          foreach(const vid_gather_pair_type& pair, buffer) {
+            const lvid_type lvid = graph.local_vid(pair.first);
+            ASSERT_TRUE(graph.l_is_master(lvid));
+            const size_t slot = partial_slot(lvid, proc);
+            const gather_reply& reply = pair.second;
+            vlocks[lvid].lock();
+            // replies requested by an earlier activation are kept too.
+            // They are only used while within the staleness bound.
+            if (reply.clock >= partial_clock[slot]) {
+              partial_clock[slot] = reply.clock;
+              partial_gather[slot] = reply.value;
+            }
+            partial_requested[slot] = 0;
+            vlocks[lvid].unlock();
+          }
+          received_from[proc].inc(buffer.size());
+        }
+      }
+    }
+
+  }; // end of class stale synchronous engine
+
+}; // namespace
+
+
+#include <graphlab/macros_undef.hpp>
+
+#endif
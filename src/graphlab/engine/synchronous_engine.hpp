@@ -35,6 +35,7 @@
 #include <graphlab/vertex_program/context.hpp>
 
 #include <graphlab/engine/execution_status.hpp>
+#include <graphlab/engine/phase_profiler.hpp>
 #include <graphlab/options/graphlab_options.hpp>
 
 
@@ -199,6 +200,17 @@ namespace graphlab {
    * for the snapshot. The path including folder and file prefix in
    * which the snapshots should be saved.
    *
+   * \li \b profile (default: 0) If set to a positive value N the
+   * engine samples one in every N gathers, applys, scatters and
+   * exchange sends with the cycle counter and records every contended
+   * vertex lock and received exchange buffer.  The time is broken down
+   * by phase, vertex degree and machine (see graphlab::phase_profiler)
+   * and written by machine 0 when \ref start returns.
+   *
+   * \li \b profile_prefix (default: "phase_profile") The output of
+   * the profiler is written to profile_prefix.json and, in the folded
+   * stack format read by flamegraph.pl, to profile_prefix.folded.
+   *
    * \see graphlab::omni_engine
    * \see graphlab::async_consistent_engine
    * \see graphlab::semi_synchronous_engine
@@ -404,6 +416,17 @@ namespace graphlab {
      */
     bool sched_allv;
 
+    /**
+     * \brief Times the phases of the vertex programs when the
+     * profile option is set.
+     */
+    phase_profiler profiler;
+
+    /**
+     * \brief The prefix of the files the profile is written to
+     */
+    std::string profile_prefix;
+
     /**
      * \brief Used to stop the engine prematurely
      */
@@ -485,6 +508,12 @@ namespace graphlab {
      */
     dense_bitset has_cache;
 
+    /**
+     * \brief The graph structure version the datastructures were last
+     * sized for. See distributed_graph::get_structure_version().
+     */
+    size_t graph_version;
+
     /**
      * \brief A bit (for master vertices) indicating if that vertex is active
      * (received a message on this iteration).
@@ -693,16 +722,26 @@ namespace graphlab {
      */
     void init();
 
-
-  private:
-
-
     /**
      * \brief Resize the datastructures to fit the graph size (in case of dynamic graph). Keep all the messages
      * and caches.
+     *
+     * start() and the signal functions commit pending graph changes and
+     * call resize() automatically when the graph structure changed, so
+     * edges and vertices may be streamed into the graph between runs.
      */
     void resize();
 
+
+  private:
+
+    /**
+     * \brief Commits any pending changes to the graph structure. If the
+     * structure changed, resizes the datastructures and clears the gather
+     * cache. Must be called on all machines at the same time.
+     */
+    void update_graph_structure();
+
     /**
      * \brief This internal stop function is called by the \ref graphlab::context to
      * terminate execution of the engine.
@@ -894,7 +933,7 @@ namespace graphlab {
      * programs and should be called after a flush of the vertex
      * program exchange.
      */
-    void recv_vertex_programs();
+    void recv_vertex_programs(size_t thread_id);
 
     /**
      * \brief Send the vertex data for the local vertex id to all of
@@ -913,7 +952,7 @@ namespace graphlab {
      * data and should be called after a flush of the vertex data
      * exchange.
      */
-    void recv_vertex_data();
+    void recv_vertex_data(size_t thread_id);
 
     /**
      * \brief Send the gather value for the vertex id to its master.
@@ -932,7 +971,7 @@ namespace graphlab {
      * buffered exchange and should be called after the buffered
      * exchange has been flushed
      */
-    void recv_gathers();
+    void recv_gathers(size_t thread_id);
 
     /**
      * \brief Send the accumulated message for the local vertex to its
@@ -949,7 +988,19 @@ namespace graphlab {
      * buffered exchange and should be called after the buffered
      * exchange has been flushed
      */
-    void recv_messages();
+    void recv_messages(size_t thread_id);
+
+    /**
+     * \brief Returns the degree of the local vertex used to bucket
+     * profiler samples.
+     */
+    size_t profile_degree(lvid_type lvid) const;
+
+    /**
+     * \brief Acquires the vertex lock, recording the time spent
+     * waiting for it when the profiler is enabled.
+     */
+    void lock_vertex(lvid_type lvid, size_t thread_id);
 
 
   }; // end of class synchronous engine
@@ -1007,7 +1058,7 @@ namespace graphlab {
     threads(2*1024*1024 /* 2MB stack per fiber*/),
     thread_barrier(opts.get_ncpus()),
     max_iterations(-1), snapshot_interval(-1), iteration_counter(0),
-    timeout(0), sched_allv(false),
+    timeout(0), sched_allv(false), profile_prefix("phase_profile"),
     vprog_exchange(dc),
     vdata_exchange(dc),
     gather_exchange(dc),
@@ -1017,6 +1068,7 @@ namespace graphlab {
     std::vector<std::string> keys = opts.get_engine_args().get_option_keys();
     per_thread_compute_time.resize(opts.get_ncpus());
     use_cache = false;
+    size_t profile_interval = 0;
     foreach(std::string opt, keys) {
       if (opt == "max_iterations") {
         opts.get_engine_args().get_option("max_iterations", max_iterations);
@@ -1048,6 +1100,16 @@ namespace graphlab {
         if (rmi.procid() == 0)
           logstream(LOG_EMPH) << "Engine Option: sched_allv = "
             << sched_allv << std::endl;
+      } else if (opt == "profile") {
+        opts.get_engine_args().get_option("profile", profile_interval);
+        if (rmi.procid() == 0)
+          logstream(LOG_EMPH) << "Engine Option: profile = "
+            << profile_interval << std::endl;
+      } else if (opt == "profile_prefix") {
+        opts.get_engine_args().get_option("profile_prefix", profile_prefix);
+        if (rmi.procid() == 0)
+          logstream(LOG_EMPH) << "Engine Option: profile_prefix = "
+            << profile_prefix << std::endl;
       } else {
         logstream(LOG_FATAL) << "Unexpected Engine Option: " << opt << std::endl;
       }
@@ -1057,6 +1119,7 @@ namespace graphlab {
       logstream(LOG_FATAL)
         << "Snapshot interval specified, but no snapshot path" << std::endl;
     }
+    profiler.init(ncpus, profile_interval);
     INITIALIZE_EVENT_LOG(dc);
     ADD_CUMULATIVE_EVENT(EVENT_APPLIES, "Applies", "Calls");
     ADD_CUMULATIVE_EVENT(EVENT_GATHERS , "Gathers", "Calls");
@@ -1105,12 +1168,29 @@ namespace graphlab {
     // Allocate bitset to track active vertices on each bitset.
     active_superstep.resize(graph.num_local_vertices());
     active_minorstep.resize(graph.num_local_vertices());
+    graph_version = graph.get_structure_version();
 
     // Print memory usage after initialization
     memory_info::log_usage("After Engine Initialization");
   }
 
 
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>:: update_graph_structure() {
+    // finalize() costs a barrier even when nothing changed, so only
+    // call it if some machine has a pending change
+    size_t pending_changes = !graph.is_finalized();
+    rmi.all_reduce(pending_changes);
+    if (pending_changes > 0) graph.finalize();
+    if (graph_version != graph.get_structure_version()) {
+      resize();
+      // the cached gathers summarize edges which may have been added or
+      // removed, even if no vertex was added
+      has_cache.clear();
+    }
+  }
+
+
   template<typename VertexProgram>
   typename synchronous_engine<VertexProgram>::aggregator_type*
   synchronous_engine<VertexProgram>::get_aggregator() {
@@ -1134,8 +1214,7 @@ namespace graphlab {
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
   signal(vertex_id_type gvid, const message_type& message) {
-    if (vlocks.size() != graph.num_local_vertices())
-      resize();
+    update_graph_structure();
     rmi.barrier();
     internal_signal_rpc(gvid, message);
     rmi.barrier();
@@ -1146,8 +1225,7 @@ namespace graphlab {
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
   signal_all(const message_type& message, const std::string& order) {
-    if (vlocks.size() != graph.num_local_vertices())
-      resize();
+    update_graph_structure();
     for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid) {
       if(graph.l_is_master(lvid)) {
         internal_signal(vertex_type(graph.l_vertex(lvid)), message);
@@ -1160,8 +1238,7 @@ namespace graphlab {
   void synchronous_engine<VertexProgram>::
   signal_vset(const vertex_set& vset,
              const message_type& message, const std::string& order) {
-    if (vlocks.size() != graph.num_local_vertices())
-      resize();
+    update_graph_structure();
     for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid) {
       if(graph.l_is_master(lvid) && vset.l_contains(lvid)) {
         internal_signal(vertex_type(graph.l_vertex(lvid)), message);
@@ -1269,8 +1346,7 @@ namespace graphlab {
 
   template<typename VertexProgram> execution_status::status_enum
   synchronous_engine<VertexProgram>::start() {
-    if (vlocks.size() != graph.num_local_vertices())
-      resize();
+    update_graph_structure();
     completed_applys = 0;
     rmi.barrier();
 
@@ -1281,6 +1357,7 @@ namespace graphlab {
     start_time = timer::approx_time_seconds();
     iteration_counter = 0;
     force_abort = false;
+    profiler.clear();
     execution_status::status_enum termination_reason =
       execution_status::UNSET;
     // if (perform_init_vtx_program) {
@@ -1288,6 +1365,7 @@ namespace graphlab {
     //   run_synchronous( &synchronous_engine::initialize_vertex_programs );
     // }
     aggregator.start();
+    aggregator.start_incremental();
     rmi.barrier();
 
     if (snapshot_interval == 0) {
@@ -1301,6 +1379,7 @@ namespace graphlab {
     }
     // Program Main loop ====================================================
     while(iteration_counter < max_iterations && !force_abort ) {
+      TRACE_SPAN("superstep", "engine");
 
       // Check first to see if we are out of time
       if(timeout != 0 && timeout < elapsed_seconds()) {
@@ -1326,7 +1405,10 @@ namespace graphlab {
       // Exchange Messages --------------------------------------------------
       // Exchange any messages in the local message vectors
       // if (rmi.procid() == 0) std::cout << "Exchange messages..." << std::endl;
-      run_synchronous( &synchronous_engine::exchange_messages );
+      {
+        TRACE_SPAN("exchange_messages", "engine");
+        run_synchronous( &synchronous_engine::exchange_messages );
+      }
       /**
        * Post conditions:
        *   1) only master vertices have messages
@@ -1339,7 +1421,10 @@ namespace graphlab {
 
       // if (rmi.procid() == 0) std::cout << "Receive messages..." << std::endl;
       num_active_vertices = 0;
-      run_synchronous( &synchronous_engine::receive_messages );
+      {
+        TRACE_SPAN("receive_messages", "engine");
+        run_synchronous( &synchronous_engine::receive_messages );
+      }
       if (sched_allv) {
         active_minorstep.fill();
       }
@@ -1372,7 +1457,10 @@ namespace graphlab {
       // Execute the gather operation for all vertices that are active
       // in this minor-step (active-minorstep bit set).
       // if (rmi.procid() == 0) std::cout << "Gathering..." << std::endl;
-      run_synchronous( &synchronous_engine::execute_gathers );
+      {
+        TRACE_SPAN("gather", "engine");
+        run_synchronous( &synchronous_engine::execute_gathers );
+      }
       // Clear the minor step bit since only super-step vertices
       // (only master vertices are required to participate in the
       // apply step)
@@ -1388,7 +1476,10 @@ namespace graphlab {
       // Execute Apply Operations -------------------------------------------
       // Run the apply function on all active vertices
       // if (rmi.procid() == 0) std::cout << "Applying..." << std::endl;
-      run_synchronous( &synchronous_engine::execute_applys );
+      {
+        TRACE_SPAN("apply", "engine");
+        run_synchronous( &synchronous_engine::execute_applys );
+      }
       /**
        * Post conditions:
        *   1) any changes to the vertex data have been synchronized
@@ -1403,7 +1494,10 @@ namespace graphlab {
 
       // Execute Scatter Operations -----------------------------------------
       // Execute each of the scatters on all minor-step active vertices.
-      run_synchronous( &synchronous_engine::execute_scatters );
+      {
+        TRACE_SPAN("scatter", "engine");
+        run_synchronous( &synchronous_engine::execute_scatters );
+      }
       /**
        * Post conditions:
        *   1) NONE
@@ -1411,11 +1505,15 @@ namespace graphlab {
       if(rmi.procid() == 0 && print_this_round)
         logstream(LOG_EMPH) << "\t Running Aggregators" << std::endl;
       // probe the aggregator
-      aggregator.tick_synchronous();
+      {
+        TRACE_SPAN("aggregator", "engine");
+        aggregator.tick_synchronous();
+      }
 
       ++iteration_counter;
 
       if (snapshot_interval > 0 && iteration_counter % snapshot_interval == 0) {
+        TRACE_SPAN("snapshot", "engine");
         graph.save_binary(snapshot_path);
       }
     }
@@ -1444,6 +1542,17 @@ namespace graphlab {
       }
       logstream(LOG_INFO) << std::endl;
     }
+    if (profiler.enabled()) {
+      std::vector<phase_profile> all_profiles(rmi.numprocs());
+      all_profiles[rmi.procid()] = profiler.local_profile();
+      rmi.all_gather(all_profiles);
+      if (rmi.procid() == 0) {
+        phase_profiler::save(profile_prefix, all_profiles,
+                             profiler.sample_interval(), "synchronous_engine");
+        logstream(LOG_EMPH) << "Phase profile written to "
+                            << profile_prefix << ".json" << std::endl;
+      }
+    }
     rmi.full_barrier();
     // Stop the aggregator
     aggregator.stop();
@@ -1482,15 +1591,18 @@ namespace graphlab {
           // clear the message to save memory
           messages[lvid] = message_type();
         }
-        if(++vcount % TRY_RECV_MOD == 0) recv_messages();
+        if(++vcount % TRY_RECV_MOD == 0) recv_messages(thread_id);
       }
     } // end of loop over vertices to send messages
     message_exchange.partial_flush();
     // Finish sending and receiving all messages
     thread_barrier.wait();
-    if(thread_id == 0) message_exchange.flush();
+    if(thread_id == 0) {
+      TRACE_SPAN("message_exchange_flush", "exchange");
+      message_exchange.flush();
+    }
     thread_barrier.wait();
-    recv_messages();
+    recv_messages(thread_id);
   } // end of exchange_messages
 
 
@@ -1540,7 +1652,7 @@ namespace graphlab {
             sync_vertex_program(lvid, thread_id);
           }
         }
-        if(++vcount % TRY_RECV_MOD == 0) recv_vertex_programs();
+        if(++vcount % TRY_RECV_MOD == 0) recv_vertex_programs(thread_id);
       }
     }
 
@@ -1550,11 +1662,12 @@ namespace graphlab {
     // programs.
     thread_barrier.wait();
     if(thread_id == 0) {
+      TRACE_SPAN("vprog_exchange_flush", "exchange");
       vprog_exchange.flush();
     }
     thread_barrier.wait();
 
-    recv_vertex_programs();
+    recv_vertex_programs(thread_id);
 
   } // end of receive messages
 
@@ -1586,6 +1699,8 @@ namespace graphlab {
         lvid_type lvid = lvid_block_start + lvid_block_offset;
         if (lvid >= graph.num_local_vertices()) break;
 
+        const unsigned long long gather_start =
+          profiler.begin(thread_id, phase_profiler::GATHER);
         bool accum_is_set = false;
         gather_type accum = gather_type();
         // if caching is enabled and we have a cache entry then use
@@ -1641,6 +1756,10 @@ namespace graphlab {
             gather_cache[lvid] = accum; has_cache.set_bit(lvid);
           } // end of if caching enabled
         }
+        if (gather_start) {
+          profiler.end(thread_id, phase_profiler::GATHER,
+                       profile_degree(lvid), gather_start);
+        }
         // If the accum contains a value for the local gather we put
         // that estimate in the gather exchange.
         if(accum_is_set) sync_gather(lvid, accum, thread_id);
@@ -1650,16 +1769,19 @@ namespace graphlab {
         }
 
         // try to recv gathers if there are any in the buffer
-        if(++vcount % TRY_RECV_MOD == 0) recv_gathers();
+        if(++vcount % TRY_RECV_MOD == 0) recv_gathers(thread_id);
       }
     } // end of loop over vertices to compute gather accumulators
     per_thread_compute_time[thread_id] += ti.current_time();
     gather_exchange.partial_flush();
       // Finish sending and receiving all gather operations
     thread_barrier.wait();
-    if(thread_id == 0) gather_exchange.flush();
+    if(thread_id == 0) {
+      TRACE_SPAN("gather_exchange_flush", "exchange");
+      gather_exchange.flush();
+    }
     thread_barrier.wait();
-    recv_gathers();
+    recv_gathers(thread_id);
   } // end of execute_gathers
 
 
@@ -1694,7 +1816,14 @@ namespace graphlab {
         // the gather_accum was not set during the gather.
         const gather_type& accum = gather_accum[lvid];
         INCREMENT_EVENT(EVENT_APPLIES, 1);
+        const unsigned long long apply_start =
+          profiler.begin(thread_id, phase_profiler::APPLY);
         vertex_programs[lvid].apply(context, vertex, accum);
+        if (apply_start) {
+          profiler.end(thread_id, phase_profiler::APPLY,
+                       profile_degree(lvid), apply_start);
+        }
+        aggregator.update_vertex(context, vertex);
         // record an apply as a completed task
         ++completed_applys;
         // Clear the accumulator to save some memory
@@ -1713,8 +1842,8 @@ namespace graphlab {
         }
       // try to receive vertex data
         if(++vcount % TRY_RECV_MOD == 0) {
-          recv_vertex_programs();
-          recv_vertex_data();
+          recv_vertex_programs(thread_id);
+          recv_vertex_data(thread_id);
         }
       }
     } // end of loop over vertices to run apply
@@ -1725,11 +1854,12 @@ namespace graphlab {
       // Finish sending and receiving all changes due to apply operations
     thread_barrier.wait();
     if(thread_id == 0) { 
-      vprog_exchange.flush(); vdata_exchange.flush(); 
+      TRACE_SPAN("vprog_vdata_exchange_flush", "exchange");
+      vprog_exchange.flush(); vdata_exchange.flush();
     }
     thread_barrier.wait();
-    recv_vertex_programs();
-    recv_vertex_data();
+    recv_vertex_programs(thread_id);
+    recv_vertex_data(thread_id);
   } // end of execute_applys
 
 
@@ -1760,6 +1890,8 @@ namespace graphlab {
         local_vertex_type local_vertex = graph.l_vertex(lvid);
         const vertex_type vertex(local_vertex);
         const edge_dir_type scatter_dir = vprog.scatter_edges(context, vertex);
+        const unsigned long long scatter_start =
+          profiler.begin(thread_id, phase_profiler::SCATTER);
 				size_t edges_touched = 0;
         // Loop over in edges
         if(scatter_dir == IN_EDGES || scatter_dir == ALL_EDGES) {
@@ -1782,6 +1914,10 @@ namespace graphlab {
 					++edges_touched;
         } // end of if out_edges/all_edges
 				INCREMENT_EVENT(EVENT_SCATTERS, edges_touched);
+        if (scatter_start) {
+          profiler.end(thread_id, phase_profiler::SCATTER,
+                       profile_degree(lvid), scatter_start);
+        }
         // Clear the vertex program
         vertex_programs[lvid] = vertex_program_type();
       } // end of if active on this minor step
@@ -1792,6 +1928,30 @@ namespace graphlab {
 
 
 
+  // Profiling ==============================================================
+  template<typename VertexProgram>
+  size_t synchronous_engine<VertexProgram>::
+  profile_degree(lvid_type lvid) const {
+    const vertex_type vertex(graph.l_vertex(lvid));
+    return vertex.num_in_edges() + vertex.num_out_edges();
+  } // end of profile_degree
+
+
+  template<typename VertexProgram>
+  void synchronous_engine<VertexProgram>::
+  lock_vertex(lvid_type lvid, const size_t thread_id) {
+    if (!profiler.enabled()) {
+      vlocks[lvid].lock();
+    } else if (!vlocks[lvid].try_lock()) {
+      const unsigned long long wait_start = rdtsc();
+      vlocks[lvid].lock();
+      profiler.end_always(thread_id, phase_profiler::LOCK_WAIT,
+                          profile_degree(lvid), wait_start);
+    }
+  } // end of lock_vertex
+
+
+
   // Data Synchronization ===================================================
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
@@ -1799,19 +1959,27 @@ namespace graphlab {
     ASSERT_TRUE(graph.l_is_master(lvid));
     const vertex_id_type vid = graph.global_vid(lvid);
     local_vertex_type vertex = graph.l_vertex(lvid);
+    const unsigned long long send_start =
+      profiler.begin(thread_id, phase_profiler::EXCHANGE_SEND);
     foreach(const procid_t& mirror, vertex.mirrors()) {
       vprog_exchange.send(mirror,
                           std::make_pair(vid, vertex_programs[lvid]));
     }
+    if (send_start) {
+      profiler.end(thread_id, phase_profiler::EXCHANGE_SEND,
+                   profile_degree(lvid), send_start);
+    }
   } // end of sync_vertex_program
 
 
 
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
-  recv_vertex_programs() {
+  recv_vertex_programs(const size_t thread_id) {
     typename vprog_exchange_type::recv_buffer_type recv_buffer;
     while(vprog_exchange.recv(recv_buffer)) {
+      const unsigned long long recv_start =
+        profiler.enabled() ? rdtsc() : 0;
       for (size_t i = 0;i < recv_buffer.size(); ++i) {
         typename vprog_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
         foreach(const vid_prog_pair_type& pair, buffer) {
@@ -1821,6 +1989,8 @@ namespace graphlab {
           active_minorstep.set_bit(lvid);
         }
       }
+      profiler.end_always(thread_id, phase_profiler::EXCHANGE_RECV,
+                          phase_profiler::NO_DEGREE, recv_start);
     }
   } // end of recv vertex programs
 
@@ -1831,9 +2001,15 @@ namespace graphlab {
     ASSERT_TRUE(graph.l_is_master(lvid));
     const vertex_id_type vid = graph.global_vid(lvid);
     local_vertex_type vertex = graph.l_vertex(lvid);
+    const unsigned long long send_start =
+      profiler.begin(thread_id, phase_profiler::EXCHANGE_SEND);
     foreach(const procid_t& mirror, vertex.mirrors()) {
       vdata_exchange.send(mirror, std::make_pair(vid, vertex.data()));
     }
+    if (send_start) {
+      profiler.end(thread_id, phase_profiler::EXCHANGE_SEND,
+                   profile_degree(lvid), send_start);
+    }
   } // end of sync_vertex_data
 
 
@@ -1842,9 +2018,11 @@ namespace graphlab {
 
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
-  recv_vertex_data() {
+  recv_vertex_data(const size_t thread_id) {
     typename vdata_exchange_type::recv_buffer_type recv_buffer;
     while(vdata_exchange.recv(recv_buffer)) {
+      const unsigned long long recv_start =
+        profiler.enabled() ? rdtsc() : 0;
       for (size_t i = 0;i < recv_buffer.size(); ++i) {
         typename vdata_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
         foreach(const vid_vdata_pair_type& pair, buffer) {
@@ -1853,6 +2031,8 @@ namespace graphlab {
           graph.l_vertex(lvid).data() = pair.second;
         }
       }
+      profiler.end_always(thread_id, phase_profiler::EXCHANGE_RECV,
+                          phase_profiler::NO_DEGREE, recv_start);
     }
   } // end of recv vertex data
 
@@ -1861,7 +2041,7 @@ namespace graphlab {
   void synchronous_engine<VertexProgram>::
   sync_gather(lvid_type lvid, const gather_type& accum, const size_t thread_id) {
     if(graph.l_is_master(lvid)) {
-      vlocks[lvid].lock();
+      lock_vertex(lvid, thread_id);
       if(has_gather_accum.get(lvid)) {
         gather_accum[lvid] += accum;
       } else {
@@ -1872,22 +2052,30 @@ namespace graphlab {
     } else {
       const procid_t master = graph.l_master(lvid);
       const vertex_id_type vid = graph.global_vid(lvid);
+      const unsigned long long send_start =
+        profiler.begin(thread_id, phase_profiler::EXCHANGE_SEND);
       gather_exchange.send(master, std::make_pair(vid, accum));
+      if (send_start) {
+        profiler.end(thread_id, phase_profiler::EXCHANGE_SEND,
+                     profile_degree(lvid), send_start);
+      }
     }
   } // end of sync_gather
 
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
-  recv_gathers() {
+  recv_gathers(const size_t thread_id) {
     typename gather_exchange_type::recv_buffer_type recv_buffer;
     while(gather_exchange.recv(recv_buffer)) {
+      const unsigned long long recv_start =
+        profiler.enabled() ? rdtsc() : 0;
       for (size_t i = 0;i < recv_buffer.size(); ++i) {
         typename gather_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
         foreach(const vid_gather_pair_type& pair, buffer) {
           const lvid_type lvid = graph.local_vid(pair.first);
           const gather_type& accum = pair.second;
           ASSERT_TRUE(graph.l_is_master(lvid));
-          vlocks[lvid].lock();
+          lock_vertex(lvid, thread_id);
           if( has_gather_accum.get(lvid) ) {
             gather_accum[lvid] += accum;
           } else {
@@ -1897,6 +2085,8 @@ namespace graphlab {
           vlocks[lvid].unlock();
         }
       }
+      profiler.end_always(thread_id, phase_profiler::EXCHANGE_RECV,
+                          phase_profiler::NO_DEGREE, recv_start);
     }
   } // end of recv_gather
 
@@ -1907,7 +2097,13 @@ namespace graphlab {
     ASSERT_FALSE(graph.l_is_master(lvid));
     const procid_t master = graph.l_master(lvid);
     const vertex_id_type vid = graph.global_vid(lvid);
+    const unsigned long long send_start =
+      profiler.begin(thread_id, phase_profiler::EXCHANGE_SEND);
     message_exchange.send(master, std::make_pair(vid, messages[lvid]));
+    if (send_start) {
+      profiler.end(thread_id, phase_profiler::EXCHANGE_SEND,
+                   profile_degree(lvid), send_start);
+    }
   } // end of send_message
 
 
@@ -1915,15 +2111,17 @@ namespace graphlab {
 
   template<typename VertexProgram>
   void synchronous_engine<VertexProgram>::
-  recv_messages() {
+  recv_messages(const size_t thread_id) {
     typename message_exchange_type::recv_buffer_type recv_buffer;
     while(message_exchange.recv(recv_buffer)) {
+      const unsigned long long recv_start =
+        profiler.enabled() ? rdtsc() : 0;
       for (size_t i = 0;i < recv_buffer.size(); ++i) {
         typename message_exchange_type::buffer_type& buffer = recv_buffer[i].buffer;
         foreach(const vid_message_pair_type& pair, buffer) {
           const lvid_type lvid = graph.local_vid(pair.first);
           ASSERT_TRUE(graph.l_is_master(lvid));
-          vlocks[lvid].lock();
+          lock_vertex(lvid, thread_id);
           if( has_message.get(lvid) ) {
             messages[lvid] += pair.second;
           } else {
@@ -1933,6 +2131,8 @@ namespace graphlab {
           vlocks[lvid].unlock();
         }
       }
+      profiler.end_always(thread_id, phase_profiler::EXCHANGE_RECV,
+                          phase_profiler::NO_DEGREE, recv_start);
     }
   } // end of recv_messages
 
@@ -28,6 +28,8 @@
 
 #include <deque>
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <graphlab/scheduler/ischeduler.hpp>
 #include <graphlab/scheduler/scheduler_factory.hpp>
@@ -48,6 +50,8 @@
 #include <graphlab/rpc/fiber_async_consensus.hpp>
 #include <graphlab/aggregation/distributed_aggregator.hpp>
 #include <graphlab/parallel/fiber_remote_request.hpp>
+#include <graphlab/parallel/fiber_conditional.hpp>
+#include <graphlab/engine/warp_graph_transform.hpp>
 #include <graphlab/macros_def.hpp>
 
 
@@ -89,6 +93,12 @@ namespace warp {
    *
    * The engine stops when the scheduler is empty.
    *
+   * The data of a vertex which has no replica on the local machine can be
+   * read with context::read_vertex(). The data is fetched from the master
+   * and cached on the machine until the master changes it, and
+   * concurrent reads of the same vertex by different fibers share a
+   * single fetch.
+   *
    * ### Construction
    *
    * The warp engine is constructed by passing in a
@@ -173,7 +183,8 @@ namespace warp {
    * \li \b stacksize (default: 16384) Stacksize of each fiber.
    */
   template <typename GraphType, typename MessageType = graphlab::empty>
-  class warp_engine {
+  class warp_engine:
+      public warp_impl::vertex_write_listener<GraphType> {
 
   public:
     /**
@@ -414,6 +425,23 @@ namespace warp {
         engine.internal_signal_gvid(gvid, message);
       }
 
+      /**
+       * \brief Returns a copy of the data of an arbitrary vertex ID.
+       *
+       * If the vertex has a replica (master or mirror) on this machine
+       * the local data is returned. Otherwise the data is read from the
+       * master of the vertex and cached on this machine. The cached
+       * copy is reused by later reads until the master synchronizes a
+       * new value, and simultaneous reads of the same vertex by
+       * different fibers wait on a single fetch. Must be called from
+       * within an update function.
+       *
+       * \param gvid [in] The vertex to read
+       */
+      vertex_data_type read_vertex(vertex_id_type gvid) {
+        return engine.read_vertex_data(gvid);
+      }
+
 
       /**
        * \internal
@@ -425,6 +453,25 @@ namespace warp {
         }
       }
 
+      /**
+       * \internal
+       * \brief Starts a new version of the data of a master vertex
+       * which the caller sends to the mirrors itself (see
+       * warp::broadcast_neighborhood()). Returns the version to send.
+       */
+      size_t new_version(const vertex_type& vertex) {
+        return engine.new_vertex_version(vertex.local_id());
+      }
+
+      /**
+       * \internal
+       * \brief Stores data sent by the master in this mirror unless a
+       * newer version has already arrived.
+       */
+      void receive_version(size_t version, vertex_data_type& vdata) {
+        engine.update_vertex_value(vtx.id(), version, vdata);
+      }
+
       /**
        * \brief Synchronizes all copies of this vertex
        * 
@@ -486,6 +533,66 @@ namespace warp {
     /// Per vertex data locks
     std::vector<simple_spinlock> vertexlocks;
 
+    /**
+     * The version of the data of each local vertex. A master bumps the
+     * version every time it sends its data to the mirrors, by
+     * synchronizing or by warp::broadcast_neighborhood(). A mirror holds the
+     * version of the master data it last received.
+     */
+    std::vector<size_t> vertex_versions;
+
+    /// A fetch of a remote vertex shared by all the fibers waiting on it
+    struct vertex_fetch {
+      bool done;
+      vertex_data_type data;
+      fiber_conditional cond;
+      vertex_fetch(): done(false) { }
+    };
+
+    /**
+     * A cached copy of a vertex which has no replica on this machine.
+     * The data is current while data_version >= known_version, where
+     * known_version is the newest version announced by the master.
+     */
+    struct cached_vertex {
+      bool has_data;
+      size_t data_version;
+      size_t known_version;
+      vertex_data_type data;
+      /// The fetch in flight, if any
+      boost::shared_ptr<vertex_fetch> fetch;
+      cached_vertex(): has_data(false), data_version(0), known_version(0) { }
+    };
+
+    /// The reply to a fetch. The data is only sent if it changed.
+    struct vertex_fetch_reply {
+      size_t version;
+      bool changed;
+      /// False if the master was running: the data may be mid update
+      bool cacheable;
+      vertex_data_type data;
+      void save(oarchive& oarc) const {
+        oarc << version << changed << cacheable;
+        if (changed) oarc << data;
+      }
+      void load(iarchive& iarc) {
+        iarc >> version >> changed >> cacheable;
+        if (changed) iarc >> data;
+      }
+    };
+
+    /// Remote vertices read on this machine
+    boost::unordered_map<vertex_id_type, cached_vertex> vertex_cache;
+    mutex cache_lock;
+
+    /**
+     * The machines caching each master vertex. They are sent the new
+     * version whenever the vertex is synchronized.
+     */
+    boost::unordered_map<lvid_type, std::vector<procid_t> > cache_subscribers;
+    dense_bitset has_subscribers;
+    mutex subscriber_lock;
+
 
     /**
      * \brief A bit indicating if the local gather for that vertex is
@@ -530,6 +637,9 @@ namespace warp {
 
     // Various counters.
     atomic<uint64_t> programs_executed;
+    atomic<uint64_t> vertex_cache_hits;
+    atomic<uint64_t> vertex_cache_fetches;
+    atomic<uint64_t> vertex_cache_coalesced;
 
     timer launch_timer;
 
@@ -593,6 +703,7 @@ namespace warp {
       termination_reason = execution_status::UNSET;
       set_options(opts);
       initialize();
+      warp_impl::vertex_write_listener<graph_type>::attach(graph, this);
       rmi.barrier();
     }
 
@@ -681,6 +792,9 @@ namespace warp {
       scheduler_ptr->set_num_vertices(graph.num_local_vertices());
       messages.resize(graph.num_local_vertices());
       vertexlocks.resize(graph.num_local_vertices());
+      vertex_versions.resize(graph.num_local_vertices(), 0);
+      has_subscribers.resize(graph.num_local_vertices());
+      has_subscribers.clear();
       program_running.resize(graph.num_local_vertices());
       hasnext.resize(graph.num_local_vertices());
       
@@ -694,6 +808,7 @@ namespace warp {
 
   public:
     ~warp_engine() {
+      warp_impl::vertex_write_listener<graph_type>::detach(graph, this);
       delete consensus;
       delete cmlocks;
       delete scheduler_ptr;
@@ -721,6 +836,31 @@ namespace warp {
       return programs_executed.value;
     }
 
+    /**
+     * \brief The number of context::read_vertex() calls on this machine
+     * since start was last invoked which were answered from the cache.
+     */
+    size_t num_vertex_cache_hits() const {
+      return vertex_cache_hits.value;
+    }
+
+    /**
+     * \brief The number of context::read_vertex() calls on this machine
+     * since start was last invoked which fetched the data from the master.
+     */
+    size_t num_vertex_cache_fetches() const {
+      return vertex_cache_fetches.value;
+    }
+
+    /**
+     * \brief The number of context::read_vertex() calls on this machine
+     * since start was last invoked which waited on the fetch of another
+     * fiber.
+     */
+    size_t num_vertex_cache_coalesced() const {
+      return vertex_cache_coalesced.value;
+    }
+
 
 
 
@@ -819,7 +959,7 @@ namespace warp {
         internal_signal(graph.vertex(gvid), message);
       } else {
         procid_t proc = graph.master(gvid);
-        rmi.remote_call(proc, &warp_engine::internal_signal,
+        rmi.remote_call(proc, &warp_engine::internal_signal_gvid,
                         gvid, message);
       }
     } 
@@ -1118,27 +1258,75 @@ namespace warp {
     }
 
     void update_vertex_value(vertex_id_type vid,
+                             size_t version,
                              vertex_data_type& vdata) {
-      local_vertex_type lvtx(graph.l_vertex(graph.local_vid(vid)));
-      lvtx.data() = vdata;
+      const lvid_type lvid = graph.local_vid(vid);
+      // updates sent without waiting may arrive out of order.
+      // keep the newest.
+      vertexlocks[lvid].lock();
+      if (version > vertex_versions[lvid]) {
+        local_vertex_type lvtx(graph.l_vertex(lvid));
+        lvtx.data() = vdata;
+        vertex_versions[lvid] = version;
+      }
+      vertexlocks[lvid].unlock();
+    }
+
+    /**
+     * \internal
+     * Starts a new version of the data of a master vertex which is about
+     * to be sent to its mirrors and tells the machines caching the
+     * vertex. Every write of master data to the mirrors goes through
+     * here, so that mirrors can discard older versions arriving late.
+     */
+    size_t new_vertex_version(lvid_type lvid) {
+      vertexlocks[lvid].lock();
+      const size_t version = ++vertex_versions[lvid];
+      vertexlocks[lvid].unlock();
+      notify_subscribers(lvid, version);
+      return version;
+    }
+
+    /**
+     * \internal
+     * Only the vertices cached by another machine need a new version
+     * when warp::transform_neighborhood() changes them.
+     */
+    bool watches_vertex(lvid_type lvid) {
+      return has_subscribers.get(lvid);
+    }
+
+    /**
+     * \internal
+     * Called when warp::transform_neighborhood() changed the data of a
+     * master vertex. The mirrors are not updated, as with any change
+     * made outside of the update function of the vertex, but the
+     * machines caching the vertex fetch the new data.
+     */
+    void vertex_changed(lvid_type lvid) {
+      new_vertex_version(lvid);
     }
 
     void synchronize_one_vertex(vertex_type vtx) {
       local_vertex_type lvtx(vtx);
+      const size_t version = new_vertex_version(vtx.local_id());
       foreach(procid_t mirror, lvtx.mirrors()) {
-        rmi.remote_call(mirror, &warp_engine::update_vertex_value, vtx.id(), vtx.data());
+        rmi.remote_call(mirror, &warp_engine::update_vertex_value,
+                        vtx.id(), version, vtx.data());
       }
     }
 
 
     void synchronize_one_vertex_wait(vertex_type vtx) {
       local_vertex_type lvtx(vtx);
+      const size_t version = new_vertex_version(vtx.local_id());
       std::vector<request_future<void> > futures;
       foreach(procid_t mirror, lvtx.mirrors()) {
         futures.push_back(object_fiber_remote_request(rmi, 
                                                       mirror, 
                                                       &warp_engine::update_vertex_value, 
                                                       vtx.id(), 
+                                                      version,
                                                       vtx.data()));
       }
       for (size_t i = 0;i < futures.size(); ++i) {
@@ -1146,6 +1334,127 @@ namespace warp {
       }
     }
 
+    /**
+     * \internal
+     * Tells the machines caching a master vertex that it has a new
+     * version.
+     */
+    void notify_subscribers(lvid_type lvid, size_t version) {
+      if (!has_subscribers.get(lvid)) return;
+      subscriber_lock.lock();
+      std::vector<procid_t> procs = cache_subscribers[lvid];
+      subscriber_lock.unlock();
+      const vertex_id_type vid = graph.global_vid(lvid);
+      foreach(procid_t proc, procs) {
+        rmi.remote_call(proc, &warp_engine::rpc_invalidate_vertex, vid, version);
+      }
+    }
+
+    /**
+     * \internal
+     * Called on a caching machine when the master of a cached vertex
+     * synchronizes a new version.
+     */
+    void rpc_invalidate_vertex(vertex_id_type vid, size_t version) {
+      cache_lock.lock();
+      typename boost::unordered_map<vertex_id_type, cached_vertex>::iterator
+          iter = vertex_cache.find(vid);
+      if (iter != vertex_cache.end()) {
+        iter->second.known_version = std::max(iter->second.known_version,
+                                              version);
+      }
+      cache_lock.unlock();
+    }
+
+    /**
+     * \internal
+     * Called on the master of a vertex to read its data for a machine
+     * without a replica. The requester is subscribed to the new
+     * versions of the vertex. The data is only returned if it is newer
+     * than the version held by the requester.
+     */
+    vertex_fetch_reply rpc_fetch_vertex(vertex_id_type vid,
+                                        procid_t requester,
+                                        bool has_data,
+                                        size_t version) {
+      const lvid_type lvid = graph.local_vid(vid);
+      subscriber_lock.lock();
+      std::vector<procid_t>& procs = cache_subscribers[lvid];
+      if (std::find(procs.begin(), procs.end(), requester) == procs.end()) {
+        procs.push_back(requester);
+      }
+      has_subscribers.set_bit(lvid);
+      subscriber_lock.unlock();
+
+      vertex_fetch_reply reply;
+      // a program cannot start on the vertex while we hold the lock.
+      // the data of a running program may change before it synchronizes
+      // so it is returned to the readers but not cached.
+      vertexlocks[lvid].lock();
+      reply.cacheable = !program_running.get(lvid);
+      reply.version = vertex_versions[lvid];
+      reply.changed = !has_data || !reply.cacheable || reply.version > version;
+      if (reply.changed) reply.data = graph.l_vertex(lvid).data();
+      vertexlocks[lvid].unlock();
+      return reply;
+    }
+
+    /**
+     * \internal
+     * Implements context::read_vertex()
+     */
+    vertex_data_type read_vertex_data(vertex_id_type vid) {
+      if (graph.contains_vertex(vid)) return graph.vertex(vid).data();
+
+      cache_lock.lock();
+      cached_vertex& entry = vertex_cache[vid];
+      if (entry.has_data && entry.data_version >= entry.known_version) {
+        vertex_data_type ret = entry.data;
+        cache_lock.unlock();
+        vertex_cache_hits.inc();
+        return ret;
+      }
+      if (entry.fetch != NULL) {
+        // someone is already fetching it. wait for the result
+        boost::shared_ptr<vertex_fetch> fetch = entry.fetch;
+        while (!fetch->done) fetch->cond.wait(cache_lock);
+        vertex_data_type ret = fetch->data;
+        cache_lock.unlock();
+        vertex_cache_coalesced.inc();
+        return ret;
+      }
+      boost::shared_ptr<vertex_fetch> fetch(new vertex_fetch);
+      entry.fetch = fetch;
+      const bool has_data = entry.has_data;
+      const size_t version = entry.data_version;
+      cache_lock.unlock();
+
+      vertex_cache_fetches.inc();
+      vertex_fetch_reply reply =
+          object_fiber_remote_request(rmi,
+                                      graph.master(vid),
+                                      &warp_engine::rpc_fetch_vertex,
+                                      vid,
+                                      rmi.procid(),
+                                      has_data,
+                                      version)();
+
+      cache_lock.lock();
+      cached_vertex& updated_entry = vertex_cache[vid];
+      if (reply.changed) fetch->data = reply.data;
+      else fetch->data = updated_entry.data;
+      if (reply.cacheable) {
+        if (reply.changed) std::swap(updated_entry.data, reply.data);
+        updated_entry.has_data = true;
+        updated_entry.data_version = reply.version;
+      }
+      updated_entry.fetch.reset();
+      fetch->done = true;
+      fetch->cond.broadcast();
+      cache_lock.unlock();
+      return fetch->data;
+    }
+
     /**
      * \internal
      * Called when the scheduler returns a vertex to run.
@@ -1292,6 +1601,14 @@ namespace warp {
       aggregator.start(ncpus);
       aggregator.aggregate_all_periodic();
 
+      // the graph may have changed since the last run
+      vertex_cache.clear();
+      cache_subscribers.clear();
+      has_subscribers.clear();
+      vertex_cache_hits = 0;
+      vertex_cache_fetches = 0;
+      vertex_cache_coalesced = 0;
+
       started = true;
 
       rmi.barrier();
@@ -1341,6 +1658,16 @@ namespace warp {
       rmi.all_reduce(numadds);
       rmi.cout() << "Schedule Adds: " << numadds << std::endl;
 
+      size_t cache_reads[3] = {vertex_cache_hits.value,
+                               vertex_cache_fetches.value,
+                               vertex_cache_coalesced.value};
+      for (size_t i = 0; i < 3; ++i) rmi.all_reduce(cache_reads[i]);
+      if (cache_reads[0] + cache_reads[1] + cache_reads[2] > 0) {
+        rmi.cout() << "Remote Vertex Reads: " << cache_reads[0] << " cached, "
+                   << cache_reads[1] << " fetched, "
+                   << cache_reads[2] << " coalesced" << std::endl;
+      }
+
 
       ASSERT_TRUE(scheduler_ptr->empty());
       started = false;
@@ -1361,6 +1688,5 @@ namespace warp {
 #include <graphlab/macros_undef.hpp>
 #include <graphlab/engine/warp_graph_broadcast.hpp>
 #include <graphlab/engine/warp_graph_mapreduce.hpp>
-#include <graphlab/engine/warp_graph_transform.hpp>
 #endif 
 
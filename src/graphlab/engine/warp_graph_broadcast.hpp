@@ -101,13 +101,14 @@ struct broadcast_neighborhood_impl {
   static void basic_local_broadcast_neighborhood_from_remote(std::pair<size_t, size_t> objid,
                                                              edge_dir_type edge_direction,
                                                              size_t broadcast_ptr,
-                                                             vertex_id_type vid,
+                                                             std::pair<vertex_id_type, size_t> vid_version,
                                                              vertex_data_type& vdata) {
     EngineType* engine = reinterpret_cast<EngineType*>(distributed_control::get_instance()->get_registered_object(objid.first));
     GraphType* graph = reinterpret_cast<GraphType*>(distributed_control::get_instance()->get_registered_object(objid.second));
+    const vertex_id_type vid = vid_version.first;
     vertex_type vertex(graph->l_vertex(graph->local_vid(vid)));
     context_type context(*engine, *graph, vertex);
-    vertex.data() = vdata;
+    context.receive_version(vid_version.second, vdata);
     // cast the mappers and combiners back into their pointer types
     void(*broadcast_fn)(context_type&, edge_type edge, vertex_type other) = 
         reinterpret_cast<void(*)(context_type&, edge_type, vertex_type)>(broadcast_ptr);
@@ -131,6 +132,11 @@ struct broadcast_neighborhood_impl {
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
     
+    // the mirrors keep this version unless a newer one reached them,
+    // and the machines caching the vertex are told about it
+    const std::pair<vertex_id_type, size_t>
+        vid_version(current.id(), context.new_version(current));
+
     // create num-mirrors worth of requests
     std::vector<request_future<void > > requests(vrecord.num_mirrors());
     
@@ -142,7 +148,7 @@ struct broadcast_neighborhood_impl {
                                              objid,
                                              edge_direction,
                                              reinterpret_cast<size_t>(broadcast_fn),
-                                             current.id(),
+                                             vid_version,
                                              current.data());
         ++ctr;
     }
@@ -226,15 +232,16 @@ struct broadcast_neighborhood_impl2 {
   static void extended_local_broadcast_neighborhood_from_remote(std::pair<size_t, size_t> objid,
                                                                 edge_dir_type edge_direction,
                                                                 size_t broadcast_ptr,
-                                                                vertex_id_type vid,
+                                                                std::pair<vertex_id_type, size_t> vid_version,
                                                                 vertex_data_type& vdata,
                                                                 const ExtraArg extra) {
 
     EngineType* engine = reinterpret_cast<EngineType*>(distributed_control::get_instance()->get_registered_object(objid.first));
     GraphType* graph = reinterpret_cast<GraphType*>(distributed_control::get_instance()->get_registered_object(objid.second));
+    const vertex_id_type vid = vid_version.first;
     vertex_type vertex(graph->l_vertex(graph->local_vid(vid)));
     context_type context(*engine, *graph, vertex);
-    vertex.data() = vdata;
+    context.receive_version(vid_version.second, vdata);
     // cast the mappers and combiners back into their pointer types
     void(*broadcast_fn)(context_type&, edge_type edge, vertex_type other, const ExtraArg) = 
         reinterpret_cast<void(*)(context_type&, edge_type, vertex_type, const ExtraArg)>(broadcast_ptr);
@@ -260,6 +267,11 @@ struct broadcast_neighborhood_impl2 {
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
     
+    // the mirrors keep this version unless a newer one reached them,
+    // and the machines caching the vertex are told about it
+    const std::pair<vertex_id_type, size_t>
+        vid_version(current.id(), context.new_version(current));
+
     // create num-mirrors worth of requests
     std::vector<request_future<void> > requests(vrecord.num_mirrors());
     
@@ -271,7 +283,7 @@ struct broadcast_neighborhood_impl2 {
                                              objid,
                                              edge_direction,
                                              reinterpret_cast<size_t>(broadcast_fn),
-                                             current.id(),
+                                             vid_version,
                                              current.data(),
                                              extra);
         ++ctr;
@@ -321,7 +333,9 @@ struct broadcast_neighborhood_impl2 {
  *
  * \attention Unlike the transform_neighborhood function, this call actually
  * performs synchronization, so the value of both vertex endpoints are
- * correct. 
+ * correct. Like a synchronization at the end of an update function, it
+ * sends the data of the current vertex as a new version, so readers
+ * caching it through context::read_vertex() see the change.
  *
  * Here is an example which schedules all vertices on out edges.
  * 
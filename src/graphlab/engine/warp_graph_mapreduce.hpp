@@ -24,10 +24,15 @@
 #ifndef GRAPHLAB_WARP_GRAPH_MAP_REDUCE_HPP
 #define GRAPHLAB_WARP_GRAPH_MAP_REDUCE_HPP
 
+#include <vector>
+#include <algorithm>
 #include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
 #include <graphlab/util/generics/conditional_combiner_wrapper.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
 #include <graphlab/parallel/fiber_group.hpp>
 #include <graphlab/parallel/fiber_control.hpp>
+#include <graphlab/parallel/fiber_conditional.hpp>
 #include <graphlab/parallel/fiber_remote_request.hpp>
 #include <graphlab/logger/assertions.hpp>
 #include <graphlab/rpc/dc.hpp>
@@ -57,6 +62,15 @@ void extended_default_combiner(T& self, const T& other, const ExtraArgs& unused)
   self += other;
 }
 
+/**
+ * Set to true by warp::set_batch_mirror_requests() to batch the requests
+ * to the mirrors.
+ */
+inline bool& batch_mirror_requests_flag() {
+  static bool batch = false;
+  return batch;
+}
+
 
 template <typename RetType, typename GraphType>
 struct map_reduce_neighborhood_impl {
@@ -82,7 +96,8 @@ struct map_reduce_neighborhood_impl {
                                                            edge_dir_type edge_direction,
                                                            RetType (*mapper)(edge_type edge, vertex_type other),
                                                            void (*combiner)(RetType&, const RetType&),
-                                                           vertex_id_type vid) {
+                                                           vertex_id_type vid,
+                                                           bool lock_edges) {
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
     
@@ -91,6 +106,10 @@ struct map_reduce_neighborhood_impl {
       foreach(local_edge_type local_edge, local_vertex.in_edges()) {
         edge_type edge(local_edge);
         vertex_type other(local_edge.source());
+        if (!lock_edges) {
+          accum += mapper(edge, other);
+          continue;
+        }
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
@@ -104,6 +123,10 @@ struct map_reduce_neighborhood_impl {
       foreach(local_edge_type local_edge, local_vertex.out_edges()) {
         edge_type edge(local_edge);
         vertex_type other(local_edge.target());
+        if (!lock_edges) {
+          accum += mapper(edge, other);
+          continue;
+        }
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
@@ -120,7 +143,8 @@ struct map_reduce_neighborhood_impl {
                                                            edge_dir_type edge_direction,
                                                            size_t mapper_ptr,
                                                            size_t combiner_ptr,
-                                                           vertex_id_type vid) {
+                                                           vertex_id_type vid,
+                                                           bool lock_edges) {
     // cast the mappers and combiners back into their pointer types
     RetType (*mapper)(edge_type edge, vertex_type other) = 
         reinterpret_cast<RetType(*)(edge_type, vertex_type)>(mapper_ptr);
@@ -131,7 +155,152 @@ struct map_reduce_neighborhood_impl {
         edge_direction,
         mapper,
         combiner,
-        vid);
+        vid,
+        lock_edges);
+  }
+
+/*
+ * Requests to the same mirror machine issued by concurrently running
+ * fibers are batched into a single remote call. The first fiber to add
+ * a request to an empty batch becomes its leader: it yields once so that
+ * the other runnable fibers can add their requests, then seals the batch,
+ * sends it, and publishes the results to the other fibers in the batch.
+ * A leader always publishes its own batches before waiting on batches
+ * led by other fibers, so the wait graph has no cycles.
+ */
+
+  /// One request in a batch sent to a mirror machine
+  struct batch_entry: public IS_POD_TYPE {
+    size_t objid;
+    size_t mapper_ptr;
+    size_t combiner_ptr;
+    vertex_id_type vid;
+    edge_dir_type edge_direction;
+    bool lock_edges;
+  };
+
+  typedef std::vector<conditional_combiner_wrapper<RetType> > batch_result_type;
+
+  /// The maximum number of requests in a batch
+  static const size_t MAX_BATCH_SIZE = 256;
+
+  struct mirror_batch {
+    std::vector<batch_entry> entries;
+    batch_result_type results;
+    bool done;
+    mutex lock;
+    fiber_conditional cond;
+    mirror_batch(): done(false) { }
+  };
+
+  /// The batch still accepting requests for each machine
+  struct batch_slot {
+    mutex lock;
+    boost::shared_ptr<mirror_batch> pending;
+  };
+
+  struct mirror_ticket {
+    boost::shared_ptr<mirror_batch> batch;
+    size_t index;
+    bool leader;
+    procid_t proc;
+    request_future<batch_result_type> future;
+  };
+
+  static std::vector<batch_slot>& batch_slots() {
+    static std::vector<batch_slot> slots(distributed_control::get_instance()->numprocs());
+    return slots;
+  }
+
+  /// Batches larger than this are mapped by several fibers
+  static const size_t REMOTE_SHARE_SIZE = 16;
+
+  /// Maps the entries first, first + stride, first + 2 * stride, ...
+  static void map_batch_share(const std::vector<batch_entry>* entries,
+                              batch_result_type* results,
+                              size_t first, size_t stride) {
+    for (size_t i = first;i < entries->size(); i += stride) {
+      const batch_entry& entry = (*entries)[i];
+      (*results)[i] = basic_local_mapper_from_remote(entry.objid,
+                                                     entry.edge_direction,
+                                                     entry.mapper_ptr,
+                                                     entry.combiner_ptr,
+                                                     entry.vid,
+                                                     entry.lock_edges);
+    }
+  }
+
+  /*
+   * Separate requests would be handled by several RPC threads at once,
+   * so a large batch is shared out over fibers rather than mapped by
+   * the one thread handling it.
+   */
+  static batch_result_type batch_local_mapper_from_remote(std::vector<batch_entry> entries) {
+    batch_result_type results(entries.size());
+    size_t nshares = (entries.size() + REMOTE_SHARE_SIZE - 1) / REMOTE_SHARE_SIZE;
+    if (nshares > 1 && !fiber_control::in_fiber()) {
+      nshares = std::min(nshares, fiber_control::get_instance().num_workers());
+    } else {
+      nshares = 1;
+    }
+    if (nshares > 1) {
+      fiber_group group(16384);
+      for (size_t i = 1;i < nshares; ++i) {
+        group.launch(boost::bind(map_batch_share, &entries, &results, i, nshares));
+      }
+      map_batch_share(&entries, &results, 0, nshares);
+      group.join();
+    } else {
+      map_batch_share(&entries, &results, 0, 1);
+    }
+    return results;
+  }
+
+  /// Adds the request to the open batch of proc, opening one if needed
+  static void enqueue_request(procid_t proc, const batch_entry& entry,
+                              mirror_ticket& ticket) {
+    batch_slot& slot = batch_slots()[proc];
+    slot.lock.lock();
+    ticket.leader = (slot.pending == NULL);
+    if (ticket.leader) slot.pending.reset(new mirror_batch);
+    ticket.batch = slot.pending;
+    ticket.index = ticket.batch->entries.size();
+    ticket.proc = proc;
+    ticket.batch->entries.push_back(entry);
+    // a full batch stops accepting requests; its leader still sends it
+    if (ticket.batch->entries.size() >= MAX_BATCH_SIZE) slot.pending.reset();
+    slot.lock.unlock();
+  }
+
+  /// Called by the leader: stop accepting requests and send the batch
+  static void send_batch(mirror_ticket& ticket) {
+    batch_slot& slot = batch_slots()[ticket.proc];
+    slot.lock.lock();
+    if (slot.pending == ticket.batch) slot.pending.reset();
+    slot.lock.unlock();
+    ticket.future = fiber_remote_request(ticket.proc,
+                                         map_reduce_neighborhood_impl<RetType, GraphType>::batch_local_mapper_from_remote,
+                                         ticket.batch->entries);
+  }
+
+  /// Called by the leader: wait for the reply and hand it to the batch
+  static conditional_combiner_wrapper<RetType> publish_batch(mirror_ticket& ticket) {
+    batch_result_type results = ticket.future();
+    mirror_batch& batch = *ticket.batch;
+    batch.lock.lock();
+    batch.results.swap(results);
+    batch.done = true;
+    batch.cond.broadcast();
+    batch.lock.unlock();
+    return batch.results[ticket.index];
+  }
+
+  static conditional_combiner_wrapper<RetType> wait_batch(mirror_ticket& ticket) {
+    mirror_batch& batch = *ticket.batch;
+    batch.lock.lock();
+    while (!batch.done) batch.cond.wait(batch.lock);
+    batch.lock.unlock();
+    return batch.results[ticket.index];
   }
 
   static RetType basic_map_reduce_neighborhood(typename GraphType::vertex_type current,
@@ -139,42 +308,72 @@ struct map_reduce_neighborhood_impl {
                                                RetType (*mapper)(edge_type edge,
                                                                  vertex_type other),
                                                void (*combiner)(RetType& self, 
-                                                                const RetType& other)) {
+                                                                const RetType& other),
+                                               bool lock_edges) {
     // get a reference to the graph
     GraphType& graph = current.graph_ref;
-    // get the object ID of the graph
-    size_t objid = graph.get_rpc_obj_id();
     typename GraphType::vertex_record vrecord = graph.l_get_vertex_record(current.local_id());
 
     // make sure we are running on a master vertex
     ASSERT_EQ(vrecord.owner, distributed_control::get_instance_procid());
-    
-    // create num-mirrors worth of requests
-    std::vector<request_future<conditional_combiner_wrapper<RetType> > > requests(vrecord.num_mirrors());
-    
+
+    const bool batch = batch_mirror_requests_flag();
+    batch_entry entry;
+    entry.objid = graph.get_rpc_obj_id();
+    entry.mapper_ptr = reinterpret_cast<size_t>(mapper);
+    entry.combiner_ptr = reinterpret_cast<size_t>(combiner);
+    entry.vid = current.id();
+    entry.edge_direction = edge_direction;
+    entry.lock_edges = lock_edges;
+
+    // add a request to the batch of every mirror, or send it directly
+    std::vector<mirror_ticket> tickets(batch ? vrecord.num_mirrors() : 0);
+    std::vector<request_future<conditional_combiner_wrapper<RetType> > >
+        requests(batch ? 0 : vrecord.num_mirrors());
+    bool leader = false;
     size_t ctr = 0;
     foreach(procid_t proc, vrecord.mirrors()) {
-      // issue the communication
-        requests[ctr] = fiber_remote_request(proc, 
+      if (batch) {
+        enqueue_request(proc, entry, tickets[ctr]);
+        leader = leader || tickets[ctr].leader;
+      } else {
+        requests[ctr] = fiber_remote_request(proc,
                                              map_reduce_neighborhood_impl<RetType, GraphType>::basic_local_mapper_from_remote,
-                                             objid,
+                                             entry.objid,
                                              edge_direction,
-                                             reinterpret_cast<size_t>(mapper),
-                                             reinterpret_cast<size_t>(combiner),
-                                             current.id());
-        ++ctr;
+                                             entry.mapper_ptr,
+                                             entry.combiner_ptr,
+                                             entry.vid,
+                                             lock_edges);
+      }
+      ++ctr;
+    }
+    // let the other fibers join the batches we lead before sending them
+    if (leader) {
+      if (fiber_control::in_fiber()) fiber_control::yield();
+      for (size_t i = 0;i < tickets.size(); ++i) {
+        if (tickets[i].leader) send_batch(tickets[i]);
+      }
     }
     // compute the local tasks
     conditional_combiner_wrapper<RetType> accum = basic_local_mapper(graph, 
                                                                      edge_direction, 
                                                                      mapper, 
                                                                      combiner,
-                                                                     current.id());
+                                                                     current.id(),
+                                                                     lock_edges);
     accum.set_combiner(combiner);
-    // now, wait for everyone
+    // now, wait for everyone. Publish the batches we lead before
+    // waiting on the batches of other fibers.
     for (size_t i = 0;i < requests.size(); ++i) {
       accum += requests[i]();
     }
+    for (size_t i = 0;i < tickets.size(); ++i) {
+      if (tickets[i].leader) accum += publish_batch(tickets[i]);
+    }
+    for (size_t i = 0;i < tickets.size(); ++i) {
+      if (!tickets[i].leader) accum += wait_batch(tickets[i]);
+    }
     return accum.value;
   }
 
@@ -206,7 +405,8 @@ struct map_reduce_neighborhood_impl2 {
                                                               RetType (*mapper)(edge_type edge, vertex_type other, const ExtraArg),
                                                               void (*combiner)(RetType&, const RetType&, const ExtraArg),
                                                               vertex_id_type vid,
-                                                              const ExtraArg extra) {
+                                                              const ExtraArg extra,
+                                                              bool lock_edges) {
 
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
@@ -216,6 +416,10 @@ struct map_reduce_neighborhood_impl2 {
       foreach(local_edge_type local_edge, local_vertex.in_edges()) {
         edge_type edge(local_edge);
         vertex_type other(local_edge.source());
+        if (!lock_edges) {
+          accum += mapper(edge, other, extra);
+          continue;
+        }
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
 
         graph.get_lock_manager()[std::min(a,b)].lock();
@@ -230,6 +434,10 @@ struct map_reduce_neighborhood_impl2 {
       foreach(local_edge_type local_edge, local_vertex.out_edges()) {
         edge_type edge(local_edge);
         vertex_type other(local_edge.target());
+        if (!lock_edges) {
+          accum += mapper(edge, other, extra);
+          continue;
+        }
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
 
         graph.get_lock_manager()[std::min(a,b)].lock();
@@ -242,6 +450,9 @@ struct map_reduce_neighborhood_impl2 {
     return accum;
   }
 
+  // LockEdges is a template argument since remote requests take at most
+  // 6 arguments
+  template <bool LockEdges>
   static conditional_combiner_wrapper<RetType> extended_local_mapper_from_remote(size_t objid,
                                                               edge_dir_type edge_direction,
                                                               size_t mapper_ptr,
@@ -259,7 +470,8 @@ struct map_reduce_neighborhood_impl2 {
         mapper,
         combiner,
         vid,
-        extra);
+        extra,
+        LockEdges);
   }
 
   static RetType extended_map_reduce_neighborhood(typename GraphType::vertex_type current,
@@ -270,7 +482,8 @@ struct map_reduce_neighborhood_impl2 {
                                                                     const ExtraArg extra),
                                                   void (*combiner)(RetType& self, 
                                                                    const RetType& other,
-                                                                   const ExtraArg extra)) {
+                                                                   const ExtraArg extra),
+                                                  bool lock_edges) {
     // get a reference to the graph
     GraphType& graph = current.graph_ref;
     typename GraphType::vertex_record vrecord = graph.l_get_vertex_record(current.local_id());
@@ -282,11 +495,17 @@ struct map_reduce_neighborhood_impl2 {
     // create num-mirrors worth of requests
     std::vector<request_future<conditional_combiner_wrapper<RetType> > > requests(vrecord.num_mirrors());
     
+    conditional_combiner_wrapper<RetType> (*remote_mapper)(size_t, edge_dir_type,
+                                                           size_t, size_t,
+                                                           vertex_id_type,
+                                                           const ExtraArg) =
+        lock_edges ? extended_local_mapper_from_remote<true> :
+                     extended_local_mapper_from_remote<false>;
     size_t ctr = 0;
     foreach(procid_t proc, vrecord.mirrors()) {
       // issue the communication
       requests[ctr] = fiber_remote_request(proc, 
-                                           map_reduce_neighborhood_impl2::extended_local_mapper_from_remote,
+                                           remote_mapper,
                                            objid,
                                            edge_direction,
                                            reinterpret_cast<size_t>(mapper),
@@ -298,7 +517,7 @@ struct map_reduce_neighborhood_impl2 {
     // compute the local tasks
     conditional_combiner_wrapper<RetType> accum = 
         extended_local_mapper(graph, edge_direction, mapper, 
-                              combiner, current.id(), extra);
+                              combiner, current.id(), extra, lock_edges);
 
     accum.set_combiner(boost::bind(combiner, _1, _2, boost::ref(extra)));
     // now, wait for everyone
@@ -312,6 +531,34 @@ struct map_reduce_neighborhood_impl2 {
 
 } // namespace warp::warp_impl
 
+
+/**
+ * \ingroup warp
+ *
+ * Sets whether warp::map_reduce_neighborhood() and
+ * warp::snapshot_map_reduce_neighborhood() batch their mirror requests.
+ * When enabled the requests to the mirrors of vertices
+ * mapped concurrently by different fibers are sent to each machine as
+ * one remote call, which the machine maps over several fibers.  This
+ * sends fewer messages on vertices with many mirrors, at the cost of
+ * one fiber yield before each batch is sent.  When disabled every
+ * mirror gets a separate request.  The setting only affects requests
+ * sent by the calling machine.  The overloads taking an extra argument
+ * never batch.  Batching is disabled by default: whether the saved
+ * messages outweigh the added yield depends on the graph and the
+ * cluster, so measure before enabling it (see the --compare option of
+ * demoapps/pagerank/warp_parfor_pagerank).
+ */
+inline void set_batch_mirror_requests(bool batch) {
+  warp_impl::batch_mirror_requests_flag() = batch;
+}
+
+/// Returns true if mirror requests are batched. \see set_batch_mirror_requests()
+inline bool get_batch_mirror_requests() {
+  return warp_impl::batch_mirror_requests_flag();
+}
+
+
 /**
  * \ingroup warp
  *
@@ -373,6 +620,10 @@ struct map_reduce_neighborhood_impl2 {
  * An overload is provided which allows you to pass an additional arbitrary
  * argument to the mappers and combiners.
  *
+ * Requests to the mirrors of vertices mapped concurrently by different
+ * fibers are batched into one remote call per machine. See
+ * warp::set_batch_mirror_requests().
+ *
  *
  * \param current The vertex to map reduce the neighborhood over
  * \param edge_direction To run over all IN_EDGES, OUT_EDGES or ALL_EDGES
@@ -399,7 +650,7 @@ RetType map_reduce_neighborhood(VertexType current,
       map_reduce_neighborhood_impl<RetType, 
                                   typename VertexType::graph_type>::
                                       basic_map_reduce_neighborhood(current, edge_direction, 
-                                                                    mapper, combiner);
+                                                                    mapper, combiner, true);
 }
 
 
@@ -495,10 +746,84 @@ RetType map_reduce_neighborhood(VertexType current,
       map_reduce_neighborhood_impl2<RetType, typename VertexType::graph_type, ExtraArg>::
                                       extended_map_reduce_neighborhood(current, edge_direction, 
                                                                        extra, 
-                                                                       mapper, combiner);
+                                                                       mapper, combiner, true);
+}
+
+
+
+/**
+ * \ingroup warp
+ *
+ * A variant of warp::map_reduce_neighborhood() which does not lock the
+ * edges. The regular map_reduce_neighborhood() takes the locks on both
+ * endpoints of every edge around each call to the mapper, which
+ * dominates the cost of cheap mappers on high degree vertices. This
+ * variant reads the edge and vertex data while other fibers may be
+ * writing it, so the mapper sees each value either before or after a
+ * concurrent update (and may see a partially written value for data
+ * types which are not updated atomically).  Use it for computations
+ * which tolerate stale neighbor values, such as PageRank:
+ *
+ * \code
+ * void pagerank(graph_type::vertex_type vertex) {
+ *    vertex.data() = 0.15 + 0.85 *
+ *        warp::snapshot_map_reduce_neighborhood(vertex, IN_EDGES, pagerank_map);
+ * }
+ * \endcode
+ *
+ * Like map_reduce_neighborhood(), the requests to the mirrors of
+ * vertices mapped concurrently by different fibers are batched into
+ * one remote call per machine unless disabled with
+ * warp::set_batch_mirror_requests().
+ *
+ * \param current The vertex to map reduce the neighborhood over
+ * \param edge_direction To run over all IN_EDGES, OUT_EDGES or ALL_EDGES
+ * \param mapper The map function that will be executed. Must be a function pointer.
+ * \param combiner The combine function that will be executed. Must be a function pointer.
+ *                 Optional. Defaults to using "+=" on the output of the mapper
+ *
+ * \see warp::map_reduce_neighborhood()
+ */
+template <typename RetType, typename VertexType>
+RetType snapshot_map_reduce_neighborhood(VertexType current,
+                                         edge_dir_type edge_direction,
+                                         RetType (*mapper)(typename VertexType::graph_type::edge_type edge,
+                                                           VertexType other),
+                                         void (*combiner)(RetType& self, 
+                                                          const RetType& other) = warp_impl::default_combiner<RetType>) {
+  return warp_impl::
+      map_reduce_neighborhood_impl<RetType, 
+                                  typename VertexType::graph_type>::
+                                      basic_map_reduce_neighborhood(current, edge_direction, 
+                                                                    mapper, combiner, false);
 }
 
 
+/**
+ * \ingroup warp
+ *
+ * The overload of warp::snapshot_map_reduce_neighborhood() which passes
+ * an additional argument to the mapper and combiner. Requests to the
+ * mirrors are not batched.
+ *
+ * \see warp::map_reduce_neighborhood()
+ */
+template <typename RetType, typename ExtraArg, typename VertexType>
+RetType snapshot_map_reduce_neighborhood(VertexType current,
+                                         edge_dir_type edge_direction,
+                                         const ExtraArg extra,
+                                         RetType (*mapper)(typename VertexType::graph_type::edge_type edge,
+                                                           VertexType other,
+                                                           const ExtraArg extra),
+                                         void (*combiner)(RetType& self, 
+                                                          const RetType& other,
+                                                          const ExtraArg extra) = warp_impl::extended_default_combiner<RetType, ExtraArg>) {
+  return warp_impl::
+      map_reduce_neighborhood_impl2<RetType, typename VertexType::graph_type, ExtraArg>::
+                                      extended_map_reduce_neighborhood(current, edge_direction, 
+                                                                       extra, 
+                                                                       mapper, combiner, false);
+}
 
 
 } // namespace warp
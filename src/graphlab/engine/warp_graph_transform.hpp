@@ -24,6 +24,8 @@
 #ifndef GRAPHLAB_WARP_GRAPH_TRANSFORM_HPP
 #define GRAPHLAB_WARP_GRAPH_TRANSFORM_HPP
 
+#include <map>
+#include <string>
 #include <boost/bind.hpp>
 #include <graphlab/util/generics/conditional_combiner_wrapper.hpp>
 #include <graphlab/parallel/fiber_group.hpp>
@@ -31,6 +33,8 @@
 #include <graphlab/parallel/fiber_remote_request.hpp>
 #include <graphlab/logger/assertions.hpp>
 #include <graphlab/rpc/dc.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/serialization/serialize_to_from_string.hpp>
 #include <graphlab/macros_def.hpp>
 namespace graphlab {
 
@@ -38,6 +42,109 @@ namespace warp {
 
 namespace warp_impl {
 
+/**
+ * \internal
+ * Told about the changes transform_neighborhood() makes to the data of
+ * the master vertices of a graph. The warp engine listens to its graph
+ * so that the machines caching a changed vertex learn of the new data.
+ */
+template <typename GraphType>
+class vertex_write_listener {
+ public:
+  virtual ~vertex_write_listener() { }
+
+  /// True if a change to the data of the local master vertex must be reported
+  virtual bool watches_vertex(lvid_type lvid) = 0;
+
+  /// Called after the data of a local master vertex changed
+  virtual void vertex_changed(lvid_type lvid) = 0;
+
+  /// Starts listening to the changes made to the vertices of the graph
+  static void attach(const GraphType& graph, vertex_write_listener* listener) {
+    registry_lock().writelock();
+    registry()[&graph] = listener;
+    registry_lock().unlock();
+  }
+
+  /// Stops listening to the graph
+  static void detach(const GraphType& graph, vertex_write_listener* listener) {
+    registry_lock().writelock();
+    typename std::map<const GraphType*, vertex_write_listener*>::iterator
+        iter = registry().find(&graph);
+    if (iter != registry().end() && iter->second == listener) {
+      registry().erase(iter);
+    }
+    registry_lock().unlock();
+  }
+
+  /// Returns the listener of the graph, or NULL if there is none
+  static vertex_write_listener* find(const GraphType& graph) {
+    registry_lock().readlock();
+    typename std::map<const GraphType*, vertex_write_listener*>::iterator
+        iter = registry().find(&graph);
+    vertex_write_listener* ret =
+        (iter == registry().end()) ? NULL : iter->second;
+    registry_lock().unlock();
+    return ret;
+  }
+
+ private:
+  static std::map<const GraphType*, vertex_write_listener*>& registry() {
+    static std::map<const GraphType*, vertex_write_listener*> listeners;
+    return listeners;
+  }
+  static rwlock& registry_lock() {
+    static rwlock lock;
+    return lock;
+  }
+};
+
+
+/**
+ * \internal
+ * Watches the data of the other end of an edge while a transform runs
+ * on it, and reports a change to the listener of the graph. Only local
+ * masters are watched: the caches read their data from the master. The
+ * data is only compared if a machine caches the vertex. A machine which
+ * started caching it during the transform may have read the old value,
+ * so the change is then reported without comparing.
+ */
+template <typename GraphType>
+class vertex_write_watch {
+ public:
+  typedef typename GraphType::vertex_type vertex_type;
+
+  vertex_write_watch(vertex_write_listener<GraphType>* listener,
+                     vertex_type other)
+      : listener(listener), other(other), watched(false) {
+    if (listener == NULL || !other.graph_ref.l_is_master(other.local_id())) {
+      this->listener = NULL;
+      return;
+    }
+    watched = listener->watches_vertex(other.local_id());
+    if (watched) original_value = serialize_to_string(other.data());
+  }
+
+  /// Called after the transform, with the locks of the edge still held
+  bool changed() const {
+    if (listener == NULL) return false;
+    if (watched) return serialize_to_string(other.data()) != original_value;
+    return listener->watches_vertex(other.local_id());
+  }
+
+  /// Reports the change. Called once the locks of the edge are released.
+  void report() {
+    listener->vertex_changed(other.local_id());
+  }
+
+ private:
+  vertex_write_listener<GraphType>* listener;
+  vertex_type other;
+  bool watched;
+  std::string original_value;
+};
+
+
 template <typename GraphType>
 struct transform_neighborhood_impl {
 
@@ -65,6 +172,8 @@ struct transform_neighborhood_impl {
                                                  vertex_id_type vid) {
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
+    vertex_write_listener<GraphType>* listener =
+        vertex_write_listener<GraphType>::find(graph);
     
     if(edge_direction == IN_EDGES || edge_direction == ALL_EDGES) {
       foreach(local_edge_type local_edge, local_vertex.in_edges()) {
@@ -73,9 +182,12 @@ struct transform_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        vertex_write_watch<GraphType> watch(listener, other);
         transform_fn(edge, other);
+        const bool changed = watch.changed();
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
+        if (changed) watch.report();
       }
     } 
     // do out edges
@@ -86,9 +198,12 @@ struct transform_neighborhood_impl {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        vertex_write_watch<GraphType> watch(listener, other);
         transform_fn(edge, other);
+        const bool changed = watch.changed();
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
+        if (changed) watch.report();
       }
     } 
   }
@@ -178,6 +293,8 @@ struct transform_neighborhood_impl2 {
                                  const ExtraArg extra) {
     lvid_type lvid = graph.local_vid(vid);
     local_vertex_type local_vertex(graph.l_vertex(lvid));
+    vertex_write_listener<GraphType>* listener =
+        vertex_write_listener<GraphType>::find(graph);
     
     if(edge_direction == IN_EDGES || edge_direction == ALL_EDGES) {
       foreach(local_edge_type local_edge, local_vertex.in_edges()) {
@@ -186,9 +303,12 @@ struct transform_neighborhood_impl2 {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        vertex_write_watch<GraphType> watch(listener, other);
         transform_fn(edge, other, extra);
+        const bool changed = watch.changed();
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
+        if (changed) watch.report();
       }
     } 
     // do out edges
@@ -199,9 +319,12 @@ struct transform_neighborhood_impl2 {
         lvid_type a = edge.source().local_id(), b = edge.target().local_id();
         graph.get_lock_manager()[std::min(a,b)].lock();
         graph.get_lock_manager()[std::max(a,b)].lock();
+        vertex_write_watch<GraphType> watch(listener, other);
         transform_fn(edge, other, extra);
+        const bool changed = watch.changed();
         graph.get_lock_manager()[a].unlock();
         graph.get_lock_manager()[b].unlock();
+        if (changed) watch.report();
       }
     } 
   }
@@ -286,7 +409,10 @@ struct transform_neighborhood_impl2 {
  * \endcode
  *
  * \attention It is important that the transform_fn should only make modifications to the
- * edge data, and not the data on the other vertex.
+ * edge data, and not the data on the other vertex. A change to the other
+ * vertex is not sent to its mirrors; under the warp engine, machines which
+ * read the vertex with context::read_vertex() do see it if it was made on
+ * the master.
  *
  * \attention This call does not accomplish synchronization, thus 
  * modifications to the current vertex will not be reflected during
@@ -362,7 +488,10 @@ void transform_neighborhood(VertexType current,
  * \endcode
  *
  * \attention It is important that the transform_fn should only make modifications to the
- * edge data, and not the data on the other vertex.
+ * edge data, and not the data on the other vertex. A change to the other
+ * vertex is not sent to its mirrors; under the warp engine, machines which
+ * read the vertex with context::read_vertex() do see it if it was made on
+ * the master.
  *
  * \attention This call does not accomplish synchronization, thus 
  * modifications to the current vertex will not be reflected during
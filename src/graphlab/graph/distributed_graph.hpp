@@ -68,6 +68,7 @@
 
 #include <graphlab/options/graphlab_options.hpp>
 #include <graphlab/serialization/serialization_includes.hpp>
+#include <graphlab/serialization/framed_archive.hpp>
 #include <graphlab/vertex_program/op_plus_eq_concept.hpp>
 
 #include <graphlab/graph/local_graph.hpp>
@@ -76,6 +77,8 @@
 #include <graphlab/graph/graph_gather_apply.hpp>
 #include <graphlab/graph/ingress/distributed_ingress_base.hpp>
 #include <graphlab/graph/ingress/distributed_oblivious_ingress.hpp>
+#include <graphlab/graph/ingress/distributed_hdrf_ingress.hpp>
+#include <graphlab/graph/ingress/distributed_fennel_ingress.hpp>
 #include <graphlab/graph/ingress/distributed_random_ingress.hpp>
 #include <graphlab/graph/ingress/distributed_identity_ingress.hpp>
 
@@ -592,7 +595,15 @@ namespace graphlab {
      *                complexity, but the increasing partition qaulity. "grid" 
      *                requires number of machine P be able to layout as a n*m = P 
      *                grid with ( |m-n| <= 2). "pds" uses requires P = p^2+p+1 where 
-     *                p is a prime number.
+     *                p is a prime number. The streaming methods "oblivious",
+     *                "hdrf" (degree aware greedy) and "fennel" (vertex
+     *                balanced placement) may be selected explicitly.
+     *
+     * \li \c hdrf_lambda The weight of the balance term of the hdrf
+     *                ingress. Defaults to 1.
+     *
+     * \li \c fennel_gamma The exponent of the load penalty of the fennel
+     *                ingress. Defaults to 1.5.
      *
      * \li \c userecent An optimization that can decrease memory utilization
      *                of oblivious and batch quite significantly (especially
@@ -611,7 +622,7 @@ namespace graphlab {
      */
     distributed_graph(distributed_control& dc,
                       const graphlab_options& opts = graphlab_options()) :
-      rpc(dc, this), finalized(false), vid2lvid(),
+      rpc(dc, this), finalized(false), structure_version(0), vid2lvid(),
       nverts(0), nedges(0), local_own_nverts(0), nreplicas(0),
       ingress_ptr(NULL), 
 #ifdef _OPENMP
@@ -637,6 +648,8 @@ namespace graphlab {
       size_t bufsize = 50000;
       bool usehash = false;
       bool userecent = false;
+      double hdrf_lambda = 1.0;
+      double fennel_gamma = 1.5;
       std::string ingress_method = "";
       std::vector<std::string> keys = opts.get_graph_args().get_option_keys();
       foreach(std::string opt, keys) {
@@ -645,6 +658,16 @@ namespace graphlab {
           if (rpc.procid() == 0)
             logstream(LOG_EMPH) << "Graph Option: ingress = "
               << ingress_method << std::endl;
+        } else if (opt == "hdrf_lambda") {
+          opts.get_graph_args().get_option("hdrf_lambda", hdrf_lambda);
+          if (rpc.procid() == 0)
+            logstream(LOG_EMPH) << "Graph Option: hdrf_lambda = "
+              << hdrf_lambda << std::endl;
+        } else if (opt == "fennel_gamma") {
+          opts.get_graph_args().get_option("fennel_gamma", fennel_gamma);
+          if (rpc.procid() == 0)
+            logstream(LOG_EMPH) << "Graph Option: fennel_gamma = "
+              << fennel_gamma << std::endl;
         } else if (opt == "parallel_ingress") {
          opts.get_graph_args().get_option("parallel_ingress", parallel_ingress);
           if (!parallel_ingress && rpc.procid() == 0)
@@ -673,7 +696,8 @@ namespace graphlab {
           logstream(LOG_ERROR) << "Unexpected Graph Option: " << opt << std::endl;
         }
     }
-      set_ingress_method(ingress_method, bufsize, usehash, userecent);
+      set_ingress_method(ingress_method, bufsize, usehash, userecent,
+                         hdrf_lambda, fennel_gamma);
     }
 
   public:
@@ -712,6 +736,20 @@ namespace graphlab {
       return finalized;
     }
 
+    /**
+     * \brief Returns the number of times finalize() changed the graph
+     * structure.
+     *
+     * With the dynamic local graph, vertices and edges may be added (or
+     * removed) after finalize(), and the next finalize() merges the changes
+     * into the local graph incrementally. Engines compare this counter to
+     * the value they last saw to detect that their per vertex (and per
+     * edge) state must be resized. The counter is identical on all machines.
+     */
+    size_t get_structure_version() const {
+      return structure_version;
+    }
+
     /** \brief Get the number of vertices */
     size_t num_vertices() const { return nverts; }
 
@@ -893,6 +931,49 @@ namespace graphlab {
     }
 
 
+    /**
+     * \brief Removes the edge connecting vertex source to vertex target.
+     *
+     * Like add_edge(), this function is parallel and distributed and may
+     * be called by any thread on any machine. The removal only takes effect
+     * at the next call to finalize(). Removals are applied to the edges
+     * present before the finalize() call, before any edges added since then
+     * are inserted. Removing an edge which does not exist has no effect.
+     * Vertices are never removed, even if they lose all their edges.
+     *
+     * Edge removal requires the dynamic local graph (USE_DYNAMIC_LOCAL_GRAPH).
+     * Every finalize() with pending removals rebuilds the local edge storage
+     * of each machine which holds a removed edge, in time linear in the
+     * number of local edges. Batch removals into as few finalize() calls as
+     * possible. Local edge ids change at such a finalize(), so they must not
+     * be kept across it (the engines reinitialize automatically).
+     *
+     * Returns true on success. Returns false if either vertex has the
+     * reserved id (vertex_id_type)(-1).
+     */
+    bool remove_edge(vertex_id_type source, vertex_id_type target) {
+#ifndef USE_DYNAMIC_LOCAL_GRAPH
+      logstream(LOG_FATAL)
+        << "\n\tAttempting to remove an edge from a static graph."
+        << "\n\tEdge removal requires USE_DYNAMIC_LOCAL_GRAPH."
+        << std::endl;
+#else
+      finalized = false;
+#endif
+      if(source == vertex_id_type(-1) || target == vertex_id_type(-1)) {
+        logstream(LOG_ERROR)
+          << "\n\tThe vertex with id vertex_id_type(-1) in edge \n"
+          << "\t(" << source << "->" << target << ") is not allowed.\n"
+          << "\tThe -1 vertex id is reserved for internal use."
+          << std::endl;
+        return false;
+      }
+      ASSERT_NE(ingress_ptr, NULL);
+      ingress_ptr->remove_edge(source, target);
+      return true;
+    }
+
+
    /**
     * \brief Performs a map-reduce operation on each vertex in the
     * graph returning the result.
@@ -1651,6 +1732,7 @@ namespace graphlab {
           >> lvid2record
           >> local_graph;
       finalized = true;
+      ++structure_version;
       // check the graph condition
     } // end of load
 
@@ -1687,14 +1769,29 @@ namespace graphlab {
     }
 
 
+    /**
+     * \brief The sections of a graph saved with save_binary() which
+     * are to be loaded by load_binary().
+     */
+    enum binary_sections {
+      /// The vertex and edge sets and their partitioning
+      BINARY_STRUCTURE = 1,
+      /// The vertex data
+      BINARY_VERTEX_DATA = 2,
+      /// The edge data
+      BINARY_EDGE_DATA = 4,
+      /// Everything
+      BINARY_ALL = 7
+    };
+
     /** \brief Load a distributed graph from a native binary format
      * previously saved with save_binary(). This function must be called
      *  simultaneously on all machines.
      *
      * This function loads a sequence of files numbered
-     * \li [prefix].0.gz
-     * \li [prefix].1.gz
-     * \li [prefix].2.gz
+     * \li [prefix]0.bin
+     * \li [prefix]1.bin
+     * \li [prefix]2.bin
      * \li etc.
      *
      * These files must be previously saved using save_binary(), and
@@ -1703,32 +1800,47 @@ namespace graphlab {
      * the user must ensure that the vertex data and edge data
      * serialization formats have not changed since the graph was saved.
      *
+     * The file is a framed archive (see graphlab::framed_oarchive) in
+     * which the structure, the vertex data and the edge data are
+     * separate checksummed sections.  The sections argument (a
+     * bitwise or of binary_sections) selects the sections to load;
+     * the others are skipped without being read.  Loading only
+     * BINARY_STRUCTURE leaves the vertex and edge data default
+     * constructed.  Loading only data sections requires the graph to
+     * already hold the same structure, for instance to restore a
+     * checkpoint of the data.  Files written by earlier versions
+     * (a single gzip compressed archive) can only be loaded whole.
+     *
      * A graph loaded using load_binary() is already finalized and
      * structure modifications are not permitted after loading.
      *
-     * Return true on success and false on failure if the file cannot be loaded.
+     * Return true on success and false on failure if the file cannot
+     * be loaded or a section fails its checksum.
      */
-    bool load_binary(const std::string& prefix) {
+    bool load_binary(const std::string& prefix,
+                     int sections = BINARY_ALL) {
       rpc.full_barrier();
       std::string fname = prefix + tostr(rpc.procid()) + ".bin";
 
       logstream(LOG_INFO) << "Load graph from " << fname << std::endl;
+      bool success = false;
       if(boost::starts_with(fname, "hdfs://")) {
         graphlab::hdfs hdfs;
         graphlab::hdfs::fstream in_file(hdfs, fname);
-        boost::iostreams::filtering_stream<boost::iostreams::input> fin;
-        fin.push(boost::iostreams::gzip_decompressor());
-        fin.push(in_file);
-
-        if(!fin.good()) {
+        if(!in_file.good()) {
           logstream(LOG_ERROR) << "\n\tError opening file: " << fname << std::endl;
           return false;
         }
-        iarchive iarc(fin);
-        iarc >> *this;
-        fin.pop();
-        fin.pop();
-        in_file.close();
+        framed_iarchive farc(in_file);
+        if(farc.good()) {
+          success = load_binary_sections(farc, sections);
+          in_file.close();
+        } else {
+          in_file.close();
+          graphlab::hdfs::fstream legacy_file(hdfs, fname);
+          success = load_legacy_binary(legacy_file, sections);
+          legacy_file.close();
+        }
       } else {
         std::ifstream in_file(fname.c_str(),
                               std::ios_base::in | std::ios_base::binary);
@@ -1736,18 +1848,23 @@ namespace graphlab {
           logstream(LOG_ERROR) << "\n\tError opening file: " << fname << std::endl;
           return false;
         }
-        boost::iostreams::filtering_stream<boost::iostreams::input> fin;
-        fin.push(boost::iostreams::gzip_decompressor());
-        fin.push(in_file);
-        iarchive iarc(fin);
-        iarc >> *this;
-        fin.pop();
-        fin.pop();
+        framed_iarchive farc(in_file);
+        if(farc.good()) {
+          success = load_binary_sections(farc, sections);
+        } else {
+          in_file.clear();
+          in_file.seekg(0, std::ios_base::beg);
+          success = load_legacy_binary(in_file, sections);
+        }
         in_file.close();
       }
-      logstream(LOG_INFO) << "Finish loading graph from " << fname << std::endl;
+      if(success) {
+        logstream(LOG_INFO) << "Finish loading graph from " << fname << std::endl;
+      } else {
+        logstream(LOG_ERROR) << "\n\tError loading graph from " << fname << std::endl;
+      }
       rpc.full_barrier();
-      return true;
+      return success;
     } // end of load
 
 
@@ -1756,9 +1873,9 @@ namespace graphlab {
      *  simultaneously on all machines.
      *
      * This function saves a sequence of files numbered
-     * \li [prefix].0.gz
-     * \li [prefix].1.gz
-     * \li [prefix].2.gz
+     * \li [prefix]0.bin
+     * \li [prefix]1.bin
+     * \li [prefix]2.bin
      * \li etc.
      *
      * This files can be loaded with load_binary() using the <b> same number
@@ -1767,32 +1884,31 @@ namespace graphlab {
      * the vertex data and edge data serialization formats must not
      * change between the use of save_binary() and load_binary().
      *
+     * Each file holds separate checksummed sections for the graph
+     * structure, the vertex data and the edge data which are zlib
+     * compressed unless compress is false.
+     *
      * If the graph is not alreasy finalized before save_binary() is called,
      * this function will finalize the graph.
      *
      * Returns true on success, and false if the graph cannot be loaded from
      * the specified file.
      */
-    bool save_binary(const std::string& prefix) {
+    bool save_binary(const std::string& prefix, bool compress = true) {
       rpc.full_barrier();
       finalize();
       timer savetime;  savetime.start();
       std::string fname = prefix + tostr(rpc.procid()) + ".bin";
       logstream(LOG_INFO) << "Save graph to " << fname << std::endl;
+      bool success = false;
       if(boost::starts_with(fname, "hdfs://")) {
         graphlab::hdfs hdfs;
         graphlab::hdfs::fstream out_file(hdfs, fname, true);
-        boost::iostreams::filtering_stream<boost::iostreams::output> fout;
-        fout.push(boost::iostreams::gzip_compressor());
-        fout.push(out_file);
-        if (!fout.good()) {
+        if (!out_file.good()) {
           logstream(LOG_ERROR) << "\n\tError opening file: " << fname << std::endl;
           return false;
         }
-        oarchive oarc(fout);
-        oarc << *this;
-        fout.pop();
-        fout.pop();
+        success = save_binary_sections(out_file, compress);
         out_file.close();
       } else {
         std::ofstream out_file(fname.c_str(),
@@ -1801,20 +1917,14 @@ namespace graphlab {
           logstream(LOG_ERROR) << "\n\tError opening file: " << fname << std::endl;
           return false;
         }
-        boost::iostreams::filtering_stream<boost::iostreams::output> fout;
-        fout.push(boost::iostreams::gzip_compressor());
-        fout.push(out_file);
-        oarchive oarc(fout);
-        oarc << *this;
-        fout.pop();
-        fout.pop();
+        success = save_binary_sections(out_file, compress);
         out_file.close();
       }
       logstream(LOG_INFO) << "Finish saving graph to " << fname << std::endl
                           << "Finished saving binary graph: "
                           << savetime.current_time() << std::endl;
       rpc.full_barrier();
-      return true;
+      return success;
     } // end of save
 
 
@@ -3129,6 +3239,9 @@ namespace graphlab {
   private:
     bool finalized;
 
+    /** Incremented each time finalize() changes the graph structure */
+    size_t structure_version;
+
     /** The local graph data */
     local_graph_type local_graph;
 
@@ -3168,12 +3281,19 @@ namespace graphlab {
     lock_manager_type lock_manager;
 
     void set_ingress_method(const std::string& method,
-        size_t bufsize = 50000, bool usehash = false, bool userecent = false) {
+        size_t bufsize = 50000, bool usehash = false, bool userecent = false,
+        double hdrf_lambda = 1.0, double fennel_gamma = 1.5) {
       if(ingress_ptr != NULL) { delete ingress_ptr; ingress_ptr = NULL; }
       if (method == "oblivious") {
         if (rpc.procid() == 0) logstream(LOG_EMPH) << "Use oblivious ingress, usehash: " << usehash
           << ", userecent: " << userecent << std::endl;
         ingress_ptr = new distributed_oblivious_ingress<VertexData, EdgeData>(rpc.dc(), *this, usehash, userecent);
+      } else if (method == "hdrf") {
+        if (rpc.procid() == 0) logstream(LOG_EMPH) << "Use hdrf ingress, lambda: " << hdrf_lambda << std::endl;
+        ingress_ptr = new distributed_hdrf_ingress<VertexData, EdgeData>(rpc.dc(), *this, hdrf_lambda);
+      } else if (method == "fennel") {
+        if (rpc.procid() == 0) logstream(LOG_EMPH) << "Use fennel ingress, gamma: " << fennel_gamma << std::endl;
+        ingress_ptr = new distributed_fennel_ingress<VertexData, EdgeData>(rpc.dc(), *this, fennel_gamma);
       } else if  (method == "random") {
         if (rpc.procid() == 0)logstream(LOG_EMPH) << "Use random ingress" << std::endl;
         ingress_ptr = new distributed_random_ingress<VertexData, EdgeData>(rpc.dc(), *this); 
@@ -3292,6 +3412,109 @@ namespace graphlab {
     }
 
 
+    /// \cond GRAPHLAB_INTERNAL
+    /** Section tags of the framed binary format */
+    static uint32_t binary_meta_tag() { return framed_tag('M','E','T','A'); }
+    static uint32_t binary_structure_tag() { return framed_tag('S','T','R','C'); }
+    static uint32_t binary_vertex_data_tag() { return framed_tag('V','D','A','T'); }
+    static uint32_t binary_edge_data_tag() { return framed_tag('E','D','A','T'); }
+
+    /** Writes the sections of the local graph to a framed archive */
+    bool save_binary_sections(std::ostream& out, bool compress) {
+      framed_oarchive farc(out);
+      farc.begin_section(binary_meta_tag(), 1)
+        << size_t(rpc.numprocs()) << nverts << nedges
+        << local_own_nverts << nreplicas;
+      farc.end_section();
+      oarchive& sarc = farc.begin_section(binary_structure_tag(), 1, compress);
+      sarc << vid2lvid << lvid2record;
+      local_graph.save_structure(sarc);
+      farc.end_section();
+      local_graph.save_vertex_data
+        (farc.begin_section(binary_vertex_data_tag(), 1, compress));
+      farc.end_section();
+      local_graph.save_edge_data
+        (farc.begin_section(binary_edge_data_tag(), 1, compress));
+      farc.end_section();
+      farc.close();
+      return !farc.fail();
+    } // end of save_binary_sections
+
+    /**
+     * Reads the requested sections from a framed archive skipping the
+     * others.  Data sections are checked against the structure.
+     */
+    bool load_binary_sections(framed_iarchive& farc, int sections) {
+      framed_section_header header;
+      size_t numprocs = 0;
+      size_t file_nverts = 0, file_nedges = 0, file_own_nverts = 0;
+      size_t file_nreplicas = 0;
+      bool has_meta = false;
+      while(farc.next_section(header)) {
+        if(header.tag == binary_meta_tag()) {
+          if(!farc.read_section()) return false;
+          farc.section_archive() >> numprocs >> file_nverts >> file_nedges
+                                 >> file_own_nverts >> file_nreplicas;
+          if(numprocs != rpc.numprocs()) {
+            logstream(LOG_ERROR) << "Graph was saved using " << numprocs
+                                 << " machines but is loaded using "
+                                 << rpc.numprocs() << std::endl;
+            return false;
+          }
+          has_meta = true;
+        } else if(header.tag == binary_structure_tag() &&
+                  (sections & BINARY_STRUCTURE)) {
+          if(!has_meta || !farc.read_section()) return false;
+          iarchive& sarc = farc.section_archive();
+          sarc >> vid2lvid >> lvid2record;
+          local_graph.load_structure(sarc);
+          nverts = file_nverts; nedges = file_nedges;
+          local_own_nverts = file_own_nverts; nreplicas = file_nreplicas;
+          finalized = true;
+          ++structure_version;
+        } else if(header.tag == binary_vertex_data_tag() &&
+                  (sections & BINARY_VERTEX_DATA)) {
+          if(!farc.read_section()) return false;
+          if(!local_graph.load_vertex_data(farc.section_archive())) {
+            logstream(LOG_ERROR) << "Vertex data does not match the graph structure"
+                                 << std::endl;
+            return false;
+          }
+        } else if(header.tag == binary_edge_data_tag() &&
+                  (sections & BINARY_EDGE_DATA)) {
+          if(!farc.read_section()) return false;
+          if(!local_graph.load_edge_data(farc.section_archive())) {
+            logstream(LOG_ERROR) << "Edge data does not match the graph structure"
+                                 << std::endl;
+            return false;
+          }
+        } else {
+          // unknown or unrequested section
+          farc.skip_section();
+        }
+      }
+      return has_meta;
+    } // end of load_binary_sections
+
+    /** Reads a graph saved as a single gzip compressed archive */
+    bool load_legacy_binary(std::istream& in, int sections) {
+      if(sections != BINARY_ALL) {
+        logstream(LOG_ERROR) << "Sections can only be loaded separately from "
+                             << "graphs saved in the framed binary format"
+                             << std::endl;
+        return false;
+      }
+      boost::iostreams::filtering_stream<boost::iostreams::input> fin;
+      fin.push(boost::iostreams::gzip_decompressor());
+      fin.push(in);
+      iarchive iarc(fin);
+      iarc >> *this;
+      fin.pop();
+      fin.pop();
+      return true;
+    } // end of load_legacy_binary
+    /// \endcond
+
     /** \brief Saves a distributed graph using a direct ostream saving function
      *
      * This function saves a sequence of files numbered
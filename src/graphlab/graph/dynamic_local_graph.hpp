@@ -121,6 +121,7 @@ namespace graphlab {
       std::vector<VertexData>().swap(vertices);
       std::vector<EdgeData>().swap(edges);
       edge_buffer.clear();
+      removal_buffer.clear();
     }
 
     /** \brief Get the number of vertices */
@@ -226,6 +227,34 @@ namespace graphlab {
     } // End of add block edges
 
 
+    /**
+     * \brief Removes the edge connecting vertex source to vertex target.
+     * The removal is buffered and applied at the next finalize() to the
+     * edges which were present before that finalize, i.e. before any
+     * buffered edge additions are inserted.
+     *
+     * A finalize() with pending removals rebuilds the CSR and CSC storage
+     * from scratch, which takes O(|E|) time and memory no matter how few
+     * edges are removed. Removals should therefore be batched into as few
+     * finalize() calls as possible. The rebuild also renumbers the edges:
+     * edge ids obtained before the finalize() are invalid afterwards.
+     *
+     * Returns true if the edge is present, in time linear in the out
+     * degree of source. Nothing is buffered otherwise.
+     */
+    bool remove_edge(lvid_type source, lvid_type target) {
+      if (source >= _csr_storage.num_keys()) return false;
+      for (csr_edge_iterator it = _csr_storage.begin(source);
+           it != _csr_storage.end(source); ++it) {
+        if ((*it).first == target) {
+          removal_buffer.push_back(std::make_pair(source, target));
+          return true;
+        }
+      }
+      return false;
+    } // End of remove edge
+
+
     /** \brief Returns a vertex of given ID. */
     vertex_type vertex(lvid_type vid) {
       ASSERT_LT(vid, vertices.size());
@@ -264,6 +293,7 @@ namespace graphlab {
 #ifdef DEBUG_GRAPH
       logstream(LOG_DEBUG) << "Graph2 finalize starts." << std::endl;
 #endif
+      if (!removal_buffer.empty()) apply_removals();
       std::vector<edge_id_type> src_permute;
       std::vector<edge_id_type> dest_permute;
       std::vector<edge_id_type> src_counting_prefix_sum;
@@ -365,6 +395,63 @@ namespace graphlab {
           << _csc_storage;
     } // end of save
 
+    /**
+     * \brief Save only the adjacency structure to an archive. The
+     * vertex and edge data are saved separately with
+     * save_vertex_data() and save_edge_data().
+     */
+    void save_structure(oarchive& arc) const {
+      arc << size_t(vertices.size())
+          << size_t(edges.size())
+          << _csr_storage
+          << _csc_storage;
+    } // end of save_structure
+
+    /**
+     * \brief Load the adjacency structure saved by save_structure().
+     * The vertex and edge data are default constructed.
+     */
+    void load_structure(iarchive& arc) {
+      clear();
+      size_t nverts = 0, nedges = 0;
+      arc >> nverts
+          >> nedges
+          >> _csr_storage
+          >> _csc_storage;
+      vertices.resize(nverts);
+      edges.resize(nedges);
+    } // end of load_structure
+
+    /** \brief Save the data of all vertices to an archive */
+    void save_vertex_data(oarchive& arc) const { arc << vertices; }
+
+    /**
+     * \brief Load the vertex data saved by save_vertex_data(). Returns
+     * false if the number of vertices does not match.
+     */
+    bool load_vertex_data(iarchive& arc) {
+      std::vector<VertexData> data;
+      arc >> data;
+      if (data.size() != vertices.size()) return false;
+      vertices.swap(data);
+      return true;
+    } // end of load_vertex_data
+
+    /** \brief Save the data of all edges to an archive */
+    void save_edge_data(oarchive& arc) const { arc << edges; }
+
+    /**
+     * \brief Load the edge data saved by save_edge_data(). Returns
+     * false if the number of edges does not match.
+     */
+    bool load_edge_data(iarchive& arc) {
+      std::vector<EdgeData> data;
+      arc >> data;
+      if (data.size() != edges.size()) return false;
+      edges.swap(data);
+      return true;
+    } // end of load_edge_data
+
     /** swap two graphs */
     void swap(dynamic_local_graph& other) {
       std::swap(vertices, other.vertices);
@@ -505,6 +592,50 @@ namespace graphlab {
     }
 
   private:
+    /**
+     * \internal
+     * Rebuilds the edge list without the edges in the removal buffer. The
+     * remaining edges are moved back into the edge buffer ahead of any
+     * pending additions so that finalize() takes the first time insertion
+     * path. This copies every edge, so the cost is O(|E| + R log R) for R
+     * removals, and edge ids are not preserved.
+     *
+     * Marking removed edges in place would avoid the copy, but every edge
+     * iterator and degree count would have to skip the dead entries, which
+     * slows down all engines on graphs that never remove an edge.
+     */
+    void apply_removals() {
+      std::sort(removal_buffer.begin(), removal_buffer.end());
+      local_edge_buffer<VertexData, EdgeData> kept;
+      kept.reserve_edge_space(edges.size() + edge_buffer.size());
+      size_t nremoved = 0;
+      for (lvid_type src = 0; src < _csr_storage.num_keys(); ++src) {
+        for (csr_edge_iterator it = _csr_storage.begin(src);
+             it != _csr_storage.end(src); ++it) {
+          const std::pair<lvid_type, edge_id_type> tgt_eid = *it;
+          if (std::binary_search(removal_buffer.begin(), removal_buffer.end(),
+                                 std::make_pair(src, tgt_eid.first))) {
+            ++nremoved;
+          } else {
+            kept.add_edge(src, tgt_eid.first, edges[tgt_eid.second]);
+          }
+        }
+      }
+      if (edge_buffer.size() > 0) {
+        kept.add_block_edges(edge_buffer.source_arr, edge_buffer.target_arr,
+                             edge_buffer.data);
+      }
+      std::vector<std::pair<lvid_type, lvid_type> >().swap(removal_buffer);
+      std::vector<EdgeData>().swap(edges);
+      _csr_storage.clear();
+      _csc_storage.clear();
+      edge_buffer.clear();
+      edge_buffer.data.swap(kept.data);
+      edge_buffer.source_arr.swap(kept.source_arr);
+      edge_buffer.target_arr.swap(kept.target_arr);
+      logstream(LOG_INFO) << "Removed " << nremoved << " edges" << std::endl;
+    }
+
     /**
      * \internal
      * CSR/CSC storage types
@@ -529,6 +660,9 @@ namespace graphlab {
         Finalize. This will be cleared after finalized.*/
     local_edge_buffer<VertexData, EdgeData> edge_buffer;
 
+    /** Edges (source, target) to be removed at the next finalize. */
+    std::vector<std::pair<lvid_type, lvid_type> > removal_buffer;
+
     /**************************************************************************/
     /*                                                                        */
     /*                            declare friends                             */
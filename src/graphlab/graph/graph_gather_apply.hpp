@@ -351,18 +351,27 @@ namespace graphlab {
         // Execute the gather operation for all vertices that are active
         // in this minor-step (active-minorstep bit set).
         // if (rmi.procid() == 0) std::cout << "Gathering..." << std::endl;
-        run_synchronous(&graph_gather_apply::execute_gathers, vset);
+        {
+          TRACE_SPAN("gather", "gather_apply");
+          run_synchronous(&graph_gather_apply::execute_gathers, vset);
+        }
 
         // Execute the gather operation for all vertices that are active
         // in this minor-step (active-minorstep bit set).
         // if (rmi.procid() == 0) std::cout << "Gathering..." << std::endl;
-        run_synchronous(&graph_gather_apply::execute_scatters, vset);
+        {
+          TRACE_SPAN("apply_scatter", "gather_apply");
+          run_synchronous(&graph_gather_apply::execute_scatters, vset);
+        }
 
 
         // Execute Apply Operations -------------------------------------------
         // Run the apply function on all active vertices
         // if (rmi.procid() == 0) std::cout << "Applying..." << std::endl;
-        run_synchronous(&graph_gather_apply::execute_applys, vset);
+        {
+          TRACE_SPAN("mirror_apply", "gather_apply");
+          run_synchronous(&graph_gather_apply::execute_applys, vset);
+        }
 
         /**
          * Post conditions:
@@ -422,7 +431,10 @@ namespace graphlab {
     gather_exchange.partial_flush(thread_id);
       // Finish sending and receiving all gather operations
     thread_barrier.wait();
-    if(thread_id == 0) gather_exchange.flush();
+    if(thread_id == 0) {
+      TRACE_SPAN("gather_exchange_flush", "exchange");
+      gather_exchange.flush();
+    }
     thread_barrier.wait();
     recv_gathers();
   } // end of execute_gathers
@@ -471,7 +483,10 @@ namespace graphlab {
     gather_exchange.partial_flush(thread_id);
       // Finish sending and receiving all gather operations
     thread_barrier.wait();
-    if(thread_id == 0) gather_exchange.flush();
+    if(thread_id == 0) {
+      TRACE_SPAN("gather_exchange_flush", "exchange");
+      gather_exchange.flush();
+    }
     thread_barrier.wait();
     recv_gathers();
   } // end of execute_gathers
@@ -0,0 +1,151 @@
+/**  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_DISTRIBUTED_FENNEL_INGRESS_HPP
+#define GRAPHLAB_DISTRIBUTED_FENNEL_INGRESS_HPP
+
+#include <cmath>
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/graph/ingress/distributed_ingress_base.hpp>
+#include <graphlab/graph/ingress/ingress_edge_decision.hpp>
+#include <graphlab/graph/distributed_graph.hpp>
+#include <graphlab/rpc/buffered_exchange.hpp>
+#include <graphlab/util/cuckoo_map_pow2.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+  template<typename VertexData, typename EdgeData>
+    class distributed_graph;
+
+  /**
+   * \brief Ingress object assigning edges using Fennel style vertex
+   * balanced placement.
+   *
+   * Each vertex is assigned a home machine the first time it is seen in
+   * the edge stream, maximizing the number of already placed neighbors
+   * minus the marginal Fennel load penalty 
+   * \f$ \alpha ((|P|+1)^\gamma - |P|^\gamma) \f$ on the number of vertices
+   * of the machine. \f$ \alpha = \sqrt{k} m / n^\gamma \f$ is computed from
+   * the number of vertices (n) and edges (m) seen so far on this machine
+   * and the number of machines (k). An edge is placed on the home of its
+   * endpoints if they agree, and otherwise on the home of the endpoint with
+   * the lower partial degree, so that high degree vertices are the ones
+   * which get replicated. The exponent is set by \c fennel_gamma.
+   */
+  template<typename VertexData, typename EdgeData>
+  class distributed_fennel_ingress : 
+    public distributed_ingress_base<VertexData, EdgeData> {
+  public:
+    typedef distributed_graph<VertexData, EdgeData> graph_type;
+    /// The type of the vertex data stored in the graph 
+    typedef VertexData vertex_data_type;
+    /// The type of the edge data stored in the graph 
+    typedef EdgeData   edge_data_type;
+    
+    typedef typename graph_type::vertex_record vertex_record;
+    typedef typename graph_type::mirror_type mirror_type;
+
+    typedef distributed_ingress_base<VertexData, EdgeData> base_type;
+
+    /** The home machine and partial degree of each vertex seen so far */
+    struct fennel_record {
+      procid_t home;
+      size_t degree;
+      fennel_record() : home(procid_t(-1)), degree(0) { }
+    };
+
+    typedef cuckoo_map_pow2<vertex_id_type, fennel_record, 3, uint32_t> vertex_hash_table_type;
+    vertex_hash_table_type vht;
+
+    /** Protects the vertex hash table and the counters */
+    mutex vht_lock;
+
+    /** Array of number of vertices assigned to each proc. */
+    std::vector<size_t> proc_num_vertices;
+
+    /** Number of edges seen by this machine */
+    size_t num_edges_seen;
+
+    /** Fennel load penalty exponent */
+    double gamma;
+
+  public:
+    distributed_fennel_ingress(distributed_control& dc, graph_type& graph,
+                               double gamma = 1.5) :
+      base_type(dc, graph),
+      vht(-1), proc_num_vertices(dc.numprocs()), num_edges_seen(0),
+      gamma(gamma) { }
+
+    ~distributed_fennel_ingress() { }
+
+    /** Add an edge to the ingress object using Fennel assignment. */
+    void add_edge(vertex_id_type source, vertex_id_type target,
+                  const EdgeData& edata) {
+      vht_lock.lock();
+      ++num_edges_seen;
+      fennel_record src_rec = vht[source];
+      fennel_record dst_rec = vht[target];
+      ++src_rec.degree; ++dst_rec.degree;
+      if (src_rec.home == procid_t(-1)) src_rec.home = assign_home(source, dst_rec);
+      if (dst_rec.home == procid_t(-1)) dst_rec.home = assign_home(target, src_rec);
+      vht[source] = src_rec;
+      vht[target] = dst_rec;
+      procid_t owning_proc;
+      if (src_rec.home == dst_rec.home) owning_proc = src_rec.home;
+      else if (src_rec.degree < dst_rec.degree) owning_proc = src_rec.home;
+      else if (dst_rec.degree < src_rec.degree) owning_proc = dst_rec.home;
+      else owning_proc = std::min(source, target) == source ? src_rec.home : dst_rec.home;
+      vht_lock.unlock();
+      typedef typename base_type::edge_buffer_record edge_buffer_record;
+      edge_buffer_record record(source, target, edata);
+      base_type::edge_exchange.send(owning_proc, record);
+    } // end of add edge
+
+    virtual void finalize() {
+      vht.clear();
+      distributed_ingress_base<VertexData, EdgeData>::finalize(); 
+    }
+
+  private:
+    /** Chooses the home of a new vertex with one (possibly placed) neighbor */
+    procid_t assign_home(vertex_id_type vid, const fennel_record& neighbor) {
+      const size_t numprocs = proc_num_vertices.size();
+      std::vector<size_t> neighbor_counts(numprocs, 0);
+      if (neighbor.home != procid_t(-1)) neighbor_counts[neighbor.home] = 1;
+      size_t num_vertices_seen = 1;
+      for (size_t i = 0; i < numprocs; ++i) num_vertices_seen += proc_num_vertices[i];
+      const double alpha = std::sqrt(double(numprocs)) * num_edges_seen /
+                           std::pow(double(num_vertices_seen), gamma);
+      return base_type::edge_decision.vertex_to_proc_fennel(vid, neighbor_counts,
+                                                            proc_num_vertices,
+                                                            alpha, gamma);
+    }
+
+  }; // end of distributed_fennel_ingress
+
+}; // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+
+#endif
@@ -0,0 +1,128 @@
+/**  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_DISTRIBUTED_HDRF_INGRESS_HPP
+#define GRAPHLAB_DISTRIBUTED_HDRF_INGRESS_HPP
+
+
+#include <graphlab/graph/graph_basic_types.hpp>
+#include <graphlab/graph/ingress/distributed_ingress_base.hpp>
+#include <graphlab/graph/ingress/ingress_edge_decision.hpp>
+#include <graphlab/graph/distributed_graph.hpp>
+#include <graphlab/rpc/buffered_exchange.hpp>
+#include <graphlab/util/dense_bitset.hpp>
+#include <graphlab/util/cuckoo_map_pow2.hpp>
+#include <graphlab/parallel/pthread_tools.hpp>
+#include <graphlab/macros_def.hpp>
+namespace graphlab {
+  template<typename VertexData, typename EdgeData>
+    class distributed_graph;
+
+  /**
+   * \brief Ingress object assigning edges using the HDRF (High Degree
+   * Replicated First) streaming greedy heuristic.
+   *
+   * Like the oblivious ingress, each machine keeps track of the machines
+   * each vertex was placed on. In addition it counts the partial degree of
+   * each vertex seen so far, and prefers placing an edge with its lower
+   * degree endpoint so that high degree vertices absorb the replication.
+   * The balance term is weighted by \c hdrf_lambda.
+   */
+  template<typename VertexData, typename EdgeData>
+  class distributed_hdrf_ingress : 
+    public distributed_ingress_base<VertexData, EdgeData> {
+  public:
+    typedef distributed_graph<VertexData, EdgeData> graph_type;
+    /// The type of the vertex data stored in the graph 
+    typedef VertexData vertex_data_type;
+    /// The type of the edge data stored in the graph 
+    typedef EdgeData   edge_data_type;
+    
+    typedef typename graph_type::vertex_record vertex_record;
+    typedef typename graph_type::mirror_type mirror_type;
+
+    typedef distributed_ingress_base<VertexData, EdgeData> base_type;
+    typedef fixed_dense_bitset<RPC_MAX_N_PROCS> bin_counts_type; 
+
+    /** The placement and partial degree of each vertex seen so far */
+    struct hdrf_record {
+      bin_counts_type replicas;
+      size_t degree;
+      hdrf_record() : degree(0) { }
+    };
+
+    /** Type of the degree hash table: 
+     * a map from vertex id to its hdrf record. */
+    typedef cuckoo_map_pow2<vertex_id_type, hdrf_record, 3, uint32_t> degree_hash_table_type;
+    degree_hash_table_type dht;
+
+    /** Protects the degree hash table */
+    mutex dht_lock;
+
+    /** Array of number of edges on each proc. */
+    std::vector<size_t> proc_num_edges;
+
+    /** Weight of the balance term */
+    double lambda;
+
+  public:
+    distributed_hdrf_ingress(distributed_control& dc, graph_type& graph,
+                             double lambda = 1.0) :
+      base_type(dc, graph),
+      dht(-1), proc_num_edges(dc.numprocs()), lambda(lambda) { }
+
+    ~distributed_hdrf_ingress() { }
+
+    /** Add an edge to the ingress object using HDRF assignment. */
+    void add_edge(vertex_id_type source, vertex_id_type target,
+                  const EdgeData& edata) {
+      dht_lock.lock();
+      ++dht[source].degree; ++dht[target].degree;
+      // both keys exist now, so the lookups below do not move entries
+      hdrf_record& src_rec = dht[source];
+      hdrf_record& dst_rec = dht[target];
+      const procid_t owning_proc = 
+        base_type::edge_decision.edge_to_proc_hdrf(source, target,
+                                                   src_rec.replicas,
+                                                   dst_rec.replicas,
+                                                   src_rec.degree,
+                                                   dst_rec.degree,
+                                                   proc_num_edges, lambda);
+      dht_lock.unlock();
+      typedef typename base_type::edge_buffer_record edge_buffer_record;
+      edge_buffer_record record(source, target, edata);
+      base_type::edge_exchange.send(owning_proc, record);
+    } // end of add edge
+
+    virtual void finalize() {
+      dht.clear();
+      distributed_ingress_base<VertexData, EdgeData>::finalize(); 
+    }
+
+  }; // end of distributed_hdrf_ingress
+
+}; // end of namespace graphlab
+#include <graphlab/macros_undef.hpp>
+
+
+#endif
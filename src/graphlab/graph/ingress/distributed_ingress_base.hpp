@@ -28,6 +28,7 @@
 #include <graphlab/graph/ingress/ingress_edge_decision.hpp>
 #include <graphlab/graph/graph_gather_apply.hpp>
 #include <graphlab/util/memory_info.hpp>
+#include <graphlab/util/timer.hpp>
 #include <graphlab/util/hopscotch_map.hpp>
 #include <graphlab/rpc/buffered_exchange.hpp>
 #include <graphlab/macros_def.hpp>
@@ -82,6 +83,10 @@ namespace graphlab {
     };
     buffered_exchange<edge_buffer_record> edge_exchange;
 
+    /// Temporary buffers used to store edge removals (source, target)
+    typedef std::pair<vertex_id_type, vertex_id_type> edge_removal_record;
+    buffered_exchange<edge_removal_record> edge_removal_exchange;
+
     /// Detail vertex record for the second pass coordination. 
     struct vertex_negotiator_record {
       mirror_type mirrors;
@@ -114,7 +119,7 @@ namespace graphlab {
   public:
     distributed_ingress_base(distributed_control& dc, graph_type& graph) :
       rpc(dc, this), graph(graph), vertex_exchange(dc), edge_exchange(dc),
-      edge_decision(dc) {
+      edge_removal_exchange(dc), edge_decision(dc) {
       rpc.barrier();
     } // end of constructor
 
@@ -130,6 +135,15 @@ namespace graphlab {
     } // end of add edge
 
 
+    /** \brief Remove an edge. The removal is routed through the master of
+     * the source vertex which knows all the replicas that may hold the edge.
+     */
+    virtual void remove_edge(vertex_id_type source, vertex_id_type target) {
+      const procid_t owning_proc = graph_hash::hash_vertex(source) % rpc.numprocs();
+      edge_removal_exchange.send(owning_proc, edge_removal_record(source, target));
+    } // end of remove edge
+
+
     /** \brief Add an vertex to the ingress object. */
     virtual void add_vertex(vertex_id_type vid, const VertexData& vdata)  { 
       const procid_t owning_proc = graph_hash::hash_vertex(vid) % rpc.numprocs();
@@ -150,7 +164,10 @@ namespace graphlab {
      * and the vertex record information. 
      *
      * \internal
-     * The finalization goes through 5 steps:
+     * The finalization goes through 6 steps:
+     *
+     * 0. Forward edge removals to all replicas of the source vertex and
+     * buffer them in the local graph.
      *
      * 1. Construct local graph using the received edges, during which
      * the vid2lvid map is built.
@@ -218,24 +235,82 @@ namespace graphlab {
       /*                       Flush any additional data                        */
       /*                                                                        */
       /**************************************************************************/
-      edge_exchange.flush(); vertex_exchange.flush();     
+      edge_exchange.flush(); vertex_exchange.flush();
+      edge_removal_exchange.flush();
 
       /**
        * Fast pass for redundant finalization with no graph changes. 
        */
+      size_t nedges_added = edge_exchange.size();
+      size_t nverts_added = vertex_exchange.size();
+      // counts the edges actually removed, not the removal requests
+      size_t nedges_removed = 0;
       {
-        size_t changed_size = edge_exchange.size() + vertex_exchange.size();
+        size_t changed_size = nedges_added + nverts_added +
+                              edge_removal_exchange.size();
         rpc.all_reduce(changed_size);
         if (changed_size == 0) {
           logstream(LOG_INFO) << "Skipping Graph Finalization because no changes happened..." << std::endl;
           return;
         }
       }
+      graphlab::timer ingest_timer; ingest_timer.start();
 
       if(rpc.procid() == 0)       
         memory_info::log_usage("Post Flush");
 
-     
+
+      /**************************************************************************/
+      /*                                                                        */
+      /*                           Remove edges                                 */
+      /*                                                                        */
+      /**************************************************************************/
+      {
+        typedef typename buffered_exchange<edge_removal_record>::buffer_type
+          edge_removal_buffer_type;
+        // The master of the source forwards the removal to every replica
+        // of the source. Only replicas holding both endpoints can hold the
+        // edge.
+        buffered_exchange<edge_removal_record> removal_forward(rpc.dc());
+        edge_removal_buffer_type removal_buffer;
+        procid_t proc;
+        while(edge_removal_exchange.recv(proc, removal_buffer)) {
+          foreach(const edge_removal_record& rec, removal_buffer) {
+            if (graph.vid2lvid.find(rec.first) == graph.vid2lvid.end()) continue;
+            const vertex_record& vrec = graph.lvid2record[graph.vid2lvid[rec.first]];
+            removal_forward.send(rpc.procid(), rec);
+            foreach(procid_t mirror, vrec.mirrors()) {
+              removal_forward.send(mirror, rec);
+            }
+          }
+        }
+        edge_removal_exchange.clear();
+        removal_forward.flush();
+        // the same edge may be removed several times
+        std::vector<edge_removal_record> removals;
+        while(removal_forward.recv(proc, removal_buffer)) {
+          removals.insert(removals.end(),
+                          removal_buffer.begin(), removal_buffer.end());
+        }
+        removal_forward.clear();
+        std::sort(removals.begin(), removals.end());
+        removals.erase(std::unique(removals.begin(), removals.end()),
+                       removals.end());
+        foreach(const edge_removal_record& rec, removals) {
+          if (graph.vid2lvid.find(rec.first) == graph.vid2lvid.end() ||
+              graph.vid2lvid.find(rec.second) == graph.vid2lvid.end()) continue;
+          const lvid_type source_lvid = graph.vid2lvid[rec.first];
+          const lvid_type target_lvid = graph.vid2lvid[rec.second];
+#ifdef USE_DYNAMIC_LOCAL_GRAPH
+          // only the machine holding the edge synchronizes its endpoints
+          if (!graph.local_graph.remove_edge(source_lvid, target_lvid)) continue;
+#endif
+          ++nedges_removed;
+          updated_lvids.set_bit(source_lvid);
+          updated_lvids.set_bit(target_lvid);
+        }
+      }
+
       /**************************************************************************/
       /*                                                                        */
       /*                         Construct local graph                          */
@@ -468,7 +543,7 @@ namespace graphlab {
 
         // Compute the vertices that needs synchronization 
         if (!first_time_finalize) {
-          vertex_set changed_vset = vertex_set(false);
+          changed_vset = vertex_set(false);
           changed_vset.make_explicit(graph);
           updated_lvids.resize(graph.num_local_vertices());
           for (lvid_type i = lvid_start; i <  graph.num_local_vertices(); ++i) {
@@ -492,6 +567,24 @@ namespace graphlab {
       }
 
       exchange_global_info();
+      ++graph.structure_version;
+
+      // Report the ingest throughput of incremental finalizations
+      if (graph.is_dynamic() && !first_time_finalize) {
+        rpc.all_reduce(nedges_added);
+        rpc.all_reduce(nedges_removed);
+        rpc.all_reduce(nverts_added);
+        const double elapsed = ingest_timer.current_time();
+        if (rpc.procid() == 0) {
+          logstream(LOG_EMPH) << "Incremental finalize: "
+                              << nedges_added << " edges added, "
+                              << nedges_removed << " edges removed, "
+                              << nverts_added << " vertices added in "
+                              << elapsed << " secs ("
+                              << (nedges_added + nedges_removed) / std::max(elapsed, 1e-6)
+                              << " edge changes/sec)" << std::endl;
+        }
+      }
     } // end of finalize
 
 
@@ -528,12 +621,28 @@ namespace graphlab {
       foreach(size_t count, swap_counts) graph.nreplicas += count;
 
 
+      // compute the load imbalance (max / mean) of edges and masters
+      std::vector<size_t> edge_counts(rpc.numprocs());
+      edge_counts[rpc.procid()] = graph.num_local_edges();
+      rpc.all_gather(edge_counts);
+      std::vector<size_t> master_counts(rpc.numprocs());
+      master_counts[rpc.procid()] = graph.num_local_own_vertices();
+      rpc.all_gather(master_counts);
+      const double edge_imbalance = 
+        (double)*std::max_element(edge_counts.begin(), edge_counts.end()) * 
+        rpc.numprocs() / std::max<size_t>(graph.nedges, 1);
+      const double master_imbalance = 
+        (double)*std::max_element(master_counts.begin(), master_counts.end()) * 
+        rpc.numprocs() / std::max<size_t>(graph.nverts, 1);
+
       if (rpc.procid() == 0) {
         logstream(LOG_EMPH) << "Graph info: "  
                             << "\n\t nverts: " << graph.num_vertices()
                             << "\n\t nedges: " << graph.num_edges()
                             << "\n\t nreplicas: " << graph.nreplicas
                             << "\n\t replication factor: " << (double)graph.nreplicas/graph.num_vertices()
+                            << "\n\t edge imbalance (max/mean): " << edge_imbalance
+                            << "\n\t master imbalance (max/mean): " << master_imbalance
                             << std::endl;
       }
     }
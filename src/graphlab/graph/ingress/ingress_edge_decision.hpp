@@ -27,6 +27,7 @@
 #include <graphlab/graph/graph_hash.hpp>
 #include <graphlab/rpc/distributed_event_log.hpp>
 #include <graphlab/util/dense_bitset.hpp>
+#include <cmath>
 #include <boost/random/uniform_int_distribution.hpp>
 
 namespace graphlab {
@@ -174,6 +175,99 @@ namespace graphlab {
         return best_proc;
       };
 
+      /** HDRF (High Degree Replicated First) assign (source, target) to a
+       *  machine using:
+       *  bitset<MAX_MACHINE> src_replicas : the machines holding the source
+       *  bitset<MAX_MACHINE> dst_replicas : the machines holding the target
+       *  size_t src_degree, dst_degree : the partial degrees seen so far
+       *  vector<size_t>      proc_num_edges : the edge counts over machines
+       *  double lambda : the weight of the balance term
+       *
+       *  A machine already holding an endpoint scores 1 + (1 - theta) where
+       *  theta is the relative degree of that endpoint, so the edge follows
+       *  the lower degree endpoint and the high degree endpoint is the one
+       *  which gets replicated.
+       * */
+      procid_t edge_to_proc_hdrf (const vertex_id_type source,
+          const vertex_id_type target,
+          bin_counts_type& src_replicas,
+          bin_counts_type& dst_replicas,
+          size_t src_degree,
+          size_t dst_degree,
+          std::vector<size_t>& proc_num_edges,
+          double lambda = 1.0) {
+        size_t numprocs = proc_num_edges.size();
+
+        const double epsilon = 1.0;
+        const double total_degree = src_degree + dst_degree;
+        const double src_theta = total_degree > 0 ? src_degree / total_degree : 0.5;
+        const double dst_theta = 1.0 - src_theta;
+        size_t minedges = *std::min_element(proc_num_edges.begin(), proc_num_edges.end());
+        size_t maxedges = *std::max_element(proc_num_edges.begin(), proc_num_edges.end());
+
+        // Compute the score of each proc.
+        std::vector<double> proc_score(numprocs);
+        for (size_t i = 0; i < numprocs; ++i) {
+          double rep = 0;
+          if (src_replicas.get(i)) rep += 1 + (1 - src_theta);
+          if (dst_replicas.get(i)) rep += 1 + (1 - dst_theta);
+          double bal = (maxedges - proc_num_edges[i])/(epsilon + maxedges - minedges);
+          proc_score[i] = rep + lambda * bal;
+        }
+        double maxscore = *std::max_element(proc_score.begin(), proc_score.end());
+
+        std::vector<procid_t> top_procs;
+        for (size_t i = 0; i < numprocs; ++i)
+          if (std::fabs(proc_score[i] - maxscore) < 1e-5)
+            top_procs.push_back(i);
+
+        // Hash the edge to one of the best procs.
+        typedef std::pair<vertex_id_type, vertex_id_type> edge_pair_type;
+        const edge_pair_type edge_pair(std::min(source, target),
+            std::max(source, target));
+        procid_t best_proc = top_procs[graph_hash::hash_edge(edge_pair) % top_procs.size()];
+
+        ASSERT_LT(best_proc, numprocs);
+        src_replicas.set_bit(best_proc);
+        dst_replicas.set_bit(best_proc);
+        ++proc_num_edges[best_proc];
+        return best_proc;
+      };
+
+      /** Fennel assign a new vertex to a machine using:
+       *  vector<size_t>  neighbor_counts : the number of neighbors already
+       *                                    assigned to each machine
+       *  vector<size_t>  proc_num_vertices : the vertex counts over machines
+       *  double alpha, gamma : the parameters of the Fennel load penalty
+       *                        alpha * |P|^gamma
+       *
+       *  Returns the machine maximizing the number of neighbors minus the
+       *  marginal load penalty.
+       * */
+      procid_t vertex_to_proc_fennel (const vertex_id_type vid,
+          const std::vector<size_t>& neighbor_counts,
+          std::vector<size_t>& proc_num_vertices,
+          double alpha, double gamma) {
+        size_t numprocs = proc_num_vertices.size();
+        std::vector<double> proc_score(numprocs);
+        for (size_t i = 0; i < numprocs; ++i) {
+          const double load = proc_num_vertices[i];
+          proc_score[i] = neighbor_counts[i] -
+            alpha * (std::pow(load + 1, gamma) - std::pow(load, gamma));
+        }
+        double maxscore = *std::max_element(proc_score.begin(), proc_score.end());
+
+        std::vector<procid_t> top_procs;
+        for (size_t i = 0; i < numprocs; ++i)
+          if (std::fabs(proc_score[i] - maxscore) < 1e-5)
+            top_procs.push_back(i);
+
+        procid_t best_proc = top_procs[graph_hash::hash_vertex(vid) % top_procs.size()];
+        ASSERT_LT(best_proc, numprocs);
+        ++proc_num_vertices[best_proc];
+        return best_proc;
+      };
+
   };// end of ingress_edge_decision
 }
 
@@ -437,6 +437,65 @@ namespace graphlab {
           << _csc_storage
           << finalized;
     } // end of save
+
+    /**
+     * \brief Save only the adjacency structure to an archive. The
+     * vertex and edge data are saved separately with
+     * save_vertex_data() and save_edge_data().
+     */
+    void save_structure(oarchive& arc) const {
+      arc << size_t(vertices.size())
+          << size_t(edges.size())
+          << _csr_storage
+          << _csc_storage
+          << finalized;
+    } // end of save_structure
+
+    /**
+     * \brief Load the adjacency structure saved by save_structure().
+     * The vertex and edge data are default constructed.
+     */
+    void load_structure(iarchive& arc) {
+      clear();
+      size_t nverts = 0, nedges = 0;
+      arc >> nverts
+          >> nedges
+          >> _csr_storage
+          >> _csc_storage
+          >> finalized;
+      vertices.resize(nverts);
+      edges.resize(nedges);
+    } // end of load_structure
+
+    /** \brief Save the data of all vertices to an archive */
+    void save_vertex_data(oarchive& arc) const { arc << vertices; }
+
+    /**
+     * \brief Load the vertex data saved by save_vertex_data(). Returns
+     * false if the number of vertices does not match.
+     */
+    bool load_vertex_data(iarchive& arc) {
+      std::vector<VertexData> data;
+      arc >> data;
+      if (data.size() != vertices.size()) return false;
+      vertices.swap(data);
+      return true;
+    } // end of load_vertex_data
+
+    /** \brief Save the data of all edges to an archive */
+    void save_edge_data(oarchive& arc) const { arc << edges; }
+
+    /**
+     * \brief Load the edge data saved by save_edge_data(). Returns
+     * false if the number of edges does not match.
+     */
+    bool load_edge_data(iarchive& arc) {
+      std::vector<EdgeData> data;
+      arc >> data;
+      if (data.size() != edges.size()) return false;
+      edges.swap(data);
+      return true;
+    } // end of load_edge_data
     
     /** swap two graphs */
     void swap(local_graph& other) {
@@ -27,7 +27,12 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <string>
 #include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <stdint.h>
 #include <graphlab/logger/backtrace.hpp>
 
 file_logger& global_logger() {
@@ -38,9 +43,95 @@ file_logger& global_logger() {
 
 
 
+namespace logger_impl {
+
+/// The header of a line stored in a log_ring
+struct log_record {
+  uint32_t len;
+  int32_t level;
+};
+
+/**
+ * A single producer, single consumer ring buffer of log lines used by
+ * asynchronous logging.  Each line is stored as a log_record followed
+ * by the line padded to a multiple of 8 bytes.  Only the owning thread
+ * writes tail and only the consumer (holding drain_mut) writes head.
+ */
+struct log_ring {
+  std::vector<char> buf;
+  size_t mask;
+  volatile size_t head;
+  volatile size_t tail;
+  /// Set when the owning thread exits. The consumer frees the ring.
+  volatile bool retired;
+
+  log_ring(size_t size) : head(0), tail(0), retired(false) {
+    size_t capacity = 64;
+    while (capacity < size) capacity *= 2;
+    buf.resize(capacity);
+    mask = capacity - 1;
+  }
+
+  static size_t record_size(size_t len) {
+    return sizeof(log_record) + ((len + 7) & ~size_t(7));
+  }
+
+  /// Returns true if a line of len bytes can ever be stored
+  bool fits(size_t len) const {
+    return record_size(len) <= buf.size();
+  }
+
+  void copy_in(size_t pos, const char* src, size_t len) {
+    pos &= mask;
+    size_t first = std::min(len, buf.size() - pos);
+    memcpy(&buf[pos], src, first);
+    if (first < len) memcpy(&buf[0], src + first, len - first);
+  }
+
+  void copy_out(size_t pos, char* dst, size_t len) const {
+    pos &= mask;
+    size_t first = std::min(len, buf.size() - pos);
+    memcpy(dst, &buf[pos], first);
+    if (first < len) memcpy(dst + first, &buf[0], len - first);
+  }
+
+  /// Appends a line. Returns false if there is not enough space.
+  bool push(int level, const char* data, size_t len) {
+    const size_t need = record_size(len);
+    if (buf.size() - (tail - head) < need) return false;
+    log_record rec;
+    rec.len = (uint32_t)len;
+    rec.level = level;
+    copy_in(tail, reinterpret_cast<const char*>(&rec), sizeof(rec));
+    copy_in(tail + sizeof(rec), data, len);
+    __sync_synchronize();
+    tail += need;
+    return true;
+  }
+
+  /// Removes the oldest line. Returns false if the ring is empty.
+  bool pop(std::string& line, int& level) {
+    if (head == tail) return false;
+    __sync_synchronize();
+    log_record rec;
+    copy_out(head, reinterpret_cast<char*>(&rec), sizeof(rec));
+    line.resize(rec.len);
+    if (rec.len > 0) copy_out(head + sizeof(rec), &line[0], rec.len);
+    level = rec.level;
+    __sync_synchronize();
+    head += record_size(rec.len);
+    return true;
+  }
+};
+
+} // namespace logger_impl
+
+
 void streambuffdestructor(void* v){
   logger_impl::streambuff_tls_entry* t =
     reinterpret_cast<logger_impl::streambuff_tls_entry*>(v);
+  // the ring may still hold lines and is freed once it is drained
+  if (t->ring != NULL) t->ring->retired = true;
   delete t;
 }
 
@@ -57,17 +148,136 @@ file_logger::file_logger() {
   log_file = "";
   log_to_console = true;
   log_level = LOG_EMPH;
+  async_mode = false;
+  block_when_full = false;
+  ring_size = 1 << 20;
+  dropped_messages = 0;
+  writer_stop = false;
+  writer_running = false;
   pthread_mutex_init(&mut, NULL);
+  pthread_mutex_init(&ring_mut, NULL);
+  pthread_mutex_init(&drain_mut, NULL);
   pthread_key_create(&streambuffkey, streambuffdestructor);
 }
 
 file_logger::~file_logger() {
+  set_async(false);
+  // Free the rings of threads which are still running as well. The
+  // key is deleted first so that those threads no longer reach their
+  // ring from streambuffdestructor when they exit.
+  logger_impl::streambuff_tls_entry* streambufentry =
+        reinterpret_cast<logger_impl::streambuff_tls_entry*>(
+                              pthread_getspecific(streambuffkey));
+  pthread_key_delete(streambuffkey);
+  delete streambufentry;
+  pthread_mutex_lock(&ring_mut);
+  for (size_t i = 0; i < rings.size(); ++i) delete rings[i];
+  rings.clear();
+  pthread_mutex_unlock(&ring_mut);
   if (fout.good()) {
     fout.flush();
     fout.close();
   }
 
   pthread_mutex_destroy(&mut);
+  pthread_mutex_destroy(&ring_mut);
+  pthread_mutex_destroy(&drain_mut);
+}
+
+
+void file_logger::set_async(bool async, size_t buffer_size,
+                            bool block) {
+  if (async) {
+    ring_size = buffer_size;
+    block_when_full = block;
+    if (!writer_running) {
+      writer_stop = false;
+      writer_running =
+        pthread_create(&writer_thread, NULL, writer_main, this) == 0;
+    }
+    async_mode = writer_running;
+  } else {
+    async_mode = false;
+    if (writer_running) {
+      writer_stop = true;
+      pthread_join(writer_thread, NULL);
+      writer_running = false;
+    }
+    flush();
+  }
+}
+
+
+void* file_logger::writer_main(void* logger) {
+  file_logger* l = reinterpret_cast<file_logger*>(logger);
+  while (!l->writer_stop) {
+    if (!l->drain_rings()) usleep(1000);
+  }
+  l->drain_rings();
+  return NULL;
+}
+
+
+bool file_logger::drain_rings() {
+  pthread_mutex_lock(&drain_mut);
+  pthread_mutex_lock(&ring_mut);
+  std::vector<logger_impl::log_ring*> current(rings);
+  pthread_mutex_unlock(&ring_mut);
+
+  bool wrote = false;
+  std::string line;
+  int level;
+  for (size_t i = 0; i < current.size(); ++i) {
+    logger_impl::log_ring* ring = current[i];
+    // lines pushed before the ring was retired are drained below
+    const bool retired = ring->retired;
+    __sync_synchronize();
+    while (ring->pop(line, level)) {
+      write_raw(level, line.data(), (int)line.length());
+      wrote = true;
+    }
+    if (retired) {
+      pthread_mutex_lock(&ring_mut);
+      rings.erase(std::find(rings.begin(), rings.end(), ring));
+      pthread_mutex_unlock(&ring_mut);
+      delete ring;
+    }
+  }
+  if (wrote && fout.good()) {
+    pthread_mutex_lock(&mut);
+    fout.flush();
+    pthread_mutex_unlock(&mut);
+  }
+  pthread_mutex_unlock(&drain_mut);
+  return wrote;
+}
+
+
+void file_logger::flush() {
+  drain_rings();
+  if (fout.good()) {
+    pthread_mutex_lock(&mut);
+    fout.flush();
+    pthread_mutex_unlock(&mut);
+  }
+}
+
+
+logger_impl::log_ring* file_logger::thread_ring() {
+  logger_impl::streambuff_tls_entry* streambufentry =
+        reinterpret_cast<logger_impl::streambuff_tls_entry*>(
+                              pthread_getspecific(streambuffkey));
+  if (streambufentry == NULL) {
+    streambufentry = new logger_impl::streambuff_tls_entry;
+    pthread_setspecific(streambuffkey, streambufentry);
+  }
+  if (streambufentry->ring == NULL) {
+    streambufentry->ring = new logger_impl::log_ring(ring_size);
+    pthread_mutex_lock(&ring_mut);
+    rings.push_back(streambufentry->ring);
+    pthread_mutex_unlock(&ring_mut);
+  }
+  return streambufentry->ring;
 }
 
 bool file_logger::set_log_file(std::string file) {
@@ -142,6 +352,10 @@ void file_logger::_log(int lineloglevel,const char* file,const char* function,
 
     str[byteswritten] = '\n';
     str[byteswritten+1] = 0;
+    if (async_mode) {
+      _lograw(lineloglevel, str, byteswritten + 1);
+      return;
+    }
     // write the output
     if (fout.good()) {
       pthread_mutex_lock(&mut);
@@ -194,6 +408,14 @@ void file_logger::_logbuf(int lineloglevel,const char* file,const char* function
       // write the actual header
       int byteswritten = snprintf(str,2047,"%s%s(%s:%d): ",
                                   messages[lineloglevel],file,function,line);
+      if (async_mode) {
+        // buffer the line as a whole so it is not interleaved
+        std::string whole(str, byteswritten);
+        whole.append(buf, len);
+        whole.append(newline);
+        _lograw(lineloglevel, whole.c_str(), (int)whole.length());
+        return;
+      }
       _lograw(lineloglevel,str, byteswritten);
       _lograw(lineloglevel,buf, len);
       _lograw(lineloglevel,newline, (int)strlen(newline));
@@ -202,6 +424,28 @@ void file_logger::_logbuf(int lineloglevel,const char* file,const char* function
 }
 
 void file_logger::_lograw(int lineloglevel, const char* buf, int len) {
+  if (async_mode) {
+    if (lineloglevel != LOG_FATAL) {
+      logger_impl::log_ring* ring = thread_ring();
+      if (ring->fits(len)) {
+        while (!ring->push(lineloglevel, buf, len)) {
+          if (!block_when_full) {
+            __sync_fetch_and_add(&dropped_messages, 1);
+            return;
+          }
+          sched_yield();
+        }
+        return;
+      }
+    }
+    // fatal or oversized lines are written directly after the
+    // buffered lines
+    flush();
+  }
+  write_raw(lineloglevel, buf, len);
+}
+
+void file_logger::write_raw(int lineloglevel, const char* buf, int len) {
   if (fout.good()) {
     pthread_mutex_lock(&mut);
     fout.write(buf,len);
@@ -46,6 +46,7 @@
 #include <cassert>
 #include <cstring>
 #include <cstdarg>
+#include <vector>
 #include <pthread.h>
 #include <graphlab/util/timer.hpp>
 #include <graphlab/logger/fail_method.hpp>
@@ -170,9 +171,14 @@
 #endif
 
 namespace logger_impl {
+struct log_ring;
+
 struct streambuff_tls_entry {
   std::stringstream streambuffer;
   bool streamactive;
+  /// The ring buffer of this thread used by asynchronous logging
+  log_ring* ring;
+  streambuff_tls_entry() : streamactive(false), ring(NULL) { }
 };
 }
 
@@ -220,6 +226,37 @@ class file_logger{
     return log_level;
   }
 
+  /**
+   * Enables or disables asynchronous logging.
+   *
+   * In asynchronous mode each thread copies its formatted log lines
+   * into a lock-free ring buffer of buffer_size bytes of its own and a
+   * background thread writes them to the log file and the console, so
+   * logging threads never contend on the output lock or block on I/O.
+   * If a ring is full the line is dropped and counted (see
+   * get_dropped_messages()) unless block_when_full is set, in which
+   * case the logging thread waits for space. LOG_FATAL lines are always
+   * written synchronously after flushing the buffered lines.
+   *
+   * Disabling asynchronous logging writes out all buffered lines.
+   * This should not be called concurrently with other threads logging.
+   */
+  void set_async(bool async, size_t buffer_size = 1 << 20,
+                 bool block_when_full = false);
+
+  /// Returns true if asynchronous logging is enabled
+  bool get_async() const {
+    return async_mode;
+  }
+
+  /// Returns the number of lines dropped because a ring buffer was full
+  size_t get_dropped_messages() const {
+    return dropped_messages;
+  }
+
+  /// Writes out all lines buffered by asynchronous logging
+  void flush();
+
   file_logger& start_stream(int lineloglevel,const char* file,const char* function, int line, bool do_start = true);
 
   template <typename T>
@@ -331,6 +368,27 @@ class file_logger{
   bool log_to_console;
   int log_level;
 
+  /// Writes a line to the log file and the console
+  void write_raw(int loglevel, const char* buf, int len);
+  /// Returns the ring buffer of the calling thread
+  logger_impl::log_ring* thread_ring();
+  /// Writes out the lines buffered in the ring buffers
+  bool drain_rings();
+  /// The main loop of the background writer thread
+  static void* writer_main(void* logger);
+
+  volatile bool async_mode;
+  bool block_when_full;
+  size_t ring_size;
+  volatile size_t dropped_messages;
+  volatile bool writer_stop;
+  bool writer_running;
+  pthread_t writer_thread;
+  /// Protects rings
+  pthread_mutex_t ring_mut;
+  /// Held by the (single) consumer of the ring buffers
+  pthread_mutex_t drain_mut;
+  std::vector<logger_impl::log_ring*> rings;
 };
 
 
@@ -29,6 +29,8 @@
 #include <graphlab/rpc/dc.hpp>
 #include <graphlab/rpc/dc_dist_object.hpp>
 #include <graphlab/util/mpi_tools.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/integral_constant.hpp>
 
 
 #include <graphlab/macros_def.hpp>
@@ -85,6 +87,14 @@ namespace graphlab {
     std::deque< buffer_record > recv_buffers;
     mutex recv_lock;
 
+    /**
+     * If true, values are written as their memory image (even 64 bit
+     * integers, which operator<< writes with a variable length encoding)
+     * after padding which aligns them relative to the start of the
+     * message, so that a received buffer can be read as a pod_array_view.
+     */
+    BOOST_STATIC_CONSTANT(bool, bulk_recv = gl_is_pod<T>::value);
+
 
     struct send_record {
       oarchive* oarc;
@@ -127,6 +137,9 @@ namespace graphlab {
          send_buffers[i].numinserts = 0;
          // begin by writing the src proc.
          (*(send_buffers[i].oarc)) << rpc.procid();
+         if (bulk_recv) {
+           send_buffers[i].oarc->align(boost::alignment_of<T>::value);
+         }
        }
        rpc.barrier();
       }
@@ -155,7 +168,8 @@ namespace graphlab {
       ASSERT_LT(index, send_locks.size());
       send_locks[index].lock();
 
-      (*(send_buffers[index].oarc)) << value;
+      if (bulk_recv) send_buffers[index].oarc->direct_assign(value);
+      else (*(send_buffers[index].oarc)) << value;
       ++send_buffers[index].numinserts;
 
       if(send_buffers[index].oarc->off >= max_buffer_size) {
@@ -288,10 +302,8 @@ namespace graphlab {
       size_t numel = 0; 
       numel_iarc.read(reinterpret_cast<char*>(&numel), sizeof(size_t));
       //std::cout << "Receiving: " << numel << "\n";
-      tmp.resize(numel);
-      for (size_t i = 0;i < numel; ++i) {
-        iarc >> tmp[i];
-      }
+      recv_values(iarc, numel, tmp,
+                  boost::integral_constant<bool, bulk_recv>());
 
       recv_lock.lock();
       recv_buffers.push_back(buffer_record());
@@ -302,6 +314,24 @@ namespace graphlab {
     } // end of rpc rcv
 
 
+    // the values are stored back to back after the padding, so they are
+    // viewed in the message and copied out at once
+    void recv_values(iarchive& iarc, size_t numel, buffer_type& ret,
+                     boost::true_type) {
+      iarc.align();
+      pod_array_view<T> values;
+      values.load_values(iarc, numel);
+      values.move_to(ret);
+    }
+
+    void recv_values(iarchive& iarc, size_t numel, buffer_type& ret,
+                     boost::false_type) {
+      ret.resize(numel);
+      for (size_t i = 0;i < numel; ++i) {
+        iarc >> ret[i];
+      }
+    }
+
     // create a new buffer for send_buffer[index], returning the old buffer
     oarchive* swap_buffer(size_t index) {
       oarchive* swaparc = rpc.split_call_begin(&buffered_exchange::rpc_recv);
@@ -314,6 +344,9 @@ namespace graphlab {
       send_buffers[index].numinserts = 0;
       // write the current procid into the new buffer
       (*(send_buffers[index].oarc)) << rpc.procid();
+      if (bulk_recv) {
+        send_buffers[index].oarc->align(boost::alignment_of<T>::value);
+      }
       return swaparc;
     }
 
@@ -47,6 +47,7 @@
 #include <graphlab/rpc/dc_stream_receive.hpp>
 #include <graphlab/rpc/request_reply_handler.hpp>
 #include <graphlab/rpc/dc_services.hpp>
+#include <graphlab/rpc/distributed_trace.hpp>
 
 #include <graphlab/rpc/dc_init_from_env.hpp>
 #include <graphlab/rpc/dc_init_from_mpi.hpp>
@@ -159,17 +160,19 @@ distributed_control::distributed_control(dc_init_param initparam) {
 
 
 distributed_control::~distributed_control() {
-  // detach the instance
-  last_dc = NULL;
-  last_dc_procid = 0;
   distributed_services->full_barrier();
   logstream(LOG_INFO) << "Shutting down distributed control " << std::endl;
   FREE_CALLBACK_EVENT(EVENT_NETWORK_BYTES);
   FREE_CALLBACK_EVENT(EVENT_RPC_CALLS);
-  // call all deletion callbacks
+  // call all deletion callbacks. They may still communicate, and a
+  // thread sending for the first time needs the instance to create
+  // its send buffer.
   for (size_t i = 0; i < deletion_callbacks.size(); ++i) {
     deletion_callbacks[i]();
   }
+  // detach the instance
+  last_dc = NULL;
+  last_dc_procid = 0;
 
   size_t bytessent = bytes_sent();
   for (size_t i = 0;i < senders.size(); ++i) {
@@ -615,6 +618,8 @@ void distributed_control::init(const std::vector<std::string> &machines,
       "MB", boost::bind(&distributed_control::network_megabytes_sent, this));
   ADD_CUMULATIVE_CALLBACK_EVENT(EVENT_RPC_CALLS, "RPC Calls",
       "Calls", boost::bind(&distributed_control::calls_sent, this));
+  // attach the timeline trace (enabled by GRAPHLAB_TRACE)
+  get_trace_log().set_dc(*this);
 }
 
 
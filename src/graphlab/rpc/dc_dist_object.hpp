@@ -40,6 +40,7 @@
 #include <graphlab/util/charstream.hpp>
 #include <boost/preprocessor.hpp>
 #include <graphlab/util/tracepoint.hpp>
+#include <graphlab/rpc/distributed_trace.hpp>
 #include <graphlab/rpc/request_reply_handler.hpp>
 #include <graphlab/macros_def.hpp>
 
@@ -1408,6 +1409,7 @@ private:
 
   /// \copydoc distributed_control::barrier()
   void barrier() {
+    TRACE_SPAN("barrier", "rpc");
     // upward message
     int barrier_val = barrier_sense;
     barrier_mut.lock();
@@ -1478,6 +1480,7 @@ private:
 
   /// \copydoc distributed_control::full_barrier()
   void full_barrier() {
+    TRACE_SPAN("full_barrier", "rpc");
     // gather a sum of all the calls issued to machine 0
     std::vector<size_t> calls_sent_to_target(numprocs(), 0);
     for (size_t i = 0;i < numprocs(); ++i) {
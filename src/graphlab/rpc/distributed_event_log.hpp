@@ -86,7 +86,7 @@ struct log_group{
 
   boost::function<double(void)> callback;
 
-  size_t sum_of_instantaneous_entries;
+  double sum_of_instantaneous_entries;
   size_t count_of_instantaneous_entries;
 
   bool machine_log_modified;  
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <graphlab/rpc/dc.hpp>
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/rpc/distributed_trace.hpp>
+#include <graphlab/parallel/fiber_control.hpp>
+#include <graphlab/logger/logger.hpp>
+
+namespace graphlab {
+
+/// The number of time requests used to estimate the clock offset
+static const size_t CLOCK_OFFSET_ROUNDS = 8;
+
+distributed_trace::distributed_trace():
+    rmi(NULL), active(false), base_time(0) { }
+
+
+void distributed_trace::set_dc(distributed_control& dc) {
+  if (rmi != NULL) return;
+  rmi = new dc_dist_object<distributed_trace>(dc, this);
+  dc.register_deletion_callback(boost::bind(&distributed_trace::destroy_trace,
+                                            this));
+  base_time = now();
+  char* env_prefix = getenv("GRAPHLAB_TRACE");
+  if (env_prefix != NULL && env_prefix[0] != 0) {
+    size_t capacity = 1 << 20;
+    char* env_capacity = getenv("GRAPHLAB_TRACE_EVENTS");
+    if (env_capacity != NULL) capacity = atol(env_capacity);
+    enable(env_prefix, capacity);
+  }
+}
+
+
+void distributed_trace::enable(const std::string& output_prefix,
+                               size_t capacity) {
+  if (active) return;
+  events.resize(capacity);
+  next_event = 0;
+  prefix = output_prefix;
+  active = true;
+}
+
+
+size_t distributed_trace::num_dropped() const {
+  return next_event.value > events.size() ?
+      next_event.value - events.size() : 0;
+}
+
+
+void distributed_trace::record(const char* name, const char* category,
+                               size_t start) {
+  const size_t idx = next_event.inc_ret_last();
+  if (idx >= events.size()) return;
+  trace_event& event = events[idx];
+  event.name = name;
+  event.category = category;
+  event.start = start;
+  event.duration = now() - start;
+  event.tid = fiber_control::in_fiber() ? fiber_control::get_worker_id() + 1 : 0;
+}
+
+
+std::pair<size_t, size_t> distributed_trace::rpc_get_time() {
+  return std::make_pair(now(), base_time);
+}
+
+
+double distributed_trace::estimate_offset() {
+  if (rmi->procid() == 0) return -double(base_time);
+  double best_offset = 0;
+  size_t best_rtt = size_t(-1);
+  for (size_t i = 0; i < CLOCK_OFFSET_ROUNDS; ++i) {
+    const size_t send_time = now();
+    std::pair<size_t, size_t> remote =
+        rmi->remote_request(0, &distributed_trace::rpc_get_time);
+    const size_t recv_time = now();
+    // assume the reply was generated half way through the round trip
+    if (recv_time - send_time < best_rtt) {
+      best_rtt = recv_time - send_time;
+      best_offset = double(remote.first) - double(remote.second)
+                    - (double(send_time) + double(recv_time)) / 2;
+    }
+  }
+  logstream(LOG_INFO) << "Trace clock offset estimated with a round trip of "
+                      << best_rtt << "us" << std::endl;
+  return best_offset;
+}
+
+
+void distributed_trace::write_events(std::ostream& out, double offset,
+                                     size_t nevents) const {
+  const procid_t procid = rmi->procid();
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << procid
+      << ",\"args\":{\"name\":\"machine " << procid << "\"}}";
+  out.setf(std::ios::fixed);
+  out.precision(0);
+  for (size_t i = 0; i < nevents; ++i) {
+    const trace_event& event = events[i];
+    out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\""
+        << event.category << "\",\"ph\":\"X\",\"pid\":" << procid
+        << ",\"tid\":" << event.tid
+        << ",\"ts\":" << double(event.start) + offset
+        << ",\"dur\":" << event.duration << "}";
+  }
+}
+
+
+static void write_trace_file(const std::string& fname,
+                             const std::string& events) {
+  std::ofstream fout(fname.c_str());
+  if (!fout.good()) {
+    logstream(LOG_ERROR) << "Unable to write trace " << fname << std::endl;
+    return;
+  }
+  fout << "{\"traceEvents\":[\n" << events << "\n]}\n";
+}
+
+
+void distributed_trace::destroy_trace() {
+  const bool was_active = active;
+  // stop recording and make sure everyone has stopped before writing
+  active = false;
+  rmi->full_barrier();
+
+  std::vector<std::string> all_events(rmi->numprocs());
+  if (was_active) {
+    const double offset = estimate_offset();
+    const size_t nevents = std::min(size_t(next_event.value), events.size());
+    std::stringstream strm;
+    write_events(strm, offset, nevents);
+    all_events[rmi->procid()] = strm.str();
+    write_trace_file(prefix + "." +
+                     boost::lexical_cast<std::string>(rmi->procid()) + ".json",
+                     all_events[rmi->procid()]);
+    if (num_dropped() > 0) {
+      logstream(LOG_WARNING) << num_dropped() << " trace spans did not fit "
+                             << "in the buffer of " << events.size()
+                             << std::endl;
+    }
+  }
+  // every process takes part in the gather so that the processes do
+  // not need to agree on whether tracing is enabled
+  rmi->gather(all_events, 0);
+  if (rmi->procid() == 0 && was_active) {
+    std::string merged;
+    for (size_t i = 0; i < all_events.size(); ++i) {
+      if (all_events[i].empty()) continue;
+      if (!merged.empty()) merged += ",\n";
+      merged += all_events[i];
+    }
+    write_trace_file(prefix + ".json", merged);
+    logstream(LOG_EMPH) << "Trace written to " << prefix << ".json"
+                        << std::endl;
+  }
+  rmi->full_barrier();
+  delete rmi;
+  rmi = NULL;
+  std::vector<trace_event>().swap(events);
+}
+
+
+distributed_trace& get_trace_log() {
+  static distributed_trace dist_trace;
+  return dist_trace;
+}
+
+} // namespace graphlab
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_DISTRIBUTED_TRACE_HPP
+#define GRAPHLAB_DISTRIBUTED_TRACE_HPP
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <utility>
+#include <boost/preprocessor/cat.hpp>
+#include <graphlab/parallel/atomic.hpp>
+#include <graphlab/util/timer.hpp>
+
+namespace graphlab {
+
+// forward declaration because we need this in the
+// class but we want dc_dist_object to be able
+// to use this class too.
+template <typename T>
+class dc_dist_object;
+class distributed_control;
+
+/// A single span. name and category must be string literals.
+struct trace_event {
+  const char* name;
+  const char* category;
+  /// start time in microseconds on the local clock
+  size_t start;
+  size_t duration;
+  size_t tid;
+};
+
+/**
+ * \ingroup rpc
+ * Records timestamped spans (supersteps, barriers, exchange flushes,
+ * ...) of every process into a bounded in-memory buffer and writes
+ * them as Chrome trace event JSON (chrome://tracing, Perfetto) when
+ * the distributed_control is destroyed.
+ *
+ * Tracing is off by default. It is switched on by setting the
+ * environment variable GRAPHLAB_TRACE to an output prefix (and
+ * optionally GRAPHLAB_TRACE_EVENTS to the buffer capacity) or by
+ * calling enable() on every process. Each process then writes
+ * prefix.[procid].json and process 0 also writes prefix.json holding
+ * the spans of all processes. Timestamps are shifted onto the clock
+ * of process 0 using the offset with the shortest round trip among a
+ * few RPC time requests, so the spans of different machines line up
+ * in the merged timeline.
+ *
+ * Once the buffer is full further spans are counted but dropped.
+ * Spans are recorded with the TRACE_SPAN macro:
+ * \code
+ * {
+ *   TRACE_SPAN("gather", "engine");
+ *   run_synchronous( &synchronous_engine::execute_gathers );
+ * }
+ * \endcode
+ */
+class distributed_trace {
+  private:
+    dc_dist_object<distributed_trace>* rmi;
+    std::vector<trace_event> events;
+    atomic<size_t> next_event;
+    volatile bool active;
+    std::string prefix;
+    /// local time at which the dc was attached
+    size_t base_time;
+
+    /** Returns (current time, base time) of this process */
+    std::pair<size_t, size_t> rpc_get_time();
+
+    /**
+     * Estimates the offset to add to local times to get times on the
+     * clock of process 0 (relative to its base time).
+     */
+    double estimate_offset();
+
+    void write_events(std::ostream& out, double offset, size_t nevents) const;
+
+  public:
+    distributed_trace();
+
+    /**
+     * Associates the trace with a DC object. Called by the
+     * distributed_control constructor.
+     */
+    void set_dc(distributed_control& dc);
+
+    /// called by the destruction of distributed_control
+    void destroy_trace();
+
+    /**
+     * Starts recording into a buffer of at most capacity spans which
+     * is written to prefix.[procid].json (and prefix.json on process
+     * 0) at shutdown. Should be called on every process.
+     */
+    void enable(const std::string& prefix, size_t capacity = 1 << 20);
+
+    inline bool enabled() const { return active; }
+
+    /// The number of spans which did not fit in the buffer
+    size_t num_dropped() const;
+
+    /// The current time in microseconds on the local clock
+    static inline size_t now() { return timer::usec_of_day(); }
+
+    /// Records a span which started at start (a value of now())
+    void record(const char* name, const char* category, size_t start);
+};
+
+extern distributed_trace& get_trace_log();
+
+
+/**
+ * \ingroup rpc
+ * Records a span from its construction to its destruction if tracing
+ * is enabled.
+ */
+class trace_span {
+  private:
+    const char* name;
+    const char* category;
+    size_t start;
+  public:
+    inline trace_span(const char* name, const char* category):
+        name(name), category(category),
+        start(get_trace_log().enabled() ? distributed_trace::now() : 0) { }
+    inline ~trace_span() {
+      if (start != 0) get_trace_log().record(name, category, start);
+    }
+};
+
+} // namespace graphlab
+
+#define TRACE_SPAN(name, category) \
+  graphlab::trace_span BOOST_PP_CAT(__trace_span_, __LINE__)(name, category);
+
+#endif
@@ -0,0 +1,497 @@
+/**  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_FRAMED_ARCHIVE_HPP
+#define GRAPHLAB_FRAMED_ARCHIVE_HPP
+
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <stdint.h>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/operations.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <graphlab/logger/logger.hpp>
+#include <graphlab/serialization/serialization_includes.hpp>
+#include <graphlab/util/crc32c.hpp>
+
+namespace graphlab {
+
+  /**
+   * \ingroup group_serialization
+   * Builds a section tag from four characters, for instance
+   * framed_tag('M','E','T','A').
+   */
+  inline uint32_t framed_tag(char a, char b, char c, char d) {
+    return uint32_t((unsigned char)a) | (uint32_t((unsigned char)b) << 8) |
+           (uint32_t((unsigned char)c) << 16) | (uint32_t((unsigned char)d) << 24);
+  }
+
+  /**
+   * \ingroup group_serialization
+   * The header preceding every section of a framed archive.
+   */
+  struct framed_section_header {
+    /// The section tag. A tag of 0 marks the end of the archive
+    uint32_t tag;
+    /// The format version of the section contents
+    uint32_t version;
+    /// Bitwise or of the FRAMED_* section flags
+    uint32_t flags;
+    /// The CRC32C of the stored (possibly compressed) bytes
+    uint32_t crc;
+    /// The number of bytes stored in the file
+    uint64_t stored_length;
+    /// The number of bytes after decompression
+    uint64_t length;
+
+    framed_section_header() :
+      tag(0), version(0), flags(0), crc(0), stored_length(0), length(0) { }
+  };
+
+  /// The section is zlib compressed
+  const uint32_t FRAMED_COMPRESSED = 1;
+
+  /// "GLFA" followed by the container version
+  const uint32_t FRAMED_MAGIC = 0x41464c47;
+  const uint32_t FRAMED_FORMAT_VERSION = 1;
+
+
+  /// Sections are checksummed and buffered in chunks of this many bytes
+  const size_t FRAMED_CHUNK_SIZE = 1 << 20;
+
+  namespace framed_impl {
+
+    /**
+     * \internal
+     * Returns true if the stream supports seeking.  Streams over
+     * devices which cannot seek report it with an exception.
+     */
+    inline bool stream_seekable(std::ios& strm, std::ios_base::openmode which) {
+      if (strm.fail()) return false;
+      bool seekable = false;
+      try {
+        std::streampos pos = strm.rdbuf()->pubseekoff(0, std::ios_base::cur, which);
+        seekable = pos != std::streampos(-1);
+      } catch (std::exception&) { }
+      return seekable;
+    }
+
+    /**
+     * \internal
+     * Output filter counting the uncompressed length of a section.
+     */
+    struct length_filter : public boost::iostreams::multichar_output_filter {
+      uint64_t* length;
+      length_filter(uint64_t* length) : length(length) { }
+      template <typename Sink>
+      std::streamsize write(Sink& snk, const char* s, std::streamsize n) {
+        std::streamsize ret = boost::iostreams::write(snk, s, n);
+        *length += ret;
+        return ret;
+      }
+    };
+
+    /**
+     * \internal
+     * Sink writing the stored bytes of a section to a stream while
+     * accumulating their checksum and length in the section header.
+     */
+    struct crc_sink : public boost::iostreams::sink {
+      std::ostream* out;
+      framed_section_header* header;
+      crc_sink(std::ostream* out, framed_section_header* header) :
+        out(out), header(header) { }
+      std::streamsize write(const char* s, std::streamsize n) {
+        out->write(s, n);
+        header->crc = crc32c(s, n, header->crc);
+        header->stored_length += n;
+        return n;
+      }
+    };
+
+    /**
+     * \internal
+     * Source reading at most remaining bytes from a stream so that a
+     * decompressor never reads past the end of its section.
+     */
+    struct bounded_source : public boost::iostreams::source {
+      std::istream* in;
+      uint64_t remaining;
+      bounded_source(std::istream* in, uint64_t remaining) :
+        in(in), remaining(remaining) { }
+      std::streamsize read(char* s, std::streamsize n) {
+        if (remaining == 0) return -1;
+        if (uint64_t(n) > remaining) n = std::streamsize(remaining);
+        in->read(s, n);
+        std::streamsize got = in->gcount();
+        remaining -= got;
+        return got > 0 ? got : -1;
+      }
+    };
+
+  } // namespace framed_impl
+
+
+  /**
+   * \ingroup group_serialization
+   * \brief Writes a framed binary container: a sequence of tagged,
+   * versioned and checksummed sections each of which may be
+   * compressed independently.
+   *
+   * \code
+   * std::ofstream fout("checkpoint.bin", std::ios_base::binary);
+   * graphlab::framed_oarchive farc(fout);
+   * farc.begin_section(graphlab::framed_tag('D','A','T','A'), 1) << values;
+   * farc.end_section();
+   * farc.close();
+   * \endcode
+   *
+   * On a seekable stream a section is written through the compressor
+   * as it is serialized, its checksum and lengths being accumulated
+   * on the way, and its header is filled in by end_section().  On
+   * other streams (HDFS for instance) the section is serialized into
+   * memory first so its header can be written ahead of it.  Either
+   * way a framed_iarchive can then verify a section, or skip it
+   * without deserializing it.
+   */
+  class framed_oarchive {
+    std::ostream* out;
+    bool seekable;
+    boost::iostreams::filtering_ostream zout;
+    oarchive streamed;
+    oarchive buffered;
+    framed_section_header header;
+    std::streampos header_pos;
+    bool in_section;
+
+    framed_oarchive(const framed_oarchive&);
+    framed_oarchive& operator=(const framed_oarchive&);
+
+  public:
+    framed_oarchive(std::ostream& out) :
+      out(&out), seekable(false), streamed(zout), in_section(false) {
+      seekable = framed_impl::stream_seekable(out, std::ios_base::out);
+      out.write(reinterpret_cast<const char*>(&FRAMED_MAGIC), sizeof(uint32_t));
+      out.write(reinterpret_cast<const char*>(&FRAMED_FORMAT_VERSION),
+                sizeof(uint32_t));
+    }
+
+    ~framed_oarchive() {
+      if (buffered.buf != NULL) free(buffered.buf);
+    }
+
+    /**
+     * Begins a new section returning the archive into which its
+     * contents are to be serialized.  The section is completed by
+     * end_section().
+     */
+    oarchive& begin_section(uint32_t tag, uint32_t version,
+                            bool compress = false) {
+      ASSERT_FALSE(in_section);
+      ASSERT_NE(tag, 0);
+      header = framed_section_header();
+      header.tag = tag;
+      header.version = version;
+      header.flags = compress ? FRAMED_COMPRESSED : 0;
+      in_section = true;
+      if (!seekable) {
+        buffered.off = 0;
+        return buffered;
+      }
+      // write a placeholder header which end_section() overwrites
+      header_pos = out->tellp();
+      out->write(reinterpret_cast<const char*>(&header), sizeof(header));
+      zout.push(framed_impl::length_filter(&header.length));
+      if (compress) zout.push(boost::iostreams::zlib_compressor());
+      zout.push(framed_impl::crc_sink(out, &header));
+      return streamed;
+    }
+
+    /// Completes the current section and writes its header
+    void end_section() {
+      ASSERT_TRUE(in_section);
+      in_section = false;
+      if (seekable) {
+        // flushes the compressor and the remaining bytes
+        zout.reset();
+        std::streampos end = out->tellp();
+        out->seekp(header_pos);
+        out->write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out->seekp(end);
+        return;
+      }
+      header.length = buffered.off;
+      const char* data = buffered.buf;
+      std::string compressed;
+      if (header.flags & FRAMED_COMPRESSED) {
+        boost::iostreams::filtering_ostream zbuf;
+        zbuf.push(boost::iostreams::zlib_compressor());
+        zbuf.push(boost::iostreams::back_inserter(compressed));
+        zbuf.write(buffered.buf, buffered.off);
+        zbuf.reset();
+        data = compressed.data();
+        header.stored_length = compressed.length();
+      } else {
+        header.stored_length = buffered.off;
+      }
+      header.crc = crc32c(data, header.stored_length);
+      out->write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out->write(data, header.stored_length);
+    }
+
+    /// Writes the end of archive marker
+    void close() {
+      ASSERT_FALSE(in_section);
+      framed_section_header end;
+      out->write(reinterpret_cast<const char*>(&end), sizeof(end));
+    }
+
+    /// Returns true if the underlying stream is in a failure state
+    bool fail() { return out->fail(); }
+  }; // end of framed_oarchive
+
+
+  /**
+   * \ingroup group_serialization
+   * \brief Reads a container written by framed_oarchive.
+   *
+   * \code
+   * graphlab::framed_iarchive farc(fin);
+   * graphlab::framed_section_header header;
+   * while (farc.next_section(header)) {
+   *   if (header.tag == graphlab::framed_tag('D','A','T','A')) {
+   *     if (!farc.read_section()) return false; // corrupt
+   *     farc.section_archive() >> values;
+   *   } else {
+   *     farc.skip_section();
+   *   }
+   * }
+   * \endcode
+   *
+   * Sections which are skipped are never read into memory: on
+   * seekable streams the reader seeks past them.  On seekable streams
+   * a section which is read is first checksummed in chunks of
+   * FRAMED_CHUNK_SIZE bytes and then deserialized (and decompressed)
+   * directly from the stream, and a section claiming to be longer
+   * than the rest of the stream is rejected before anything is
+   * allocated.  Other streams read the section into memory a chunk at
+   * a time.
+   */
+  class framed_iarchive {
+    std::istream* in;
+    bool seekable;
+    bool valid;
+    bool pending;
+    bool streaming;
+    framed_section_header header;
+    std::streampos section_end;
+    std::string payload;
+    std::vector<char> chunk;
+    boost::iostreams::filtering_istream zin;
+    iarchive section;
+
+    framed_iarchive(const framed_iarchive&);
+    framed_iarchive& operator=(const framed_iarchive&);
+
+    /// The number of bytes left in a seekable stream
+    uint64_t bytes_remaining() {
+      std::streampos pos = in->tellg();
+      in->seekg(0, std::ios_base::end);
+      std::streampos end = in->tellg();
+      in->seekg(pos);
+      return end > pos ? uint64_t(end - pos) : 0;
+    }
+
+    /// Checksums the stored bytes of the current section chunk by chunk
+    bool verify_section() {
+      uint32_t crc = 0;
+      uint64_t left = header.stored_length;
+      chunk.resize(std::min<uint64_t>(left, FRAMED_CHUNK_SIZE));
+      while (left > 0) {
+        size_t n = std::min<uint64_t>(left, FRAMED_CHUNK_SIZE);
+        in->read(&(chunk[0]), n);
+        if (in->fail()) {
+          logstream(LOG_ERROR) << "Framed archive section is truncated"
+                               << std::endl;
+          return false;
+        }
+        crc = crc32c(&(chunk[0]), n, crc);
+        left -= n;
+      }
+      if (crc != header.crc) {
+        logstream(LOG_ERROR) << "Framed archive section checksum mismatch"
+                             << std::endl;
+        return false;
+      }
+      return true;
+    }
+
+    /// Leaves a section deserialized from the stream
+    void finish_section() {
+      if (!streaming) return;
+      streaming = false;
+      section = iarchive(NULL, 0);
+      zin.reset();
+      in->clear();
+      in->seekg(section_end);
+    }
+
+    /// Reads the current section into memory on streams which cannot seek
+    bool read_buffered() {
+      payload.clear();
+      while (payload.length() < header.stored_length) {
+        size_t old = payload.length();
+        size_t n = std::min<uint64_t>(header.stored_length - old,
+                                      FRAMED_CHUNK_SIZE);
+        payload.resize(old + n);
+        in->read(&(payload[old]), n);
+        if (in->fail()) {
+          logstream(LOG_ERROR) << "Framed archive section is truncated"
+                               << std::endl;
+          return false;
+        }
+      }
+      if (crc32c(payload.data(), payload.length()) != header.crc) {
+        logstream(LOG_ERROR) << "Framed archive section checksum mismatch"
+                             << std::endl;
+        return false;
+      }
+      if (header.flags & FRAMED_COMPRESSED) {
+        std::string raw;
+        boost::iostreams::filtering_istream zbuf;
+        zbuf.push(boost::iostreams::zlib_decompressor());
+        zbuf.push(boost::iostreams::array_source(payload.data(), payload.length()));
+        boost::iostreams::copy(zbuf, boost::iostreams::back_inserter(raw));
+        payload.swap(raw);
+      }
+      if (payload.length() != header.length) {
+        logstream(LOG_ERROR) << "Framed archive section has the wrong length"
+                             << std::endl;
+        return false;
+      }
+      section = iarchive(payload.data(), payload.length());
+      return true;
+    }
+
+  public:
+    /**
+     * Reads the container header. good() returns false if the stream
+     * does not contain a framed archive, in which case the leading
+     * bytes of the stream have been consumed.
+     */
+    framed_iarchive(std::istream& in) :
+      in(&in), seekable(false), valid(false), pending(false),
+      streaming(false), section(NULL, 0) {
+      seekable = framed_impl::stream_seekable(in, std::ios_base::in);
+      uint32_t magic = 0, version = 0;
+      in.read(reinterpret_cast<char*>(&magic), sizeof(uint32_t));
+      in.read(reinterpret_cast<char*>(&version), sizeof(uint32_t));
+      if (!in.fail() && magic == FRAMED_MAGIC) {
+        if (version > FRAMED_FORMAT_VERSION) {
+          logstream(LOG_ERROR) << "Framed archive version " << version
+                               << " is newer than the supported version "
+                               << FRAMED_FORMAT_VERSION << std::endl;
+        } else {
+          valid = true;
+        }
+      }
+    }
+
+    /// Returns true if the stream holds a readable framed archive
+    bool good() const { return valid; }
+
+    /**
+     * Reads the header of the next section, skipping the current one
+     * if it has not been read. Returns false at the end of the archive.
+     */
+    bool next_section(framed_section_header& hdr) {
+      if (!valid) return false;
+      if (pending) skip_section();
+      finish_section();
+      in->read(reinterpret_cast<char*>(&header), sizeof(header));
+      if (in->fail() || header.tag == 0) return false;
+      pending = true;
+      hdr = header;
+      return true;
+    }
+
+    /// Skips over the contents of the current section
+    void skip_section() {
+      if (!pending) return;
+      pending = false;
+      if (seekable) {
+        in->seekg(header.stored_length, std::ios_base::cur);
+      } else {
+        in->ignore(header.stored_length);
+      }
+    }
+
+    /**
+     * Reads and verifies the current section.  Returns false if the
+     * section is truncated, its checksum does not match or its length
+     * is inconsistent.  On success section_archive() reads its
+     * contents, decompressing them if needed.
+     */
+    bool read_section() {
+      ASSERT_TRUE(pending);
+      pending = false;
+      if (!seekable) return read_buffered();
+      if (header.stored_length > bytes_remaining()) {
+        logstream(LOG_ERROR) << "Framed archive section is truncated" << std::endl;
+        return false;
+      }
+      if (!(header.flags & FRAMED_COMPRESSED) &&
+          header.length != header.stored_length) {
+        logstream(LOG_ERROR) << "Framed archive section has the wrong length"
+                             << std::endl;
+        return false;
+      }
+      std::streampos begin = in->tellg();
+      if (!verify_section()) return false;
+      in->seekg(begin);
+      section_end = begin + std::streamoff(header.stored_length);
+      if (header.flags & FRAMED_COMPRESSED) {
+        zin.push(boost::iostreams::zlib_decompressor());
+      }
+      zin.push(framed_impl::bounded_source(in, header.stored_length));
+      section = iarchive(zin);
+      streaming = true;
+      return true;
+    }
+
+    /// The archive reading the contents of the last read section
+    iarchive& section_archive() { return section; }
+  }; // end of framed_iarchive
+
+} // namespace graphlab
+
+#endif
@@ -31,6 +31,7 @@
 #define GRAPHLAB_IARCHIVE_HPP
 
 #include <iostream>
+#include <algorithm>
 #include <graphlab/logger/assertions.hpp>
 #include <graphlab/serialization/is_pod.hpp>
 #include <graphlab/serialization/has_load.hpp>
@@ -106,6 +107,30 @@ namespace graphlab {
       }
     }
 
+    /**
+     *  Returns a pointer to the next "l" bytes of the underlying
+     *  buffer and skips over them without copying. Returns NULL
+     *  (and reads nothing) if the archive reads from a stream.
+     *  The returned pointer is only valid while the buffer is.
+     *  Fails if fewer than "l" bytes remain in the buffer.
+     */
+    inline const char* borrow(size_t l) {
+      if (buf == NULL) return NULL;
+      ASSERT_LE(l, len - std::min(off, len));
+      const char* ret = buf + off;
+      off += l;
+      return ret;
+    }
+
+    /**
+     *  Skips the padding written by oarchive::align()
+     */
+    inline void align() {
+      unsigned char pad = read_char();
+      if (buf) off += pad;
+      else in->ignore(pad);
+    }
+
 
     /// Returns true if the underlying stream is in a failure state
     inline bool fail() {
@@ -155,6 +180,21 @@ namespace graphlab {
       iarc->read(c, len);
     }
 
+    /**
+     *  Returns a pointer to the next "len" bytes of the underlying
+     *  buffer without copying. See iarchive::borrow()
+     */
+    inline const char* borrow(size_t len) {
+      return iarc->borrow(len);
+    }
+
+    /**
+     *  Skips the padding written by oarchive::align()
+     */
+    inline void align() {
+      iarc->align();
+    }
+
     /// Returns true if the underlying stream is in a failure state
     inline bool fail() {
       return iarc->fail();
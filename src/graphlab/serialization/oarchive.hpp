@@ -135,6 +135,26 @@ namespace graphlab {
       }
     }
 
+    /**
+     * Pads the archive so that the next byte written is at an offset
+     * from the start of the buffer which is a multiple of alignment
+     * (at most 128). A one byte padding length is written first so
+     * that iarchive::align() can skip the padding. The data is only
+     * aligned in memory if the reader's buffer starts at the same
+     * alignment as this one. Streams are not padded.
+     */
+    inline void align(size_t alignment) {
+      ASSERT_LE(alignment, 128);
+      const unsigned char pad =
+        out == NULL ? (alignment - (off + 1) % alignment) % alignment : 0;
+      direct_assign(pad);
+      if (out == NULL) {
+        expand_buf(pad);
+        memset(buf + off, 0, pad);
+        off += pad;
+      }
+    }
+
     /// Returns true if the underlying stream is in a failure state
     inline bool fail() {
       return out == NULL ? false : out->fail();
@@ -0,0 +1,174 @@
+/**  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#ifndef GRAPHLAB_SERIALIZE_POD_ARRAY_VIEW_HPP
+#define GRAPHLAB_SERIALIZE_POD_ARRAY_VIEW_HPP
+
+#include <vector>
+#include <cstring>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <graphlab/serialization/iarchive.hpp>
+#include <graphlab/serialization/oarchive.hpp>
+#include <graphlab/serialization/vector.hpp>
+
+namespace graphlab {
+
+  /**
+   * \ingroup group_serialization
+   * \brief A read-only view of a contiguous array of POD values which
+   * deserializes without copying where possible.
+   *
+   * The values are written after padding (see oarchive::align()) which
+   * aligns them relative to the start of the output buffer, so the
+   * format differs from that of a std::vector<T> and both sides must use
+   * a view.  When loaded from an iarchive reading from a buffer (as is
+   * the case for the arguments of an RPC call) and the array is aligned
+   * in memory, the view points directly into the buffer.  This is the
+   * case when the input buffer starts at the same alignment as the
+   * output buffer, for instance when both are allocated with malloc.
+   * Otherwise the values are copied into storage owned by the view.
+   *
+   * \code
+   * // The sender views its vector
+   * rmi.remote_call(1, &my_class::receive_values,
+   *                 graphlab::pod_array_view<double>(values));
+   * ...
+   * // and the receiver reads it in place
+   * void receive_values(const graphlab::pod_array_view<double>& values) {
+   *   for (size_t i = 0; i < values.size(); ++i) total += values[i];
+   * }
+   * \endcode
+   *
+   * \warning A view which does not own its data is only valid while
+   * the buffer it was loaded from is. For an RPC argument this is the
+   * duration of the call.  Use owns_data() to check and to_vector() to
+   * keep a copy.
+   */
+  template <typename T>
+  class pod_array_view {
+    BOOST_STATIC_ASSERT(gl_is_pod_or_scaler<T>::value);
+    const T* ptr;
+    size_t len;
+    std::vector<T> storage;
+
+    void own() {
+      ptr = storage.empty() ? NULL : &(storage[0]);
+      len = storage.size();
+    }
+
+  public:
+    typedef T value_type;
+    typedef const T* const_iterator;
+
+    /// Constructs an empty view
+    pod_array_view() : ptr(NULL), len(0) { }
+
+    /// Views the contents of vec which must outlive the view
+    pod_array_view(const std::vector<T>& vec)
+      : ptr(vec.empty() ? NULL : &(vec[0])), len(vec.size()) { }
+
+    /// Views len values starting at ptr which must outlive the view
+    pod_array_view(const T* ptr, size_t len) : ptr(ptr), len(len) { }
+
+    pod_array_view(const pod_array_view& other)
+      : ptr(other.ptr), len(other.len), storage(other.storage) {
+      if (other.owns_data()) own();
+    }
+
+    pod_array_view& operator=(const pod_array_view& other) {
+      if (this != &other) {
+        storage = other.storage;
+        if (other.owns_data()) own();
+        else { ptr = other.ptr; len = other.len; }
+      }
+      return *this;
+    }
+
+    /// Returns a pointer to the first value
+    const T* data() const { return ptr; }
+    /// Returns the number of values
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const_iterator begin() const { return ptr; }
+    const_iterator end() const { return ptr + len; }
+
+    /// Returns true if the values are stored in the view itself
+    bool owns_data() const { return !storage.empty(); }
+
+    /// Returns a copy of the values
+    std::vector<T> to_vector() const {
+      return std::vector<T>(begin(), end());
+    }
+
+    /**
+     * Replaces the contents of vec with the values, copying them only
+     * if the view does not own them. The view is empty afterwards.
+     */
+    void move_to(std::vector<T>& vec) {
+      if (owns_data()) vec.swap(storage);
+      else vec.assign(begin(), end());
+      storage.clear();
+      own();
+    }
+
+    void save(oarchive& oarc) const {
+      oarc << len;
+      oarc.align(boost::alignment_of<T>::value);
+      serialize(oarc, ptr, sizeof(T) * len);
+    }
+
+    void load(iarchive& iarc) {
+      size_t n;
+      iarc >> n;
+      iarc.align();
+      load_values(iarc, n);
+    }
+
+    /**
+     * Reads n values written back to back, without the length and the
+     * padding written by save(). The values are viewed in place under the
+     * same conditions as for load().
+     */
+    void load_values(iarchive& iarc, size_t n) {
+      storage.clear();
+      const char* src = iarc.borrow(sizeof(T) * n);
+      if (src != NULL &&
+          reinterpret_cast<size_t>(src) % boost::alignment_of<T>::value == 0) {
+        ptr = reinterpret_cast<const T*>(src);
+        len = n;
+        return;
+      }
+      storage.resize(n);
+      if (n > 0) {
+        if (src != NULL) memcpy(&(storage[0]), src, sizeof(T) * n);
+        else deserialize(iarc, &(storage[0]), sizeof(T) * n);
+      }
+      own();
+    }
+  }; // end of pod_array_view
+
+} // namespace graphlab
+
+#endif
@@ -30,6 +30,7 @@
 #include <graphlab/serialization/list.hpp>
 #include <graphlab/serialization/set.hpp>
 #include <graphlab/serialization/vector.hpp>
+#include <graphlab/serialization/pod_array_view.hpp>
 #include <graphlab/serialization/map.hpp>
 #include <graphlab/serialization/unordered_map.hpp>
 #include <graphlab/serialization/unordered_set.hpp>
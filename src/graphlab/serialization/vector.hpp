@@ -24,6 +24,8 @@
 #ifndef GRAPHLAB_SERIALIZE_VECTOR_HPP
 #define GRAPHLAB_SERIALIZE_VECTOR_HPP
 #include <vector>
+#include <cstring>
+#include <boost/type_traits/alignment_of.hpp>
 #include <graphlab/serialization/iarchive.hpp>
 #include <graphlab/serialization/oarchive.hpp>
 #include <graphlab/serialization/iterator.hpp>
@@ -93,8 +95,21 @@ namespace graphlab {
       static void exec(InArcType& iarc, std::vector<ValueType>& vec){
         size_t len;
         iarc >> len;
+        // When reading from a buffer copy straight out of it rather
+        // than zero filling the vector and then copying over it.
+        const char* src = iarc.borrow(sizeof(ValueType) * len);
+        if (src != NULL &&
+            reinterpret_cast<size_t>(src) % 
+            boost::alignment_of<ValueType>::value == 0) {
+          const ValueType* begin = reinterpret_cast<const ValueType*>(src);
+          vec.assign(begin, begin + len);
+          return;
+        }
         vec.clear(); vec.resize(len);
-        deserialize(iarc, &(vec[0]), sizeof(ValueType)*vec.size());
+        if (src != NULL) {
+          if (len > 0) memcpy(&(vec[0]), src, sizeof(ValueType) * len);
+        }
+        else deserialize(iarc, &(vec[0]), sizeof(ValueType)*vec.size());
       }
     };
 
@@ -0,0 +1,97 @@
+/*  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+
+#ifndef GRAPHLAB_CRC32C_HPP
+#define GRAPHLAB_CRC32C_HPP
+#include <cstring>
+#include <stdint.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+namespace graphlab {
+namespace crc32c_impl {
+
+/**
+ * \internal
+ * Byte-at-a-time lookup table for the CRC32C (Castagnoli) polynomial
+ * (reflected 0x82F63B78) used when SSE4.2 is not available.
+ */
+struct crc32c_table {
+  uint32_t table[256];
+  crc32c_table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (size_t j = 0; j < 8; ++j) {
+        crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+      }
+      table[i] = crc;
+    }
+  }
+};
+
+inline const uint32_t* get_crc32c_table() {
+  static crc32c_table t;
+  return t.table;
+}
+
+} // namespace crc32c_impl
+
+/**
+ * \ingroup util
+ * Computes the CRC32C (Castagnoli) checksum of len bytes at data.
+ * A checksum may be computed incrementally by passing the checksum of
+ * the preceding bytes as crc.  When compiled with SSE4.2 support (as
+ * with -march=native on any recent x86 processor) the hardware crc32
+ * instruction is used, processing 8 bytes per instruction.
+ */
+inline uint32_t crc32c(const void* data, size_t len, uint32_t crc = 0) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  crc = ~crc;
+#ifdef __SSE4_2__
+#ifdef __x86_64__
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t word;
+    memcpy(&word, p, 8);
+    crc64 = _mm_crc32_u64(crc64, word);
+    p += 8; len -= 8;
+  }
+  crc = (uint32_t)crc64;
+#endif
+  while (len > 0) {
+    crc = _mm_crc32_u8(crc, *p);
+    ++p; --len;
+  }
+#else
+  const uint32_t* table = crc32c_impl::get_crc32c_table();
+  while (len > 0) {
+    crc = table[(crc ^ *p) & 0xff] ^ (crc >> 8);
+    ++p; --len;
+  }
+#endif
+  return ~crc;
+}
+
+} // namespace graphlab
+#endif
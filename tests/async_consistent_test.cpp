@@ -158,6 +158,64 @@ void test_all_neighbors(graphlab::distributed_control& dc,
 
 
 
+/**
+ * Every vertex runs five times and increments all its edges in the
+ * scatter, sleeping between the read and the write. It gathers nothing,
+ * so only a consistency model which covers the scatter edges keeps two
+ * adjacent scatters from losing an increment.
+ */
+class increment_edges :
+  public graphlab::ivertex_program<graph_type, int>,
+  public graphlab::IS_POD_TYPE {
+public:
+  edge_dir_type
+  gather_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::NO_EDGES;
+  }
+  void apply(icontext_type& context, vertex_type& vertex,
+             const gather_type& total) {
+    ++vertex.data();
+    if (vertex.data() < 5) context.signal(vertex);
+  }
+  edge_dir_type
+  scatter_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::ALL_EDGES;
+  }
+  void scatter(icontext_type& context, const vertex_type& vertex,
+               edge_type& edge) const {
+    const int value = edge.data();
+    graphlab::timer::sleep_ms(1);
+    edge.data() = value + 1;
+  }
+}; // end of increment edges
+
+void set_to_zero(graph_type::vertex_type vtx) { vtx.data() = 0; }
+void set_to_zero_edge(graph_type::edge_type e) { e.data() = 0; }
+
+size_t count_lost_increments(graph_type::edge_type e) {
+  return e.data() != e.source().data() + e.target().data();
+}
+
+void test_optimistic(graphlab::distributed_control& dc,
+                     graph_type& graph) {
+  std::cout << "Constructing an optimistic engine" << std::endl;
+  graphlab::command_line_options clopts("Test code.");
+  clopts.set_scheduler_type("queued_fifo");
+  clopts.engine_args.set_option("optimistic", true);
+  typedef graphlab::async_consistent_engine<increment_edges> engine_type;
+  engine_type engine(dc, graph, clopts);
+  graph.transform_vertices(set_to_zero);
+  graph.transform_edges(set_to_zero_edge);
+  engine.signal_all();
+  std::cout << "Running!" << std::endl;
+  engine.start();
+  std::cout << "Finished" << std::endl;
+  ASSERT_EQ(graph.map_reduce_edges<size_t>(count_lost_increments), 0);
+}
+
+
+
+
 // Make a slow version so that the asynchronous aggregators get a change
 // to run. Basically, sleep a bit on apply.
 class count_all_neighbors_slow :
@@ -329,6 +387,7 @@ int main(int argc, char** argv) {
   test_out_neighbors(dc, clopts, graph);
   test_all_neighbors(dc, clopts, graph);
   test_aggregator(dc, clopts, graph);
+  test_optimistic(dc, graph);
   graphlab::mpi_tools::finalize();
 } // end of main
 
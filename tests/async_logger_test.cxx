@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <cxxtest/TestSuite.h>
+
+#include <graphlab/logger/logger.hpp>
+
+const size_t NTHREADS = 8;
+const size_t NLINES = 2000;
+
+struct log_job {
+  file_logger* logger;
+  size_t thread;
+};
+
+/// Logs NLINES numbered lines
+void* log_lines(void* arg) {
+  log_job* job = reinterpret_cast<log_job*>(arg);
+  for (size_t i = 0; i < NLINES; ++i) {
+    job->logger->start_stream(LOG_INFO, __FILE__, __FUNCTION__, __LINE__)
+      << "thread " << job->thread << " line " << i << std::endl;
+  }
+  return NULL;
+}
+
+/// Logs from NTHREADS threads and from the calling thread
+void log_from_threads(file_logger& logger) {
+  std::vector<pthread_t> threads(NTHREADS);
+  std::vector<log_job> jobs(NTHREADS + 1);
+  for (size_t t = 0; t < NTHREADS; ++t) {
+    jobs[t].logger = &logger;
+    jobs[t].thread = t;
+    pthread_create(&threads[t], NULL, log_lines, &jobs[t]);
+  }
+  // the calling thread keeps its ring until the logger is destroyed
+  jobs[NTHREADS].logger = &logger;
+  jobs[NTHREADS].thread = NTHREADS;
+  log_lines(&jobs[NTHREADS]);
+  for (size_t t = 0; t < NTHREADS; ++t) pthread_join(threads[t], NULL);
+}
+
+/**
+ * Returns true if the file holds every line of every thread with the
+ * lines of each thread in order.
+ */
+bool check_log(const std::string& fname) {
+  std::ifstream fin(fname.c_str());
+  std::vector<size_t> next(NTHREADS + 1, 0);
+  std::string line;
+  while (std::getline(fin, line)) {
+    size_t pos = line.find("thread ");
+    if (pos == std::string::npos) continue;
+    std::stringstream strm(line.substr(pos));
+    std::string word;
+    size_t thread = 0, i = 0;
+    strm >> word >> thread >> word >> i;
+    if (thread > NTHREADS || i != next[thread]) return false;
+    ++next[thread];
+  }
+  for (size_t t = 0; t <= NTHREADS; ++t) {
+    if (next[t] != NLINES) return false;
+  }
+  return true;
+}
+
+
+class AsyncLoggerTestSuite : public CxxTest::TestSuite {
+public:
+  std::string temp_file(const char* name) {
+    std::stringstream strm;
+    strm << "async_logger_" << name << "_" << getpid() << ".log";
+    return strm.str();
+  }
+
+  void test_ordering(void) {
+    std::string fname = temp_file("order");
+    file_logger logger;
+    logger.set_log_file(fname);
+    logger.set_log_to_console(false);
+    logger.set_log_level(LOG_INFO);
+    // a small ring which the threads fill up and wrap around
+    logger.set_async(true, 4096, true);
+    log_from_threads(logger);
+    logger.flush();
+    TS_ASSERT_EQUALS(logger.get_dropped_messages(), size_t(0));
+    TS_ASSERT(check_log(fname));
+    logger.set_async(false);
+    remove(fname.c_str());
+  }
+
+  void test_flush_on_exit(void) {
+    std::string fname = temp_file("exit");
+    pid_t pid = fork();
+    if (pid == 0) {
+      // exit without flushing: destroying the global logger writes
+      // out the lines buffered in the rings
+      global_logger().set_log_file(fname);
+      global_logger().set_log_to_console(false);
+      global_logger().set_log_level(LOG_INFO);
+      global_logger().set_async(true, 1 << 16, true);
+      log_from_threads(global_logger());
+      exit(0);
+    }
+    int status = -1;
+    waitpid(pid, &status, 0);
+    TS_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    TS_ASSERT(check_log(fname));
+    remove(fname.c_str());
+  }
+};
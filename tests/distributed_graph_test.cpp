@@ -245,6 +245,20 @@ class distributed_graph_test  {
                ASSERT_TRUE(g.l_out_edges(i)[j].data() == g2.l_out_edges(i)[j].data());
              }
            }
+
+           // load the structure and the data separately
+           Graph g3(*dc);
+           ASSERT_TRUE(g3.load_binary(prefix.string(), Graph::BINARY_STRUCTURE));
+           ASSERT_EQ(g.num_edges(), g3.num_edges());
+           ASSERT_TRUE(g3.load_binary(prefix.string(),
+                                      Graph::BINARY_VERTEX_DATA |
+                                      Graph::BINARY_EDGE_DATA));
+           for (size_t i = 0; i < g.num_local_vertices(); ++i) {
+             ASSERT_TRUE(g.l_vertex(i).data() == g3.l_vertex(i).data());
+             for (size_t j = 0; j < g.l_in_edges(i).size(); ++j) {
+               ASSERT_TRUE(g.l_in_edges(i)[j].data() == g3.l_in_edges(i)[j].data());
+             }
+           }
            dc->cout() << "Remove path: " << ph.string()<< std::endl;
            remove_all(ph);
          } else {
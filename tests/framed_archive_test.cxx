@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstring>
+
+#include <cxxtest/TestSuite.h>
+
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+
+#include <graphlab/serialization/framed_archive.hpp>
+#include <graphlab/util/crc32c.hpp>
+
+
+using namespace graphlab;
+
+/// A source which cannot seek, like an HDFS stream
+struct unseekable_source : public boost::iostreams::source {
+  const std::string* data;
+  size_t pos;
+  unseekable_source(const std::string* data) : data(data), pos(0) { }
+  std::streamsize read(char* s, std::streamsize n) {
+    if (pos == data->length()) return -1;
+    n = std::min<size_t>(n, data->length() - pos);
+    memcpy(s, data->data() + pos, n);
+    pos += n;
+    return n;
+  }
+};
+
+typedef boost::iostreams::stream<unseekable_source> unseekable_istream;
+typedef boost::iostreams::stream<
+  boost::iostreams::back_insert_device<std::string> > unseekable_ostream;
+
+
+class FramedArchiveTestSuite : public CxxTest::TestSuite {
+public:
+  std::vector<size_t> values;
+  std::string text;
+
+  FramedArchiveTestSuite() : text("framed") {
+    for (size_t i = 0; i < 100000; ++i) values.push_back(i * i);
+  }
+
+  /// Writes a META section, a compressed DATA section and a TEXT section
+  void write_archive(std::ostream& out) {
+    framed_oarchive farc(out);
+    farc.begin_section(framed_tag('M','E','T','A'), 1) << values.size();
+    farc.end_section();
+    farc.begin_section(framed_tag('D','A','T','A'), 2, true) << values;
+    farc.end_section();
+    farc.begin_section(framed_tag('T','E','X','T'), 1) << text;
+    farc.end_section();
+    farc.close();
+    TS_ASSERT(!farc.fail());
+  }
+
+  /// Reads every section back checking the contents
+  void check_archive(std::istream& in) {
+    framed_iarchive farc(in);
+    TS_ASSERT(farc.good());
+    framed_section_header header;
+    size_t nvalues = 0;
+    std::vector<size_t> rvalues;
+    std::string rtext;
+    TS_ASSERT(farc.next_section(header));
+    TS_ASSERT_EQUALS(header.tag, framed_tag('M','E','T','A'));
+    TS_ASSERT(farc.read_section());
+    farc.section_archive() >> nvalues;
+    TS_ASSERT(farc.next_section(header));
+    TS_ASSERT_EQUALS(header.tag, framed_tag('D','A','T','A'));
+    TS_ASSERT_EQUALS(header.version, uint32_t(2));
+    TS_ASSERT(header.flags & FRAMED_COMPRESSED);
+    TS_ASSERT(header.stored_length < header.length);
+    TS_ASSERT(farc.read_section());
+    farc.section_archive() >> rvalues;
+    TS_ASSERT(farc.next_section(header));
+    TS_ASSERT_EQUALS(header.tag, framed_tag('T','E','X','T'));
+    TS_ASSERT(farc.read_section());
+    farc.section_archive() >> rtext;
+    TS_ASSERT(!farc.next_section(header));
+    TS_ASSERT_EQUALS(nvalues, values.size());
+    TS_ASSERT(rvalues == values);
+    TS_ASSERT_EQUALS(rtext, text);
+  }
+
+  void test_crc32c(void) {
+    // the CRC-32C check value
+    const char* check = "123456789";
+    TS_ASSERT_EQUALS(crc32c(check, 9), uint32_t(0xe3069283));
+    TS_ASSERT_EQUALS(crc32c(check + 4, 5, crc32c(check, 4)), crc32c(check, 9));
+    TS_ASSERT_EQUALS(crc32c(check, 0), uint32_t(0));
+  }
+
+  void test_round_trip(void) {
+    std::stringstream strm;
+    write_archive(strm);
+    check_archive(strm);
+  }
+
+  void test_round_trip_unseekable(void) {
+    std::string data;
+    {
+      unseekable_ostream out(data);
+      write_archive(out);
+    }
+    // both writers produce the same container
+    std::stringstream strm;
+    write_archive(strm);
+    TS_ASSERT(strm.str() == data);
+    unseekable_istream in(&data);
+    check_archive(in);
+  }
+
+  void test_partial_sections(void) {
+    std::stringstream strm;
+    write_archive(strm);
+    std::string data = strm.str();
+    for (size_t seekable = 0; seekable < 2; ++seekable) {
+      std::stringstream sin(data);
+      unseekable_istream uin(&data);
+      framed_iarchive farc(seekable ? static_cast<std::istream&>(sin) : uin);
+      framed_section_header header;
+      std::vector<uint32_t> tags;
+      std::string rtext;
+      // skip DATA explicitly, leave META unread
+      while (farc.next_section(header)) {
+        tags.push_back(header.tag);
+        if (header.tag == framed_tag('D','A','T','A')) {
+          farc.skip_section();
+        } else if (header.tag == framed_tag('T','E','X','T')) {
+          TS_ASSERT(farc.read_section());
+          farc.section_archive() >> rtext;
+        }
+      }
+      TS_ASSERT_EQUALS(tags.size(), size_t(3));
+      TS_ASSERT_EQUALS(rtext, text);
+    }
+    // a section which is only partially deserialized does not
+    // disturb the following one
+    std::stringstream sin(data);
+    framed_iarchive farc(sin);
+    framed_section_header header;
+    size_t first = 1;
+    std::string rtext;
+    while (farc.next_section(header)) {
+      if (header.tag == framed_tag('D','A','T','A')) {
+        TS_ASSERT(farc.read_section());
+        size_t len;
+        farc.section_archive() >> len >> first;
+      } else if (header.tag == framed_tag('T','E','X','T')) {
+        TS_ASSERT(farc.read_section());
+        farc.section_archive() >> rtext;
+      }
+    }
+    TS_ASSERT_EQUALS(first, size_t(0));
+    TS_ASSERT_EQUALS(rtext, text);
+  }
+
+  void test_checksum_mismatch(void) {
+    std::stringstream strm;
+    write_archive(strm);
+    std::string data = strm.str();
+    // flip a byte of the TEXT section contents
+    data[data.length() - sizeof(framed_section_header) - 2] ^= 0x10;
+    for (size_t seekable = 0; seekable < 2; ++seekable) {
+      std::stringstream sin(data);
+      unseekable_istream uin(&data);
+      framed_iarchive farc(seekable ? static_cast<std::istream&>(sin) : uin);
+      framed_section_header header;
+      bool text_ok = true;
+      while (farc.next_section(header)) {
+        if (header.tag == framed_tag('T','E','X','T')) {
+          text_ok = farc.read_section();
+        } else {
+          TS_ASSERT(farc.read_section());
+        }
+      }
+      TS_ASSERT(!text_ok);
+    }
+  }
+
+  void test_truncated(void) {
+    std::stringstream strm;
+    {
+      framed_oarchive farc(strm);
+      farc.begin_section(framed_tag('T','E','X','T'), 1) << text;
+      farc.end_section();
+      farc.close();
+    }
+    std::string data = strm.str();
+    // claim a length far beyond the end of the file: the reader must
+    // refuse it rather than allocate it
+    framed_section_header header;
+    memcpy(&header, data.data() + 2 * sizeof(uint32_t), sizeof(header));
+    header.stored_length = header.length = uint64_t(1) << 60;
+    memcpy(&(data[2 * sizeof(uint32_t)]), &header, sizeof(header));
+    for (size_t seekable = 0; seekable < 2; ++seekable) {
+      std::stringstream sin(data);
+      unseekable_istream uin(&data);
+      framed_iarchive farc(seekable ? static_cast<std::istream&>(sin) : uin);
+      TS_ASSERT(farc.next_section(header));
+      TS_ASSERT(!farc.read_section());
+    }
+  }
+
+  void test_legacy_gzip(void) {
+    // earlier binary graphs were a single gzip compressed archive
+    std::stringstream strm;
+    {
+      boost::iostreams::filtering_stream<boost::iostreams::output> fout;
+      fout.push(boost::iostreams::gzip_compressor());
+      fout.push(strm);
+      oarchive oarc(fout);
+      oarc << values;
+    }
+    framed_iarchive farc(strm);
+    TS_ASSERT(!farc.good());
+    framed_section_header header;
+    TS_ASSERT(!farc.next_section(header));
+    // the caller rewinds and reads the legacy format
+    strm.clear();
+    strm.seekg(0, std::ios_base::beg);
+    boost::iostreams::filtering_stream<boost::iostreams::input> fin;
+    fin.push(boost::iostreams::gzip_decompressor());
+    fin.push(strm);
+    iarchive iarc(fin);
+    std::vector<size_t> rvalues;
+    iarc >> rvalues;
+    TS_ASSERT(rvalues == values);
+  }
+};
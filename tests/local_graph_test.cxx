@@ -86,6 +86,37 @@ public:
     std::cout << "\n+ Pass test: graph dynamicly add edge. :) \n";
   }
 
+  void test_dynamic_remove_edge() {
+    typedef graphlab::dynamic_local_graph<vertex_data, edge_data> graph_type;
+    typedef graph_type::vertex_id_type vertex_id_type;
+    graph_type g;
+    const size_t nverts = 100;
+    for (size_t i = 0; i + 1 < nverts; ++i) g.add_edge(i, i + 1, edge_data(i, i + 1));
+    g.finalize();
+    ASSERT_EQ(g.num_edges(), nverts - 1);
+
+    // remove the even edges and add a back edge from every odd vertex.
+    boost::unordered_map<vertex_id_type, std::vector<vertex_id_type> > out_edges;
+    boost::unordered_map<vertex_id_type, std::vector<vertex_id_type> > in_edges;
+    size_t nedges = 0;
+    for (size_t i = 0; i + 1 < nverts; ++i) {
+      if (i % 2 == 0) {
+        g.remove_edge(i, i + 1);
+      } else {
+        out_edges[i].push_back(i + 1); in_edges[i + 1].push_back(i);
+        g.add_edge(i, i - 1, edge_data(i, i - 1));
+        out_edges[i].push_back(i - 1); in_edges[i - 1].push_back(i);
+        nedges += 2;
+      }
+    }
+    // removing an edge which does not exist is a no-op
+    g.remove_edge(0, 2);
+    g.finalize();
+    check_adjacency(g, in_edges, out_edges, nedges);
+    check_edge_data(g);
+    std::cout << "\n+ Pass test: dynamic graph remove edge. :) \n";
+  }
+
   void test_powerlaw_graph() {
     graphlab::local_graph<vertex_data, edge_data> g;
     graphlab::dynamic_local_graph<vertex_data, edge_data> g2;
@@ -164,6 +164,62 @@ public:
   }
 
 
+  void test_pod_array_view(void) {
+    std::vector<double> v;
+    for (int i = 0;i< 100; ++i) v.push_back(i * 0.5);
+    graphlab::pod_array_view<double> w;
+    // the array is padded so that it is aligned in the buffer and is
+    // viewed in place whatever precedes it
+    for (size_t prefix = 0;prefix < 8; ++prefix) {
+      oarchive a;
+      for (size_t i = 0;i < prefix; ++i) a << char(i);
+      a << graphlab::pod_array_view<double>(v) << char(42);
+      iarchive b(a.buf, a.off);
+      char ch;
+      for (size_t i = 0;i < prefix; ++i) b >> ch;
+      b >> w >> ch;
+      TS_ASSERT(!w.owns_data());
+      TS_ASSERT_EQUALS(reinterpret_cast<size_t>(w.data()) % sizeof(double), 0);
+      TS_ASSERT_EQUALS(w.size(), v.size());
+      for (size_t i = 0;i < v.size(); ++i) TS_ASSERT_EQUALS(v[i], w[i]);
+      TS_ASSERT_EQUALS(ch, 42);
+      TS_ASSERT_EQUALS(b.off, a.off);
+      // a copy of the view is still a view into the buffer
+      graphlab::pod_array_view<double> x = w;
+      TS_ASSERT_EQUALS(x.data(), w.data());
+      free(a.buf);
+    }
+
+    // if the input buffer is not aligned like the output buffer the
+    // array is copied
+    oarchive c;
+    c << graphlab::pod_array_view<double>(v);
+    char* shifted = (char*)malloc(c.off + 1);
+    memcpy(shifted + 1, c.buf, c.off);
+    iarchive d(shifted + 1, c.off);
+    d >> w;
+    TS_ASSERT(w.owns_data());
+    graphlab::pod_array_view<double> x = w;
+    TS_ASSERT(x.owns_data());
+    TS_ASSERT_DIFFERS(x.data(), w.data());
+    for (size_t i = 0;i < v.size(); ++i) TS_ASSERT_EQUALS(v[i], x[i]);
+    free(shifted);
+    free(c.buf);
+
+    // streams are not padded
+    std::stringstream strm;
+    oarchive e(strm);
+    e << x << char(42);
+    strm.flush();
+    iarchive f(strm);
+    char ch;
+    f >> w >> ch;
+    TS_ASSERT(w.owns_data());
+    TS_ASSERT_EQUALS(w.size(), v.size());
+    for (size_t i = 0;i < v.size(); ++i) TS_ASSERT_EQUALS(v[i], w[i]);
+    TS_ASSERT_EQUALS(ch, 42);
+  }
+
   void test_class_serialization(void) {
     // create a test class
     TestClass t;
@@ -0,0 +1,168 @@
+/**  
+ * Copyright (c) 2009 Carnegie Mellon University. 
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+#include <graphlab.hpp>
+
+typedef graphlab::distributed_graph<int,int> graph_type;
+
+
+class count_all_neighbors : 
+  public graphlab::ivertex_program<graph_type, int>,
+  public graphlab::IS_POD_TYPE {
+public:
+  edge_dir_type 
+  gather_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::ALL_EDGES;
+  }
+  gather_type 
+  gather(icontext_type& context, const vertex_type& vertex, 
+         edge_type& edge) const {
+    return 1;
+  }
+  void apply(icontext_type& context, vertex_type& vertex, 
+             const gather_type& total) {
+    ASSERT_EQ( total, int(vertex.num_in_edges() + vertex.num_out_edges() ) );
+    context.signal(vertex);
+  }
+  edge_dir_type 
+  scatter_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::NO_EDGES;
+  }
+}; // end of count neighbors
+
+/**
+ * Runs until max_iterations since every vertex signals itself.
+ */
+void test_all_neighbors(graphlab::distributed_control& dc,
+                        graphlab::command_line_options& clopts,
+                        graph_type& graph) {
+  std::cout << "Constructing a stale synchronous engine for all neighbors"
+            << std::endl;
+  typedef graphlab::stale_synchronous_engine<count_all_neighbors> engine_type;
+  engine_type engine(dc, graph, clopts);
+  std::cout << "Scheduling all vertices to count their neighbors" << std::endl;
+  engine.signal_all();
+  std::cout << "Running!" << std::endl;
+  engine.start();
+  std::cout << "Finished" << std::endl;
+}
+
+
+
+/**
+ * Every vertex scatters once to its out neighbors, which add up the
+ * messages they receive. The second activation of a vertex gathers with a
+ * program which does not scatter, so a mirror must not lose the scatter of
+ * the first activation when both requests arrive in the same clock.
+ */
+class scatter_once : 
+  public graphlab::ivertex_program<graph_type, int, int>,
+  public graphlab::IS_POD_TYPE {
+  int message_value;
+public:
+  void init(icontext_type& context, const vertex_type& vertex,
+            const message_type& msg) {
+    message_value = msg;
+  } 
+
+  edge_dir_type 
+  gather_edges(icontext_type& context, const vertex_type& vertex) const {
+    return graphlab::IN_EDGES;
+  }
+ 
+  gather_type gather(icontext_type& context, const vertex_type& vertex, 
+                     edge_type& edge) const {
+    return 1;
+  }
+
+  void apply(icontext_type& context, vertex_type& vertex, 
+             const gather_type& total) {
+    ASSERT_EQ(total, int(vertex.num_in_edges()));
+    if (message_value < 0) vertex.data() = 0;
+    else vertex.data() += message_value;
+  }
+
+  edge_dir_type 
+  scatter_edges(icontext_type& context, const vertex_type& vertex) const {
+    return message_value < 0 ? graphlab::OUT_EDGES : graphlab::NO_EDGES;
+  }
+
+  void scatter(icontext_type& context, const vertex_type& vertex, 
+               edge_type& edge) const {
+    context.signal(edge.target(), 1);
+  }
+}; // end of scatter once
+
+size_t count_wrong_messages(const graph_type::vertex_type& vertex) {
+  return vertex.data() != int(vertex.num_in_edges());
+}
+
+/**
+ * Terminates by quiescence.
+ */
+void test_messages(graphlab::distributed_control& dc,
+                   graphlab::command_line_options& clopts,
+                   graph_type& graph) {
+  std::cout << "Testing messages" << std::endl;
+  typedef graphlab::stale_synchronous_engine<scatter_once> engine_type;
+  engine_type engine(dc, graph, clopts);
+  std::cout << "Scheduling all vertices to test messages" << std::endl;
+  engine.signal_all(-1);
+  std::cout << "Running!" << std::endl;
+  ASSERT_EQ(engine.start(), graphlab::execution_status::TASK_DEPLETION);
+  std::cout << "Finished" << std::endl;
+  ASSERT_EQ(graph.map_reduce_vertices<size_t>(count_wrong_messages), 0);
+}
+
+
+
+int main(int argc, char** argv) {
+  ///! Initialize control plain using mpi
+  graphlab::mpi_tools::init(argc, argv);
+  graphlab::dc_init_param rpc_parameters;
+  graphlab::init_param_from_mpi(rpc_parameters);
+  graphlab::distributed_control dc(rpc_parameters);
+
+  std::cout << "Creating a powerlaw graph" << std::endl;
+  graphlab::command_line_options graph_opts("Test code.");
+  graph_type graph(dc, graph_opts);
+  graph.load_synthetic_powerlaw(10000);
+  graph.finalize();
+
+  const size_t staleness[] = {0, 1, 3};
+  for (size_t i = 0; i < sizeof(staleness) / sizeof(size_t); ++i) {
+    std::cout << "Staleness " << staleness[i] << std::endl;
+    graphlab::command_line_options clopts("Test code.");
+    clopts.engine_args.set_option("max_iterations", 10);
+    clopts.engine_args.set_option("staleness", staleness[i]);
+    test_all_neighbors(dc, clopts, graph);
+    graphlab::command_line_options msg_opts("Test code.");
+    msg_opts.engine_args.set_option("staleness", staleness[i]);
+    test_messages(dc, msg_opts, graph);
+  }
+
+  graphlab::mpi_tools::finalize();
+} // end of main
@@ -316,6 +316,32 @@ void test_count_aggregators(graphlab::distributed_control& dc,
 }
 
 
+void reset_vertex(graph_type::vertex_type& vertex) {
+  vertex.data() = 0;
+}
+
+void test_incremental_count_aggregators(graphlab::distributed_control& dc,
+                                        graphlab::command_line_options& clopts,
+                                        graph_type& graph) {
+  std::cout << "Constructing a syncrhonous engine for incremental aggregators"
+            << std::endl;
+  typedef graphlab::synchronous_engine<count_aggregators> engine_type;
+  graph.transform_vertices(reset_vertex);
+  finalize_iter = 0;
+  engine_type engine(dc, graph, clopts);
+  engine.add_incremental_vertex_aggregator<int>("iteration_counter", 
+                                                iteration_counter, 
+                                                iteration_finalize);
+  engine.aggregate_periodic("iteration_counter", 0);
+  std::cout << "Scheduling all vertices to count their neighbors" << std::endl;
+  engine.signal_all();
+  std::cout << "Running!" << std::endl;
+  engine.start();
+  std::cout << "Finished" << std::endl;
+  ASSERT_EQ(finalize_iter, engine.iteration());
+}
+
+
 
 
 int main(int argc, char** argv) {
@@ -336,6 +362,7 @@ int main(int argc, char** argv) {
   test_all_neighbors(dc, clopts, graph);
   test_messages(dc, clopts, graph);
   test_count_aggregators(dc, clopts, graph);
+  test_incremental_count_aggregators(dc, clopts, graph);
 
   graphlab::mpi_tools::finalize();
 } // end of main
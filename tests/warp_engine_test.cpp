@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+/*
+ * Tests the remote vertex cache of the warp engine. Run with at least
+ * two machines, for instance mpiexec -n 2 ./warp_engine_test; with a
+ * single machine every vertex is local and the remote reads are skipped.
+ */
+
+#include <vector>
+#include <iostream>
+
+#include <graphlab.hpp>
+#include <graphlab/engine/warp_engine.hpp>
+
+typedef graphlab::distributed_graph<size_t, graphlab::empty> graph_type;
+typedef graphlab::warp::warp_engine<graph_type> engine_type;
+
+/// Vertices below NUM_TARGETS are read, the others read them
+const size_t NUM_TARGETS = 16;
+const size_t NUM_VERTICES = 2000;
+const size_t OLD_VALUE = 1;
+const size_t NEW_VALUE = 2;
+
+/// A target which has no replica on this machine, or -1 if there is none
+graphlab::vertex_id_type remote_target = graphlab::vertex_id_type(-1);
+
+/// The remote reads issued on this machine
+graphlab::atomic<size_t> remote_reads;
+
+bool is_target(const graph_type::vertex_type& vertex) {
+  return vertex.id() < NUM_TARGETS;
+}
+
+bool is_reader(const graph_type::vertex_type& vertex) {
+  return !is_target(vertex);
+}
+
+/// Targets are joined in pairs by an edge
+graphlab::vertex_id_type partner(graphlab::vertex_id_type target) {
+  return target < NUM_TARGETS / 2 ? target + NUM_TARGETS / 2
+                                  : target - NUM_TARGETS / 2;
+}
+
+void init_vertex(graph_type::vertex_type& vertex) {
+  vertex.data() = is_target(vertex) ? OLD_VALUE : 0;
+}
+
+size_t unfinished_reader(const graph_type::vertex_type& vertex) {
+  return is_reader(vertex) && vertex.data() != 1;
+}
+
+/// Every reader reads the remote target once, all at the same time
+void read_once(engine_type::context& context,
+               graph_type::vertex_type vertex) {
+  if (remote_target == graphlab::vertex_id_type(-1)) return;
+  remote_reads.inc();
+  ASSERT_EQ(context.read_vertex(remote_target), OLD_VALUE);
+}
+
+void no_op(engine_type::context& context,
+           graph_type::edge_type edge, graph_type::vertex_type other) { }
+
+/**
+ * Readers read the remote target until they see the new value, asking
+ * the target to change after they have seen the old one. A target
+ * changes its value by broadcasting it, and the readers only see the
+ * change if the broadcast invalidates their cached copy.
+ */
+void read_until_changed(engine_type::context& context,
+                        graph_type::vertex_type vertex) {
+  if (is_target(vertex)) {
+    if (vertex.data() == OLD_VALUE) {
+      vertex.data() = NEW_VALUE;
+      graphlab::warp::broadcast_neighborhood(context, vertex,
+                                             graphlab::ALL_EDGES, no_op);
+    }
+    return;
+  }
+  if (remote_target == graphlab::vertex_id_type(-1)) {
+    vertex.data() = 1;
+    return;
+  }
+  const size_t value = context.read_vertex(remote_target);
+  if (value == OLD_VALUE) {
+    context.signal(remote_target);
+    context.signal(vertex);
+  } else {
+    ASSERT_EQ(value, NEW_VALUE);
+    vertex.data() = 1;
+  }
+}
+
+void set_other_value(graph_type::edge_type edge,
+                     graph_type::vertex_type other) {
+  other.data() = NEW_VALUE;
+}
+
+/**
+ * As read_until_changed, but the readers ask the partner of the remote
+ * target to change it with a transform. The target never synchronizes,
+ * so the readers only see the change if the transform invalidates their
+ * cached copy.
+ */
+void read_until_transformed(engine_type::context& context,
+                            graph_type::vertex_type vertex) {
+  if (is_target(vertex)) {
+    if (vertex.data() == OLD_VALUE) {
+      vertex.data() = NEW_VALUE;
+      graphlab::warp::transform_neighborhood(vertex, graphlab::ALL_EDGES,
+                                             set_other_value);
+    }
+    return;
+  }
+  if (remote_target == graphlab::vertex_id_type(-1)) {
+    vertex.data() = 1;
+    return;
+  }
+  const size_t value = context.read_vertex(remote_target);
+  if (value == OLD_VALUE) {
+    context.signal(partner(remote_target));
+    context.signal(vertex);
+  } else {
+    ASSERT_EQ(value, NEW_VALUE);
+    vertex.data() = 1;
+  }
+}
+
+
+int main(int argc, char** argv) {
+  ///! Initialize control plain using mpi
+  graphlab::mpi_tools::init(argc, argv);
+  graphlab::dc_init_param rpc_parameters;
+  graphlab::init_param_from_mpi(rpc_parameters);
+  graphlab::distributed_control dc(rpc_parameters);
+
+  // isolated vertices only have a replica on their master
+  graphlab::command_line_options graph_opts("Test code.");
+  graph_type graph(dc, graph_opts);
+  if (dc.procid() == 0) {
+    for (size_t i = 0; i < NUM_VERTICES; ++i) graph.add_vertex(i, 0);
+    for (size_t i = 0; i < NUM_TARGETS / 2; ++i) graph.add_edge(i, partner(i));
+  }
+  graph.finalize();
+  for (size_t i = 0; i < NUM_TARGETS; ++i) {
+    if (!graph.contains_vertex(i)) {
+      remote_target = i;
+      break;
+    }
+  }
+  if (remote_target == graphlab::vertex_id_type(-1)) {
+    std::cout << "No remote vertex on machine " << dc.procid()
+              << ". Run with several machines to test remote reads."
+              << std::endl;
+  }
+
+  graphlab::command_line_options clopts("Test code.");
+  // a broken invalidation makes the readers spin
+  clopts.engine_args.set_option("timeout", 60);
+  engine_type engine(dc, graph, clopts);
+  graphlab::vertex_set readers = graph.select(is_reader);
+
+  std::cout << "Reading a remote vertex from many fibers" << std::endl;
+  graph.transform_vertices(init_vertex);
+  engine.set_update_function(read_once);
+  engine.signal_vset(readers);
+  engine.start();
+  const size_t reads = engine.num_vertex_cache_hits() +
+                       engine.num_vertex_cache_fetches() +
+                       engine.num_vertex_cache_coalesced();
+  std::cout << engine.num_vertex_cache_fetches() << " fetched, "
+            << engine.num_vertex_cache_coalesced() << " coalesced, "
+            << engine.num_vertex_cache_hits() << " cached" << std::endl;
+  if (remote_target != graphlab::vertex_id_type(-1)) {
+    // the target never changes, so it is fetched once. the cache
+    // counters only count the reads made on this machine
+    ASSERT_EQ(reads, remote_reads.value);
+    ASSERT_EQ(engine.num_vertex_cache_fetches(), 1);
+  }
+
+  std::cout << "Changing a cached vertex by broadcasting it" << std::endl;
+  graph.transform_vertices(init_vertex);
+  engine.set_update_function(read_until_changed);
+  engine.signal_vset(readers);
+  ASSERT_EQ(engine.start(), graphlab::execution_status::TASK_DEPLETION);
+  ASSERT_EQ(graph.map_reduce_vertices<size_t>(unfinished_reader), 0);
+
+  // a remote target has no replica here. with two machines the edge to
+  // its partner is then on its master, where the transform changes it
+  if (dc.numprocs() == 2) {
+    std::cout << "Changing a cached vertex by transforming it" << std::endl;
+    graph.transform_vertices(init_vertex);
+    engine.set_update_function(read_until_transformed);
+    engine.signal_vset(readers);
+    ASSERT_EQ(engine.start(), graphlab::execution_status::TASK_DEPLETION);
+    ASSERT_EQ(graph.map_reduce_vertices<size_t>(unfinished_reader), 0);
+  }
+  std::cout << "Finished" << std::endl;
+
+  graphlab::mpi_tools::finalize();
+} // end of main
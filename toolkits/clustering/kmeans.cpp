@@ -49,8 +49,13 @@
 #include <limits>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <graphlab.hpp>
 
@@ -58,10 +63,53 @@
 size_t NUM_CLUSTERS = 0;
 bool IS_SPARSE = false;
 
+/*
+ * A sparse vector stored as two parallel arrays: the feature ids in
+ * strictly increasing order and their values.
+ */
+struct sparse_vector {
+  std::vector<size_t> index;
+  std::vector<double> value;
+
+  size_t size() const { return index.size(); }
+  bool empty() const { return index.empty(); }
+  void clear() {
+    index.clear();
+    value.clear();
+  }
+
+  // builds the vector from (feature id, value) pairs in any order.
+  // If a feature id is repeated, the first value is kept.
+  void assign(std::vector<std::pair<size_t, double> >& entries) {
+    std::stable_sort(entries.begin(), entries.end(), compare_index);
+    clear();
+    index.reserve(entries.size());
+    value.reserve(entries.size());
+    for (size_t i = 0;i < entries.size(); ++i) {
+      if (i > 0 && entries[i].first == entries[i - 1].first) continue;
+      index.push_back(entries[i].first);
+      value.push_back(entries[i].second);
+    }
+  }
+
+  static bool compare_index(const std::pair<size_t, double>& a,
+                            const std::pair<size_t, double>& b) {
+    return a.first < b.first;
+  }
+
+  void save(graphlab::oarchive& oarc) const {
+    oarc << index << value;
+  }
+
+  void load(graphlab::iarchive& iarc) {
+    iarc >> index >> value;
+  }
+};
+
 struct cluster {
   cluster(): count(0), changed(false) { }
   std::vector<double> center;
-  std::map<size_t, double> center_sparse;
+  sparse_vector center_sparse;
   size_t count;
   bool changed;
 
@@ -81,16 +129,22 @@ size_t KMEANS_INITIALIZATION;
 
 struct vertex_data{
   std::vector<double> point;
-  std::map<size_t, double> point_sparse;
+  sparse_vector point_sparse;
   size_t best_cluster;
   double best_distance;
   bool changed;
+  // bounds on the (non squared) distance to the assigned center and to
+  // the second closest center, used to skip distance computations
+  double upper_bound;
+  double lower_bound;
 
   void save(graphlab::oarchive& oarc) const {
-    oarc << point << best_cluster << best_distance << changed << point_sparse;
+    oarc << point << best_cluster << best_distance << changed << point_sparse
+         << upper_bound << lower_bound;
   }
   void load(graphlab::iarchive& iarc) {
-    iarc >> point >> best_cluster >> best_distance >> changed >> point_sparse;
+    iarc >> point >> best_cluster >> best_distance >> changed >> point_sparse
+         >> upper_bound >> lower_bound;
   }
 };
 
@@ -117,35 +171,51 @@ struct edge_data {
 double sqr_distance(const std::vector<double>& a,
                     const std::vector<double>& b) {
   ASSERT_EQ(a.size(), b.size());
+  const size_t n = a.size();
+  size_t i = 0;
   double total = 0;
-  for (size_t i = 0;i < a.size(); ++i) {
+#ifdef __SSE2__
+  // two independent accumulators of two lanes each
+  __m128d acc0 = _mm_setzero_pd();
+  __m128d acc1 = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    const __m128d d0 = _mm_sub_pd(_mm_loadu_pd(&a[i]), _mm_loadu_pd(&b[i]));
+    const __m128d d1 = _mm_sub_pd(_mm_loadu_pd(&a[i + 2]), _mm_loadu_pd(&b[i + 2]));
+    acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+    acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+  }
+  double lanes[2];
+  _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+  total = lanes[0] + lanes[1];
+#endif
+  for (;i < n; ++i) {
     double d = a[i] - b[i];
     total += d * d;
   }
   return total;
 }
 
-double sqr_distance(const std::map<size_t, double>& a,
-                    const std::map<size_t, double>& b) {
+double sqr_distance(const sparse_vector& a,
+                    const sparse_vector& b) {
   double total = 0.0;
-  for(std::map<size_t, double>::const_iterator iter = a.begin();
-      iter != a.end(); ++iter){
-    size_t id = (*iter).first;
-    double val = (*iter).second;
-    if(b.find(id) != b.end()){
-      double d = val - b.at(id);
-      total += d*d;
-    }else{
-      total += val * val;
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    if (a.index[i] < b.index[j]) {
+      total += a.value[i] * a.value[i];
+      ++i;
     }
-  }
-  for(std::map<size_t, double>::const_iterator iter = b.begin();
-      iter != b.end(); ++iter){
-    double val = (*iter).second;
-    if(a.find((*iter).first) == a.end()){
-      total += val * val;
+    else if (b.index[j] < a.index[i]) {
+      total += b.value[j] * b.value[j];
+      ++j;
+    }
+    else {
+      double d = a.value[i] - b.value[j];
+      total += d * d;
+      ++i; ++j;
     }
   }
+  for (; i < a.size(); ++i) total += a.value[i] * a.value[i];
+  for (; j < b.size(); ++j) total += b.value[j] * b.value[j];
 
   return total;
 
@@ -191,18 +261,30 @@ std::vector<double>& plus_equal_vector(std::vector<double>& a,
 }
 
 // helper function to add two vectors
-std::map<size_t, double>& plus_equal_vector(std::map<size_t, double>& a,
-                                       const std::map<size_t, double>& b) {
-  for(std::map<size_t, double>::const_iterator iter = b.begin();
-    iter != b.end(); ++iter){
-    size_t id = (*iter).first;
-    double val = (*iter).second;
-    if(a.find(id) != a.end()){
-      a[id] += b.at(id);
-    }else{
-      a.insert(std::make_pair<size_t, double>(id, val));
+sparse_vector& plus_equal_vector(sparse_vector& a,
+                                 const sparse_vector& b) {
+  sparse_vector sum;
+  sum.index.reserve(a.size() + b.size());
+  sum.value.reserve(a.size() + b.size());
+  size_t i = 0, j = 0;
+  while (i < a.size() || j < b.size()) {
+    if (j == b.size() || (i < a.size() && a.index[i] < b.index[j])) {
+      sum.index.push_back(a.index[i]);
+      sum.value.push_back(a.value[i]);
+      ++i;
+    }
+    else if (i == a.size() || b.index[j] < a.index[i]) {
+      sum.index.push_back(b.index[j]);
+      sum.value.push_back(b.value[j]);
+      ++j;
+    }
+    else {
+      sum.index.push_back(a.index[i]);
+      sum.value.push_back(a.value[i] + b.value[j]);
+      ++i; ++j;
     }
   }
+  std::swap(a, sum);
   return a;
 }
 
@@ -215,14 +297,8 @@ std::vector<double>& scale_vector(std::vector<double>& a, double d) {
 }
 
 // helper function to scale a vector vectors
-std::map<size_t, double>& scale_vector(std::map<size_t, double>& a, double d) {
-  for(std::map<size_t, double>::iterator iter = a.begin();
-    iter != a.end(); ++iter){
-  size_t id = (*iter).first;
-  double val = (*iter).second;
-  a[id] = val*d;
-//    (*iter).second *= d;
-  }
+sparse_vector& scale_vector(sparse_vector& a, double d) {
+  scale_vector(a.value, d);
   return a;
 }
 
@@ -253,6 +329,8 @@ bool vertex_loader(graph_type& graph, const std::string& fname,
   vtx.best_cluster = (size_t)(-1);
   vtx.best_distance = std::numeric_limits<double>::infinity();
   vtx.changed = false;
+  vtx.upper_bound = std::numeric_limits<double>::infinity();
+  vtx.lower_bound = 0;
   graph.add_vertex(NEXT_VID.inc_ret_last(1), vtx);
   return true;
 }
@@ -263,6 +341,7 @@ bool vertex_loader_sparse(graph_type& graph, const std::string& fname,
   if (line.empty()) return true;
 
   vertex_data vtx;
+  std::vector<std::pair<size_t, double> > entries;
   boost::char_separator<char> sep(" ");
   boost::tokenizer< boost::char_separator<char> > tokens(line, sep);
   BOOST_FOREACH (const std::string& t, tokens) {
@@ -270,12 +349,15 @@ bool vertex_loader_sparse(graph_type& graph, const std::string& fname,
     if(pos > 0){
       size_t id = (size_t)std::atoi(t.substr(0, pos).c_str());
       double val = std::atof(t.substr(pos+1, t.length() - pos -1).c_str());
-      vtx.point_sparse.insert(std::make_pair<size_t, double>(id, val));
+      entries.push_back(std::make_pair(id, val));
     }
   }
+  vtx.point_sparse.assign(entries);
   vtx.best_cluster = (size_t)(-1);
   vtx.best_distance = std::numeric_limits<double>::infinity();
   vtx.changed = false;
+  vtx.upper_bound = std::numeric_limits<double>::infinity();
+  vtx.lower_bound = 0;
   graph.add_vertex(NEXT_VID.inc_ret_last(1), vtx);
   return true;
 }
@@ -304,6 +386,8 @@ bool vertex_loader_with_id(graph_type& graph, const std::string& fname,
   vtx.best_cluster = (size_t)(-1);
   vtx.best_distance = std::numeric_limits<double>::infinity();
   vtx.changed = false;
+  vtx.upper_bound = std::numeric_limits<double>::infinity();
+  vtx.lower_bound = 0;
   graph.add_vertex(id, vtx);
   return true;
 }
@@ -314,6 +398,7 @@ bool vertex_loader_with_id_sparse(graph_type& graph, const std::string& fname,
   if (line.empty()) return true;
 
   vertex_data vtx;
+  std::vector<std::pair<size_t, double> > entries;
   size_t id = 0;
   boost::char_separator<char> sep(" ");
   boost::tokenizer<boost::char_separator<char> > tokens(line, sep);
@@ -327,13 +412,16 @@ bool vertex_loader_with_id_sparse(graph_type& graph, const std::string& fname,
       if(pos > 0){
         size_t id = (size_t)std::atoi(t.substr(0, pos).c_str());
         double val = std::atof(t.substr(pos+1, t.length() - pos -1).c_str());
-        vtx.point_sparse.insert(std::make_pair<size_t, double>(id, val));
+        entries.push_back(std::make_pair(id, val));
       }
     }
   }
+  vtx.point_sparse.assign(entries);
   vtx.best_cluster = (size_t)(-1);
   vtx.best_distance = std::numeric_limits<double>::infinity();
   vtx.changed = false;
+  vtx.upper_bound = std::numeric_limits<double>::infinity();
+  vtx.lower_bound = 0;
   graph.add_vertex(id, vtx);
   return true;
 }
@@ -470,11 +558,11 @@ struct random_sample_reducer {
 };
 
 struct random_sample_reducer_sparse{
-  std::map<size_t, double> vtx;
+  sparse_vector vtx;
   double weight;
 
   random_sample_reducer_sparse():weight(0) { }
-  random_sample_reducer_sparse(const std::map<size_t, double>& vtx,
+  random_sample_reducer_sparse(const sparse_vector& vtx,
                         double weight):vtx(vtx),weight(weight) { }
 
   static random_sample_reducer_sparse get_weight(const graph_type::vertex_type& v) {
@@ -562,6 +650,139 @@ void kmeans_iteration(graph_type::vertex_type& v) {
   v.data().changed = (prev_asg != v.data().best_cluster);
 }
 
+
+/*
+ * Triangle inequality pruning (G. Hamerly, Making k-means even faster,
+ * SDM 2010). Each point keeps an upper bound u on the distance to its
+ * assigned center a and a lower bound l on the distance to every other
+ * center. When the centers move, u grows by the shift of a and l
+ * shrinks by the largest shift of any other center. If u is at most
+ * max(l, s(a)), where s(a) is half the distance from a to its closest
+ * center, no other center can be closer and the point is skipped.
+ */
+bool USE_BOUNDS = false;
+// how far each center moved in the last update
+std::vector<double> CENTER_SHIFT;
+// half the distance from each center to the closest other center
+std::vector<double> CENTER_SEPARATION;
+// the largest and second largest center shifts
+size_t MAX_SHIFT_CLUSTER = 0;
+double MAX_SHIFT = 0;
+double SECOND_MAX_SHIFT = 0;
+
+bool cluster_exists(size_t i) {
+  return CLUSTERS[i].center.size() > 0 || CLUSTERS[i].center_sparse.size() > 0;
+}
+
+double sqr_distance_to_cluster(const vertex_data& vdata, size_t i) {
+  if (IS_SPARSE) return sqr_distance(vdata.point_sparse, CLUSTERS[i].center_sparse);
+  else return sqr_distance(vdata.point, CLUSTERS[i].center);
+}
+
+double sqr_distance_between(const cluster& a, const cluster& b) {
+  if (IS_SPARSE) return sqr_distance(a.center_sparse, b.center_sparse);
+  else return sqr_distance(a.center, b.center);
+}
+
+/*
+ * Records the shift of a center which is about to be replaced.
+ * Must be called before CLUSTERS[i] is overwritten.
+ */
+void record_center_shift(size_t i, const cluster& new_cluster) {
+  const bool had_center = cluster_exists(i);
+  const bool has_center = new_cluster.center.size() > 0 ||
+    new_cluster.center_sparse.size() > 0;
+  // a center which vanishes cannot come closer to any point
+  CENTER_SHIFT[i] = (had_center && has_center) ?
+    std::sqrt(sqr_distance_between(CLUSTERS[i], new_cluster)) : 0;
+}
+
+/*
+ * Computes the center separations and the largest shifts once all the
+ * centers have been updated.
+ */
+void update_center_bounds() {
+  MAX_SHIFT = SECOND_MAX_SHIFT = 0;
+  MAX_SHIFT_CLUSTER = 0;
+  for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
+    if (CENTER_SHIFT[i] > MAX_SHIFT) {
+      SECOND_MAX_SHIFT = MAX_SHIFT;
+      MAX_SHIFT = CENTER_SHIFT[i];
+      MAX_SHIFT_CLUSTER = i;
+    }
+    else if (CENTER_SHIFT[i] > SECOND_MAX_SHIFT) {
+      SECOND_MAX_SHIFT = CENTER_SHIFT[i];
+    }
+  }
+  std::fill(CENTER_SEPARATION.begin(), CENTER_SEPARATION.end(),
+            std::numeric_limits<double>::infinity());
+  for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
+    if (!cluster_exists(i)) continue;
+    for (size_t j = i + 1;j < NUM_CLUSTERS; ++j) {
+      if (!cluster_exists(j)) continue;
+      const double half = std::sqrt(sqr_distance_between(CLUSTERS[i], CLUSTERS[j])) / 2;
+      CENTER_SEPARATION[i] = std::min(CENTER_SEPARATION[i], half);
+      CENTER_SEPARATION[j] = std::min(CENTER_SEPARATION[j], half);
+    }
+  }
+}
+
+/*
+ * The k-means iteration with triangle inequality pruning. Points which
+ * are skipped keep their assignment and report the square of the upper
+ * bound as their distance, so the reported cost is an upper bound.
+ */
+void kmeans_iteration_bounded(graph_type::vertex_type& v) {
+  vertex_data& vdata = v.data();
+  const size_t prev_asg = vdata.best_cluster;
+  vdata.upper_bound += CENTER_SHIFT[prev_asg];
+  vdata.lower_bound -= (prev_asg == MAX_SHIFT_CLUSTER) ? SECOND_MAX_SHIFT : MAX_SHIFT;
+  const double bound = std::max(vdata.lower_bound, CENTER_SEPARATION[prev_asg]);
+  if (vdata.upper_bound > bound || !cluster_exists(prev_asg)) {
+    // tighten the upper bound and test again
+    if (cluster_exists(prev_asg)) {
+      vdata.best_distance = sqr_distance_to_cluster(vdata, prev_asg);
+      vdata.upper_bound = std::sqrt(vdata.best_distance);
+    }
+    if (vdata.upper_bound > bound || !cluster_exists(prev_asg)) {
+      // compute the distance to all centers keeping the two closest
+      double second = std::numeric_limits<double>::infinity();
+      vdata.best_cluster = (size_t)(-1);
+      vdata.best_distance = std::numeric_limits<double>::infinity();
+      for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
+        if (!cluster_exists(i)) continue;
+        const double d = sqr_distance_to_cluster(vdata, i);
+        if (d < vdata.best_distance) {
+          second = vdata.best_distance;
+          vdata.best_distance = d;
+          vdata.best_cluster = i;
+        }
+        else if (d < second) {
+          second = d;
+        }
+      }
+      vdata.upper_bound = std::sqrt(vdata.best_distance);
+      vdata.lower_bound = std::sqrt(second);
+    }
+  }
+  else {
+    vdata.best_distance = vdata.upper_bound * vdata.upper_bound;
+  }
+  vdata.changed = (prev_asg != vdata.best_cluster);
+}
+
+/*
+ * After the k-means++ initialization the best distance is exact, but
+ * nothing is known about the other centers.
+ */
+void initialize_bounds(graph_type::vertex_type& v) {
+  v.data().upper_bound = std::sqrt(v.data().best_distance);
+  v.data().lower_bound = 0;
+}
+
+// the probability that a point is part of a mini-batch
+double MINIBATCH_FRACTION = 0;
+
 //gathered information
 //used when edge weight file is given
 struct neighbor_info {
@@ -691,6 +912,34 @@ struct cluster_center_reducer {
     return cc;
   }
 
+  /*
+   * Used by the mini-batch mode: a random subset of the points is
+   * assigned to the closest current center without modifying the
+   * vertex.
+   */
+  static cluster_center_reducer get_minibatch_center(const graph_type::vertex_type& v) {
+    cluster_center_reducer cc;
+    if (!graphlab::random::bernoulli(MINIBATCH_FRACTION)) return cc;
+    size_t best_cluster = (size_t)(-1);
+    double best_distance = std::numeric_limits<double>::infinity();
+    for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
+      if (!cluster_exists(i)) continue;
+      const double d = sqr_distance_to_cluster(v.data(), i);
+      if (d < best_distance) {
+        best_distance = d;
+        best_cluster = i;
+      }
+    }
+    if (best_cluster == (size_t)(-1)) return cc;
+    if(IS_SPARSE == true)
+      cc.new_clusters[best_cluster].center_sparse = v.data().point_sparse;
+    else
+      cc.new_clusters[best_cluster].center = v.data().point;
+    cc.new_clusters[best_cluster].count = 1;
+    cc.cost = best_distance;
+    return cc;
+  }
+
   cluster_center_reducer& operator+=(const cluster_center_reducer& other) {
     for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
       if (new_clusters[i].count == 0) new_clusters[i] = other.new_clusters[i];
@@ -734,9 +983,9 @@ struct vertex_writer {
 struct vertex_writer_sparse {
   std::string save_vertex(graph_type::vertex_type v) {
     std::stringstream strm;
-    for(std::map<size_t, double>::iterator iter = v.data().point_sparse.begin();
-        iter != v.data().point_sparse.end();++iter){
-      strm << (*iter).first << ":" << (*iter).second << " ";
+    const sparse_vector& point = v.data().point_sparse;
+    for(size_t i = 0;i < point.size(); ++i){
+      strm << point.index[i] << ":" << point.value[i] << " ";
     }
     strm << v.data().best_cluster << "\n";
     strm.flush();
@@ -758,6 +1007,48 @@ struct vertex_writer_with_id {
   std::string save_edge(graph_type::edge_type e) { return ""; }
 };
 
+/*
+ * Mini-batch k-means (D. Sculley, Web-scale k-means clustering, WWW 2010).
+ * Each iteration assigns a random sample of the points to the current
+ * centers and moves every center towards its sampled points with a
+ * learning rate of 1 / (number of points assigned to the center so far).
+ * Once done, every point is assigned to the closest final center.
+ */
+void run_minibatch_kmeans(graphlab::distributed_control& dc,
+                          graph_type& graph, size_t iterations) {
+  for (size_t i = 0;i < NUM_CLUSTERS; ++i) CLUSTERS[i].count = 0;
+  for (size_t iteration = 0; iteration < iterations; ++iteration) {
+    cluster_center_reducer cc = graph.map_reduce_vertices<cluster_center_reducer>
+                                    (cluster_center_reducer::get_minibatch_center);
+    size_t batch_size = 0;
+    for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
+      const size_t n = cc.new_clusters[i].count;
+      if (n == 0) continue;
+      const double v = CLUSTERS[i].count;
+      // center = (v * center + sum of the n new points) / (v + n)
+      if(IS_SPARSE){
+        scale_vector(CLUSTERS[i].center_sparse, v);
+        plus_equal_vector(CLUSTERS[i].center_sparse, cc.new_clusters[i].center_sparse);
+        scale_vector(CLUSTERS[i].center_sparse, 1.0 / (v + n));
+      }else{
+        scale_vector(CLUSTERS[i].center, v);
+        plus_equal_vector(CLUSTERS[i].center, cc.new_clusters[i].center);
+        scale_vector(CLUSTERS[i].center, 1.0 / (v + n));
+      }
+      CLUSTERS[i].count += n;
+      batch_size += n;
+    }
+    dc.cout() << "Mini-batch iteration " << iteration + 1 << ": " <<
+                 "batch size = " << batch_size <<
+                 " batch cost: " << cc.cost << std::endl;
+  }
+  for (size_t i = 0;i < NUM_CLUSTERS; ++i) CLUSTERS[i].changed = true;
+  graph.transform_vertices(kmeans_iteration);
+  cluster_center_reducer cc = graph.map_reduce_vertices<cluster_center_reducer>
+                                  (cluster_center_reducer::get_center);
+  dc.cout() << "Final assignment: total cost: " << cc.cost << std::endl;
+}
+
 
 int main(int argc, char** argv) {
   std::cout << "Computes a K-means clustering of data.\n\n";
@@ -776,6 +1067,7 @@ int main(int argc, char** argv) {
   std::string outdata_file;
   std::string edgedata_file;
   size_t MAX_ITERATION = 0;
+  size_t minibatch_size = 0;
   bool use_id = false;
   clopts.attach_option("data", datafile,
                        "Input file. Each line holds a white-space or comma separated numeric vector");
@@ -806,6 +1098,15 @@ int main(int argc, char** argv) {
                        "[reward]. This mode must be used with --id option.");
   clopts.attach_option("max-iteration", MAX_ITERATION,
                        "The max number of iterations");
+  clopts.attach_option("prune", USE_BOUNDS,
+                       "If set to true, use triangle inequality bounds "
+                       "to skip distance computations which cannot change the "
+                       "assignment of a point. The reported cost is then an upper "
+                       "bound. Off by default. Not used with --pairwise-reward.");
+  clopts.attach_option("minibatch", minibatch_size,
+                       "If non-zero, run mini-batch k-means where each iteration "
+                       "updates the centers from a random sample of about this "
+                       "many points. Runs --max-iteration iterations (100 if not set).");
 
   if(!clopts.parse(argc, argv)) return EXIT_FAILURE;
   if (datafile == "") {
@@ -821,6 +1122,11 @@ int main(int argc, char** argv) {
       std::cout << "--id is not optional when you use edge data\n";
       return EXIT_FAILURE;
     }
+    if(minibatch_size > 0){
+      std::cout << "--minibatch cannot be used with edge data\n";
+      return EXIT_FAILURE;
+    }
+    USE_BOUNDS = false;
   }
 
   graphlab::mpi_tools::init(argc, argv);
@@ -894,65 +1200,83 @@ int main(int argc, char** argv) {
 
   // "reset" all clusters
   for (size_t i = 0; i < NUM_CLUSTERS; ++i) CLUSTERS[i].changed = true;
-  // perform Kmeans iteration
-
-  dc.cout() << "Running Kmeans...\n";
-  bool clusters_changed = true;
-  size_t iteration_count = 0;
-  while(clusters_changed) {
-		if(MAX_ITERATION > 0 && iteration_count >= MAX_ITERATION)
-			break;
 
-    cluster_center_reducer cc = graph.map_reduce_vertices<cluster_center_reducer>
-                                    (cluster_center_reducer::get_center);
-    // the first round (iteration_count == 0) is not so meaningful
-    // since I am just recomputing the centers from the output of the KMeans++
-    // initialization
-    if (iteration_count > 0) {
-      dc.cout() << "Kmeans iteration " << iteration_count << ": " <<
-                 "# points with changed assignments = " << cc.num_changed << 
-		 " total cost: " << cc.cost << std::endl;
+  if (minibatch_size > 0) {
+    dc.cout() << "Running mini-batch Kmeans...\n";
+    MINIBATCH_FRACTION = std::min(1.0, double(minibatch_size) / graph.num_vertices());
+    run_minibatch_kmeans(dc, graph, MAX_ITERATION > 0 ? MAX_ITERATION : 100);
+  }
+  else {
+    // perform Kmeans iteration
+    dc.cout() << "Running Kmeans...\n";
+    if (USE_BOUNDS) {
+      CENTER_SHIFT.assign(NUM_CLUSTERS, 0);
+      CENTER_SEPARATION.assign(NUM_CLUSTERS, 0);
+      graph.transform_vertices(initialize_bounds);
     }
-    for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
-      double d = cc.new_clusters[i].count;
-      if(IS_SPARSE){
-        if (d > 0) scale_vector(cc.new_clusters[i].center_sparse, 1.0 / d);
-        if (cc.new_clusters[i].count == 0 && CLUSTERS[i].count > 0) {
-          dc.cout() << "Cluster " << i << " lost" << std::endl;
-          CLUSTERS[i].center_sparse.clear();
-          CLUSTERS[i].count = 0;
-          CLUSTERS[i].changed = false;
-        }
-        else {
-          CLUSTERS[i] = cc.new_clusters[i];
-          CLUSTERS[i].changed = true;
+    bool clusters_changed = true;
+    size_t iteration_count = 0;
+    while(clusters_changed) {
+      if(MAX_ITERATION > 0 && iteration_count >= MAX_ITERATION)
+        break;
+
+      cluster_center_reducer cc = graph.map_reduce_vertices<cluster_center_reducer>
+                                      (cluster_center_reducer::get_center);
+      // the first round (iteration_count == 0) is not so meaningful
+      // since I am just recomputing the centers from the output of the KMeans++
+      // initialization
+      if (iteration_count > 0) {
+        dc.cout() << "Kmeans iteration " << iteration_count << ": " <<
+                   "# points with changed assignments = " << cc.num_changed << 
+                   (USE_BOUNDS ? " total cost (upper bound): " : " total cost: ") <<
+                   cc.cost << std::endl;
+      }
+      for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
+        double d = cc.new_clusters[i].count;
+        if(IS_SPARSE){
+          if (d > 0) scale_vector(cc.new_clusters[i].center_sparse, 1.0 / d);
+          if (USE_BOUNDS) record_center_shift(i, cc.new_clusters[i]);
+          if (cc.new_clusters[i].count == 0 && CLUSTERS[i].count > 0) {
+            dc.cout() << "Cluster " << i << " lost" << std::endl;
+            CLUSTERS[i].center_sparse.clear();
+            CLUSTERS[i].count = 0;
+            CLUSTERS[i].changed = false;
+          }
+          else {
+            CLUSTERS[i] = cc.new_clusters[i];
+            CLUSTERS[i].changed = true;
+          }
+        }else{
+          if (d > 0) scale_vector(cc.new_clusters[i].center, 1.0 / d);
+          if (USE_BOUNDS) record_center_shift(i, cc.new_clusters[i]);
+          if (cc.new_clusters[i].count == 0 && CLUSTERS[i].count > 0) {
+            dc.cout() << "Cluster " << i << " lost" << std::endl;
+            CLUSTERS[i].center.clear();
+            CLUSTERS[i].count = 0;
+            CLUSTERS[i].changed = false;
+          }
+          else {
+            CLUSTERS[i] = cc.new_clusters[i];
+            CLUSTERS[i].changed = true;
+          }
         }
+      }
+      if (USE_BOUNDS) update_center_bounds();
+      clusters_changed = iteration_count == 0 || cc.num_changed > 0;
+
+      if(edgedata_file.size() > 0){
+        clopts.engine_args.set_option("factorized", true);
+        graphlab::omni_engine<cluster_assignment> engine(dc, graph, "async", clopts);
+        engine.signal_all();
+        engine.start();
+      }else if (USE_BOUNDS){
+        graph.transform_vertices(kmeans_iteration_bounded);
       }else{
-        if (d > 0) scale_vector(cc.new_clusters[i].center, 1.0 / d);
-        if (cc.new_clusters[i].count == 0 && CLUSTERS[i].count > 0) {
-          dc.cout() << "Cluster " << i << " lost" << std::endl;
-          CLUSTERS[i].center.clear();
-          CLUSTERS[i].count = 0;
-          CLUSTERS[i].changed = false;
-        }
-        else {
-          CLUSTERS[i] = cc.new_clusters[i];
-          CLUSTERS[i].changed = true;
-        }
+        graph.transform_vertices(kmeans_iteration);
       }
-    }
-    clusters_changed = iteration_count == 0 || cc.num_changed > 0;
 
-    if(edgedata_file.size() > 0){
-      clopts.engine_args.set_option("factorized", true);
-      graphlab::omni_engine<cluster_assignment> engine(dc, graph, "async", clopts);
-      engine.signal_all();
-      engine.start();
-    }else{
-      graph.transform_vertices(kmeans_iteration);
+      ++iteration_count;
     }
-
-    ++iteration_count;
   }
 
 
@@ -963,9 +1287,9 @@ int main(int argc, char** argv) {
       for (size_t i = 0;i < NUM_CLUSTERS; ++i) {
         if(use_id)
           fout << i+1 << "\t";
-        for (std::map<size_t, double>::iterator iter = CLUSTERS[i].center_sparse.begin();
-             iter != CLUSTERS[i].center_sparse.end();++iter) {
-          fout << (*iter).first << ":" << (*iter).second << " ";
+        const sparse_vector& center = CLUSTERS[i].center_sparse;
+        for (size_t j = 0; j < center.size(); ++j) {
+          fout << center.index[j] << ":" << center.value[j] << " ";
         }
         fout << "\n";
       }
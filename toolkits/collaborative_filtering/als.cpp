@@ -194,12 +194,25 @@ get_other_vertex(graph_type::edge_type& edge,
  * added. The gather type represents that tuple and provides the
  * necessary gather_type::operator+= operation.
  *
+ * Rather than forming a rank-1 update of XtX for every edge the
+ * neighbor factors are appended to a panel of up to BLOCK_SIZE rows
+ * which is folded into the upper triangle of XtX with a single
+ * symmetric rank-k update (SYRK) when full.  A gather from a single
+ * edge is therefore only O(d) and XtX is serialized as a packed
+ * upper triangle.
  */
 class gather_type {
 public:
   /**
-   * \brief Stores the current sum of nbr.factor.transpose() *
-   * nbr.factor
+   * \brief The number of neighbor factors batched into each rank-k
+   * update of XtX.  A block size of 1 performs a rank-1 update for
+   * every edge.
+   */
+  static size_t BLOCK_SIZE;
+
+  /**
+   * \brief Stores the upper triangle of the sum of
+   * nbr.factor.transpose() * nbr.factor over the flushed panels
    */
   mat_type XtX;
 
@@ -208,24 +221,56 @@ public:
    */
   vec_type Xy;
 
+  /**
+   * \brief The neighbor factors (one per row) not yet added to XtX
+   */
+  mat_type panel;
+
+  /** \brief The number of rows of panel in use */
+  size_t npanel;
+
   /** \brief basic default constructor */
-  gather_type() { }
+  gather_type() : npanel(0) { }
 
   /**
-   * \brief This constructor computes XtX and Xy and stores the result
-   * in XtX and Xy
+   * \brief This constructor stores X in the panel and computes Xy
    */
   gather_type(const vec_type& X, const double y) :
-    XtX(X.size(), X.size()), Xy(X.size()) {
-    XtX.triangularView<Eigen::Upper>() = X * X.transpose();
-    Xy = X * y;
-  } // end of constructor for gather type
+    Xy(X * y), panel(X.transpose()), npanel(1) { }
+
+  /** \brief Add the rows of the panel to XtX */
+  void flush() {
+    if(npanel == 0) return;
+    if(XtX.size() == 0) XtX.setZero(Xy.size(), Xy.size());
+    XtX.selfadjointView<Eigen::Upper>().rankUpdate(panel.topRows(npanel).transpose());
+    npanel = 0;
+  } // end of flush
 
   /** \brief Save the values to a binary archive */
-  void save(graphlab::oarchive& arc) const { arc << XtX << Xy; }
+  void save(graphlab::oarchive& arc) const {
+    // Only the upper triangle of XtX is stored
+    vec_type packed(XtX.rows() * (XtX.rows() + 1) / 2);
+    for(int j = 0, k = 0; j < XtX.cols(); ++j)
+      for(int i = 0; i <= j; ++i) packed(k++) = XtX(i,j);
+    arc << Xy << packed << npanel;
+    for(size_t r = 0; r < npanel; ++r) arc << vec_type(panel.row(r));
+  }
 
   /** \brief Read the values from a binary archive */
-  void load(graphlab::iarchive& arc) { arc >> XtX >> Xy; }  
+  void load(graphlab::iarchive& arc) {
+    vec_type packed;
+    arc >> Xy >> packed >> npanel;
+    if(packed.size() == 0) XtX.resize(0,0);
+    else {
+      XtX.resize(Xy.size(), Xy.size());
+      for(int j = 0, k = 0; j < XtX.cols(); ++j)
+        for(int i = 0; i <= j; ++i) XtX(i,j) = packed(k++);
+    }
+    panel.resize(npanel, Xy.size());
+    for(size_t r = 0; r < npanel; ++r) {
+      vec_type row; arc >> row; panel.row(r) = row;
+    }
+  }
 
   /** 
    * \brief Computes XtX += other.XtX and Xy += other.Xy updating this
@@ -234,15 +279,24 @@ public:
   gather_type& operator+=(const gather_type& other) {
     if(other.Xy.size() == 0) {
       ASSERT_EQ(other.XtX.rows(), 0);
-      ASSERT_EQ(other.XtX.cols(), 0);
+      ASSERT_EQ(other.npanel, 0);
     } else {
       if(Xy.size() == 0) {
         ASSERT_EQ(XtX.rows(), 0); 
-        ASSERT_EQ(XtX.cols(), 0);
-        XtX = other.XtX; Xy = other.Xy;
+        ASSERT_EQ(npanel, 0);
+        *this = other;
       } else {
-        XtX.triangularView<Eigen::Upper>() += other.XtX;  
+        if(other.XtX.size() > 0) {
+          if(XtX.size() == 0) XtX = other.XtX;
+          else XtX.triangularView<Eigen::Upper>() += other.XtX;  
+        }
         Xy += other.Xy;
+        if(panel.rows() < int(BLOCK_SIZE))
+          panel.conservativeResize(BLOCK_SIZE, Xy.size());
+        for(size_t r = 0; r < other.npanel; ++r) {
+          if(npanel >= BLOCK_SIZE) flush();
+          panel.row(npanel++) = other.panel.row(r);
+        }
       }
     }
     return *this;
@@ -250,6 +304,44 @@ public:
 
 }; // end of gather type
 
+size_t gather_type::BLOCK_SIZE = 32;
+
+
+/**
+ * \brief The per-thread scratch space used to solve the normal
+ * equations in apply without allocating new temporaries.
+ */
+struct als_workspace {
+  mat_type XtX;
+  vec_type old_factor;
+  Eigen::LDLT<mat_type, Eigen::Upper> ldlt;
+};
+
+pthread_key_t als_workspace_key;
+
+void destroy_als_workspace(void* ptr) {
+  als_workspace* workspace = reinterpret_cast<als_workspace*>(ptr);
+  if(workspace != NULL) delete workspace;
+}
+
+struct als_workspace_key_creater {
+  als_workspace_key_creater() {
+    pthread_key_create(&als_workspace_key, destroy_als_workspace);
+  }
+};
+static const als_workspace_key_creater make_als_workspace_key;
+
+/** \brief Get the workspace of the calling thread */
+als_workspace& get_als_workspace() {
+  als_workspace* workspace =
+    reinterpret_cast<als_workspace*>(pthread_getspecific(als_workspace_key));
+  if(workspace == NULL) {
+    workspace = new als_workspace();
+    pthread_setspecific(als_workspace_key, workspace);
+  }
+  return *workspace;
+} // end of get_als_workspace
+
 
 
 /**
@@ -317,8 +409,15 @@ public:
     // Determine the number of neighbors.  Each vertex has only in or
     // out edges depending on which side of the graph it is located
     if(sum.Xy.size() == 0) { vdata.residual = 0; ++vdata.nupdates; return; }
-    mat_type XtX = sum.XtX;
-    vec_type Xy = sum.Xy;
+    als_workspace& workspace = get_als_workspace();
+    mat_type& XtX = workspace.XtX;
+    const int nlatent = sum.Xy.size();
+    if(sum.XtX.size() > 0) XtX = sum.XtX;
+    else XtX.setZero(nlatent, nlatent);
+    if(sum.npanel > 0) {
+      XtX.selfadjointView<Eigen::Upper>()
+        .rankUpdate(sum.panel.topRows(sum.npanel).transpose());
+    }
     // Add regularization
     double regularization = LAMBDA;
     if (REGNORMAL)
@@ -326,10 +425,11 @@ public:
     for(int i = 0; i < XtX.rows(); ++i) 
       XtX(i,i) += regularization; 
     // Solve the least squares problem using eigen ----------------------------
-    const vec_type old_factor = vdata.factor;
-    vdata.factor = XtX.selfadjointView<Eigen::Upper>().ldlt().solve(Xy);
+    workspace.old_factor = vdata.factor;
+    workspace.ldlt.compute(XtX);
+    vdata.factor = workspace.ldlt.solve(sum.Xy);
     // Compute the residual change in the factor factor -----------------------
-    vdata.residual = (vdata.factor - old_factor).cwiseAbs().sum() / XtX.rows();
+    vdata.residual = (vdata.factor - workspace.old_factor).cwiseAbs().sum() / XtX.rows();
     ++vdata.nupdates;
   } // end of apply
   
@@ -597,6 +697,8 @@ int main(int argc, char** argv) {
                        "The engine type synchronous or asynchronous");
   clopts.attach_option("regnormal", als_vertex_program::REGNORMAL, 
                        "regularization type. 1 = weighted according to neighbors num. 0 = no weighting - just lambda");
+  clopts.attach_option("gather_block", gather_type::BLOCK_SIZE,
+                       "The number of neighbor factors batched into each rank-k update of XtX.");
   
   parse_implicit_command_line(clopts);
   
@@ -608,6 +710,11 @@ int main(int argc, char** argv) {
 
 
 
+  if(gather_type::BLOCK_SIZE == 0) {
+    std::cout << "gather_block must be positive." << std::endl;
+    return EXIT_FAILURE;
+  }
+
   ///! Initialize control plain using mpi
   graphlab::mpi_tools::init(argc, argv);
   graphlab::distributed_control dc;
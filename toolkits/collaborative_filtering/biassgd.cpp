@@ -553,6 +553,42 @@ size_t biassgd_vertex_program::NUM_TRAINING_EDGES = 0;
  */
 typedef graphlab::omni_engine<biassgd_vertex_program> engine_type;
 
+#include "block_sgd.hpp"
+
+bool is_train_edge(const edge_data& edata) {
+  return edata.role == edge_data::TRAIN;
+}
+bool is_validate_edge(const edge_data& edata) {
+  return edata.role == edge_data::VALIDATE;
+}
+
+/**
+ * \brief Run bias-SGD with the shared memory block_sgd fast path
+ * instead of the engine and store the factors and biases back into
+ * the graph.  Returns the number of ratings processed.
+ */
+size_t run_block_sgd(graphlab::distributed_control& dc, graph_type& graph,
+                     size_t nblocks) {
+  block_sgd<graph_type> sgd(graph, nblocks, is_train_edge, is_validate_edge);
+  sgd.load(vertex_data::NLATENT);
+  for(graph_type::lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid)
+    sgd.bias(lvid) = graph.l_vertex(lvid).data().bias;
+  sgd.use_bias = true;
+  sgd.global_mean = biassgd_vertex_program::GLOBAL_MEAN;
+  sgd.gamma = biassgd_vertex_program::GAMMA;
+  sgd.lambda = biassgd_vertex_program::LAMBDA;
+  sgd.step_dec = biassgd_vertex_program::STEP_DEC;
+  sgd.minval = biassgd_vertex_program::MINVAL;
+  sgd.maxval = biassgd_vertex_program::MAXVAL;
+  const size_t epochs = sgd.run(biassgd_vertex_program::MAX_UPDATES,
+                                biassgd_vertex_program::TOLERANCE, dc.cout());
+  sgd.store();
+  for(graph_type::lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid)
+    graph.l_vertex(lvid).data().bias = sgd.bias(lvid);
+  dc.cout() << "Epochs executed: " << epochs << std::endl;
+  return epochs * sgd.num_training();
+} // end of run_block_sgd
+
 double calc_global_mean(const graph_type::edge_type & edge){
   if (edge.data().role == edge_data::TRAIN)
      return edge.data().obs;
@@ -578,6 +614,8 @@ int main(int argc, char** argv) {
   std::string predictions;
   size_t interval = 0;
   std::string exec_type = "synchronous";
+  bool use_block_sgd = false;
+  size_t sgd_blocks = 0;
   clopts.attach_option("matrix", input_dir,
                        "The directory containing the matrix file");
   clopts.add_positional("matrix");
@@ -602,6 +640,10 @@ int main(int argc, char** argv) {
                        "The time in seconds between error reports");
   clopts.attach_option("predictions", predictions,
                        "The prefix (folder and filename) to save predictions.");
+  clopts.attach_option("block_sgd", use_block_sgd,
+                       "Run the shared memory blocked SGD instead of the engine (single machine only)");
+  clopts.attach_option("sgd_blocks", sgd_blocks,
+                       "The number of user and item blocks used by --block_sgd (0 = automatic)");
 
   parse_implicit_command_line(clopts);
 
@@ -678,17 +720,36 @@ dc.cout() << "Finalizing graph." << std::endl;
   dc.cout() << "Please send bug reports to danny.bickson@gmail.com" << std::endl;
   dc.cout() << "Time   Training    Validation" <<std::endl;
   dc.cout() << "       RMSE        RMSE " <<std::endl;
+  if(use_block_sgd && dc.numprocs() > 1) {
+    logstream(LOG_WARNING) << "--block_sgd only runs on a single machine. "
+                           << "Using the engine instead." << std::endl;
+    use_block_sgd = false;
+  }
   timer.start();
-  engine.start();  
-
-  const double runtime = timer.current_time();
-  dc.cout() << "----------------------------------------------------------"
-            << std::endl
-            << "Final Runtime (seconds):   " << runtime 
-            << std::endl
-            << "Updates executed: " << engine.num_updates() << std::endl
-            << "Update Rate (updates/second): " 
-            << engine.num_updates() / runtime << std::endl;
+  if(use_block_sgd) {
+    if(sgd_blocks == 0) {
+      sgd_blocks = block_sgd<graph_type>::default_nblocks
+        (graph.num_local_vertices(), vertex_data::NLATENT, clopts.get_ncpus());
+    }
+    const size_t nratings = run_block_sgd(dc, graph, sgd_blocks);
+    const double runtime = timer.current_time();
+    dc.cout() << "----------------------------------------------------------"
+              << std::endl
+              << "Final Runtime (seconds):   " << runtime << std::endl
+              << "Ratings processed: " << nratings << std::endl
+              << "Update Rate (ratings/second): " << nratings / runtime << std::endl;
+  } else {
+    engine.start();  
+
+    const double runtime = timer.current_time();
+    dc.cout() << "----------------------------------------------------------"
+              << std::endl
+              << "Final Runtime (seconds):   " << runtime 
+              << std::endl
+              << "Updates executed: " << engine.num_updates() << std::endl
+              << "Update Rate (updates/second): " 
+              << engine.num_updates() / runtime << std::endl;
+  }
 
   // Compute the final training error -----------------------------------------
   dc.cout() << "Final error: " << std::endl;
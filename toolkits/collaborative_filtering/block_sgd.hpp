@@ -0,0 +1,265 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ * Shared memory blocked (DSGD/FPSGD style) stochastic gradient
+ * descent used as a fast path by sgd and biassgd on a single machine.
+ */
+
+
+#ifndef TK_BLOCK_SGD
+#define TK_BLOCK_SGD
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <Eigen/Dense>
+#include <graphlab/util/random.hpp>
+#include <graphlab/util/timer.hpp>
+
+
+/**
+ * \brief Runs SGD matrix factorization directly over the local edges
+ * of a graph without going through the engine.
+ *
+ * The users and items are each hashed into nblocks ranges which
+ * splits the rating matrix into nblocks x nblocks blocks.  An epoch
+ * is made of nblocks strata.  Each stratum is a set of nblocks blocks
+ * which share no user or item, so the blocks of a stratum are
+ * processed in parallel with lock-free updates.  The order of the
+ * strata and the pairing of the block columns are reshuffled every
+ * epoch.
+ *
+ * The factors are copied into a single row-major matrix so that each
+ * update is a pair of vectorized dot products and axpys on contiguous
+ * memory.  The caller copies the factors (and biases) in and out of
+ * the graph with load() and store().
+ *
+ * The predicted value of a rating is
+ * \code
+ *   global_mean + bias[user] + bias[item] + factor[user].dot(factor[item])
+ * \endcode
+ * where the biases are only used (and learned) if use_bias is set.
+ */
+template<typename Graph>
+class block_sgd {
+public:
+  typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic,
+                        Eigen::RowMajor> factor_matrix_type;
+  typedef typename Graph::lvid_type lvid_type;
+
+  /** \brief A rating stored by the local ids of the user and item */
+  struct rating_type {
+    lvid_type user, item;
+    float obs;
+  };
+
+  /** \brief The latent factors, one row per local vertex */
+  factor_matrix_type factors;
+  /** \brief The bias of each local vertex */
+  Eigen::VectorXd bias;
+
+  double gamma, lambda, step_dec;
+  double minval, maxval;
+  double global_mean;
+  bool use_bias;
+
+private:
+  Graph& graph;
+  size_t nblocks;
+  /** \brief The training ratings grouped by block */
+  std::vector<rating_type> ratings;
+  /** \brief The offset of block (i,j) in ratings is block_offset[i*nblocks+j] */
+  std::vector<size_t> block_offset;
+  std::vector<rating_type> validation;
+
+  size_t block_of(lvid_type lvid) const {
+    return (size_t(lvid) * 2654435761u) % nblocks;
+  }
+
+  double predict(const rating_type& r) const {
+    double pred = factors.row(r.user).dot(factors.row(r.item));
+    if(use_bias) pred += global_mean + bias(r.user) + bias(r.item);
+    pred = std::min(pred, maxval);
+    pred = std::max(pred, minval);
+    return pred;
+  }
+
+  /** \brief Run SGD over a single block returning the squared error */
+  double run_block(size_t i, size_t j) {
+    double sqerr = 0;
+    const size_t begin = block_offset[i * nblocks + j];
+    const size_t end = block_offset[i * nblocks + j + 1];
+    for(size_t k = begin; k < end; ++k) {
+      const rating_type& r = ratings[k];
+      const double err = r.obs - predict(r);
+      sqerr += err * err;
+      if(use_bias) {
+        bias(r.user) += gamma * (err - lambda * bias(r.user));
+        bias(r.item) += gamma * (err - lambda * bias(r.item));
+      }
+      // The rows are contiguous so this loop is vectorized
+      double* __restrict__ pu = &factors(r.user, 0);
+      double* __restrict__ qi = &factors(r.item, 0);
+      const int nlatent = factors.cols();
+      for(int d = 0; d < nlatent; ++d) {
+        const double u = pu[d], v = qi[d];
+        pu[d] += gamma * (err * v - lambda * u);
+        qi[d] += gamma * (err * u - lambda * v);
+      }
+    }
+    return sqerr;
+  } // end of run_block
+
+public:
+  /**
+   * \brief Collect the ratings of the local graph.  The graph must be
+   * finalized and is_train / is_validate select the edges used for
+   * training and validation.
+   */
+  template<typename TrainPredicate, typename ValidatePredicate>
+  block_sgd(Graph& graph, size_t nblocks,
+            TrainPredicate is_train, ValidatePredicate is_validate) :
+    gamma(0.001), lambda(0.001), step_dec(0.9),
+    minval(-1e100), maxval(1e100), global_mean(0), use_bias(false),
+    graph(graph), nblocks(std::max(nblocks, size_t(1))) {
+    const size_t nblocks2 = this->nblocks * this->nblocks;
+    std::vector<size_t> counts(nblocks2 + 1, 0);
+    std::vector<rating_type> unsorted;
+    for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid) {
+      typedef typename Graph::local_edge_type local_edge_type;
+      foreach(const local_edge_type& e, graph.l_vertex(lvid).out_edges()) {
+        rating_type r;
+        r.user = e.source().id(); r.item = e.target().id();
+        r.obs = e.data().obs;
+        if(is_train(e.data())) {
+          unsorted.push_back(r);
+          ++counts[block_of(r.user) * this->nblocks + block_of(r.item) + 1];
+        } else if(is_validate(e.data())) validation.push_back(r);
+      }
+    }
+    // Bucket the ratings by block and shuffle within each block
+    graphlab::random::shuffle(unsorted);
+    block_offset.resize(nblocks2 + 1, 0);
+    for(size_t b = 0; b < nblocks2; ++b)
+      block_offset[b + 1] = block_offset[b] + counts[b + 1];
+    std::vector<size_t> next(block_offset.begin(), block_offset.end() - 1);
+    ratings.resize(unsorted.size());
+    foreach(const rating_type& r, unsorted) {
+      ratings[next[block_of(r.user) * this->nblocks + block_of(r.item)]++] = r;
+    }
+  } // end of constructor
+
+  /**
+   * \brief Choose enough blocks to keep every thread busy and to keep
+   * the factors touched by one block (1/nblocks of the users and of
+   * the items) within about 1MB of cache.
+   */
+  static size_t default_nblocks(size_t nvertices, size_t nlatent,
+                                size_t ncpus) {
+    const size_t cache_bytes = 1 << 20;
+    const size_t nblocks =
+      (nvertices * nlatent * sizeof(double) + cache_bytes - 1) / cache_bytes;
+    return std::max(ncpus, std::min(nblocks, size_t(1024)));
+  }
+
+  size_t num_training() const { return ratings.size(); }
+  size_t num_validation() const { return validation.size(); }
+
+  /** \brief Copy the factor of every local vertex out of the graph */
+  void load(size_t nlatent) {
+    factors.resize(graph.num_local_vertices(), nlatent);
+    bias.setZero(graph.num_local_vertices());
+    for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid)
+      factors.row(lvid) = graph.l_vertex(lvid).data().pvec.transpose();
+  }
+
+  /** \brief Copy the factors back into the graph */
+  void store() {
+    for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid)
+      graph.l_vertex(lvid).data().pvec = factors.row(lvid).transpose();
+  }
+
+  /** \brief The RMSE over the validation ratings */
+  double validation_rmse() const {
+    if(validation.empty()) return 0;
+    double sqerr = 0;
+    foreach(const rating_type& r, validation) {
+      const double err = r.obs - predict(r);
+      sqerr += err * err;
+    }
+    return std::sqrt(sqerr / validation.size());
+  }
+
+  /**
+   * \brief Run one epoch over all the training ratings returning the
+   * training RMSE observed during the epoch.
+   */
+  double run_epoch() {
+    std::vector<size_t> column = graphlab::random::permutation<size_t>(nblocks);
+    std::vector<size_t> strata = graphlab::random::permutation<size_t>(nblocks);
+    double sqerr = 0;
+    foreach(size_t s, strata) {
+      double stratum_sqerr = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:stratum_sqerr)
+      for(int i = 0; i < int(nblocks); ++i) {
+        stratum_sqerr += run_block(i, column[(i + s) % nblocks]);
+      }
+      sqerr += stratum_sqerr;
+    }
+    gamma *= step_dec;
+    return ratings.empty() ? 0 : std::sqrt(sqerr / ratings.size());
+  } // end of run_epoch
+
+  /**
+   * \brief Run up to max_epochs epochs, stopping early once the
+   * training RMSE changes by less than tolerance, and print the
+   * RMSE-vs-time trace in the same format as the engine path.
+   */
+  template<typename Ostream>
+  size_t run(size_t max_epochs, double tolerance, Ostream& out) {
+    graphlab::timer timer;
+    timer.start();
+    double last_rmse = -1;
+    size_t epoch = 0;
+    for(; epoch < max_epochs; ++epoch) {
+      const double rmse = run_epoch();
+      out << std::setw(8) << timer.current_time() << "  "
+          << std::setw(8) << rmse;
+      if(!validation.empty())
+        out << "   " << std::setw(8) << validation_rmse();
+      out << std::endl;
+      if(std::isnan(rmse))
+        logstream(LOG_FATAL) << "Got into numeric errors.. try to tune step size "
+                             << "and regularization using --lambda and --gamma flags"
+                             << std::endl;
+      if(last_rmse >= 0 && std::fabs(last_rmse - rmse) < tolerance) {
+        ++epoch;
+        break;
+      }
+      last_rmse = rmse;
+    }
+    return epoch;
+  } // end of run
+
+}; // end of block_sgd
+
+
+#endif
@@ -0,0 +1,244 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ * Distributed linear algebra kernels executed directly over the
+ * local graph of a distributed_graph, without running the engine.
+ */
+
+
+#ifndef TK_DIST_LINALG
+#define TK_DIST_LINALG
+
+#include <vector>
+#include <set>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <graphlab/rpc/dc_dist_object.hpp>
+#include <graphlab/rpc/buffered_exchange.hpp>
+#include <graphlab/macros_def.hpp>
+
+
+/**
+ * \brief Fused distributed vector and sparse matrix operations over
+ * the vertex vectors (vertex_data::pvec) of a distributed_graph.
+ *
+ * Each vertex stores one entry of every distributed vector; the
+ * vector is identified by its offset in pvec.  Vector operations
+ * (transform() and reduce()) run as a single parallel loop over the
+ * local master vertices followed by at most one all_reduce.  Because
+ * only masters are written the mirrors of the written offsets are
+ * marked stale and are refreshed lazily (one exchange of doubles)
+ * the next time an spmv() reads them.
+ *
+ * spmv() computes a partial sum for every selected local vertex over
+ * its local edges, sends the partial sums of mirrors to their
+ * masters, and then applies the result on the masters.
+ */
+template<typename Graph>
+class dist_linalg {
+public:
+  typedef typename Graph::lvid_type lvid_type;
+  typedef typename Graph::vertex_id_type vertex_id_type;
+  typedef typename Graph::vertex_type vertex_type;
+  typedef typename Graph::local_vertex_type local_vertex_type;
+  typedef typename Graph::local_edge_type local_edge_type;
+  typedef std::pair<vertex_id_type, double> entry_type;
+  typedef typename graphlab::buffered_exchange<entry_type>::buffer_type
+  buffer_type;
+
+private:
+  graphlab::dc_dist_object<dist_linalg> rmi;
+  Graph& graph;
+  graphlab::buffered_exchange<entry_type> exchange;
+  /** \brief The local masters */
+  std::vector<lvid_type> masters;
+  /** \brief The partial sums of the last spmv indexed by lvid */
+  std::vector<double> partial;
+  /** \brief The offsets whose mirrors are stale */
+  std::set<int> stale;
+
+  static size_t thread_id() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+  }
+
+  void receive(buffer_type& buffer, int offset, bool accumulate) {
+    foreach(const entry_type& entry, buffer) {
+      const lvid_type lvid = graph.local_vid(entry.first);
+      if(accumulate) partial[lvid] += entry.second;
+      else graph.l_vertex(lvid).data().pvec[offset] = entry.second;
+    }
+    buffer.clear();
+  }
+
+  void drain(int offset, bool accumulate) {
+    graphlab::procid_t proc;
+    buffer_type buffer;
+    exchange.flush();
+    while(exchange.recv(proc, buffer)) receive(buffer, offset, accumulate);
+    ASSERT_TRUE(exchange.empty());
+    // a machine which is done could otherwise send the entries of the
+    // next operation before this one has stopped receiving
+    rmi.barrier();
+  }
+
+public:
+  dist_linalg(graphlab::distributed_control& dc, Graph& graph) :
+    rmi(dc, this), graph(graph),
+#ifdef _OPENMP
+    exchange(dc, omp_get_max_threads())
+#else
+    exchange(dc)
+#endif
+  {
+    for(lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid)
+      if(graph.l_vertex(lvid).owned()) masters.push_back(lvid);
+    partial.resize(graph.num_local_vertices(), 0);
+    rmi.barrier();
+  }
+
+  /**
+   * \brief Apply fn(vertex) to every local master vertex_type whose
+   * global id is accepted by select.  The caller marks the offsets written by fn with
+   * invalidate().
+   */
+  template<typename Select, typename Fn>
+  void transform(Select select, Fn fn) {
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for(int i = 0; i < int(masters.size()); ++i) {
+      vertex_type vertex(graph, masters[i]);
+      if(select(vertex.id())) fn(vertex);
+    }
+  }
+
+  /**
+   * \brief Sum fn(vertex) over every master vertex accepted by select
+   * on all machines using a single all_reduce.
+   */
+  template<typename T, typename Select, typename Fn>
+  T reduce(Select select, Fn fn, const T& zero) {
+#ifdef _OPENMP
+    std::vector<T> sums(omp_get_max_threads(), zero);
+#pragma omp parallel for
+#else
+    std::vector<T> sums(1, zero);
+#endif
+    for(int i = 0; i < int(masters.size()); ++i) {
+      vertex_type vertex(graph, masters[i]);
+      if(select(vertex.id())) sums[thread_id()] += fn(vertex);
+    }
+    T total = sums[0];
+    for(size_t t = 1; t < sums.size(); ++t) total += sums[t];
+    rmi.all_reduce(total);
+    return total;
+  }
+
+  /** \brief Mark pvec[offset] of the mirrors as out of date */
+  void invalidate(int offset) {
+    if(offset >= 0) stale.insert(offset);
+  }
+
+  /**
+   * \brief Copy pvec[offset] from the masters to all mirrors if it was
+   * written since the last synchronization.
+   */
+  void synchronize(int offset) {
+    if(offset < 0 || stale.count(offset) == 0) return;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for(int i = 0; i < int(masters.size()); ++i) {
+      local_vertex_type vertex = graph.l_vertex(masters[i]);
+      const entry_type entry(vertex.global_id(), vertex.data().pvec[offset]);
+      foreach(size_t proc, vertex.mirrors()) exchange.send(proc, entry, thread_id());
+    }
+    drain(offset, false);
+    stale.erase(offset);
+  }
+
+  /** \brief Synchronize every stale offset */
+  void synchronize_all() {
+    std::vector<int> offsets(stale.begin(), stale.end());
+    foreach(int offset, offsets) synchronize(offset);
+  }
+
+  /**
+   * \brief Sparse matrix vector product.
+   *
+   * For every local vertex accepted by select the partial sum of
+   * edge_value(vertex, edge) over its local out edges (if
+   * use_out_edges(vertex) is true) or in edges is computed.  The
+   * partial sums of mirrors are then reduced to the masters where
+   * apply(vertex, total) is called with the master vertex_type.  The offsets listed in inputs
+   * (those read by edge_value) are synchronized to the mirrors first.
+   */
+  template<typename Select, typename Direction, typename EdgeValue,
+           typename Apply>
+  void spmv(Select select, Direction use_out_edges, EdgeValue edge_value,
+            Apply apply, const std::vector<int>& inputs) {
+    foreach(int offset, inputs) synchronize(offset);
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for(int lvid = 0; lvid < int(graph.num_local_vertices()); ++lvid) {
+      local_vertex_type vertex = graph.l_vertex(lvid);
+      double sum = 0;
+      if(select(vertex.global_id())) {
+        if(use_out_edges(vertex)) {
+          foreach(const local_edge_type& edge, vertex.out_edges())
+            sum += edge_value(vertex, edge);
+        } else {
+          foreach(const local_edge_type& edge, vertex.in_edges())
+            sum += edge_value(vertex, edge);
+        }
+        if(!vertex.owned() && sum != 0) {
+          exchange.send(vertex.owner(), entry_type(vertex.global_id(), sum),
+                        thread_id());
+          sum = 0;
+        }
+      }
+      partial[lvid] = sum;
+    }
+    drain(-1, true);
+    transform(select, apply_partial<Apply>(apply, partial));
+  }
+
+private:
+  template<typename Apply>
+  struct apply_partial {
+    Apply apply;
+    const std::vector<double>& partial;
+    apply_partial(Apply apply, const std::vector<double>& partial) :
+      apply(apply), partial(partial) { }
+    void operator()(vertex_type& vertex) const {
+      apply(vertex, partial[vertex.local_id()]);
+    }
+  };
+
+}; // end of dist_linalg
+
+
+#endif
@@ -27,6 +27,7 @@
 #include "types.hpp"
 #include "graphlab.hpp"
 #include "graphlab/util/tracepoint.hpp"
+#include "dist_linalg.hpp"
 
 
 DECLARE_TRACER(Axbtrace);
@@ -104,6 +105,71 @@ double runtime = 0;
 using namespace graphlab;
 
 vec curvec;
+
+/**
+ * When set the Axb operation and the vector operations of norm() and
+ * orthogonalize_vs_all() run directly over the local graph using a
+ * single parallel loop (and at most one all_reduce) instead of an
+ * engine pass each. See dist_linalg.hpp
+ */
+dist_linalg<graph_type> * plinalg = NULL;
+
+/* selects the vertices with ids in [start, end) */
+struct vid_in_range {
+  graph_type::vertex_id_type start, end;
+  vid_in_range(int start, int end) : start(start), end(end) { }
+  bool operator()(graph_type::vertex_id_type vid) const {
+    return vid >= start && vid < end;
+  }
+};
+
+/***
+ * COMPUTE r = c*A*x + d*y (or orthogonalize) given the sum of the
+ * gathered edges, shared by the Axb vertex program and fused_axb()
+ */
+void axb_apply(vertex_data & user, const double total){
+  assert(mi.x_offset >=0 || mi.y_offset >= 0);
+  assert(mi.r_offset >=0);
+
+  /* perform orthogonalization of current vector */
+  if (mi.orthogonalization){
+    for (int i=mi.mat_offset; i< mi.vec_offset; i++){
+      user.pvec[mi.vec_offset] -= alphas.pvec[i-mi.mat_offset] * user.pvec[i];
+    }
+    return;
+  }
+
+  double val = total;
+  //assert(total != 0 || mi.y_offset >= 0);
+
+  //store previous value for convergence detection
+  if (mi.prev_offset >= 0)
+    user.pvec[mi.prev_offset ] = user.pvec[mi.r_offset];
+
+  assert(mi.x_offset >=0 || mi.y_offset>=0);
+  if (mi.A_offset  && mi.x_offset >= 0){
+    if  (info.is_square() && mi.use_diag)// add the diagonal term
+      val += (/*mi.c**/ (user.A_ii+ regularization) * user.pvec[mi.x_offset]);
+    val *= mi.c;
+  }
+  /***** COMPUTE r = c*I*x  *****/
+  else if (!mi.A_offset && mi.x_offset >= 0){
+    val = mi.c*user.pvec[mi.x_offset];
+  }
+
+  /**** COMPUTE r+= d*y (optional) ***/
+  if (mi.y_offset>= 0){
+    val += mi.d*user.pvec[mi.y_offset];
+  }
+
+  /***** compute r = (... ) / div */
+  if (mi.div_offset >= 0){
+    val /= user.pvec[mi.div_offset];
+  }
+
+  user.pvec[mi.r_offset] = val;
+}
+
 /***
  * UPDATE FUNCTION (ROWS)
  */
@@ -137,49 +203,7 @@ class Axb :
         const double& total) {
 
       //printf("Entered apply on node %d value %lg\n", vertex.id(), total);
-      vertex_data & user = vertex.data();
-      assert(mi.x_offset >=0 || mi.y_offset >= 0);
-      assert(mi.r_offset >=0);
-
-      /* perform orthogonalization of current vector */
-      if (mi.orthogonalization){
-         for (int i=mi.mat_offset; i< mi.vec_offset; i++){
-            vertex.data().pvec[mi.vec_offset] -= alphas.pvec[i-mi.mat_offset] * vertex.data().pvec[i]; 
-         }
-         return;
-      }
-
-      double val = total;
-      //assert(total != 0 || mi.y_offset >= 0);
-
-      //store previous value for convergence detection
-      if (mi.prev_offset >= 0)
-        user.pvec[mi.prev_offset ] = user.pvec[mi.r_offset];
-
-      assert(mi.x_offset >=0 || mi.y_offset>=0);
-      if (mi.A_offset  && mi.x_offset >= 0){
-        if  (info.is_square() && mi.use_diag)// add the diagonal term
-          val += (/*mi.c**/ (user.A_ii+ regularization) * user.pvec[mi.x_offset]);
-        //printf("node %d added diag term: %lg\n", vertex.id(), user.A_ii);
-        val *= mi.c;
-      }
-      /***** COMPUTE r = c*I*x  *****/
-      else if (!mi.A_offset && mi.x_offset >= 0){
-        val = mi.c*user.pvec[mi.x_offset];
-      }
-
-      /**** COMPUTE r+= d*y (optional) ***/
-      if (mi.y_offset>= 0){
-        val += mi.d*user.pvec[mi.y_offset]; 
-      }
-
-      /***** compute r = (... ) / div */
-      if (mi.div_offset >= 0){
-        val /= user.pvec[mi.div_offset];
-      }
-
-      user.pvec[mi.r_offset] = val;
-      //printf("Exit apply on node %d value %lg\n", vertex.id(), val);
+      axb_apply(vertex.data(), total);
     }
 
     edge_dir_type gather_edges(icontext_type& context,
@@ -727,12 +751,17 @@ DistDouble norm(const DistVec &vec){
   DistDouble mval;
   mval.val = 0;
   pcurrent = (DistVec*)&vec;
+  if (plinalg != NULL){
+    gather_type ret = plinalg->reduce(vid_in_range(vec.start, vec.end), calc_norm, gather_type());
+    mval.val = sqrt(ret.training_rmse);
+    return mval;
+  }
   vertex_set nodes = pgraph->select(select_in_range);
   //for (int i=vec.start; i < vec.end; i++){
     // TODO const vertex_data * data = &pgraph->vertex_data(i);
     //double * px = (double*)&data->pvec[0];
     // mval.val += px[vec.offset]*px[vec.offset];
-  gather_type ret = pgraph->map_reduce_vertices<gather_type>(calc_norm);
+  gather_type ret = pgraph->map_reduce_vertices<gather_type>(calc_norm, nodes);
   //}
   mval.val = sqrt(ret.training_rmse);
   return mval;
@@ -798,6 +827,61 @@ gather_type map_reduce_ortho(const graph_type::vertex_type & vertex){
         (vertex.id() < (uint)info.get_end_node(!pcurrent->transpose)));
   }
 
+  /* the range of vertices selected by selected_node() */
+  vid_in_range selected_range(){
+    if (info.is_square())
+      return vid_in_range(0, info.total());
+    return vid_in_range(info.get_start_node(!pcurrent->transpose),
+        info.get_end_node(!pcurrent->transpose));
+  }
+
+  /* the gather edges and gather of the Axb vertex program */
+  struct fused_axb_out_edges {
+    bool operator()(const graph_type::local_vertex_type & vertex) const {
+      return vertex.global_id() < (uint)rows;
+    }
+  };
+  struct fused_axb_gather {
+    double operator()(const graph_type::local_vertex_type & vertex,
+        const graph_type::local_edge_type & edge) const {
+      if (edge.data().role == edge_data::PREDICT)
+        return 0;
+      bool brows = vertex.global_id() < (uint)info.get_start_node(false);
+      if (info.is_square())
+        brows = !mi.A_transpose;
+      return edge.data().obs * (brows ? edge.target().data().pvec[mi.x_offset] :
+          edge.source().data().pvec[mi.x_offset]);
+    }
+  };
+  struct fused_axb_apply {
+    void operator()(graph_type::vertex_type & vertex) const {
+      axb_apply(vertex.data(), 0);
+    }
+    void operator()(graph_type::vertex_type & vertex, double total) const {
+      axb_apply(vertex.data(), total);
+    }
+  };
+
+  /**
+   * Runs the Axb operation described by mi over the selected vertices
+   * without the engine: a sparse matrix vector product when A is
+   * involved and a single local loop otherwise.
+   */
+  void fused_axb(){
+    assert(plinalg != NULL);
+    if (mi.A_offset && mi.x_offset >= 0 && !mi.orthogonalization){
+      plinalg->spmv(selected_range(), fused_axb_out_edges(), fused_axb_gather(),
+          fused_axb_apply(), std::vector<int>(1, mi.x_offset));
+    }
+    else plinalg->transform(selected_range(), fused_axb_apply());
+    if (mi.orthogonalization)
+      plinalg->invalidate(mi.vec_offset);
+    else {
+      plinalg->invalidate(mi.r_offset);
+      plinalg->invalidate(mi.prev_offset);
+    }
+  }
+
 
   double orthogonalize_vs_all(DistSlicedMat & mat, int _curoffset, double &alpha){
     assert(mi.ortho_repeats >=1 && mi.ortho_repeats <= 3);
@@ -812,6 +896,30 @@ gather_type map_reduce_ortho(const graph_type::vertex_type & vertex){
     pcurrent =&current;
     mi.vec_offset = pcurrent->offset;
     assert(mat.start_offset <= current.offset); 
+    if (plinalg != NULL){
+      /* all the dot products in one pass, then the subtraction and
+         the normalization as local loops */
+      const vid_in_range selected = selected_range();
+      if (curoffset > 0){
+        gather_type zero;
+        zero.pvec = vec::Zero(curoffset);
+        for (int j=0; j < mi.ortho_repeats; j++){
+          alphas = plinalg->reduce(selected, map_reduce_ortho, zero);
+          plinalg->transform(selected, transform_ortho);
+        }
+      }
+      debug = old_debug;
+      sum_alpha = plinalg->reduce(selected, map_reduce_sum_power, gather_type());
+      sum_alpha.training_rmse = sqrt(sum_alpha.training_rmse);
+      alpha = sum_alpha.training_rmse;
+      if (alpha >= 1e-10)
+        plinalg->transform(selected, divide_by_sum);
+      plinalg->invalidate(current.offset);
+      mi.reset_offsets();
+      current.debug_print(current.name);
+      END_TRACEPOINT(orthogonalize_vs_alltrace);
+      return alpha;
+    }
     vertex_set nodes = pgraph->select(selected_node);
     if (curoffset > 0){
       for (int j=0; j < mi.ortho_repeats; j++){
@@ -821,6 +929,8 @@ gather_type map_reduce_ortho(const graph_type::vertex_type & vertex){
         END_TRACEPOINT(orth1);
         //pgraph->transform_vertices(transform_ortho, nodes);
         mat[_curoffset] = mat[_curoffset].orthogonalize(); 
+        // the assignment left pcurrent on the temporary mat[_curoffset]
+        pcurrent = &current;
       } //for ortho_repeast 
     }
 
@@ -837,6 +947,7 @@ gather_type map_reduce_ortho(const graph_type::vertex_type & vertex){
        BEGIN_TRACEPOINT(orth3);
        //pgraph->transform_vertices(divide_by_sum, nodes);    
        mat[_curoffset] = mat[_curoffset] / alpha;
+       pcurrent = &current;
        END_TRACEPOINT(orth3);
     }
     END_TRACEPOINT(orthogonalize_vs_alltrace);
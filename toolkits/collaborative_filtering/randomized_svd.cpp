@@ -0,0 +1,577 @@
+/**
+ * Copyright (c) 2009 Carnegie Mellon University.
+ *     All rights reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing,
+ *  software distributed under the License is distributed on an "AS
+ *  IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ *  express or implied.  See the License for the specific language
+ *  governing permissions and limitations under the License.
+ *
+ * For more about this software visit:
+ *
+ *      http://www.graphlab.ml.cmu.edu
+ *
+ */
+
+
+/**
+ * \file
+ * Block (randomized range finder) SVD, as given in:
+ * N. Halko, P. G. Martinsson and J. A. Tropp. Finding structure with
+ * randomness: Probabilistic algorithms for constructing approximate
+ * matrix decompositions. SIAM Review 53(2), 2011.
+ *
+ * Every vertex stores one row of a tall-skinny block of b = nsv +
+ * oversampling vectors.  Each engine pass multiplies the sparse matrix
+ * by the whole block, so computing nsv singular vectors takes
+ * 2*power_iter + 2 sweeps over the edges instead of a few sweeps per
+ * Lanczos vector.
+ */
+
+#include <graphlab/util/stl_util.hpp>
+#include <graphlab.hpp>
+
+#include <Eigen/Dense>
+#include "eigen_serialization.hpp"
+#include "types.hpp"
+#include <graphlab/macros_def.hpp>
+#include <graphlab/util/timer.hpp>
+
+typedef Eigen::VectorXd vec;
+typedef Eigen::MatrixXd mat;
+
+int nsv = 10;
+int oversampling = 10;
+int power_iter = 2;
+int rows = -1, cols = -1;
+int input_file_offset = 0; //if set to non zero, each row/col id will be reduced the input_file_offset
+bool binary = false; //if true, all edges = 1
+bool error_estimate = true;
+bipartite_graph_descriptor info;
+
+/** \brief The number of vectors in the block (nsv + oversampling) */
+int block_size = 0;
+/** \brief The b x b matrix applied by transform_block() */
+mat block_transform;
+/** \brief The singular values used by the residual pass */
+vec sigma;
+/** \brief When set the engine pass stores the residual of A*V - U*S
+ *  (or A^T*U - V*S) instead of overwriting the block */
+bool residual_pass = false;
+
+/**
+ * \brief Each row and each column of the matrix is a vertex which
+ * stores its row of the current block.
+ */
+struct vertex_data {
+  /** \brief The row of the current b-wide block */
+  vec pvec;
+  /** \brief Squared residual of each singular vector (error estimate) */
+  vec residual;
+
+  vertex_data() { }
+  void save(graphlab::oarchive& arc) const { arc << pvec << residual; }
+  void load(graphlab::iarchive& arc) { arc >> pvec >> residual; }
+}; // end of vertex data
+
+
+/**
+ * \brief The edge data stores the entry in the matrix.
+ */
+struct edge_data : public graphlab::IS_POD_TYPE {
+  /**
+   * \brief The type of data on the edge;
+   *
+   * \li *Train:* the observed value is correct and used in training
+   * \li *Predict:* The observed value is not correct and should not be
+   *        used in training.
+   */
+  enum data_role_type { TRAIN, VALIDATE, PREDICT  };
+
+  /** \brief the observed value for the edge */
+  double obs;
+
+  /** \brief The train/validation/test designation of the edge */
+  data_role_type role;
+
+  /** \brief basic initialization */
+  edge_data(double obs = 0, data_role_type role = PREDICT) :
+    obs(obs), role(role) { }
+
+}; // end of edge data
+
+
+/**
+ * \brief The graph type is defined in terms of the vertex and edge
+ * data.
+ */
+typedef graphlab::distributed_graph<vertex_data, edge_data> graph_type;
+
+
+/**
+ * \brief The sum of the scaled block rows of the neighbors.  An empty
+ * pvec is the zero vector so edges which are skipped do not allocate.
+ *
+ * gather() returns a reference to the row of the neighbor and its
+ * scale instead of a scaled copy. Adding it to the accumulator is an
+ * axpy into the accumulator's storage, so only the first edge of each
+ * vertex allocates. Copies always hold the sum itself.
+ */
+class gather_type {
+  public:
+    vec pvec;
+    gather_type() : scale(0), row(NULL) { }
+    gather_type(const vec & _pvec) : pvec(_pvec), scale(0), row(NULL) { }
+    /** \brief The row scaled by scale, read when the value is added */
+    gather_type(double scale, const vec & row) : scale(scale), row(&row) { }
+    gather_type(const gather_type& other) : scale(0), row(NULL) {
+      *this = other;
+    }
+    gather_type& operator=(const gather_type& other) {
+      if (this == &other)
+        return *this;
+      if (other.row != NULL)
+        pvec.noalias() = other.scale * *other.row;
+      else pvec = other.pvec;
+      row = NULL;
+      return *this;
+    }
+    void save(graphlab::oarchive& arc) const {
+      if (row != NULL) arc << vec(scale * *row);
+      else arc << pvec;
+    }
+    void load(graphlab::iarchive& arc) { row = NULL; arc >> pvec; }
+    gather_type& operator+=(const gather_type& other) {
+      if (other.row != NULL) {
+        if (pvec.size() == 0)
+          pvec.noalias() = other.scale * *other.row;
+        else pvec.noalias() += other.scale * *other.row;
+        return *this;
+      }
+      if (other.pvec.size() == 0)
+        return *this;
+      if (pvec.size() == 0)
+        pvec = other.pvec;
+      else pvec += other.pvec;
+      return *this;
+    }
+  private:
+    double scale;
+    const vec* row;
+};
+
+
+/**
+ * \brief The b x b Gram matrix of a block (or the sum of the
+ * residuals) reduced over the vertices.
+ */
+class gram_type {
+  public:
+    mat gram;
+    vec residual;
+    gram_type() { }
+    void save(graphlab::oarchive& arc) const { arc << gram << residual; }
+    void load(graphlab::iarchive& arc) { arc >> gram >> residual; }
+    gram_type& operator+=(const gram_type& other) {
+      if (gram.size() == 0)
+        gram = other.gram;
+      else if (other.gram.size() != 0)
+        gram += other.gram;
+      if (residual.size() == 0)
+        residual = other.residual;
+      else if (other.residual.size() != 0)
+        residual += other.residual;
+      return *this;
+    }
+};
+
+
+bool is_row_node(const graph_type::vertex_type & vertex){
+  return vertex.id() < (uint)rows;
+}
+
+
+/**
+ * \brief Multiplies the sparse matrix (or its transpose) by the block
+ * stored on the other side of the bipartite graph.  Row vertices
+ * compute A*X and column vertices compute A^T*X.
+ */
+class block_spmm :
+  public graphlab::ivertex_program<graph_type, gather_type>,
+  public graphlab::IS_POD_TYPE {
+    public:
+    edge_dir_type gather_edges(icontext_type& context,
+        const vertex_type& vertex) const {
+      return is_row_node(vertex) ? graphlab::OUT_EDGES : graphlab::IN_EDGES;
+    }
+
+    /* the row of the other vertex scaled by the matrix entry, a
+       single b-wide axpy per edge into the accumulator */
+    gather_type gather(icontext_type& context, const vertex_type& vertex,
+        edge_type& edge) const {
+      if (edge.data().role == edge_data::PREDICT)
+        return gather_type();
+      const vertex_type other = is_row_node(vertex) ? edge.target() : edge.source();
+      return gather_type(edge.data().obs, other.data().pvec);
+    }
+
+    void apply(icontext_type& context, vertex_type& vertex,
+        const gather_type& total) {
+      vertex_data & vdata = vertex.data();
+      const vec product = total.pvec.size() == 0 ? vec(vec::Zero(block_size)) : total.pvec;
+      if (residual_pass)
+        vdata.residual = (product.head(nsv) - sigma.cwiseProduct(vdata.pvec.head(nsv))).cwiseAbs2();
+      else vdata.pvec = product;
+    }
+
+    edge_dir_type scatter_edges(icontext_type& context,
+        const vertex_type& vertex) const {
+      return graphlab::NO_EDGES;
+    }
+};
+
+typedef graphlab::omni_engine<block_spmm> engine_type;
+
+
+void init_block(graph_type::vertex_type & vertex){
+  vertex.data().pvec = vec::Zero(block_size);
+  if (!is_row_node(vertex))
+    for (int i=0; i< block_size; i++)
+      vertex.data().pvec[i] = graphlab::random::gaussian();
+}
+
+gram_type map_gram(const graph_type::vertex_type & vertex){
+  gram_type ret;
+  ret.gram = vertex.data().pvec * vertex.data().pvec.transpose();
+  return ret;
+}
+
+gram_type map_residual(const graph_type::vertex_type & vertex){
+  gram_type ret;
+  ret.residual = vertex.data().residual;
+  return ret;
+}
+
+/* replaces the row x of the block by block_transform^T x, namely
+   multiplies the block on the right by block_transform */
+void transform_block(graph_type::vertex_type & vertex){
+  vertex.data().pvec = block_transform.transpose() * vertex.data().pvec;
+}
+
+
+/**
+ * \brief Orthonormalizes the columns of the block X stored on the
+ * given side, X = Q*R, overwriting X by Q and returning R.
+ *
+ * The Gram matrix X^T X is reduced in one pass and its eigen
+ * decomposition V L V^T gives Q = X V L^-1/2 and R = L^1/2 V^T.
+ * Directions with a negligible eigenvalue are dropped (their column of
+ * Q is zero).  The step is repeated once to recover the orthogonality
+ * lost when squaring the condition number.
+ */
+mat orthonormalize(graph_type & graph, const graphlab::vertex_set & side){
+  mat R = mat::Identity(block_size, block_size);
+  for (int repeat = 0; repeat < 2; repeat++){
+    gram_type g = graph.map_reduce_vertices<gram_type>(map_gram, side);
+    Eigen::SelfAdjointEigenSolver<mat> eig(g.gram);
+    const vec & lambda = eig.eigenvalues();
+    const double threshold = std::max(lambda.maxCoeff(), 0.0) * block_size * 1e-14;
+    vec scale = vec::Zero(block_size), inv_scale = vec::Zero(block_size);
+    for (int i=0; i< block_size; i++){
+      if (lambda[i] > threshold){
+        scale[i] = sqrt(lambda[i]);
+        inv_scale[i] = 1.0 / scale[i];
+      }
+    }
+    block_transform = eig.eigenvectors() * inv_scale.asDiagonal();
+    graph.transform_vertices(transform_block, side);
+    R = scale.asDiagonal() * eig.eigenvectors().transpose() * R;
+  }
+  return R;
+}
+
+void run_pass(engine_type & engine, const graphlab::vertex_set & side){
+  engine.signal_vset(side);
+  engine.start();
+}
+
+
+struct linear_model_saver_U {
+  typedef graph_type::vertex_type vertex_type;
+  typedef graph_type::edge_type   edge_type;
+  /* save the linear model, using the format:
+     row_id factor1 factor2 ... factor_nsv \n
+  */
+  std::string save_vertex(const vertex_type& vertex) const {
+    if (vertex.id() < (uint)rows){
+      std::string ret = boost::lexical_cast<std::string>(vertex.id()+input_file_offset) + " ";
+      for (int i=0; i< nsv; i++)
+        ret += boost::lexical_cast<std::string>(vertex.data().pvec[i]) + " ";
+      ret += "\n";
+      return ret;
+    }
+    else return "";
+  }
+  std::string save_edge(const edge_type& edge) const {
+    return "";
+  }
+};
+
+struct linear_model_saver_V {
+  typedef graph_type::vertex_type vertex_type;
+  typedef graph_type::edge_type   edge_type;
+  /* save the linear model, using the format:
+     col_id factor1 factor2 ... factor_nsv \n
+  */
+  std::string save_vertex(const vertex_type& vertex) const {
+    if (vertex.id() >= (uint)rows){
+      std::string ret = boost::lexical_cast<std::string>(vertex.id()-rows+input_file_offset) + " ";
+      for (int i=0; i< nsv; i++)
+        ret += boost::lexical_cast<std::string>(vertex.data().pvec[i]) + " ";
+      ret += "\n";
+      return ret;
+    }
+    else return "";
+  }
+  std::string save_edge(const edge_type& edge) const {
+    return "";
+  }
+};
+
+
+/**
+ * \brief The graph loader function is a line parser used for
+ * distributed graph construction.
+ */
+inline bool graph_loader(graph_type& graph,
+    const std::string& filename,
+    const std::string& line) {
+
+  if (boost::ends_with(filename,"singular_values"))
+    return true;
+  if (line.find("#") != std::string::npos || line.find("%") != std::string::npos)
+    return true;
+
+  // Determine the role of the data
+  edge_data::data_role_type role = edge_data::TRAIN;
+  if (boost::ends_with(filename,".predict"))
+    role = edge_data::PREDICT;
+
+  // Parse the line
+  std::stringstream strm(line);
+  graph_type::vertex_id_type source_id(-1), target_id(-1);
+  double obs = 1;
+  strm >> source_id >> target_id;
+  if (source_id == graph_type::vertex_id_type(-1) || target_id == graph_type::vertex_id_type(-1)){
+    logstream(LOG_WARNING)<<"Failed to read input line: "<< line << " in file: "  << filename << " (or node id is -1). " << std::endl;
+    return true;
+  }
+
+  if (input_file_offset != 0){
+     source_id-=input_file_offset;
+     target_id-=input_file_offset;
+  }
+  if (source_id >= (uint)rows)
+    logstream(LOG_FATAL)<<"Problem at input line: [ " << line << " ] row id ( = " << source_id+input_file_offset << " ) should be < than matrix rows (= " << rows << " ) " << std::endl;
+  if (target_id >= (uint)cols)
+    logstream(LOG_FATAL)<<"Problem at input line: [ " << line << " ] col id ( = " << target_id+input_file_offset << " ) should be < than matrix cols (= " << cols << " ) " << std::endl;
+
+  if (!binary)
+     strm >> obs;
+  // rows and columns always get their own vertices
+  target_id = rows + target_id;
+
+  // Create an edge and add it to the graph
+  graph.add_edge(source_id, target_id, edge_data(obs, role));
+  return true; // successful load
+} // end of graph_loader
+
+
+void write_output_vector(const std::string datafile, const vec & output, std::string comment)
+{
+  FILE * f = fopen(datafile.c_str(),"w");
+  if (f == NULL)
+    logstream(LOG_FATAL)<<"Failed to open file: " << datafile << " for writing. " << std::endl;
+
+  if (comment.size() > 0) // add a comment to the matrix market header
+    fprintf(f, "%c%s\n", '%', comment.c_str());
+  for (int j=0; j<(int)output.size(); j++){
+    fprintf(f, "%10.13g\n", output[j]);
+  }
+
+  fclose(f);
+}
+
+
+int main(int argc, char** argv) {
+  global_logger().set_log_to_console(true);
+
+  // Parse command line options -----------------------------------------------
+  const std::string description =
+    "Compute the truncated SVD of a matrix using a randomized block method.";
+  graphlab::command_line_options clopts(description);
+  std::string input_dir;
+  std::string predictions;
+  std::string exec_type = "synchronous";
+  bool quiet = false;
+  bool save_vectors = false;
+  clopts.attach_option("matrix", input_dir,
+      "The directory containing the matrix file");
+  clopts.add_positional("matrix");
+  clopts.attach_option("nsv", nsv, "Number of requested singular values to compute");
+  clopts.attach_option("oversampling", oversampling, "Number of extra vectors in the block (block size is nsv + oversampling)");
+  clopts.attach_option("power_iter", power_iter, "Number of power iterations. Increase for higher accuracy when the singular values decay slowly");
+  clopts.attach_option("error_estimate", error_estimate, "Compute the error estimate of each singular value (two extra passes)");
+  clopts.attach_option("rows", rows, "number of rows");
+  clopts.attach_option("cols", cols, "number of cols");
+  clopts.attach_option("quiet", quiet, "quiet mode (less verbose)");
+  clopts.attach_option("save_vectors", save_vectors, "save output matrices U and V.");
+  clopts.attach_option("predictions", predictions, "output file prefix");
+  clopts.attach_option("binary", binary, "If true, all edges are weighted as one");
+  clopts.attach_option("input_file_offset", input_file_offset, "input file node id offset (default 0)");
+  clopts.attach_option("engine", exec_type,
+                       "The engine type synchronous or asynchronous");
+  if(!clopts.parse(argc, argv) || input_dir == "") {
+    std::cout << "Error in parsing command line arguments." << std::endl;
+    clopts.print_description();
+    return EXIT_FAILURE;
+  }
+  if (quiet)
+    global_logger().set_log_level(LOG_ERROR);
+
+  if (rows <= 0 || cols <= 0)
+    logstream(LOG_FATAL)<<"Please specify number of rows/cols of the input matrix" << std::endl;
+  if (nsv <= 0 || oversampling < 0 || power_iter < 0)
+    logstream(LOG_FATAL)<<"--nsv should be positive and --oversampling and --power_iter non negative" << std::endl;
+  block_size = nsv + oversampling;
+  if (block_size > std::min(rows, cols)){
+    logstream(LOG_WARNING)<<"Block size " << block_size << " is larger than the matrix rank bound, using " << std::min(rows, cols) << std::endl;
+    block_size = std::min(rows, cols);
+    nsv = std::min(nsv, block_size);
+  }
+  info.rows = rows;
+  info.cols = cols;
+  info.force_non_square = true;
+
+  graphlab::mpi_tools::init(argc, argv);
+  graphlab::distributed_control dc;
+
+  dc.cout() << "Loading graph." << std::endl;
+  graphlab::timer timer;
+  graph_type graph(dc, clopts);
+  graph.load(input_dir, graph_loader);
+  dc.cout() << "Loading graph. Finished in "
+    << timer.current_time() << std::endl;
+  dc.cout() << "Finalizing graph." << std::endl;
+  timer.start();
+  graph.finalize();
+  dc.cout() << "Finalizing graph. Finished in "
+    << timer.current_time() << std::endl;
+
+  if (!graph.num_edges() || !graph.num_vertices())
+     logstream(LOG_FATAL)<< "Failed to load graph. Check your input path: " << input_dir << std::endl;
+
+  dc.cout()
+    << "========== Graph statistics on proc " << dc.procid()
+    << " ==============="
+    << "\n Num vertices: " << graph.num_vertices()
+    << "\n Num edges: " << graph.num_edges()
+    << "\n Num replica: " << graph.num_replicas()
+    << "\n Replica to vertex ratio: "
+    << float(graph.num_replicas())/graph.num_vertices()
+    << "\n --------------------------------------------"
+    << "\n Num local own vertices: " << graph.num_local_own_vertices()
+    << "\n Num local vertices: " << graph.num_local_vertices()
+    << "\n Replica to own ratio: "
+    << (float)graph.num_local_vertices()/graph.num_local_own_vertices()
+    << "\n Num local edges: " << graph.num_local_edges()
+    << "\n Edge balance ratio: "
+    << float(graph.num_local_edges())/graph.num_edges()
+    << std::endl;
+
+  dc.cout() << "Creating engine" << std::endl;
+  engine_type engine(dc, graph, exec_type, clopts);
+
+  dc.cout() << "Running randomized SVD with block size " << block_size << std::endl;
+  timer.start();
+
+  graphlab::vertex_set row_nodes = graph.select(is_row_node);
+  graphlab::vertex_set col_nodes = ~row_nodes;
+
+  // Range finder: Q = orth(A * Omega) for a gaussian block Omega,
+  // refined by power iterations Q = orth(A * orth(A^T * Q))
+  graph.transform_vertices(init_block);
+  run_pass(engine, row_nodes);
+  orthonormalize(graph, row_nodes);
+  for (int i=0; i< power_iter; i++){
+    logstream(LOG_EMPH)<<"Starting power iteration: " << i << " at time: " << timer.current_time() << std::endl;
+    run_pass(engine, col_nodes);
+    orthonormalize(graph, col_nodes);
+    run_pass(engine, row_nodes);
+    orthonormalize(graph, row_nodes);
+  }
+
+  // B^T = A^T Q = Qz * Rz and B = Rz^T Qz^T. With the small SVD
+  // Rz^T = Ub * S * Vb^T we get A ~ (Q * Ub) * S * (Qz * Vb)^T
+  run_pass(engine, col_nodes);
+  const mat Rz = orthonormalize(graph, col_nodes);
+  Eigen::JacobiSVD<mat> small_svd(Rz.transpose(), Eigen::ComputeFullU | Eigen::ComputeFullV);
+  block_transform = small_svd.matrixU();
+  graph.transform_vertices(transform_block, row_nodes);
+  block_transform = small_svd.matrixV();
+  graph.transform_vertices(transform_block, col_nodes);
+  sigma = small_svd.singularValues().head(nsv);
+
+  vec errest = vec::Zero(nsv);
+  if (error_estimate){
+    // sqrt( ||A v_i - sigma_i u_i||^2 + ||A^T u_i - sigma_i v_i||^2 ) / sigma_i
+    residual_pass = true;
+    run_pass(engine, row_nodes);
+    run_pass(engine, col_nodes);
+    residual_pass = false;
+    gram_type err = graph.map_reduce_vertices<gram_type>(map_residual);
+    for (int i=0; i< nsv; i++){
+      errest[i] = sqrt(err.residual[i]);
+      if (sigma[i] > 0)
+        errest[i] /= sigma[i];
+    }
+  }
+  for (int i=0; i< nsv; i++)
+    dc.cout() << "Singular value " << i << " \t" << std::setw(13) << sigma[i]
+      << "\tError estimate: " << std::setw(13) << errest[i] << std::endl;
+
+  const double runtime = timer.current_time();
+  dc.cout() << "----------------------------------------------------------"
+    << std::endl
+    << "Final Runtime (seconds):   " << runtime
+                                        << std::endl
+                                        << "Updates executed: " << engine.num_updates() << std::endl
+                                        << "Update Rate (updates/second): "
+                                          << engine.num_updates() / runtime << std::endl;
+
+  if (dc.procid() == 0)
+    write_output_vector(predictions + ".singular_values", sigma, "%GraphLab randomized SVD. This file contains the singular values.");
+
+  if (save_vectors){
+    if (predictions == "")
+      logstream(LOG_FATAL)<<"Please specify prediction output file name using the --predictions=filename command"<<std::endl;
+    const bool gzip_output = false;
+    const bool save_vertices = true;
+    const bool save_edges = false;
+    const size_t threads_per_machine = 1;
+    graph.save(predictions + ".U", linear_model_saver_U(),
+        gzip_output, save_vertices, save_edges, threads_per_machine);
+    graph.save(predictions + ".V", linear_model_saver_V(),
+        gzip_output, save_vertices, save_edges, threads_per_machine);
+  }
+
+  graphlab::mpi_tools::finalize();
+  return EXIT_SUCCESS;
+} // end of main
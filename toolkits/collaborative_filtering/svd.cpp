@@ -52,6 +52,7 @@ bool finished = false;
 double ortho_repeats = 3;
 bool update_function = false;
 bool save_vectors = false;
+bool fused_linalg = false;
 bool use_ids = true;
 std::string datafile; 
 std::string vecfile;
@@ -522,8 +523,9 @@ void lanczos(bipartite_graph_descriptor & info, timer & mytimer, vec & errest,
 
   printf(" Number of computed signular values %d",nconv);
   printf("\n");
-  DistVec normret(info, nconv, false, "normret");
-  DistVec normret_tranpose(info, nconv, true, "normret_tranpose");
+  // V*A' - U*sigma lives on the columns and U*A - V*sigma on the rows
+  DistVec normret(info, nconv, true, "normret");
+  DistVec normret_tranpose(info, nconv, false, "normret_tranpose");
   INITIALIZE_TRACER(svd_error2, "svd error2");
   BEGIN_TRACEPOINT(svd_error2);
   for (int i=0; i < std::min(nsv,nconv); i++){
@@ -545,6 +547,10 @@ void lanczos(bipartite_graph_descriptor & info, timer & mytimer, vec & errest,
   }
   END_TRACEPOINT(svd_error2);
 
+  // the savers read the vectors of mirrors too
+  if (plinalg != NULL)
+    plinalg->synchronize_all();
+
   if (save_vectors){
     if (nconv == 0)
       logstream(LOG_FATAL)<<"No converged vectors. Aborting the save operation" << std::endl;
@@ -582,6 +588,10 @@ void lanczos(bipartite_graph_descriptor & info, timer & mytimer, vec & errest,
 }
 
 void start_engine(){
+  if (plinalg != NULL){
+    fused_axb();
+    return;
+  }
   vertex_set nodes = pgraph->select(selected_node);
   pengine->signal_vset(nodes);
   pengine->start();
@@ -638,6 +648,7 @@ int main(int argc, char** argv) {
   clopts.attach_option("predictions", predictions, "predictions file prefix");
   clopts.attach_option("binary", binary, "If true, all edges are weighted as one");
   clopts.attach_option("input_file_offset", input_file_offset, "input file node id offset (default 0)");
+  clopts.attach_option("fused_linalg", fused_linalg, "run the matrix and vector operations directly over the local graph instead of through the engine");
   if(!clopts.parse(argc, argv) || input_dir == "") {
     std::cout << "Error in parsing command line arguments." << std::endl;
     clopts.print_description();
@@ -745,6 +756,8 @@ int main(int argc, char** argv) {
 
   init_lanczos(&graph, info);
   init_math(&graph, info, ortho_repeats, update_function);
+  if (fused_linalg)
+    plinalg = new dist_linalg<graph_type>(dc, graph);
   if (vecfile.size() > 0){
     std::cout << "Load inital vector from file" << vecfile << std::endl;
     FILE * file = fopen((vecfile).c_str(), "r");
@@ -795,6 +808,8 @@ int main(int argc, char** argv) {
  
 
 
+  delete plinalg;
+  plinalg = NULL;
   graphlab::mpi_tools::finalize();
   return EXIT_SUCCESS;
 } // end of main
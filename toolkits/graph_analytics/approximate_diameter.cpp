@@ -28,6 +28,11 @@
 #include <vector>
 #include <map>
 #include <time.h>
+#include <cmath>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <graphlab.hpp>
 
@@ -271,6 +276,189 @@ size_t absolute_vertex_data_with_hash(
     return count;
 }
 
+
+//HyperLogLog counters (HyperANF)
+//Boldi, Rosa and Vigna. HyperANF: Approximating the Neighbourhood
+//Function of Very Large Graphs on a Budget. WWW 2011.
+
+//number of registers of each counter (2^HLL_BITS)
+const size_t HLL_BITS = 6;
+const size_t HLL_REGISTERS = 1 << HLL_BITS;
+
+//a HyperLogLog counter packed as one byte per register
+struct hll_counter : public graphlab::IS_POD_TYPE {
+  uint8_t reg[HLL_REGISTERS];
+
+  hll_counter() {
+    memset(reg, 0, sizeof(reg));
+  }
+
+  //add an element with the given 64 bit hash
+  void add(uint64_t hash) {
+    const size_t index = hash >> (64 - HLL_BITS);
+    const uint64_t rest = hash << HLL_BITS;
+    const uint8_t rank = rest == 0 ? uint8_t(64 - HLL_BITS + 1)
+        : uint8_t(__builtin_clzll(rest) + 1);
+    reg[index] = std::max(reg[index], rank);
+  }
+
+  //union of the two counters: the register-wise max
+  hll_counter& operator+=(const hll_counter& other) {
+#ifdef __SSE2__
+    for (size_t i = 0; i < HLL_REGISTERS; i += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i*) (reg + i));
+      __m128i b = _mm_loadu_si128((const __m128i*) (other.reg + i));
+      _mm_storeu_si128((__m128i*) (reg + i), _mm_max_epu8(a, b));
+    }
+#else
+    for (size_t i = 0; i < HLL_REGISTERS; ++i)
+      reg[i] = std::max(reg[i], other.reg[i]);
+#endif
+    return *this;
+  }
+
+  //estimated number of distinct elements
+  double estimate() const {
+    const double m = HLL_REGISTERS;
+    double sum = 0.0;
+    size_t zeros = 0;
+    for (size_t i = 0; i < HLL_REGISTERS; ++i) {
+      sum += ldexp(1.0, -int(reg[i]));
+      if (reg[i] == 0)
+        zeros++;
+    }
+    double e = 0.709 * m * m / sum;
+    //small range correction (linear counting)
+    if (e <= 2.5 * m && zeros > 0)
+      e = m * log(m / zeros);
+    return e;
+  }
+};
+
+//two counters, for hop t and hop t + 1. hll_current selects the
+//counter holding hop t on every vertex, so no copy is needed between
+//hops
+struct hll_vdata : public graphlab::IS_POD_TYPE {
+  hll_counter counter[2];
+};
+size_t hll_current = 0;
+uint64_t hll_seed = 0;
+
+typedef graphlab::distributed_graph<hll_vdata, graphlab::empty> hll_graph_type;
+
+//mix the bits of the vertex id into a 64 bit hash (splitmix64)
+uint64_t hll_hash(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL * (hll_seed + 1);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+void initialize_hll_vertex(hll_graph_type::vertex_type& v) {
+  v.data().counter[0] = hll_counter();
+  v.data().counter[0].add(hll_hash(v.id()));
+  v.data().counter[1] = v.data().counter[0];
+}
+
+//c(h + 1; i) = c(h; i) UNION {c(h; k) | source = i & target = k}.
+class hll_one_hop: public graphlab::ivertex_program<hll_graph_type, hll_counter>,
+    public graphlab::IS_POD_TYPE {
+public:
+  edge_dir_type gather_edges(icontext_type& context,
+      const vertex_type& vertex) const {
+    return graphlab::OUT_EDGES;
+  }
+
+  hll_counter gather(icontext_type& context, const vertex_type& vertex,
+      edge_type& edge) const {
+    return edge.target().data().counter[hll_current];
+  }
+
+  //only the counter of the next hop is written
+  void apply(icontext_type& context, vertex_type& vertex,
+      const gather_type& total) {
+    hll_counter next = vertex.data().counter[hll_current];
+    next += total;
+    vertex.data().counter[1 - hll_current] = next;
+  }
+
+  edge_dir_type scatter_edges(icontext_type& context,
+      const vertex_type& vertex) const {
+    return graphlab::NO_EDGES;
+  }
+  void scatter(icontext_type& context, const vertex_type& vertex,
+      edge_type& edge) const {
+  }
+};
+
+//estimated number of vertices reached from this vertex
+double hll_vertex_estimate(const hll_graph_type::vertex_type& vertex) {
+  return vertex.data().counter[hll_current].estimate();
+}
+
+//run the HyperANF iteration and print the neighbourhood function
+//N(t), the number of vertex pairs within distance t
+void run_hyperanf(graphlab::distributed_control& dc,
+    graphlab::command_line_options& clopts, const std::string& graph_dir,
+    const std::string& format, const std::string& exec_type,
+    float termination_criteria, size_t max_iter) {
+  hll_graph_type graph(dc, clopts);
+  dc.cout() << "Loading graph in format: "<< format << std::endl;
+  graph.load_format(graph_dir, format);
+  graph.finalize();
+
+  graphlab::timer timer;
+  hll_current = 0;
+  graph.transform_vertices(initialize_hll_vertex);
+  graphlab::omni_engine<hll_one_hop> engine(dc, graph, exec_type, clopts);
+
+  std::vector<double> nf;
+  nf.push_back(graph.map_reduce_vertices<double>(hll_vertex_estimate));
+  size_t diameter = 0;
+  for (size_t iter = 0; iter < max_iter; ++iter) {
+    engine.signal_all();
+    engine.start();
+    hll_current = 1 - hll_current;
+
+    const double current_count =
+        graph.map_reduce_vertices<double>(hll_vertex_estimate);
+    nf.push_back(current_count);
+    dc.cout() << iter + 1 << "-th hop: " << (size_t) current_count
+        << " vertex pairs are reached\n";
+    if (iter > 0 && current_count < nf[iter] * (1.0 + termination_criteria)) {
+      diameter = iter;
+      dc.cout() << "converge\n";
+      break;
+    }
+  }
+
+  //effective diameter: the (interpolated) number of hops within which
+  //90% of the reachable pairs are reached
+  const double total_pairs = nf.back();
+  double effective_diameter = 0;
+  for (size_t t = 1; t < nf.size(); ++t) {
+    if (nf[t] >= 0.9 * total_pairs) {
+      effective_diameter = (t - 1)
+          + (0.9 * total_pairs - nf[t - 1]) / std::max(nf[t] - nf[t - 1], 1e-9);
+      break;
+    }
+  }
+  //average distance over the reachable pairs of distinct vertices
+  double average_distance = 0;
+  for (size_t t = 1; t < nf.size(); ++t)
+    average_distance += t * (nf[t] - nf[t - 1]);
+  if (total_pairs > nf[0])
+    average_distance /= total_pairs - nf[0];
+
+  dc.cout() << "Neighbourhood function (hops, reached vertex pairs):\n";
+  for (size_t t = 0; t < nf.size(); ++t)
+    dc.cout() << t << "\t" << (size_t) nf[t] << "\n";
+  dc.cout() << "graph calculation time is " << timer.current_time() << " sec\n";
+  dc.cout() << "The approximate diameter is " << diameter << "\n";
+  dc.cout() << "The effective diameter is " << effective_diameter << "\n";
+  dc.cout() << "The average distance is " << average_distance << "\n";
+}
+
 int main(int argc, char** argv) {
   std::cout << "Approximate graph diameter\n\n";
   graphlab::mpi_tools::init(argc, argv);
@@ -285,6 +473,8 @@ int main(int argc, char** argv) {
   std::string graph_dir;
   std::string format = "adj";
   bool use_sketch = true;
+  bool use_hll = false;
+  size_t max_iter = 100;
   std::string exec_type = "synchronous";
   clopts.attach_option("graph", graph_dir,
                        "The graph file. This is not optional");
@@ -296,6 +486,15 @@ int main(int argc, char** argv) {
   clopts.attach_option("use-sketch", use_sketch,
                        "If true, will use Flajolet & Martin bitmask, "
                        "which is more compact and faster.");
+  clopts.attach_option("hll", use_hll,
+                       "If true, will use packed HyperLogLog counters "
+                       "(HyperANF), which need far less memory than the "
+                       "bitmasks, and will also output the neighbourhood "
+                       "function and the effective diameter.");
+  clopts.attach_option("hll-seed", hll_seed,
+                       "The seed of the HyperLogLog vertex hash.");
+  clopts.attach_option("max-iter", max_iter,
+                       "The maximum number of hops.");
 
   if (!clopts.parse(argc, argv)){
     dc.cout() << "Error in parsing command line arguments." << std::endl;
@@ -306,6 +505,13 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
+  if (use_hll) {
+    run_hyperanf(dc, clopts, graph_dir, format, exec_type,
+        termination_criteria, max_iter);
+    graphlab::mpi_tools::finalize();
+    return EXIT_SUCCESS;
+  }
+
   //load graph
   graph_type graph(dc, clopts);
   dc.cout() << "Loading graph in format: "<< format << std::endl;
@@ -325,7 +531,7 @@ int main(int argc, char** argv) {
   //main iteration
   size_t previous_count = 0;
   size_t diameter = 0;
-  for (size_t iter = 0; iter < 100; ++iter) {
+  for (size_t iter = 0; iter < max_iter; ++iter) {
     engine.signal_all();
     engine.start();
 
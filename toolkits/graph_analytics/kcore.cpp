@@ -35,6 +35,14 @@
  *  - Essentially, recursively remove everything with degree 1
  *  - Then recursively remove everything with degree 2
  *  - etc.
+ *
+ * With --coreness, the coreness of every vertex is instead computed in
+ * a single run using the h-index iteration of
+ *
+ * A. Montresor, F. De Pellegrini and D. Miorandi, Distributed k-Core
+ * Decomposition, PODC 2011
+ *
+ * and each K-core is then read off the coreness values.
  */
 
 /*
@@ -145,6 +153,96 @@ public:
 // type of the synchronous_engine
 typedef graphlab::synchronous_engine<k_core> engine_type;
 
+
+// If set, the coreness of every vertex is computed in one run
+bool CORENESS = false;
+
+/*
+ * A histogram of the core estimates of the neighbors of a vertex.
+ * count[i] is the number of neighbors with estimate i, where the
+ * estimates are capped at the estimate of the vertex itself (larger
+ * values never change its h-index).
+ */
+struct core_histogram {
+  std::vector<int> count;
+  core_histogram() { }
+  explicit core_histogram(int value):count(value + 1, 0) {
+    count[value] = 1;
+  }
+  core_histogram& operator+=(const core_histogram& other) {
+    if (other.count.size() > count.size()) count.resize(other.count.size(), 0);
+    for (size_t i = 0; i < other.count.size(); ++i) count[i] += other.count[i];
+    return *this;
+  }
+  void save(graphlab::oarchive& oarc) const {
+    oarc << count;
+  }
+  void load(graphlab::iarchive& iarc) {
+    iarc >> count;
+  }
+};
+
+/*
+ * The h-index iteration. Every vertex starts with its degree as the
+ * estimate of its coreness. On each update the estimate is lowered to
+ * the largest h such that at least h neighbors have an estimate of at
+ * least h. The estimates only ever decrease and converge to the
+ * coreness. When an estimate drops, only the neighbors whose estimate
+ * is still larger can be affected, so only those are signaled.
+ */
+class k_core_hindex :
+  public graphlab::ivertex_program<graph_type, core_histogram>,
+  public graphlab::IS_POD_TYPE  {
+public:
+  bool changed;
+
+  k_core_hindex():changed(false) { }
+
+  edge_dir_type gather_edges(icontext_type& context,
+                             const vertex_type& vertex) const {
+    return graphlab::ALL_EDGES;
+  }
+
+  gather_type gather(icontext_type& context,
+                     const vertex_type& vertex,
+                     edge_type& edge) const {
+    const vertex_type other = edge.source().id() == vertex.id() ?
+      edge.target() : edge.source();
+    return core_histogram(std::min(other.data(), vertex.data()));
+  }
+
+  void apply(icontext_type& context, vertex_type& vertex,
+             const gather_type& histogram) {
+    changed = false;
+    // walk down from the current estimate accumulating the number of
+    // neighbors with an estimate of at least h
+    int h = std::min(vertex.data(), (int)histogram.count.size() - 1);
+    int at_least = 0;
+    for (; h > 0; --h) {
+      at_least += histogram.count[h];
+      if (at_least >= h) break;
+    }
+    h = std::max(h, 0);
+    if (h < vertex.data()) {
+      vertex.data() = h;
+      changed = true;
+    }
+  }
+
+  edge_dir_type scatter_edges(icontext_type& context,
+                              const vertex_type& vertex) const {
+    return changed ? graphlab::ALL_EDGES : graphlab::NO_EDGES;
+  }
+
+  void scatter(icontext_type& context,
+               const vertex_type& vertex,
+               edge_type& edge) const {
+    const vertex_type other = edge.source().id() == vertex.id() ?
+      edge.target() : edge.source();
+    if (other.data() > vertex.data()) context.signal(other);
+  }
+};
+
 /*
  * Called before any graph operation is performed.
  * Initializes all vertex data to the number of adjacent edges.
@@ -167,11 +265,22 @@ graphlab::empty signal_vertices_at_k(engine_type::icontext_type& ctx,
   return graphlab::empty();
 }
 
+/*
+ * Returns true if the vertex belongs to the current K-core.
+ * When peeling, vertices which are not deleted are in the core.
+ * When the coreness is known, the K-core is the set of vertices with
+ * coreness at least K (ignoring isolated vertices as peeling does)
+ */
+bool in_core(const graph_type::vertex_type& vertex) {
+  if (CORENESS) return vertex.data() >= std::max((int)CURRENT_K, 1);
+  return vertex.data() > 0;
+}
+
 /*
  * Counts the number of un-deleted vertices.
  */
 size_t count_active_vertices(const graph_type::vertex_type& vertex) {
-  return vertex.data() > 0;
+  return in_core(vertex);
 }
 
 /*
@@ -182,6 +291,15 @@ size_t double_count_active_edges(const graph_type::vertex_type& vertex) {
   return (size_t) vertex.data();
 }
 
+/*
+ * Counts the edges of the current K-core once.
+ * Used when the vertex data holds the coreness rather than the
+ * remaining degree.
+ */
+size_t count_core_edges(const graph_type::edge_type& edge) {
+  return in_core(edge.source()) && in_core(edge.target());
+}
+
 
 
 /*
@@ -192,13 +310,24 @@ size_t double_count_active_edges(const graph_type::vertex_type& vertex) {
 struct save_core_at_k {
   std::string save_vertex(graph_type::vertex_type) { return ""; }
   std::string save_edge(graph_type::edge_type e) {
-    if (e.source().data() > 0 && e.target().data() > 0) {
+    if (in_core(e.source()) && in_core(e.target())) {
       return graphlab::tostr(e.source().id()) + "\t" +
         graphlab::tostr(e.target().id()) + "\n";
     }
     else return "";
   }
 };
+
+/*
+ * Saves the coreness of each vertex as a vid / coreness pair
+ */
+struct save_coreness {
+  std::string save_vertex(graph_type::vertex_type v) {
+    return graphlab::tostr(v.id()) + "\t" +
+      graphlab::tostr(v.data()) + "\n";
+  }
+  std::string save_edge(graph_type::edge_type e) { return ""; }
+};
     
 int main(int argc, char** argv) {
   std::cout << "Computes a k-core decomposition of a graph.\n\n";
@@ -213,6 +342,8 @@ int main(int argc, char** argv) {
   size_t kmin = 0;
   size_t kmax = (size_t)(-1);
   std::string savecores;
+  std::string savecoreness;
+  std::string exec_type = "synchronous";
   clopts.attach_option("graph", prefix,
                        "Graph input. reads all graphs matching prefix*");
   clopts.attach_option("format", format,
@@ -223,6 +354,16 @@ int main(int argc, char** argv) {
                        "Compute the k-Core for k the range [kmin,kmax]");
   clopts.attach_option("savecores", savecores,
                        "If non-empty, will save tsv of each core with prefix [savecores].K.");
+  clopts.attach_option("coreness", CORENESS,
+                       "If true, compute the coreness of every vertex in a "
+                       "single run (h-index iteration) instead of peeling "
+                       "once for each K.");
+  clopts.attach_option("savecoreness", savecoreness,
+                       "If non-empty, will save the coreness of each vertex "
+                       "with prefix [savecoreness]. Implies --coreness.");
+  clopts.attach_option("engine", exec_type,
+                       "The engine type synchronous or asynchronous. "
+                       "Only used with --coreness.");
 
   if(!clopts.parse(argc, argv)) return EXIT_FAILURE;
   if (prefix == "") {
@@ -240,6 +381,7 @@ int main(int argc, char** argv) {
     clopts.print_description();
     return EXIT_FAILURE;
   }
+  if (savecoreness != "") CORENESS = true;
   // Initialize control plane using mpi
   graphlab::mpi_tools::init(argc, argv);
   graphlab::distributed_control dc;
@@ -252,20 +394,41 @@ int main(int argc, char** argv) {
 
   graphlab::timer ti;
 
-  graphlab::synchronous_engine<k_core> engine(dc, graph, clopts);
-
   // initialize the vertex data with the degree
   graph.transform_vertices(initialize_vertex_values);
 
+  if (CORENESS) {
+    // refine the degrees down to the coreness of every vertex
+    graphlab::omni_engine<k_core_hindex> hindex(dc, graph, exec_type, clopts);
+    hindex.signal_all();
+    hindex.start();
+    dc.cout() << "Coreness computed in " << ti.current_time()
+              << " seconds" << std::endl;
+    if (savecoreness != "") {
+      graph.save(savecoreness,
+                 save_coreness(),
+                 false, /* no compression */
+                 true, /* save vertex */
+                 false, /* do not save edge */
+                 clopts.get_ncpus()); /* one file per machine */
+    }
+  }
+
+  graphlab::synchronous_engine<k_core> engine(dc, graph, clopts);
+
   // for each K value
   for (CURRENT_K = kmin; CURRENT_K <= kmax; CURRENT_K++) {
-    // signal all vertices with degree less than K
-    engine.map_reduce_vertices<graphlab::empty>(signal_vertices_at_k);
-    // recursively delete all vertices with degree less than K
-    engine.start();
+    if (!CORENESS) {
+      // signal all vertices with degree less than K
+      engine.map_reduce_vertices<graphlab::empty>(signal_vertices_at_k);
+      // recursively delete all vertices with degree less than K
+      engine.start();
+    }
     // count the number of vertices and edges remaining
     size_t numv = graph.map_reduce_vertices<size_t>(count_active_vertices);
-    size_t nume = graph.map_reduce_vertices<size_t>(double_count_active_edges) / 2;
+    size_t nume = CORENESS ?
+      graph.map_reduce_edges<size_t>(count_core_edges) :
+      graph.map_reduce_vertices<size_t>(double_count_active_edges) / 2;
     if (numv == 0) break;
     // Output the size of the graph
     dc.cout() << "K=" << CURRENT_K << ":  #V = "
@@ -21,6 +21,7 @@
  */
 
 #include <vector>
+#include <map>
 #include <string>
 #include <fstream>
 
@@ -63,9 +64,9 @@ void init_vertex(graph_type::vertex_type& vertex) { vertex.data() = 1; }
  *      assumed to be the same as the vertex_data_type unless
  *      otherwise specified
  *
- * In addition ivertex program also takes a message type which is
- * assumed to be empty. Since we do not need messages no message type
- * is provided.
+ * In addition ivertex program also takes a message type. Here the
+ * message is the net change in the out degree of the vertex caused by a
+ * graph delta (see --updates), and is zero otherwise.
  *
  * pagerank also extends graphlab::IS_POD_TYPE (is plain old data type)
  * which tells graphlab that the pagerank program can be serialized
@@ -74,11 +75,17 @@ void init_vertex(graph_type::vertex_type& vertex) { vertex.data() = 1; }
  * graphlab::IS_POD_TYPE it must implement load and save functions.
  */
 class pagerank :
-  public graphlab::ivertex_program<graph_type, double> {
+  public graphlab::ivertex_program<graph_type, double, double> {
 
   double last_change;
+  double degree_change;
 public:
 
+  void init(icontext_type& context, const vertex_type& vertex,
+            const message_type& msg) {
+    degree_change = msg;
+  }
+
   /**
    * Gather only in edges.
    */
@@ -100,6 +107,17 @@ public:
 
     const double newval = (1.0 - RESET_PROB) * total + RESET_PROB;
     last_change = (newval - vertex.data());
+    if (degree_change != 0) {
+      // The out neighbors received vertex.data() / old_degree, and now
+      // receive newval / new_degree. Express the difference as a change
+      // in rank so that the scatter can test it against the tolerance.
+      const double new_degree = vertex.num_out_edges();
+      const double old_degree = new_degree - degree_change;
+      last_change = newval;
+      if (old_degree > 0) {
+        last_change -= vertex.data() * new_degree / old_degree;
+      }
+    }
     vertex.data() = newval;
     if (ITERATIONS) context.signal(vertex);
   }
@@ -136,11 +154,11 @@ public:
     // If we are using iterations as a counter then we do not need to
     // move the last change in the vertex program along with the
     // vertex data.
-    if (ITERATIONS == 0) oarc << last_change;
+    if (ITERATIONS == 0) oarc << last_change << degree_change;
   }
 
   void load(graphlab::iarchive& iarc) {
-    if (ITERATIONS == 0) iarc >> last_change;
+    if (ITERATIONS == 0) iarc >> last_change >> degree_change;
   }
 
 }; // end of factorized_pagerank update functor
@@ -167,6 +185,80 @@ double pagerank_sum(graph_type::vertex_type v) {
   return v.data();
 }
 
+
+/*
+ * Endpoints of the edges changed by the graph delta being loaded, each
+ * with its change in out degree: +1 or -1 for the source of an inserted
+ * or removed edge, and 0 for the target. Filled by delta_parser (possibly
+ * from several threads) and later used to select the vertices to signal.
+ */
+typedef std::pair<graphlab::vertex_id_type, int> degree_change_type;
+graphlab::mutex delta_lock;
+std::vector<degree_change_type> delta_endpoints;
+
+/*
+ * Parses a graph delta. Each line is either "+ src dst" which inserts the
+ * edge src->dst or "- src dst" which removes it.
+ */
+bool delta_parser(graph_type& graph, const std::string& filename,
+                  const std::string& textline) {
+  if (textline.empty() || textline[0] == '#') return true;
+  std::stringstream strm(textline);
+  char op = 0;
+  graphlab::vertex_id_type source, target;
+  strm >> op >> source >> target;
+  if (strm.fail()) return false;
+  int change = 0;
+  if (op == '+' && graph.add_edge(source, target)) change = 1;
+  else if (op == '-' && graph.remove_edge(source, target)) change = -1;
+  if (change == 0) return false;
+  delta_lock.lock();
+  delta_endpoints.push_back(degree_change_type(source, change));
+  delta_endpoints.push_back(degree_change_type(target, 0));
+  delta_lock.unlock();
+  return true;
+}
+
+/*
+ * Signals the endpoints of the changed edges, each with the net change in
+ * its out degree. Every machine receives all the endpoints and marks its
+ * own replicas, so the vertex sets are consistent without synchronization
+ * and the cost is proportional to the size of the delta. Vertices are
+ * grouped by degree change since signal_vset sends one message to the
+ * whole set. Returns the number of distinct vertices signaled.
+ */
+template<typename EngineType>
+size_t signal_endpoints(graphlab::distributed_control& dc, graph_type& graph,
+                        EngineType& engine,
+                        const std::vector<degree_change_type>& local_endpoints) {
+  std::vector<std::vector<degree_change_type> > all_endpoints(dc.numprocs());
+  all_endpoints[dc.procid()] = local_endpoints;
+  dc.all_gather(all_endpoints);
+  boost::unordered_map<graphlab::vertex_id_type, int> degree_changes;
+  for (size_t i = 0; i < all_endpoints.size(); ++i) {
+    for (size_t j = 0; j < all_endpoints[i].size(); ++j) {
+      degree_changes[all_endpoints[i][j].first] += all_endpoints[i][j].second;
+    }
+  }
+  // ordered so that all machines signal the groups in the same order
+  std::map<int, graphlab::vertex_set> groups;
+  boost::unordered_map<graphlab::vertex_id_type, int>::const_iterator iter;
+  for (iter = degree_changes.begin(); iter != degree_changes.end(); ++iter) {
+    if (groups.count(iter->second) == 0) {
+      groups[iter->second] = graphlab::vertex_set(false);
+      groups[iter->second].make_explicit(graph);
+    }
+    if (graph.contains_vertex(iter->first)) {
+      groups[iter->second].set_lvid_unsync(graph.local_vid(iter->first));
+    }
+  }
+  std::map<int, graphlab::vertex_set>::const_iterator group;
+  for (group = groups.begin(); group != groups.end(); ++group) {
+    engine.signal_vset(group->second, double(group->first));
+  }
+  return degree_changes.size();
+}
+
 int main(int argc, char** argv) {
   // Initialize control plain using mpi
   graphlab::mpi_tools::init(argc, argv);
@@ -199,6 +291,15 @@ int main(int argc, char** argv) {
                        "option in the engine");
   clopts.attach_option("use_delta", USE_DELTA_CACHE,
                        "Use the delta cache to reduce time in gather.");
+  std::vector<std::string> updates;
+  clopts.attach_option("updates", updates,
+                       "A sequence of graph delta files (or prefixes) "
+                       "applied in order after the initial run. Each line is "
+                       "\"+ src dst\" to insert or \"- src dst\" to remove "
+                       "an edge. PageRank is updated incrementally after each "
+                       "delta by signaling only the affected vertices. "
+                       "A delta with removals rebuilds the local edge storage, "
+                       "so its ingest time is linear in the number of edges.");
   std::string saveprefix;
   clopts.attach_option("saveprefix", saveprefix,
                        "If set, will save the resultant pagerank to a "
@@ -210,6 +311,12 @@ int main(int argc, char** argv) {
   }
 
 
+  if (ITERATIONS && !updates.empty()) {
+    dc.cout() << "--updates requires dynamic PageRank and cannot be used "
+              << "with --iterations." << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Enable gather caching in the engine
   clopts.get_engine_args().set_option("use_cache", USE_DELTA_CACHE);
 
@@ -254,6 +361,35 @@ int main(int argc, char** argv) {
             << " seconds." << std::endl;
 
 
+  // Incremental updates -----------------------------------------------------
+  // After each delta only the endpoints of the changed edges are signaled.
+  // The targets recompute their rank. The sources also receive their change
+  // in out degree, which seeds the residual seen by their out neighbors, so
+  // these are only signaled if their input changed by more than the
+  // tolerance. The residual then propagates through the scatter as usual,
+  // so the work is proportional to the change.
+  for (size_t i = 0; i < updates.size(); ++i) {
+    delta_endpoints.clear();
+    graphlab::timer ti;
+    dc.cout() << "Applying graph delta: " << updates[i] << std::endl;
+    graph.load(updates[i], delta_parser);
+    graph.finalize();
+    size_t nchanges = delta_endpoints.size() / 2;
+    dc.all_reduce(nchanges);
+    const double ingest_time = ti.current_time();
+
+    // the engine resizes itself to the new graph structure
+    const size_t nsignaled =
+      signal_endpoints(dc, graph, engine, delta_endpoints);
+    engine.start();
+    dc.cout() << "Delta " << updates[i] << ": " << nchanges << " edge changes "
+              << "ingested in " << ingest_time << " seconds ("
+              << nchanges / std::max(ingest_time, 1e-6) << " changes/sec), "
+              << nsignaled << " vertices signaled, "
+              << engine.num_updates() << " updates in "
+              << engine.elapsed_seconds() << " seconds." << std::endl;
+  }
+
   const double total_rank = graph.map_reduce_vertices<double>(map_rank);
   std::cout << "Total rank: " << total_rank << std::endl;
 
@@ -22,6 +22,9 @@
 
 
 #include <boost/unordered_set.hpp>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include <graphlab.hpp>
 #include <graphlab/ui/metrics_server.hpp>
 #include <graphlab/util/hopscotch_set.hpp>
@@ -319,6 +322,66 @@ static uint32_t count_set_intersect(
 
 
 
+/*
+ * Counts the size of the intersection of two sorted arrays without
+ * duplicates. When one array is much longer, each element of the
+ * shorter one is located with a galloping (exponential) search.
+ * Otherwise the arrays are merged 4x4 elements at a time with SSE2:
+ * each block of a is compared to the 4 rotations of the block of b and
+ * the block with the smaller last element is advanced.
+ */
+static size_t sorted_intersect_count(const graphlab::vertex_id_type* a, size_t na,
+                                     const graphlab::vertex_id_type* b, size_t nb) {
+  if (na > nb) {
+    std::swap(a, b);
+    std::swap(na, nb);
+  }
+  if (na == 0) return 0;
+  size_t count = 0;
+  size_t i = 0, j = 0;
+  if (nb / na >= 32) {
+    for (; i < na && j < nb; ++i) {
+      const graphlab::vertex_id_type x = a[i];
+      size_t step = 1;
+      while (j + step < nb && b[j + step] < x) step *= 2;
+      j = std::lower_bound(b + j, b + std::min(j + step + 1, nb), x) - b;
+      if (j < nb && b[j] == x) {
+        ++count;
+        ++j;
+      }
+    }
+    return count;
+  }
+#ifdef __SSE2__
+  while (i + 4 <= na && j + 4 <= nb) {
+    const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    const __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+    const __m128i m01 =
+      _mm_or_si128(_mm_cmpeq_epi32(va, vb),
+                   _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0,3,2,1))));
+    const __m128i m23 =
+      _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1,0,3,2))),
+                   _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2,1,0,3))));
+    count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(m01, m23))));
+    const graphlab::vertex_id_type amax = a[i + 3], bmax = b[j + 3];
+    if (amax <= bmax) i += 4;
+    if (bmax <= amax) j += 4;
+  }
+#endif
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) ++i;
+    else if (b[j] < a[i]) ++j;
+    else {
+      ++count;
+      ++i;
+      ++j;
+    }
+  }
+  return count;
+}
+
+
+
 /*
  * Each vertex maintains a list of all its neighbors.
  * and a final count for the number of triangles it is involved in
@@ -564,6 +627,121 @@ public:
 
 typedef graphlab::synchronous_engine<triangle_count> engine_type;
 
+
+/*
+ * The sorted adjacency path. Instead of collecting the neighborhood
+ * through the gather of the engine (which copies the sets), every
+ * machine sends the endpoints of its local edges directly to the
+ * master of the vertex which stores it. Each master then sorts its
+ * array (kept in vid_set.vid_vec) and the arrays are synchronized to
+ * the mirrors.
+ *
+ * When only the total count is needed, the edges are oriented by
+ * degree rank (ties broken by ID) and a vertex only stores the
+ * neighbors ranked above itself, so every triangle is counted once, on
+ * the edge joining its two lowest ranked vertices, and the arrays of
+ * the high degree vertices stay short.
+ */
+bool SORTED_ADJACENCY = false;
+
+// returns true if (du, u) is ranked below (dv, v)
+inline bool rank_less(size_t du, graphlab::vertex_id_type u,
+                      size_t dv, graphlab::vertex_id_type v) {
+  return du < dv || (du == dv && u < v);
+}
+
+// the degree of a vertex in the whole graph. The edges of a triangle may
+// be on different machines, and ranking by the degrees of the local
+// replicas would orient them inconsistently.
+inline size_t global_degree(const graph_type& graph,
+                            graph_type::lvid_type lvid) {
+  return graph.l_get_vertex_record(lvid).num_in_edges +
+         graph.l_get_vertex_record(lvid).num_out_edges;
+}
+
+void build_sorted_adjacency(graphlab::distributed_control& dc,
+                            graph_type& graph) {
+  typedef std::pair<graphlab::vertex_id_type, graphlab::vertex_id_type> arc_type;
+#ifdef _OPENMP
+  graphlab::buffered_exchange<arc_type> exchange(dc, omp_get_max_threads());
+#else
+  graphlab::buffered_exchange<arc_type> exchange(dc);
+#endif
+  for (graph_type::lvid_type lvid = 0; lvid < graph.num_local_vertices(); ++lvid) {
+    graph.l_vertex(lvid).data().vid_set.clear();
+  }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int lvid = 0; lvid < (int)graph.num_local_vertices(); ++lvid) {
+#ifdef _OPENMP
+    const size_t thread_id = omp_get_thread_num();
+#else
+    const size_t thread_id = 0;
+#endif
+    graph_type::local_vertex_type src = graph.l_vertex(lvid);
+    const size_t src_degree = global_degree(graph, lvid);
+    foreach(graph_type::local_edge_type e, src.out_edges()) {
+      graph_type::local_vertex_type dst = e.target();
+      const size_t dst_degree = global_degree(graph, dst.id());
+      const arc_type forward(src.global_id(), dst.global_id());
+      const arc_type backward(dst.global_id(), src.global_id());
+      if (PER_VERTEX_COUNT) {
+        exchange.send(src.owner(), forward, thread_id);
+        exchange.send(dst.owner(), backward, thread_id);
+      }
+      else if (rank_less(src_degree, src.global_id(), dst_degree, dst.global_id())) {
+        exchange.send(src.owner(), forward, thread_id);
+      }
+      else {
+        exchange.send(dst.owner(), backward, thread_id);
+      }
+    }
+  }
+  exchange.flush();
+  graphlab::procid_t proc;
+  graphlab::buffered_exchange<arc_type>::buffer_type buffer;
+  while (exchange.recv(proc, buffer)) {
+    foreach(const arc_type& arc, buffer) {
+      graph.l_vertex(graph.local_vid(arc.first)).data().vid_set.vid_vec.push_back(arc.second);
+    }
+    buffer.clear();
+  }
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+  for (int lvid = 0; lvid < (int)graph.num_local_vertices(); ++lvid) {
+    std::vector<graphlab::vertex_id_type>& adj =
+      graph.l_vertex(lvid).data().vid_set.vid_vec;
+    if (adj.size() > 64) radix_sort(&(adj[0]), 0, adj.size(), 24);
+    else std::sort(adj.begin(), adj.end());
+    adj.erase(std::unique(adj.begin(), adj.end()), adj.end());
+    // release the slack of the push_backs
+    std::vector<graphlab::vertex_id_type>(adj).swap(adj);
+  }
+  graph.synchronize();
+}
+
+/*
+ * Stores on every local edge the size of the intersection of the
+ * arrays of its endpoints.
+ */
+void count_sorted_adjacency(graph_type& graph) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for (int lvid = 0; lvid < (int)graph.num_local_vertices(); ++lvid) {
+    graph_type::local_vertex_type src = graph.l_vertex(lvid);
+    const std::vector<graphlab::vertex_id_type>& a = src.data().vid_set.vid_vec;
+    foreach(graph_type::local_edge_type e, src.out_edges()) {
+      const std::vector<graphlab::vertex_id_type>& b =
+        e.target().data().vid_set.vid_vec;
+      e.data() = (a.empty() || b.empty()) ? 0 :
+        sorted_intersect_count(&(a[0]), a.size(), &(b[0]), b.size());
+    }
+  }
+}
+
 /* Used to sum over all the edges in the graph in a
  * map_reduce_edges call
  * to get the total number of triangles
@@ -572,8 +750,20 @@ size_t get_edge_data(const graph_type::edge_type& e) {
   return e.data();
 }
 
+/*
+ * The local clustering coefficient: the fraction of the pairs of
+ * neighbors of the vertex which are connected
+ */
+double clustering_coefficient(const graph_type::vertex_type& v) {
+  const double degree = v.num_in_edges() + v.num_out_edges();
+  if (degree < 2) return 0;
+  return 2.0 * v.data().num_triangles / (degree * (degree - 1));
+}
+
 /*
  * A saver which saves a file where each line is a vid / # triangles pair
+ * followed by the out degree, in degree and the local clustering
+ * coefficient
  */
 struct save_triangle_count{
   std::string save_vertex(graph_type::vertex_type v) { 
@@ -584,7 +774,8 @@ struct save_triangle_count{
     return graphlab::tostr(v.id()) + "\t" +
            graphlab::tostr(nt) + "\t" +
            graphlab::tostr(n_followed) + "\t" + 
-           graphlab::tostr(n_following) + "\n";
+           graphlab::tostr(n_following) + "\t" +
+           graphlab::tostr(clustering_coefficient(v)) + "\n";
   }
   std::string save_edge(graph_type::edge_type e) {
     return "";
@@ -611,6 +802,11 @@ int main(int argc, char** argv) {
                        "The graph format");
  clopts.attach_option("ht", HASH_THRESHOLD,
                        "Above this size, hash sets are used");
+  clopts.attach_option("sorted_adjacency", SORTED_ADJACENCY,
+                       "If true, build degree ordered sorted adjacency "
+                       "arrays directly from the local edges and count "
+                       "with merge / galloping intersections instead of "
+                       "collecting neighbor sets through the engine");
   clopts.attach_option("per_vertex", per_vertex,
                        "If not empty, will count the number of "
                        "triangles each vertex belongs to and "
@@ -647,9 +843,17 @@ int main(int argc, char** argv) {
   
   // create engine to count the number of triangles
   dc.cout() << "Counting Triangles..." << std::endl;
-  engine_type engine(dc, graph, clopts);
-  engine.signal_all();
-  engine.start();
+  if (SORTED_ADJACENCY) {
+    build_sorted_adjacency(dc, graph);
+    dc.cout() << "Sorted adjacency built in " << ti.current_time()
+              << " seconds" << std::endl;
+    count_sorted_adjacency(graph);
+  }
+  else {
+    engine_type engine(dc, graph, clopts);
+    engine.signal_all();
+    engine.start();
+  }
 
   dc.cout() << "Counted in " << ti.current_time() << " seconds" << std::endl;
 
@@ -667,6 +871,10 @@ int main(int argc, char** argv) {
             true, /* save vertex */
             false, /* do not save edge */
             clopts.get_ncpus()); /* one file per machine */
+    const double total_cc =
+      graph.map_reduce_vertices<double>(clustering_coefficient);
+    dc.cout() << "Average local clustering coefficient: "
+              << total_cc / graph.num_vertices() << std::endl;
 
   }
   
@@ -49,6 +49,9 @@
 #include <vector>
 #include <set>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Random number generation
 #include <graphlab/util/random.hpp>
@@ -419,6 +422,114 @@ namespace graphlab {
       }
     };
 
+    /**
+     * Maps the linear index of a table onto the linear index of a table
+     * over a subset of its variables. Since the variable with the lowest
+     * id iterates fastest, the table is a sequence of contiguous rows
+     * made of its leading variables, which are either all in the sub
+     * domain (the row is also contiguous in the sub table) or all absent
+     * from it (the whole row maps onto a single entry). The remaining
+     * (outer) variables are walked with an odometer by advance().
+     */
+    struct stride_plan {
+      size_t row;
+      bool row_in_sub;
+      size_t num_rows;
+      size_t num_outer;
+      size_t outer_size[MAX_DIM];
+      size_t outer_stride[MAX_DIM];
+
+      stride_plan(const domain_type& dom, const domain_type& sub) {
+        // the stride in sub of every variable of dom (0 if absent)
+        size_t sub_stride[MAX_DIM];
+        size_t multiple = 1;
+        size_t j = 0;
+        for(size_t i = 0; i < dom.num_vars(); ++i) {
+          if(j < sub.num_vars() && sub.var(j) == dom.var(i)) {
+            sub_stride[i] = multiple;
+            multiple *= sub.var(j).size();
+            ++j;
+          } else {
+            sub_stride[i] = 0;
+          }
+        }
+        DCHECK_EQ(j, sub.num_vars());
+        size_t i = 0;
+        row = 1;
+        row_in_sub = dom.num_vars() > 0 && sub_stride[0] != 0;
+        for( ; i < dom.num_vars() && (sub_stride[i] != 0) == row_in_sub; ++i)
+          row *= dom.var(i).size();
+        for(num_outer = 0; i < dom.num_vars(); ++i, ++num_outer) {
+          outer_size[num_outer] = dom.var(i).size();
+          outer_stride[num_outer] = sub_stride[i];
+        }
+        num_rows = dom.size() / row;
+      }
+
+      //! move sub to the offset of the next row
+      inline void advance(size_t* counter, size_t& sub) const {
+        for(size_t k = 0; k < num_outer; ++k) {
+          sub += outer_stride[k];
+          if(++counter[k] < outer_size[k]) return;
+          sub -= outer_stride[k] * outer_size[k];
+          counter[k] = 0;
+        }
+      }
+    };
+
+    //! max_j(init, row[j])
+    static double row_max(const double* row, const size_t n, double init) {
+      size_t j = 0;
+#ifdef __SSE2__
+      __m128d acc = _mm_set1_pd(init);
+      for( ; j + 2 <= n; j += 2) acc = _mm_max_pd(acc, _mm_loadu_pd(row + j));
+      double lanes[2];
+      _mm_storeu_pd(lanes, acc);
+      init = std::max(lanes[0], lanes[1]);
+#endif
+      for( ; j < n; ++j) init = std::max(init, row[j]);
+      return init;
+    }
+
+    //! acc[j] = max(acc[j], row[j])
+    static void row_max_into(double* acc, const double* row, const size_t n) {
+      size_t j = 0;
+#ifdef __SSE2__
+      for( ; j + 2 <= n; j += 2) 
+        _mm_storeu_pd(acc + j, _mm_max_pd(_mm_loadu_pd(acc + j), 
+                                          _mm_loadu_pd(row + j)));
+#endif
+      for( ; j < n; ++j) acc[j] = std::max(acc[j], row[j]);
+    }
+
+    //! sum_j exp(row[j] - shift)
+    static double row_sum_exp(const double* row, const size_t n, const double shift) {
+      double sum0 = 0, sum1 = 0;
+      size_t j = 0;
+      for( ; j + 2 <= n; j += 2) {
+        sum0 += exp(row[j] - shift);
+        sum1 += exp(row[j + 1] - shift);
+      }
+      if(j < n) sum0 += exp(row[j] - shift);
+      return sum0 + sum1;
+    }
+
+    /**
+     * Computes the max of every entry of sub over the entries of this
+     * table which map onto it. sub must be initialized.
+     */
+    void max_onto(const stride_plan& plan, double* sub_data) const {
+      const double* data = &_data[0];
+      size_t counter[MAX_DIM] = { 0 };
+      size_t sub = 0;
+      for(size_t r = 0; r < plan.num_rows; ++r) {
+        const double* row = data + r * plan.row;
+        if(plan.row_in_sub) row_max_into(sub_data + sub, row, plan.row);
+        else sub_data[sub] = row_max(row, plan.row, sub_data[sub]);
+        plan.advance(counter, sub);
+      }
+    }
+
     template<class Func>
     inline dense_table_impl& for_each_assignment(const dense_table_impl& other, 
         const Func& f) {
@@ -435,11 +546,23 @@ namespace graphlab {
         // other domain must be a subset of this domain
         DCHECK_EQ((args() + other.args()).num_vars(), num_vars());
 
-        typename domain_type::const_iterator asg = args().begin();
-        typename domain_type::const_iterator end = args().end();
-        for( ; asg != end; ++asg) {
-          double val = f(logP(asg->linear_index()), other.logP(*asg));
-          set_logP( asg->linear_index(), val );
+        // broadcast other across the rows of this table
+        const stride_plan plan(args(), other.args());
+        double* data = &_data[0];
+        const double* odata = &other._data[0];
+        size_t counter[MAX_DIM] = { 0 };
+        size_t sub = 0;
+        for(size_t r = 0; r < plan.num_rows; ++r) {
+          double* row = data + r * plan.row;
+          if(plan.row_in_sub) {
+            for(size_t j = 0; j < plan.row; ++j) 
+              row[j] = std::max(f(row[j], odata[sub + j]), APPROX_LOG_ZERO());
+          } else {
+            const double val = odata[sub];
+            for(size_t j = 0; j < plan.row; ++j) 
+              row[j] = std::max(f(row[j], val), APPROX_LOG_ZERO());
+          }
+          plan.advance(counter, sub);
         }
       }
       //ASSERT_TRUE(is_finite());
@@ -535,30 +658,39 @@ namespace graphlab {
         msg = *this;
         return;
       }
-      // Compute the domain to remove
-      domain_type ydom = args() - msg.args();
-      DCHECK_GT(ydom.num_vars(), 0);
-          
-      fast_discrete_assignment<MAX_DIM> fastyasg(args());
-      fastyasg.transpose_to_start(ydom);
-      // count the number of elements in ydom
-      size_t numel = ydom.size();
-      // Loop over x
-      typename domain_type::const_iterator xasg = msg.args().begin(); 
-      typename domain_type::const_iterator end = msg.args().end();
-      for( ; xasg != end; ++xasg) {
-        double sum = 0;
-        for(size_t i = 0;i < numel; ++i) {
-          sum += exp(logP(fastyasg.linear_index()));
-          ++fastyasg;
+      DCHECK_GT((args() - msg.args()).num_vars(), 0);
+      // Log-sum-exp in two passes: the max of each entry of msg and then
+      // the sum of the exponentials shifted by that max
+      const stride_plan plan(args(), msg.args());
+      double* max_data = &msg._data[0];
+      std::fill(msg._data.begin(), msg._data.end(), 
+                -std::numeric_limits<double>::infinity());
+      max_onto(plan, max_data);
+      std::vector<double> sums(msg.size(), 0);
+      const double* data = &_data[0];
+      size_t counter[MAX_DIM] = { 0 };
+      size_t sub = 0;
+      for(size_t r = 0; r < plan.num_rows; ++r) {
+        const double* row = data + r * plan.row;
+        if(plan.row_in_sub) {
+          for(size_t j = 0; j < plan.row; ++j) 
+            sums[sub + j] += exp(row[j] - max_data[sub + j]);
+        } else {
+          sums[sub] += row_sum_exp(row, plan.row, max_data[sub]);
         }
-        DASSERT_FALSE( std::isinf(sum) );
-        DASSERT_FALSE( std::isnan(sum) );
-        DCHECK_GE(sum, 0.0);
-        if(sum == 0) 
-          msg.set_logP( xasg->linear_index(), APPROX_LOG_ZERO() );
-        else 
-          msg.set_logP( xasg->linear_index(), log(sum) );
+        plan.advance(counter, sub);
+      }
+      for(size_t i = 0; i < msg.size(); ++i) {
+        // Every term is (approximately) zero: the sum is zero as well
+        // and must not grow by log of the number of terms
+        if(max_data[i] <= APPROX_LOG_ZERO()) {
+          msg.set_logP( i, APPROX_LOG_ZERO() );
+          continue;
+        }
+        DASSERT_FALSE( std::isinf(sums[i]) );
+        DASSERT_FALSE( std::isnan(sums[i]) );
+        DCHECK_GE(sums[i], 1.0);
+        msg.set_logP( i, max_data[i] + log(sums[i]) );
       }
     }
       
@@ -573,25 +705,9 @@ namespace graphlab {
         msg = *this;
         return;
       }
-      // Compute the domain to remove
-      domain_type ydom = args() - msg.args();
-      DCHECK_GT(ydom.num_vars(), 0);
-        
-      fast_discrete_assignment<MAX_DIM> fastyasg(args());
-      fastyasg.transpose_to_start(ydom);
-      // count the number of elements in ydom
-      size_t numel = ydom.size();
-      // Loop over x
-      typename domain_type::const_iterator xasg = msg.args().begin();
-      typename domain_type::const_iterator end = msg.args().end();
-      for( ; xasg != end; ++xasg) {
-        double maxval = APPROX_LOG_ZERO();
-        for(size_t i = 0;i < numel; ++i) {
-          maxval = std::max(maxval, logP(fastyasg.linear_index()));
-          ++fastyasg;
-        }
-        msg.set_logP( xasg->linear_index(), maxval );
-      }
+      DCHECK_GT((args() - msg.args()).num_vars(), 0);
+      std::fill(msg._data.begin(), msg._data.end(), APPROX_LOG_ZERO());
+      max_onto(stride_plan(args(), msg.args()), &msg._data[0]);
       //ASSERT_TRUE(is_finite());
     }
 
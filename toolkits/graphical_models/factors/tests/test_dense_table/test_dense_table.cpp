@@ -39,6 +39,7 @@
 #include <map>
 #include <set>
 #include <algorithm>
+#include <cmath>
 
 #include <factors/dense_table.hpp>
 
@@ -205,6 +206,68 @@ void multiplyTest(unsigned v0_id, unsigned v1_id, unsigned v2_id)
   }
 }
 
+// compare marginalize(), MAP() and the broadcast of a two variable message
+// against a brute force loop over the assignments of the table
+void marginalizeTest(unsigned v0_id, unsigned v1_id, unsigned v2_id) 
+{
+  dense_table_t dt = create_dense_table(v0_id, v1_id, v2_id);
+  for(unsigned keep = 0; keep < 3; ++keep) {
+    unsigned ids[3] = { v0_id, v1_id, v2_id };
+    variable_t v = dt.var(dt.domain().var_location(ids[keep]));
+    dense_table_t sum(v), max(v);
+    dt.marginalize(sum);
+    dt.MAP(max);
+    for(size_t j = 0; j < v.size(); ++j) {
+      double total = 0;
+      double maxval = dense_table_t::APPROX_LOG_ZERO();
+      for(size_t i = 0; i < dt.size(); ++i) {
+        assignment_t dt_asg(dt.domain(), i);
+        if(dt_asg.restrict(sum.domain()).linear_index() != j) continue;
+        total += exp(dt.logP(dt_asg));
+        maxval = std::max(maxval, dt.logP(dt_asg));
+      }
+      ASSERT_LT(fabs(sum.logP(j) - log(total)), 1e-9);
+      ASSERT_EQ(max.logP(j), maxval);
+    }
+  }
+
+  // divide by a message over the two variables with the largest ids
+  domain_t msg_dom = dt.domain() - domain_t(dt.var(0));
+  dense_table_t msg(msg_dom);
+  for(size_t i = 0; i < msg.size(); ++i) {
+    msg.set_logP( assignment_t(msg_dom, i), -1*(rand() % 100) );
+  }
+  dense_table_t dt_gm = dt;
+  dt /= msg;
+  for(size_t i=0; i < dt.size(); ++i) {
+    assignment_t dt_asg(dt.domain(), i);
+    assignment_t msg_asg = dt_asg.restrict(msg.domain());
+    ASSERT_EQ(dt.logP(dt_asg), 
+        std::max(dt_gm.logP(dt_asg)-msg.logP(msg_asg), dense_table_t::APPROX_LOG_ZERO()));
+  }
+}
+
+// an entry of the marginal whose terms are all APPROX_LOG_ZERO must be 
+// APPROX_LOG_ZERO rather than APPROX_LOG_ZERO + log(number of terms)
+void marginalizeZeroTest() 
+{
+  variable_t v0(0, 2);
+  variable_t v1(1, 3);
+  std::vector<variable_t> vars;
+  vars.push_back(v0);
+  vars.push_back(v1);
+  domain_t domain(vars);
+  dense_table_t dt(domain);
+  for(size_t i = 0; i < dt.size(); ++i) {
+    assignment_t asg(domain, i);
+    dt.set_logP(asg, asg.asg(v0) == 0 ? dense_table_t::APPROX_LOG_ZERO() : -1);
+  }
+  dense_table_t sum(v0);
+  dt.marginalize(sum);
+  ASSERT_EQ(sum.logP(0), dense_table_t::APPROX_LOG_ZERO());
+  ASSERT_LT(fabs(sum.logP(1) - (-1 + log(3.0))), 1e-9);
+}
+
 int main() {
   // create a table 
   dense_table_t dt_gm = create_dense_table(2, 0, 1);
@@ -242,5 +305,14 @@ int main() {
   multiplyTest(4, 2, 3);
   multiplyTest(4, 3, 2);
 
+  // marginalize test - compare the stride plans to the assignments
+  marginalizeTest(2, 3, 4);
+  marginalizeTest(2, 4, 3);
+  marginalizeTest(3, 2, 4);
+  marginalizeTest(3, 4, 2);
+  marginalizeTest(4, 2, 3);
+  marginalizeTest(4, 3, 2);
+  marginalizeZeroTest();
+
   std::cout << "All tests passed" << std::endl;
 }
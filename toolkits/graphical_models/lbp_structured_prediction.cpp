@@ -157,6 +157,81 @@ double DAMPING = 0.1;
  */
 double TOLERANCE = 0.01;
 
+/**
+ * \brief If true each edge caches the cavity from which its last
+ * outbound message was computed and the message is only recomputed
+ * when the change in the cavity could move the message by more than
+ * TOLERANCE.
+ *
+ * The convolution with the Ising-Potts factor followed by log-space
+ * renormalization changes each message entry by at most twice the
+ * largest change in the cavity.  Since the damped message only moves
+ * towards the last convolution this bounds the residual the
+ * recomputed message would have:
+ *
+ * \code
+ * residual <= (1-DAMPING) * 2 * nstates * max(abs(cavity - cached_cavity))
+ *             + last_residual
+ * \endcode
+ *
+ * This parameter is set as a command line argument.
+ */
+bool RESIDUAL_CACHE = false;
+
+
+/**
+ * \brief The largest and the sum of the message residuals computed
+ * since the event log last sampled them.  These are only maintained
+ * when the residual telemetry is enabled.
+ */
+bool TRACK_RESIDUALS = false;
+volatile double RESIDUAL_MAX = 0;
+volatile double RESIDUAL_SUM = 0;
+graphlab::atomic<size_t> RESIDUAL_COUNT;
+
+/**
+ * \brief Record the residual of a recomputed message.
+ */
+inline void record_residual(double residual) {
+  double current = RESIDUAL_MAX;
+  while(residual > current &&
+        !graphlab::atomic_compare_and_swap(RESIDUAL_MAX, current, residual))
+    current = RESIDUAL_MAX;
+  current = RESIDUAL_SUM;
+  while(!graphlab::atomic_compare_and_swap(RESIDUAL_SUM, current,
+                                           current + residual))
+    current = RESIDUAL_SUM;
+  RESIDUAL_COUNT.inc();
+} // end of record_residual
+
+/**
+ * \brief Atomically read a residual statistic and reset it to zero.
+ */
+inline double take_residual_stat(volatile double& stat) {
+  double current = stat;
+  while(!graphlab::atomic_compare_and_swap(stat, current, 0.0))
+    current = stat;
+  return current;
+} // end of take_residual_stat
+
+/**
+ * \brief Event log callback returning the largest residual since the
+ * last call.
+ */
+double sample_max_residual() {
+  return take_residual_stat(RESIDUAL_MAX);
+} // end of sample_max_residual
+
+/**
+ * \brief Event log callback returning the mean residual since the
+ * last call.
+ */
+double sample_mean_residual() {
+  const double sum = take_residual_stat(RESIDUAL_SUM);
+  const size_t count = RESIDUAL_COUNT.exchange(0);
+  return count == 0? 0 : sum / count;
+} // end of sample_mean_residual
+
 
 /**
  * \brief The vertex data contains the vertex potential as well as the
@@ -190,6 +265,23 @@ class edge_data {
    * using the \ref message_idx function.
    */
   factor_type messages_[4];
+  /**
+   * \brief The cavity used to compute the last recomputed message and
+   * the residual of that message in one direction.
+   */
+  struct message_cache {
+    factor_type cavity;
+    double residual;
+    message_cache() : residual(0) { }
+  };
+  /**
+   * \brief The message caches in each direction (indexed by source_id
+   * < target_id).  Only allocated when RESIDUAL_CACHE is set and never
+   * serialized: an empty cavity only forces the message to be
+   * recomputed.  Must be allocated before the engine starts since both
+   * endpoints may access the caches of an edge concurrently.
+   */
+  std::vector<message_cache> caches_;
   /**
    * \brief The weight associated with the edge (used to scale the
    * smoothing parameter)
@@ -221,6 +313,28 @@ public:
      return messages_[message_idx(source_id, target_id, false)];
   }
 
+  /**
+   * \brief Get the cavity from which the message from source_id to
+   * target_id was last computed
+   */
+  factor_type& cavity(size_t source_id, size_t target_id) {
+    DASSERT_EQ(caches_.size(), 2);
+    return caches_[size_t(source_id < target_id)].cavity;
+  }
+  /**
+   * \brief Get the residual of the last computed message from
+   * source_id to target_id
+   */
+  double& residual(size_t source_id, size_t target_id) {
+    DASSERT_EQ(caches_.size(), 2);
+    return caches_[size_t(source_id < target_id)].residual;
+  }
+
+  /**
+   * \brief Allocate the message caches in both directions
+   */
+  void allocate_caches() { caches_.resize(2); }
+
   /**
    * \brief Set the old message value equal to the new message value
    */
@@ -251,6 +365,8 @@ public:
   void load(graphlab::iarchive& arc) {
     for(size_t i = 0; i < 4; ++i) arc >> messages_[i];
     arc >> weight_;
+    caches_.clear();
+    if(RESIDUAL_CACHE) allocate_caches();
   }
 }; // End of edge data
 
@@ -355,6 +471,20 @@ struct bp_vertex_program :
       edata.old_message(other_vertex.id(), vertex.id());
     ASSERT_EQ(old_in_message.size(), vertex.data().belief.size());
     factor_type cavity = vertex.data().belief - old_in_message;
+    // If the cavity has barely moved since the message was last
+    // computed the new message cannot differ from the current one by
+    // more than the tolerance so we skip the convolution entirely.
+    if(RESIDUAL_CACHE) {
+      factor_type& cached_cavity = 
+        edata.cavity(vertex.id(), other_vertex.id());
+      if(cached_cavity.size() == cavity.size()) {
+        const double change = (cavity - cached_cavity).cwiseAbs().maxCoeff();
+        const double bound = (1-DAMPING) * 2 * cavity.size() * change + 
+          edata.residual(vertex.id(), other_vertex.id());
+        if(bound <= TOLERANCE) return;
+      }
+      cached_cavity = cavity;
+    }
     // compute the new message by convolving with the Ising-Potts Edge
     // factor.
     factor_type& new_out_message = 
@@ -370,6 +500,8 @@ struct bp_vertex_program :
     // Compute message residual
     const double residual = 
       (new_out_message - old_out_message).cwiseAbs().sum();
+    if(RESIDUAL_CACHE) edata.residual(vertex.id(), other_vertex.id()) = residual;
+    if(TRACK_RESIDUALS) record_residual(residual);
     context.clear_gather_cache(other_vertex);
     // Schedule the adjacent vertex
     if(residual > TOLERANCE) context.signal(other_vertex, residual);
@@ -530,6 +662,7 @@ void edge_initializer(graph_type::edge_type& edge) {
   const graphlab::vertex_id_type target_id = edge.target().id();
   const size_t ntarget = edge.target().data().potential.size();
   edata.initialize(source_id, nsource, target_id, ntarget);
+  if(RESIDUAL_CACHE) edata.allocate_caches();
 } // end of edge initializer
 
 
@@ -617,10 +750,27 @@ int main(int argc, char** argv) {
                        "Return maximizing assignment instead of the posterior distribution.");
   clopts.attach_option("engine", exec_type,
                        "The type of engine to use {async, sync}.");
+  clopts.attach_option("residual_cache", RESIDUAL_CACHE,
+                       "Only recompute messages whose cavity changed enough "
+                       "to exceed the tolerance.");
+  clopts.attach_option("track_residuals", TRACK_RESIDUALS,
+                       "Publish the max and mean message residual through "
+                       "the event log.");
+  bool residual = false;
+  clopts.attach_option("residual", residual,
+                       "Run residual BP: the vertices with the largest "
+                       "message residual run first (overrides --scheduler "
+                       "with the priority scheduler). This only approximates "
+                       "splash scheduling: vertices are ordered one at a "
+                       "time and no local trees are built. The generic "
+                       "bp_vertex_program in factors/ is unchanged.");
   if(!clopts.parse(argc, argv)) {
     graphlab::mpi_tools::finalize();
     return clopts.is_set("help")? EXIT_SUCCESS : EXIT_FAILURE;
   }
+  // Messages are signaled with their residual as the priority, which
+  // only orders the updates with the priority scheduler
+  if(residual) clopts.set_scheduler_type("priority");
 
   if(prior_dir.empty()) {
     logstream(LOG_ERROR) << "No prior was provided." << std::endl;
@@ -649,6 +799,14 @@ int main(int argc, char** argv) {
 
   typedef graphlab::omni_engine<bp_vertex_program> engine_type;
   engine_type engine(dc, graph, exec_type, clopts);
+  DECLARE_EVENT(EVENT_MAX_RESIDUAL);
+  DECLARE_EVENT(EVENT_MEAN_RESIDUAL);
+  if(TRACK_RESIDUALS) {
+    ADD_INSTANTANEOUS_CALLBACK_EVENT(EVENT_MAX_RESIDUAL, "Max Residual",
+                                     "Residual", sample_max_residual);
+    ADD_INSTANTANEOUS_CALLBACK_EVENT(EVENT_MEAN_RESIDUAL, "Mean Residual",
+                                     "Residual", sample_mean_residual);
+  }
   engine.signal_all();
   graphlab::timer timer;
   engine.start();  
@@ -660,6 +818,10 @@ int main(int argc, char** argv) {
     << "Updates executed: " << engine.num_updates() << std::endl
     << "Update Rate (updates/second): " 
     << engine.num_updates() / runtime << std::endl;
+  if(TRACK_RESIDUALS) {
+    FREE_CALLBACK_EVENT(EVENT_MAX_RESIDUAL);
+    FREE_CALLBACK_EVENT(EVENT_MEAN_RESIDUAL);
+  }
     
     
   std::cout << "Saving predictions" << std::endl;
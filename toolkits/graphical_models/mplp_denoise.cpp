@@ -1034,7 +1034,9 @@ int main(int argc, char** argv) {
     std::cout << "Creating the engine. " << std::endl;
     engine_type engine(dc, graph, clopts);
 
-    engine.add_vertex_aggregator<double>("energy", get_energy_fun, finalize_fun);
+    // the energy of a vertex only changes in its apply
+    engine.add_incremental_vertex_aggregator<double>("energy", get_energy_fun,
+                                                     finalize_fun);
     engine.aggregate_periodic("energy", 3); // run every 3 seconds
 
     engine.transform_vertices(mplp_vertex_program::init_vertex_data);
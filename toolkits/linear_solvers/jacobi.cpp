@@ -56,6 +56,7 @@ int max_iter = 10;
 double tol = 1e-5;
 int quiet = 0;
 int unittest = 0;
+bool fused_linalg = false;
 
 struct vertex_data {
   vec pvec;
@@ -204,6 +205,10 @@ struct linear_model_saver {
 
 
 void start_engine(){
+  if (plinalg != NULL){
+    fused_axb();
+    return;
+  }
   vertex_set nodes = pgraph->select(selected_node);
   pengine->signal_vset(nodes);
   pengine->start();
@@ -231,6 +236,7 @@ int main(int argc, char** argv) {
   clopts.attach_option("rows", rows, "number of rows");
   clopts.attach_option("cols", cols, "number of cols");
   clopts.attach_option("quiet", quiet, "quiet mode (less verbose)");
+  clopts.attach_option("fused_linalg", fused_linalg, "run the matrix and vector operations directly over the local graph instead of through the engine");
   if(!clopts.parse(argc, argv) || input_dir == "") {
     std::cout << "Error in parsing command line arguments." << std::endl;
     clopts.print_description();
@@ -289,6 +295,8 @@ int main(int argc, char** argv) {
   pengine = &engine;
 
   init_math(&graph, info, ortho_repeats, update_function);
+  if (fused_linalg)
+    plinalg = new dist_linalg<graph_type>(dc, graph);
 
   if (vecfile.size() > 0){
     std::cout << "Load b vector from file" << input_dir << vecfile << std::endl;
@@ -348,7 +356,11 @@ int main(int argc, char** argv) {
                                         << "Update Rate (updates/second): " 
                                           << engine.num_updates() / runtime << std::endl;
 
+  if (plinalg != NULL)
+    plinalg->synchronize_all();
   graph.save("x.out", linear_model_saver(JACOBI_X), false, true, false, 1);
+  delete plinalg;
+  plinalg = NULL;
   graphlab::mpi_tools::finalize();
 
    return EXIT_SUCCESS;
@@ -46,6 +46,7 @@
 #include <boost/spirit/include/phoenix_operator.hpp>
 #include <boost/spirit/include/phoenix_stl.hpp>
 #include <graphlab/parallel/atomic.hpp>
+#include <boost/shared_ptr.hpp>
 
 
 
@@ -189,6 +190,338 @@ size_t MAX_COUNT = 100;
  */
 float BURNIN = -1;
 
+/**
+ * \brief If true tokens are resampled using the Metropolis-Hastings
+ * alias sampler rather than the dense O(NTOPICS) Gibbs sampler.
+ */
+bool ALIAS_SAMPLER = false;
+
+/**
+ * \brief The number of Metropolis-Hastings cycles (a word proposal
+ * followed by a doc proposal) run for each token by the alias
+ * sampler.
+ */
+size_t MH_STEPS = 2;
+
+/**
+ * \brief The number of tokens resampled on this machine.  Used to
+ * report the sampling throughput.
+ */
+graphlab::atomic<size_t> TOKENS_SAMPLED;
+
+/**
+ * \brief The fraction of topics above which a topic count vector
+ * switches from the sparse to the dense representation.
+ */
+double DENSE_THRESHOLD = 0.25;
+
+
+/**
+ * \brief A hybrid sparse/dense vector of topic counts used to store
+ * the counts of each word and document.
+ *
+ * Vertices with few nonzero topics (short documents and rare words)
+ * store a sorted list of (topic, count) pairs while vertices whose
+ * number of nonzero topics exceeds DENSE_THRESHOLD * NTOPICS store a
+ * dense vector of counts.
+ *
+ * Like factor_type the counts are atomic so that concurrent scatters
+ * may increment and decrement the counts of adjacent vertices, and the
+ * storage never moves during inc() and dec().  When a sparse vector is
+ * assigned in apply it reserves free slots after the sorted entries
+ * and inc() of a topic that is not stored claims one of them.  There
+ * is a free slot for every resample of every token of the vertex (each
+ * token is resampled at most twice, once from each endpoint of its
+ * edge, before the next apply of the synchronous engine), so no
+ * increment is ever dropped.
+ *
+ * The storage of a sparse vector is reallocated by assign() and load()
+ * and must therefore not be used while apply and scatter may run
+ * concurrently on adjacent vertices.  Sparse vertex counts are only used
+ * with the synchronous engine: with any other engine every vertex is
+ * made dense before the engine starts, and a dense vector stays dense
+ * and never reallocates its storage.  Gather results are always
+ * allowed to be sparse.
+ */
+class topic_count_vector {
+  ///! The nsorted sorted stored topics followed by the claimed and
+  ///! free (NULL_TOPIC) slots.  Empty if dense.
+  std::vector<topic_id_type> topics;
+  ///! The count of each stored topic or slot or of every topic if dense
+  std::vector< graphlab::atomic<count_type> > counts;
+  ///! The number of sorted stored topics
+  uint32_t nsorted;
+  ///! The number of claimed slots following the sorted topics
+  graphlab::atomic<uint32_t> nclaimed;
+  ///! True if counts are stored densely
+  bool dense;
+
+  /** \brief The index of a stored topic or -1 if it is not stored */
+  inline int find(size_t t) const {
+    if(dense) return t;
+    std::vector<topic_id_type>::const_iterator iter =
+      std::lower_bound(topics.begin(), topics.begin() + nsorted,
+                       topic_id_type(t));
+    if(iter != topics.begin() + nsorted && *iter == t)
+      return int(iter - topics.begin());
+    const size_t end = nsorted + nclaimed.value;
+    for(size_t i = nsorted; i < end; ++i)
+      if(((const volatile topic_id_type*)&topics[i])[0] == t) return int(i);
+    return -1;
+  } // end of find
+
+  /**
+   * \brief The index of topic t claiming a free slot if it is not
+   * stored.  Safe to call concurrently with inc() and dec().
+   */
+  int claim(size_t t) {
+    ASSERT_MSG(!topics.empty(), "No free topic slots reserved");
+    volatile topic_id_type* slots = &topics[0];
+    while(true) {
+      const uint32_t n = nclaimed.value;
+      for(size_t i = nsorted; i < nsorted + n; ++i)
+        if(slots[i] == t) return int(i);
+      const size_t slot = nsorted + n;
+      ASSERT_MSG(slot < topics.size(), "Out of free topic slots");
+      if(graphlab::atomic_compare_and_swap(slots[slot], NULL_TOPIC,
+                                           topic_id_type(t))) {
+        nclaimed.inc();
+        return int(slot);
+      }
+      // A concurrent inc() of the same topic claimed the slot
+      if(slots[slot] == t) return int(slot);
+      // Another topic claimed the slot.  Wait until it is published
+      while(nclaimed.value == n) sched_yield();
+    }
+  } // end of claim
+
+  /** \brief The stored entries sorted by topic, skipping free slots */
+  void sorted_entries(std::vector<topic_id_type>& out_topics,
+                      std::vector<count_type>& out_counts) const {
+    out_topics.assign(topics.begin(), topics.begin() + nsorted);
+    out_counts.resize(nsorted);
+    for(size_t i = 0; i < nsorted; ++i) out_counts[i] = counts[i];
+    const size_t end = nsorted + nclaimed.value;
+    for(size_t i = nsorted; i < end; ++i) {
+      std::vector<topic_id_type>::iterator iter =
+        std::lower_bound(out_topics.begin(), out_topics.end(), topics[i]);
+      const size_t index = iter - out_topics.begin();
+      out_topics.insert(iter, topics[i]);
+      out_counts.insert(out_counts.begin() + index, count_type(counts[i]));
+    }
+  } // end of sorted_entries
+
+  /**
+   * \brief Replace the storage by the given sorted entries followed by
+   * nfree free slots, or by a dense vector if that takes more than
+   * DENSE_THRESHOLD * NTOPICS entries.
+   */
+  void reset_sparse(std::vector<topic_id_type>& new_topics,
+                    const std::vector<count_type>& new_counts,
+                    size_t nfree) {
+    dense = false;
+    nsorted = new_topics.size();
+    nclaimed = 0;
+    nfree = std::min(nfree, NTOPICS - nsorted);
+    counts.resize(nsorted + nfree);
+    for(size_t i = 0; i < nsorted; ++i) counts[i] = new_counts[i];
+    for(size_t i = nsorted; i < counts.size(); ++i) counts[i] = 0;
+    topics.swap(new_topics);
+    topics.resize(nsorted + nfree, NULL_TOPIC);
+    if(topics.size() > DENSE_THRESHOLD * NTOPICS) densify();
+  } // end of reset_sparse
+
+  /** \brief Merge the claimed slots into the sorted entries */
+  void compact() {
+    if(dense || (nclaimed == 0 && topics.size() == nsorted)) return;
+    std::vector<topic_id_type> new_topics;
+    std::vector<count_type> new_counts;
+    sorted_entries(new_topics, new_counts);
+    reset_sparse(new_topics, new_counts, 0);
+  } // end of compact
+
+public:
+  topic_count_vector() : nsorted(0), nclaimed(0), dense(false) { }
+
+  /** \brief The number of stored entries */
+  inline size_t size() const { return counts.size(); }
+
+  /**
+   * \brief The topic of the i'th stored entry.  Entries are sorted by
+   * topic except for topics claimed since the last assign() and free
+   * slots have topic NULL_TOPIC and count 0.
+   */
+  inline topic_id_type topic(size_t i) const {
+    return dense ? topic_id_type(i) : topics[i];
+  }
+
+  /** \brief The count of the i'th stored entry */
+  inline count_type count(size_t i) const { return counts[i]; }
+
+  /** \brief The count of topic t */
+  inline count_type operator[](size_t t) const {
+    const int i = find(t);
+    return i < 0 ? 0 : count_type(counts[i]);
+  }
+
+  /** \brief Atomically increment a topic count */
+  inline void inc(size_t t) {
+    int i = find(t);
+    if(i < 0) i = claim(t);
+    counts[i].inc();
+  }
+
+  /** \brief Atomically decrement a stored topic count */
+  inline void dec(size_t t) {
+    const int i = find(t);
+    if(i >= 0) counts[i].dec();
+  }
+
+  /** \brief Convert to the dense representation */
+  void densify() {
+    if(dense) return;
+    std::vector< graphlab::atomic<count_type> > dense_counts(NTOPICS);
+    const size_t end = nsorted + nclaimed.value;
+    for(size_t i = 0; i < end; ++i)
+      dense_counts[topics[i]] += count_type(counts[i]);
+    counts.swap(dense_counts);
+    std::vector<topic_id_type>().swap(topics);
+    nsorted = 0; nclaimed = 0;
+    dense = true;
+  } // end of densify
+
+  /**
+   * \brief Set the counts to those of other reserving free slots for
+   * nresamples increments of topics which are not stored.  A dense
+   * vector is updated in place.  This is not safe to call concurrently.
+   */
+  void assign(const topic_count_vector& other, size_t nresamples) {
+    if(dense) {
+      std::vector<topic_id_type> other_topics;
+      std::vector<count_type> other_counts;
+      if(!other.dense) other.sorted_entries(other_topics, other_counts);
+      size_t j = 0;
+      for(size_t t = 0; t < NTOPICS; ++t) {
+        count_type value = 0;
+        if(other.dense) value = other.counts[t];
+        else if(j < other_topics.size() && other_topics[j] == t)
+          value = other_counts[j++];
+        counts[t] = value;
+      }
+      return;
+    }
+    std::vector<topic_id_type> new_topics;
+    std::vector<count_type> new_counts;
+    if(other.dense) {
+      for(size_t t = 0; t < other.counts.size(); ++t) {
+        if(other.counts[t] != 0) {
+          new_topics.push_back(t);
+          new_counts.push_back(other.counts[t]);
+        }
+      }
+    } else other.sorted_entries(new_topics, new_counts);
+    reset_sparse(new_topics, new_counts, nresamples);
+  } // end of assign
+
+  /**
+   * \brief Reserve free slots for nresamples more increments of topics
+   * which are not stored.  This is not safe to call concurrently.
+   */
+  void reserve(size_t nresamples) {
+    if(dense) return;
+    const size_t nslots = std::min(topics.size() + nresamples, NTOPICS);
+    topics.resize(nslots, NULL_TOPIC);
+    counts.resize(nslots);
+    if(topics.size() > DENSE_THRESHOLD * NTOPICS) densify();
+  } // end of reserve
+
+  /**
+   * \brief Add value to the count of topic t inserting the topic if
+   * necessary.  This is not safe to call concurrently.
+   */
+  void add(size_t t, count_type value) {
+    compact();
+    const int i = find(t);
+    if(i >= 0) { counts[i] += value; return; }
+    std::vector<topic_id_type>::iterator iter =
+      std::lower_bound(topics.begin(), topics.end(), topic_id_type(t));
+    const size_t index = iter - topics.begin();
+    topics.insert(iter, topic_id_type(t));
+    counts.insert(counts.begin() + index, graphlab::atomic<count_type>(value));
+    ++nsorted;
+    if(topics.size() > DENSE_THRESHOLD * NTOPICS) densify();
+  } // end of add
+
+  topic_count_vector& operator+=(const topic_count_vector& other) {
+    if(other.counts.empty()) return *this;
+    if(counts.empty()) { *this = other; compact(); return *this; }
+    if(!dense && !other.dense) {
+      // Merge the two sorted lists
+      std::vector<topic_id_type> my_topics, other_topics;
+      std::vector<count_type> my_counts, other_counts;
+      sorted_entries(my_topics, my_counts);
+      other.sorted_entries(other_topics, other_counts);
+      std::vector<topic_id_type> merged_topics;
+      std::vector<count_type> merged_counts;
+      merged_topics.reserve(my_topics.size() + other_topics.size());
+      merged_counts.reserve(my_topics.size() + other_topics.size());
+      size_t i = 0, j = 0;
+      while(i < my_topics.size() || j < other_topics.size()) {
+        if(j == other_topics.size() ||
+           (i < my_topics.size() && my_topics[i] < other_topics[j])) {
+          merged_topics.push_back(my_topics[i]);
+          merged_counts.push_back(my_counts[i++]);
+        } else if(i == my_topics.size() || other_topics[j] < my_topics[i]) {
+          merged_topics.push_back(other_topics[j]);
+          merged_counts.push_back(other_counts[j++]);
+        } else {
+          merged_topics.push_back(my_topics[i]);
+          merged_counts.push_back(my_counts[i++] + other_counts[j++]);
+        }
+      }
+      reset_sparse(merged_topics, merged_counts, 0);
+    } else {
+      densify();
+      for(size_t i = 0; i < other.size(); ++i) {
+        if(other.count(i) != 0) counts[other.topic(i)] += other.count(i);
+      }
+    }
+    return *this;
+  } // end of operator +=
+
+  /** \brief Only the stored entries and the number of free slots are sent */
+  void save(graphlab::oarchive& arc) const {
+    arc << dense;
+    if(dense) { arc << counts; return; }
+    std::vector<topic_id_type> sorted_topics;
+    std::vector<count_type> sorted_counts;
+    sorted_entries(sorted_topics, sorted_counts);
+    const size_t nfree = topics.size() - sorted_topics.size();
+    arc << sorted_topics << sorted_counts << nfree;
+  }
+  void load(graphlab::iarchive& arc) {
+    bool is_dense;
+    arc >> is_dense;
+    if(is_dense) {
+      if(!dense) densify();
+      arc >> counts;
+      return;
+    }
+    std::vector<topic_id_type> sorted_topics;
+    std::vector<count_type> sorted_counts;
+    size_t nfree;
+    arc >> sorted_topics >> sorted_counts >> nfree;
+    if(dense) {
+      // keep the dense storage in place
+      topic_count_vector other;
+      other.reset_sparse(sorted_topics, sorted_counts, 0);
+      assign(other, 0);
+    } else reset_sparse(sorted_topics, sorted_counts, nfree);
+  }
+}; // end of topic_count_vector
+
+
+
 /**
  * \brief The json top word struct contains the current set of top
  * words for each topic encoded in the form of a json string.
@@ -247,8 +580,8 @@ struct vertex_data {
   ///! The total number of changes to adjacent tokens
   uint32_t nchanges;
   ///! The count of tokens in each topic
-  factor_type factor;
-  vertex_data() : nupdates(0), nchanges(0), factor(NTOPICS) { }
+  topic_count_vector factor;
+  vertex_data() : nupdates(0), nchanges(0) { }
   void save(graphlab::oarchive& arc) const {
     arc << nupdates << nchanges << factor;
   }
@@ -384,6 +717,22 @@ inline bool is_doc(const graph_type::vertex_type& vertex) {
   return vertex.num_out_edges() > 0 ? 1 : 0;
 }
 
+/**
+ * \brief Switch the topic counts of a vertex to the dense
+ * representation.
+ */
+inline void make_dense(graph_type::vertex_type& vertex) {
+  vertex.data().factor.densify();
+}
+
+/**
+ * \brief Reserve free topic slots on the target (word) of an edge for
+ * every token on the edge.
+ */
+inline void reserve_word_slots(graph_type::edge_type& edge) {
+  edge.target().data().factor.reserve(edge.data().assignment.size());
+}
+
 /**
  * \brief return the number of tokens on a particular edge.
  */
@@ -416,21 +765,148 @@ get_other_vertex(const graph_type::edge_type& edge,
  *
  */
 struct gather_type {
-  factor_type factor;
+  topic_count_vector factor;
   uint32_t nchanges;
-  gather_type() : nchanges(0) { };
-  gather_type(uint32_t nchanges) : factor(NTOPICS), nchanges(nchanges) { };
-  void save(graphlab::oarchive& arc) const { arc << factor << nchanges; }
-  void load(graphlab::iarchive& arc) { arc >> factor >> nchanges; }
+  ///! The number of tokens including the unassigned ones
+  uint32_t ntokens;
+  gather_type() : nchanges(0), ntokens(0) { };
+  gather_type(uint32_t nchanges, uint32_t ntokens) :
+    nchanges(nchanges), ntokens(ntokens) { };
+  void save(graphlab::oarchive& arc) const {
+    arc << factor << nchanges << ntokens;
+  }
+  void load(graphlab::iarchive& arc) { arc >> factor >> nchanges >> ntokens; }
   gather_type& operator+=(const gather_type& other) {
     factor += other.factor;
     nchanges += other.nchanges;
+    ntokens += other.ntokens;
     return *this;
   }
 }; // end of gather type
 
 
 
+/**
+ * \brief A sparse alias table used as a (possibly stale) proposal
+ * distribution by the Metropolis-Hastings sampler.
+ *
+ * The proposal is proportional to (n_t + prior) where n_t are the
+ * topic counts of a vertex at the time the table was built.  It is
+ * represented as a mixture of an alias table over the nonzero counts
+ * and a uniform distribution over all topics, so the table only uses
+ * O(nnz) memory and can be sampled in O(1).
+ */
+struct alias_table {
+  ///! The sorted list of topics with nonzero counts
+  std::vector<topic_id_type> topics;
+  ///! The count of each topic in topics when the table was built
+  std::vector<count_type> counts;
+  ///! The probability of keeping the bucket in the alias table
+  std::vector<float> prob;
+  ///! The alias of each bucket
+  std::vector<uint32_t> alias;
+  ///! The sum of the counts
+  double mass;
+  ///! The pseudo count added to every topic
+  double prior;
+
+  alias_table(const topic_count_vector& factor, double prior) :
+    mass(0), prior(prior) {
+    std::vector< std::pair<topic_id_type, count_type> > entries;
+    for(size_t i = 0; i < factor.size(); ++i) {
+      const count_type count = factor.count(i);
+      if(count > 0) entries.push_back(std::make_pair(factor.topic(i), count));
+    }
+    // Recently claimed topics are not sorted
+    std::sort(entries.begin(), entries.end());
+    for(size_t i = 0; i < entries.size(); ++i) {
+      topics.push_back(entries[i].first);
+      counts.push_back(entries[i].second);
+      mass += entries[i].second;
+    }
+    // Build the alias table using Vose's method
+    const size_t n = topics.size();
+    prob.resize(n); alias.resize(n);
+    std::vector<double> scaled(n);
+    std::vector<uint32_t> small, large;
+    for(size_t i = 0; i < n; ++i) {
+      scaled[i] = counts[i] * n / mass;
+      if(scaled[i] < 1) small.push_back(i); else large.push_back(i);
+    }
+    while(!small.empty() && !large.empty()) {
+      const uint32_t s = small.back(); small.pop_back();
+      const uint32_t l = large.back();
+      prob[s] = scaled[s]; alias[s] = l;
+      scaled[l] = (scaled[l] + scaled[s]) - 1;
+      if(scaled[l] < 1) { large.pop_back(); small.push_back(l); }
+    }
+    foreach(uint32_t i, large) { prob[i] = 1; alias[i] = i; }
+    foreach(uint32_t i, small) { prob[i] = 1; alias[i] = i; }
+  } // end of constructor
+
+  /** \brief Draw a topic from the proposal */
+  topic_id_type sample() const {
+    const double total = mass + prior * NTOPICS;
+    if(graphlab::random::rand01() * total < mass) {
+      const size_t i = graphlab::random::fast_uniform<size_t>(0, topics.size() - 1);
+      return graphlab::random::rand01() < prob[i] ?
+        topics[i] : topics[alias[i]];
+    }
+    return topic_id_type(graphlab::random::fast_uniform<size_t>(0, NTOPICS - 1));
+  } // end of sample
+
+  /** \brief The unnormalized proposal probability of a topic */
+  double weight(topic_id_type t) const {
+    std::vector<topic_id_type>::const_iterator iter =
+      std::lower_bound(topics.begin(), topics.end(), t);
+    const bool found = iter != topics.end() && *iter == t;
+    return prior + (found ? counts[iter - topics.begin()] : 0);
+  } // end of weight
+}; // end of alias_table
+
+
+/**
+ * \brief The alias tables of all local vertices.
+ *
+ * Tables are rebuilt lazily once they have served NTOPICS proposals
+ * so the O(NTOPICS) construction cost is amortized to O(1) per
+ * token.  The Metropolis-Hastings acceptance step corrects for the
+ * staleness of the proposal.
+ */
+class alias_cache {
+  struct entry {
+    graphlab::simple_spinlock lock;
+    boost::shared_ptr<const alias_table> table;
+    size_t ndraws;
+    entry() : ndraws(0) { }
+  };
+  std::vector<entry> entries;
+public:
+  void resize(size_t nvertices) { entries.resize(nvertices); }
+
+  /**
+   * \brief Get the alias table for the vertex reserving ndraws
+   * proposals, rebuilding the table if it is missing or exhausted.
+   */
+  boost::shared_ptr<const alias_table>
+  get(const graph_type::vertex_type& vertex, double prior, size_t ndraws) {
+    ASSERT_LT(vertex.local_id(), entries.size());
+    entry& e = entries[vertex.local_id()];
+    e.lock.lock();
+    boost::shared_ptr<const alias_table> table = e.table;
+    const bool rebuild = table == NULL || e.ndraws >= NTOPICS;
+    e.ndraws = (rebuild ? 0 : e.ndraws) + ndraws;
+    e.lock.unlock();
+    if(rebuild) {
+      table.reset(new alias_table(vertex.data().factor, prior));
+      e.lock.lock(); e.table = table; e.lock.unlock();
+    }
+    return table;
+  } // end of get
+} ALIAS_CACHE;
+
+
+
 
 
 
@@ -463,10 +939,10 @@ public:
    */
   gather_type gather(icontext_type& context, const vertex_type& vertex,
                      edge_type& edge) const {
-    gather_type ret(edge.data().nchanges);
     const assignment_type& assignment = edge.data().assignment;
+    gather_type ret(edge.data().nchanges, assignment.size());
     foreach(topic_id_type asg, assignment) {
-      if(asg != NULL_TOPIC) ++ret.factor[asg];
+      if(asg != NULL_TOPIC) ret.factor.add(asg, 1);
     }
     return ret;
   } // end of gather
@@ -483,11 +959,11 @@ public:
     ASSERT_GT(num_neighbors, 0);
     // There should be no new edge data since the vertex program has been cleared
     vertex_data& vdata = vertex.data();
-    ASSERT_EQ(sum.factor.size(), NTOPICS);
-    ASSERT_EQ(vdata.factor.size(), NTOPICS);
     vdata.nupdates++;
     vdata.nchanges = sum.nchanges;
-    vdata.factor = sum.factor;
+    // Each token may be resampled from both of its endpoints before
+    // the next apply
+    vdata.factor.assign(sum.factor, 2 * sum.ntokens);
   } // end of apply
 
 
@@ -503,6 +979,22 @@ public:
   }; // end of scatter edges
 
 
+  /**
+   * \brief The unnormalized conditional probability of topic t given
+   * the (cavity) doc and word topic counts.
+   */
+  static double topic_weight(const topic_count_vector& doc_topic_count,
+                             const topic_count_vector& word_topic_count,
+                             size_t t) {
+    const double n_dt =
+      std::max(count_type(doc_topic_count[t]), count_type(0));
+    const double n_wt =
+      std::max(count_type(word_topic_count[t]), count_type(0));
+    const double n_t  =
+      std::max(count_type(GLOBAL_TOPIC_COUNT[t]), count_type(0));
+    return (ALPHA + n_dt) * (BETA + n_wt) / (BETA * NWORDS + n_t);
+  } // end of topic_weight
+
   /**
    * \brief Draw new topic assignments for each edge token.
    *
@@ -512,43 +1004,82 @@ public:
    * running on the same machine.  However, these changes will be
    * overwritten during the apply step and are only used to accelerate
    * sampling.  This is a potentially dangerous violation of the
-   * abstraction and should be taken with caution.  In our case all
-   * vertex topic counts are preallocated and atomic operations are
-   * used.  In addition during the sampling phase we must be careful
+   * abstraction and should be taken with caution.  In our case the
+   * structure of the vertex topic counts is only changed in apply
+   * and atomic operations are used.  In addition during the sampling phase we must be careful
    * to guard against potentially negative temporary counts.
+   *
+   * If ALIAS_SAMPLER is set each token is resampled by MH_STEPS
+   * Metropolis-Hastings cycles using the stale word and doc alias
+   * tables as proposals, which costs O(1) rather than O(NTOPICS) per
+   * token.
    */
   void scatter(icontext_type& context, const vertex_type& vertex,
                edge_type& edge) const {
-    factor_type& doc_topic_count =  is_doc(edge.source()) ?
+    topic_count_vector& doc_topic_count =  is_doc(edge.source()) ?
       edge.source().data().factor : edge.target().data().factor;
-    factor_type& word_topic_count = is_word(edge.source()) ?
+    topic_count_vector& word_topic_count = is_word(edge.source()) ?
       edge.source().data().factor : edge.target().data().factor;
-    ASSERT_EQ(doc_topic_count.size(), NTOPICS);
-    ASSERT_EQ(word_topic_count.size(), NTOPICS);
-    // run the actual gibbs sampling
-    std::vector<double> prob(NTOPICS);
     assignment_type& assignment = edge.data().assignment;
     edge.data().nchanges = 0;
+    TOKENS_SAMPLED.inc(assignment.size());
+    if(ALIAS_SAMPLER) {
+      const vertex_type doc = is_doc(edge.source()) ? edge.source() : edge.target();
+      const vertex_type word = is_word(edge.source()) ? edge.source() : edge.target();
+      const size_t ndraws = assignment.size() * MH_STEPS;
+      const boost::shared_ptr<const alias_table> doc_proposal =
+        ALIAS_CACHE.get(doc, ALPHA, ndraws);
+      const boost::shared_ptr<const alias_table> word_proposal =
+        ALIAS_CACHE.get(word, BETA, ndraws);
+      foreach(topic_id_type& asg, assignment) {
+        const topic_id_type old_asg = asg;
+        if(asg != NULL_TOPIC) { // construct the cavity
+          doc_topic_count.dec(asg);
+          word_topic_count.dec(asg);
+          --GLOBAL_TOPIC_COUNT[asg];
+        } else asg = word_proposal->sample();
+        double p_asg = topic_weight(doc_topic_count, word_topic_count, asg);
+        for(size_t i = 0; i < MH_STEPS; ++i) {
+          // Alternate between the word and doc proposals
+          for(size_t j = 0; j < 2; ++j) {
+            const alias_table& proposal = j == 0 ? *word_proposal : *doc_proposal;
+            const topic_id_type t = proposal.sample();
+            if(t == asg) continue;
+            const double p_t = topic_weight(doc_topic_count, word_topic_count, t);
+            const double accept =
+              (p_t * proposal.weight(asg)) / (p_asg * proposal.weight(t));
+            if(accept >= 1 || graphlab::random::rand01() < accept) {
+              asg = t; p_asg = p_t;
+            }
+          }
+        }
+        doc_topic_count.inc(asg);
+        word_topic_count.inc(asg);
+        ++GLOBAL_TOPIC_COUNT[asg];
+        if(asg != old_asg) {
+          ++edge.data().nchanges;
+          INCREMENT_EVENT(TOKEN_CHANGES,1);
+        }
+      } // End of loop over each token
+      context.signal(get_other_vertex(edge, vertex));
+      return;
+    }
+    // run the actual gibbs sampling
+    std::vector<double> prob(NTOPICS);
     foreach(topic_id_type& asg, assignment) {
       const topic_id_type old_asg = asg;
       if(asg != NULL_TOPIC) { // construct the cavity
-        --doc_topic_count[asg];
-        --word_topic_count[asg];
+        doc_topic_count.dec(asg);
+        word_topic_count.dec(asg);
         --GLOBAL_TOPIC_COUNT[asg];
       }
       for(size_t t = 0; t < NTOPICS; ++t) {
-        const double n_dt =
-          std::max(count_type(doc_topic_count[t]), count_type(0));
-        const double n_wt =
-          std::max(count_type(word_topic_count[t]), count_type(0));
-        const double n_t  =
-          std::max(count_type(GLOBAL_TOPIC_COUNT[t]), count_type(0));
-        prob[t] = (ALPHA + n_dt) * (BETA + n_wt) / (BETA * NWORDS + n_t);
+        prob[t] = topic_weight(doc_topic_count, word_topic_count, t);
       }
       asg = graphlab::random::multinomial(prob);
       // asg = std::max_element(prob.begin(), prob.end()) - prob.begin();
-      ++doc_topic_count[asg];
-      ++word_topic_count[asg];
+      doc_topic_count.inc(asg);
+      word_topic_count.inc(asg);
       ++GLOBAL_TOPIC_COUNT[asg];
       if(asg != old_asg) {
         ++edge.data().nchanges;
@@ -621,10 +1152,11 @@ public:
     ret_value.nupdates = vdata.nupdates;
     if(is_word(vertex)) {
       const graphlab::vertex_id_type wordid = vertex.id();
-      ret_value.top_words.resize(vdata.factor.size());
+      ret_value.top_words.resize(NTOPICS);
       for(size_t i = 0; i < vdata.factor.size(); ++i) {
-        const cw_pair_type pair(vdata.factor[i], wordid);
-        ret_value.top_words[i].insert(pair);
+        if(vdata.factor.count(i) <= 0) continue;
+        const cw_pair_type pair(vdata.factor.count(i), wordid);
+        ret_value.top_words[vdata.factor.topic(i)].insert(pair);
       }
     }
     return ret_value;
@@ -676,13 +1208,15 @@ public:
  */
 struct global_counts_aggregator {
   typedef graph_type::vertex_type vertex_type;
-  static factor_type map(icontext_type& context, const vertex_type& vertex) {
+  static topic_count_vector map(icontext_type& context,
+                                const vertex_type& vertex) {
     return vertex.data().factor;
   } // end of map function
 
-  static void finalize(icontext_type& context, const factor_type& total) {
+  static void finalize(icontext_type& context,
+                       const topic_count_vector& total) {
     size_t sum = 0;
-    for(size_t t = 0; t < total.size(); ++t) {
+    for(size_t t = 0; t < NTOPICS; ++t) {
       GLOBAL_TOPIC_COUNT[t] =
         std::max(count_type(total[t]/2), count_type(0));
       sum += GLOBAL_TOPIC_COUNT[t];
@@ -768,21 +1302,24 @@ public:
   static likelihood_aggregator
   map(icontext_type& context, const vertex_type& vertex) {
     // using boost::math::lgamma;
-    const factor_type& factor = vertex.data().factor;
-    ASSERT_EQ(factor.size(), NTOPICS);
+    // Topics which are not stored have zero counts and so only the
+    // stored entries are visited
+    const topic_count_vector& factor = vertex.data().factor;
     likelihood_aggregator ret;
     if(is_word(vertex)) {
-      for(size_t t = 0; t < NTOPICS; ++t) {
-        const count_type value = std::max(count_type(factor[t]), count_type(0));
+      ret.lik_words_given_topics += NTOPICS * BETA_LGAMMA(0);
+      for(size_t i = 0; i < factor.size(); ++i) {
+        const count_type value = std::max(factor.count(i), count_type(0));
         //ret.lik_words_given_topics += lgamma(value + BETA);
-        ret.lik_words_given_topics += BETA_LGAMMA(value);
+        ret.lik_words_given_topics += BETA_LGAMMA(value) - BETA_LGAMMA(0);
       }
     } else {  ASSERT_TRUE(is_doc(vertex));
       double ntokens_in_doc = 0;
-      for(size_t t = 0; t < NTOPICS; ++t) {
-        const count_type value = std::max(count_type(factor[t]), count_type(0));
+      ret.lik_topics += NTOPICS * ALPHA_LGAMMA(0);
+      for(size_t i = 0; i < factor.size(); ++i) {
+        const count_type value = std::max(factor.count(i), count_type(0));
         //ret.lik_topics += lgamma(value + ALPHA);
-        ret.lik_topics += ALPHA_LGAMMA(value);
+        ret.lik_topics += ALPHA_LGAMMA(value) - ALPHA_LGAMMA(0);
         ntokens_in_doc += value;
       }
       ret.lik_topics -= lgamma(ntokens_in_doc + NTOPICS * ALPHA);
@@ -1025,10 +1562,10 @@ struct count_saver {
       const graphlab::vertex_id_type vid = (-vertex.id()) - 2;
       strm << vid << '\t';
     }
-    const factor_type& factor = vertex.data().factor;
-    for(size_t i = 0; i < factor.size(); ++i) { 
+    const topic_count_vector& factor = vertex.data().factor;
+    for(size_t i = 0; i < NTOPICS; ++i) { 
       strm << factor[i];
-      if(i+1 < factor.size()) strm << '\t';
+      if(i+1 < NTOPICS) strm << '\t';
     }
     strm << '\n';
     return strm.str();
@@ -1096,6 +1633,7 @@ int main(int argc, char** argv) {
   std::string word_dir;
   std::string exec_type = "asynchronous";
   std::string format = "matrix";
+  std::string sampler = "dense";
   
   clopts.attach_option("dictionary", dictionary_fname,
                        "The file containing the list of unique words");
@@ -1120,6 +1658,15 @@ int main(int argc, char** argv) {
                        "The maximum number of occurences of a word in a document.");
   clopts.attach_option("format", format,
                        "Formats: matrix,json,json-gzip");
+  clopts.attach_option("sampler", sampler,
+                       "The token sampler: dense (exact O(ntopics) Gibbs) or "
+                       "alias (Metropolis-Hastings with alias table proposals).");
+  clopts.attach_option("dense_threshold", DENSE_THRESHOLD,
+                       "The fraction of nonzero topics above which vertex "
+                       "topic counts are stored densely.");
+  clopts.attach_option("mh_steps", MH_STEPS,
+                       "The number of Metropolis-Hastings cycles per token "
+                       "used by the alias sampler.");
   clopts.attach_option("burnin", BURNIN, 
                        "The time in second to run until a sample is collected. "
                        "If less than zero the sampler runs indefinitely.");
@@ -1144,6 +1691,13 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
+  if(sampler == "alias") {
+    ALIAS_SAMPLER = true;
+  } else if(sampler != "dense") {
+    logstream(LOG_ERROR) << "Unknown sampler " << sampler << "." << std::endl;
+    return EXIT_FAILURE;
+  }
+
   // Start the webserver
   graphlab::launch_metric_server();
   graphlab::add_metric_server_callback("wordclouds", word_cloud_callback);
@@ -1190,6 +1744,18 @@ int main(int argc, char** argv) {
 
   const size_t ntokens = graph.map_reduce_edges<size_t>(count_tokens);
   dc.cout() << "Total tokens: " << ntokens << std::endl;
+  if(exec_type != "sync" && exec_type != "synchronous") {
+    // Only the synchronous engine never runs apply concurrently with
+    // the scatters of adjacent vertices
+    dc.cout() << "Using dense vertex topic counts with the "
+              << exec_type << " engine" << std::endl;
+    graph.transform_vertices(make_dense);
+  } else {
+    // The words are resampled by the first scatter of the docs before
+    // their first apply
+    graph.transform_edges(reserve_word_slots);
+  }
+  if(ALIAS_SAMPLER) ALIAS_CACHE.resize(graph.num_local_vertices());
 
 
 
@@ -1205,7 +1771,7 @@ int main(int argc, char** argv) {
 
   { // Add the Global counts aggregator
     const bool success =
-      engine.add_vertex_aggregator<factor_type>
+      engine.add_vertex_aggregator<topic_count_vector>
       ("global_counts", 
        global_counts_aggregator::map, 
        global_counts_aggregator::finalize) &&
@@ -1231,6 +1797,9 @@ int main(int argc, char** argv) {
   cgs_lda_vertex_program::DISABLE_SAMPLING = false;
   // Run the engine
   engine.start();
+  const double sampling_runtime = timer.current_time();
+  size_t tokens_sampled = TOKENS_SAMPLED.value;
+  dc.all_reduce(tokens_sampled);
   // Finalize the counts
   cgs_lda_vertex_program::DISABLE_SAMPLING = true;
   engine.signal_all();
@@ -1243,7 +1812,10 @@ int main(int argc, char** argv) {
     << std::endl
     << "Updates executed: " << engine.num_updates() << std::endl
     << "Update Rate (updates/second): "
-    << engine.num_updates() / runtime << std::endl;
+    << engine.num_updates() / runtime << std::endl
+    << "Tokens sampled: " << tokens_sampled << std::endl
+    << "Sampling Rate (tokens/second): "
+    << tokens_sampled / sampling_runtime << std::endl;
   
   
   